@@ -0,0 +1,89 @@
+#!/usr/bin/env python3
+"""Check the steering hot path timings against a budget.
+
+Usage: bench-check.py [--host] <bench-budget.txt> [bench.txt]
+
+Reads the "bench <stage> <count> <min> <mean> <max>" lines the firmware built
+with BENCH=1 prints on RTT channel 2, from the file or from stdin. Capture
+with e.g. JLinkRTTLogger -Device NRF52832_XXAA -RTTChannel 2 bench.txt
+The report repeats, the last line of each stage counts. The mean is checked
+against the cycles column of the budget and the max against the max one, or
+only the mean against the host_ns column with --host for
+host/_build/benchmark. Exits 1 if a stage is over its budget or missing.
+"""
+import sys
+
+
+def read_budget(path, columns):
+    budget = {}
+    with open(path, 'r') as f:
+        for line in f:
+            fields = line.split('#', 1)[0].split()
+            if not fields:
+                continue
+            if len(fields) != 4:
+                raise SystemExit('%s: bad line: %s' % (path, line.rstrip()))
+            # Mean and max, None where the max is not checked
+            budget[fields[0]] = tuple(
+                int(fields[c]) if c else None for c in columns)
+    if not budget:
+        raise SystemExit('%s: no stages' % path)
+    return budget
+
+
+def read_results(f):
+    results = {}
+    for line in f:
+        fields = line.split()
+        if len(fields) != 6 or fields[0] != 'bench':
+            continue
+        count, low, mean, high = (int(x) for x in fields[2:])
+        results[fields[1]] = (count, low, mean, high)
+    return results
+
+
+def main():
+    args = sys.argv[1:]
+    host = '--host' in args
+    if host:
+        args.remove('--host')
+    if len(args) not in (1, 2):
+        raise SystemExit(__doc__)
+
+    budget = read_budget(args[0], (3, None) if host else (1, 2))
+    if len(args) == 2:
+        with open(args[1], 'r') as f:
+            results = read_results(f)
+    else:
+        results = read_results(sys.stdin)
+
+    unit = 'ns' if host else 'cycles'
+    print('%-12s %10s %10s %10s %10s %10s %10s  %s' % (
+        'stage', 'count', 'min', 'mean', 'max', 'budget', 'max budget',
+        unit))
+    failed = 0
+    for stage, (limit, high_limit) in budget.items():
+        if stage not in results:
+            print('%-12s %65s  MISSING' % (stage, ''))
+            failed += 1
+            continue
+        count, low, mean, high = results[stage]
+        over = []
+        if mean > limit:
+            over.append('mean')
+        if high_limit is not None and high > high_limit:
+            over.append('max')
+        if over:
+            failed += 1
+        print('%-12s %10d %10d %10d %10d %10d %10s  %s' % (
+            stage, count, low, mean, high, limit,
+            '-' if high_limit is None else high_limit,
+            'OVER ' + ', '.join(over) if over else 'ok'))
+
+    if failed:
+        print('%d of %d stages failed' % (failed, len(budget)))
+        sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,117 @@
+/**
+ * Copyright (c) 2018 Keith Wakeham
+ *
+ * All rights reserved.
+ *
+ *
+ */
+
+#include "bench.h"
+
+#if BENCH_ENABLED
+
+#include <stdio.h>
+#include <string.h>
+
+#include "SEGGER_RTT.h"
+#include "app_util.h"
+#include "app_util_platform.h"
+
+#define BENCH_RTT_BUFFER_SIZE 256
+
+// Pairs of reads timed to find what timing itself costs, the fastest counts
+#define BENCH_OVERHEAD_RUNS 32
+
+static char const *const m_names[BENCH_STAGE_COUNT] = {
+    [BENCH_STAGE_SAADC] = "saadc",
+    [BENCH_STAGE_PROCESS] = "process",
+    [BENCH_STAGE_FILTER] = "filter",
+    [BENCH_STAGE_GET_ANGLE] = "get_angle",
+    [BENCH_STAGE_NOTIFY] = "notify",
+    [BENCH_STAGE_TX_COMPLETE] = "tx_complete",
+};
+
+static bench_stats_t m_stats[BENCH_STAGE_COUNT];
+static uint32_t      m_overhead;
+static uint8_t       m_rtt_buffer[BENCH_RTT_BUFFER_SIZE];
+
+void bench_init(void)
+{
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+    m_overhead = UINT32_MAX;
+    for (uint32_t i = 0; i < BENCH_OVERHEAD_RUNS; i++)
+    {
+        uint32_t begin = bench_cycles();
+
+        m_overhead = MIN(m_overhead, bench_cycles() - begin);
+    }
+
+    bench_reset();
+
+    UNUSED_RETURN_VALUE(SEGGER_RTT_ConfigUpBuffer(
+        BENCH_RTT_CHANNEL, "Bench", m_rtt_buffer, sizeof(m_rtt_buffer),
+        SEGGER_RTT_MODE_NO_BLOCK_SKIP));
+}
+
+void bench_record(bench_stage_t stage, uint32_t cycles)
+{
+    bench_stats_t *p_stats = &m_stats[stage];
+
+    // Every stage is only timed from one context, no lock needed
+    cycles = (cycles > m_overhead) ? cycles - m_overhead : 0;
+    p_stats->count++;
+    p_stats->min = MIN(p_stats->min, cycles);
+    p_stats->max = MAX(p_stats->max, cycles);
+    p_stats->sum += cycles;
+}
+
+void bench_stats_get(bench_stage_t stage, bench_stats_t *p_stats)
+{
+    CRITICAL_REGION_ENTER();
+    *p_stats = m_stats[stage];
+    CRITICAL_REGION_EXIT();
+}
+
+void bench_reset(void)
+{
+    CRITICAL_REGION_ENTER();
+    for (uint32_t i = 0; i < BENCH_STAGE_COUNT; i++)
+    {
+        memset(&m_stats[i], 0, sizeof(m_stats[i]));
+        m_stats[i].min = UINT32_MAX;
+    }
+    CRITICAL_REGION_EXIT();
+}
+
+char const *bench_stage_name(bench_stage_t stage)
+{
+    return (stage < BENCH_STAGE_COUNT) ? m_names[stage] : "unknown";
+}
+
+void bench_report_rtt(void)
+{
+    for (uint32_t i = 0; i < BENCH_STAGE_COUNT; i++)
+    {
+        bench_stats_t stats;
+        char          line[64];
+        int           len;
+
+        bench_stats_get((bench_stage_t)i, &stats);
+        if (stats.count == 0)
+        {
+            continue;
+        }
+        len = snprintf(line, sizeof(line), "bench %s %lu %lu %lu %lu\n",
+                       m_names[i], (unsigned long)stats.count,
+                       (unsigned long)stats.min,
+                       (unsigned long)(stats.sum / stats.count),
+                       (unsigned long)stats.max);
+        UNUSED_RETURN_VALUE(SEGGER_RTT_WriteNoLock(
+            BENCH_RTT_CHANNEL, line, (unsigned)MIN(len, sizeof(line) - 1)));
+    }
+}
+
+#endif  // BENCH_ENABLED
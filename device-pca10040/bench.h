@@ -0,0 +1,123 @@
+/**
+ * Copyright (c) 2018 Keith Wakeham
+ *
+ * All rights reserved.
+ *
+ *
+ */
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdint.h>
+
+#include "nrf.h"
+
+// Set to 1 to time the steering hot path with the DWT cycle counter
+#ifndef BENCH_ENABLED
+#define BENCH_ENABLED 0
+#endif
+
+// RTT up channel the results are printed on, 1 belongs to the trace
+#define BENCH_RTT_CHANNEL 2
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+    /**
+     * @brief Timed stages
+     *
+     * @details bench-check.py matches the names bench_stage_name() gives
+     * against bench-budget.txt.
+     */
+    typedef enum
+    {
+        BENCH_STAGE_SAADC,       // saadc_callback with a full buffer
+        BENCH_STAGE_PROCESS,     // steering_process, filter and calibration
+        BENCH_STAGE_FILTER,      // filter_update, one sample
+        BENCH_STAGE_GET_ANGLE,   // get_angle
+        BENCH_STAGE_NOTIFY,      // ble_cus_steering_value_update
+        BENCH_STAGE_TX_COMPLETE, // BLE_GATTS_EVT_HVN_TX_COMPLETE in ble_cus
+        BENCH_STAGE_COUNT
+    } bench_stage_t;
+
+    /**
+     * @brief Cycles per call of one stage, without the cost of timing it
+     *
+     */
+    typedef struct
+    {
+        uint32_t count;
+        uint32_t min;
+        uint32_t max;
+        uint64_t sum;
+    } bench_stats_t;
+
+    /**
+     * @brief Start the cycle counter and measure what timing costs
+     *
+     */
+    void bench_init(void);
+
+    /**
+     * @brief Read the cycle counter
+     *
+     */
+    static inline uint32_t bench_cycles(void) { return DWT->CYCCNT; }
+
+    /**
+     * @brief Account one call, safe from the context the stage runs in
+     *
+     * @param stage stage
+     * @param cycles bench_cycles() at the end minus at the start
+     */
+    void bench_record(bench_stage_t stage, uint32_t cycles);
+
+    /**
+     * @brief Copy the statistics of a stage
+     *
+     * @param stage stage
+     * @param p_stats filled with the calls since init or the last reset
+     */
+    void bench_stats_get(bench_stage_t stage, bench_stats_t *p_stats);
+
+    /**
+     * @brief Clear the statistics of every stage
+     *
+     */
+    void bench_reset(void);
+
+    /**
+     * @brief Name of a stage as it appears in reports and the budget file
+     *
+     */
+    char const *bench_stage_name(bench_stage_t stage);
+
+    /**
+     * @brief Print the statistics of every stage on RTT, one line each
+     *
+     * @details "bench <stage> <count> <min> <mean> <max>" in cycles, lines
+     * that do not fit the channel are skipped. Main context only.
+     */
+    void bench_report_rtt(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#if BENCH_ENABLED
+// The end has to be in the same block as the begin
+#define BENCH_BEGIN(stage) uint32_t const bench_begin_##stage = bench_cycles()
+#define BENCH_END(stage) \
+    bench_record((stage), bench_cycles() - bench_begin_##stage)
+#define BENCH_INIT() bench_init()
+#define BENCH_REPORT() bench_report_rtt()
+#else
+#define BENCH_BEGIN(stage)
+#define BENCH_END(stage)
+#define BENCH_INIT()
+#define BENCH_REPORT()
+#endif
+
+#endif  // BENCH_H
@@ -1,10 +1,78 @@
 #include "ble_cus.h"
 #include <string.h>
+#include "app_timer.h"
+#include "app_util_platform.h"
+#include "bench.h"
 #include "ble_srv_common.h"
 #include "boards.h"
 #include "nrf_gpio.h"
+#include "latency.h"
 #include "nrf_log.h"
 #include "sdk_common.h"
+#include "storage.h"
+#include "trace.h"
+
+/**@brief Function for finding the per-link state of a connection.
+ *
+ * @param[in]   p_cus         Custom Service structure.
+ * @param[in]   conn_handle   Connection handle, BLE_CONN_HANDLE_INVALID finds
+ * a free slot.
+ *
+ * @return      The link, or NULL if there is none.
+ */
+static ble_cus_link_t *link_get(ble_cus_t *p_cus, uint16_t conn_handle)
+{
+    for (uint8_t i = 0; i < BLE_CUS_MAX_LINKS; i++)
+    {
+        if (p_cus->links[i].conn_handle == conn_handle)
+        {
+            return &p_cus->links[i];
+        }
+    }
+
+    return NULL;
+}
+
+/**@brief Function for resetting the per-link state.
+ *
+ * @param[in]   p_link        Link to reset.
+ * @param[in]   conn_handle   Connection handle the link now belongs to.
+ */
+static void link_reset(ble_cus_link_t *p_link, uint16_t conn_handle)
+{
+    CRITICAL_REGION_ENTER();
+    p_link->conn_handle = conn_handle;
+    p_link->handshake = BLE_CUS_HANDSHAKE_NONE;
+    p_link->notify_enabled = false;
+    p_link->steering_in_flight = 0;
+    p_link->diag_in_flight = 0;
+    p_link->steering_pending = false;
+    p_link->hvx_timestamp = 0;
+    p_link->conn_evt_known = false;
+    p_link->conn_evt_timestamp = 0;
+    p_link->conn_interval = 0;
+    p_link->diag_notify_enabled = false;
+    CRITICAL_REGION_EXIT();
+}
+
+/**@brief Function for sending an event to the application.
+ *
+ * @param[in]   p_cus         Custom Service structure.
+ * @param[in]   evt_type      Type of event.
+ * @param[in]   conn_handle   Connection the event belongs to.
+ */
+static void evt_send(ble_cus_t *p_cus, ble_cus_evt_type_t evt_type,
+                     uint16_t conn_handle)
+{
+    ble_cus_evt_t evt;
+
+    evt.evt_type = evt_type;
+    evt.conn_handle = conn_handle;
+    evt.p_data = NULL;
+    evt.len = 0;
+
+    p_cus->evt_handler(p_cus, &evt);
+}
 
 /**@brief Function for handling the Connect event.
  *
@@ -13,13 +81,37 @@
  */
 static void on_connect(ble_cus_t *p_cus, ble_evt_t const *p_ble_evt)
 {
-    p_cus->conn_handle = p_ble_evt->evt.gap_evt.conn_handle;
+    uint16_t        conn_handle = p_ble_evt->evt.gap_evt.conn_handle;
+    ble_cus_link_t *p_link = link_get(p_cus, BLE_CONN_HANDLE_INVALID);
 
-    ble_cus_evt_t evt;
+    if (p_link == NULL)
+    {
+        // More links than NRF_SDH_BLE_PERIPHERAL_LINK_COUNT, cannot happen
+        return;
+    }
+    link_reset(p_link, conn_handle);
+    p_link->conn_interval =
+        p_ble_evt->evt.gap_evt.params.connected.conn_params.max_conn_interval;
 
-    evt.evt_type = BLE_CUS_EVT_CONNECTED;
+    evt_send(p_cus, BLE_CUS_EVT_CONNECTED, conn_handle);
+}
 
-    p_cus->evt_handler(p_cus, &evt);
+/**@brief Function for handling the Connection Parameters Update event.
+ *
+ * @param[in]   p_cus       Custom Service structure.
+ * @param[in]   p_ble_evt   Event received from the BLE stack.
+ */
+static void on_conn_param_update(ble_cus_t *p_cus, ble_evt_t const *p_ble_evt)
+{
+    uint16_t        conn_handle = p_ble_evt->evt.gap_evt.conn_handle;
+    ble_cus_link_t *p_link = link_get(p_cus, conn_handle);
+
+    if (p_link == NULL)
+    {
+        return;
+    }
+    p_link->conn_interval = p_ble_evt->evt.gap_evt.params.conn_param_update
+                                .conn_params.max_conn_interval;
 }
 
 /**@brief Function for handling the Disconnect event.
@@ -29,51 +121,344 @@ static void on_connect(ble_cus_t *p_cus, ble_evt_t const *p_ble_evt)
  */
 static void on_disconnect(ble_cus_t *p_cus, ble_evt_t const *p_ble_evt)
 {
-    UNUSED_PARAMETER(p_ble_evt);
-    p_cus->conn_handle = BLE_CONN_HANDLE_INVALID;
+    uint16_t        conn_handle = p_ble_evt->evt.gap_evt.conn_handle;
+    ble_cus_link_t *p_link = link_get(p_cus, conn_handle);
 
-    ble_cus_evt_t evt;
+    if (p_link == NULL)
+    {
+        return;
+    }
+    link_reset(p_link, BLE_CONN_HANDLE_INVALID);
+
+    evt_send(p_cus, BLE_CUS_EVT_DISCONNECTED, conn_handle);
+}
 
-    evt.evt_type = BLE_CUS_EVT_DISCONNECTED;
+/**@brief Function for counting an error returned by sd_ble_gatts_hvx.
+ *
+ * @param[in]   p_cus       Custom Service structure.
+ * @param[in]   err_code    Error returned.
+ */
+static void hvx_error_count(ble_cus_t *p_cus, uint32_t err_code)
+{
+    ble_cus_hvx_err_t kind;
 
-    p_cus->evt_handler(p_cus, &evt);
+    switch (err_code)
+    {
+        case NRF_ERROR_RESOURCES:
+            kind = BLE_CUS_HVX_ERR_RESOURCES;
+            break;
+
+        case NRF_ERROR_INVALID_STATE:
+            kind = BLE_CUS_HVX_ERR_INVALID_STATE;
+            break;
+
+        case BLE_ERROR_GATTS_SYS_ATTR_MISSING:
+            kind = BLE_CUS_HVX_ERR_SYS_ATTR_MISSING;
+            break;
+
+        case BLE_ERROR_INVALID_CONN_HANDLE:
+            kind = BLE_CUS_HVX_ERR_CONN_HANDLE;
+            break;
+
+        default:
+            kind = BLE_CUS_HVX_ERR_OTHER;
+            break;
+    }
+
+    if (p_cus->steering_stats.hvx_errors[kind] < UINT16_MAX)
+    {
+        p_cus->steering_stats.hvx_errors[kind]++;
+    }
+}
+
+/**@brief Function for queueing a steering notification on one link.
+ *
+ * @details The value lives in user memory, so hvx sends whatever
+ * steering_value holds at that moment without a sd_ble_gatts_value_set copy.
+ * A link that cannot take it now only gets marked pending, it picks up the
+ * newest value on its next TX complete. Must be called inside a critical
+ * region.
+ *
+ * @param[in]   p_cus       Custom Service structure.
+ * @param[in]   p_link      Link to send on.
+ *
+ * @return      NRF_SUCCESS if the value was queued or kept as pending,
+ * otherwise an error code.
+ */
+static uint32_t steering_send(ble_cus_t *p_cus, ble_cus_link_t *p_link)
+{
+    uint32_t               err_code;
+    uint16_t               len = sizeof(float);
+    ble_gatts_hvx_params_t hvx_params;
+
+    if (p_link->steering_in_flight >= BLE_CUS_STEERING_MAX_IN_FLIGHT)
+    {
+        err_code = NRF_ERROR_RESOURCES;
+    }
+    else
+    {
+        memset(&hvx_params, 0, sizeof(hvx_params));
+
+        hvx_params.handle = p_cus->steerer_handles.value_handle;
+        hvx_params.type = BLE_GATT_HVX_NOTIFICATION;
+        hvx_params.offset = 0;
+        hvx_params.p_len = &len;
+        hvx_params.p_data = NULL;
+
+        err_code = sd_ble_gatts_hvx(p_link->conn_handle, &hvx_params);
+        if (err_code != NRF_SUCCESS)
+        {
+            hvx_error_count(p_cus, err_code);
+        }
+    }
+
+    switch (err_code)
+    {
+        case NRF_SUCCESS:
+        {
+            uint32_t now = app_timer_cnt_get();
+
+            if (p_cus->steering_changed)
+            {
+                latency_record(LATENCY_SAMPLE_TO_HVX,
+                               app_timer_cnt_diff_compute(
+                                   now, p_cus->steering_timestamp));
+            }
+            // TX complete accounts for the oldest one in flight
+            if (p_link->steering_in_flight == 0)
+            {
+                p_link->hvx_timestamp = now;
+            }
+            p_link->steering_in_flight++;
+            p_cus->steering_stats.queued++;
+            TRACE(TRACE_EVT_HVX_QUEUED, p_link->conn_handle,
+                  p_link->steering_in_flight);
+        }
+        break;
+
+        case NRF_ERROR_RESOURCES:
+            // Latest value wins, it goes out on the next TX complete
+            if (p_link->steering_pending)
+            {
+                p_cus->steering_stats.coalesced++;
+            }
+            TRACE(TRACE_EVT_HVX_PENDING, p_link->conn_handle,
+                  p_link->steering_pending);
+            p_link->steering_pending = true;
+            err_code = NRF_SUCCESS;
+            break;
+
+        default:
+            p_cus->steering_stats.dropped++;
+            TRACE(TRACE_EVT_HVX_ERROR, p_link->conn_handle, err_code);
+            break;
+    }
+
+    return err_code;
+}
+
+/**@brief Function for checking if a link wants steering notifications.
+ *
+ * @param[in]   p_link      Link to check.
+ */
+static bool steering_subscribed(ble_cus_link_t const *p_link)
+{
+    return p_link->conn_handle != BLE_CONN_HANDLE_INVALID &&
+           p_link->handshake == BLE_CUS_HANDSHAKE_DONE &&
+           p_link->notify_enabled;
+}
+
+/**@brief Function for handling the HVN TX complete event.
+ *
+ * @param[in]   p_cus       Custom Service structure.
+ * @param[in]   p_ble_evt   Event received from the BLE stack.
+ */
+static void on_hvn_tx_complete(ble_cus_t *p_cus, ble_evt_t const *p_ble_evt)
+{
+    uint8_t         count = p_ble_evt->evt.gatts_evt.params.hvn_tx_complete.count;
+    ble_cus_link_t *p_link = link_get(p_cus, p_ble_evt->evt.gatts_evt.conn_handle);
+    uint8_t         diag;
+    uint8_t         steering;
+
+    TRACE(TRACE_EVT_TX_COMPLETE, p_ble_evt->evt.gatts_evt.conn_handle, count);
+
+    if (p_link == NULL)
+    {
+        return;
+    }
+
+    BENCH_BEGIN(BENCH_STAGE_TX_COMPLETE);
+    CRITICAL_REGION_ENTER();
+    p_link->conn_evt_known = true;
+    p_link->conn_evt_timestamp = app_timer_cnt_get();
+    // The count covers the diagnostics too. Taking those first may keep a
+    // steering one in flight a connection event too long, never too short.
+    diag = MIN(count, p_link->diag_in_flight);
+    p_link->diag_in_flight -= diag;
+    steering = MIN(count - diag, p_link->steering_in_flight);
+    if (steering > 0)
+    {
+        uint32_t ticks = app_timer_cnt_diff_compute(app_timer_cnt_get(),
+                                                    p_link->hvx_timestamp);
+
+        latency_record(LATENCY_HVX_TO_TX, ticks);
+        if (storage_busy_since(p_link->hvx_timestamp))
+        {
+            latency_record(LATENCY_HVX_TO_TX_FLASH, ticks);
+        }
+    }
+    p_link->steering_in_flight -= steering;
+    if (steering > 0 && p_link->steering_in_flight > 0)
+    {
+        // Only known to have been queued before now
+        p_link->hvx_timestamp = app_timer_cnt_get();
+    }
+
+    if (p_link->steering_pending)
+    {
+        p_link->steering_pending = false;
+        UNUSED_RETURN_VALUE(steering_send(p_cus, p_link));
+    }
+    CRITICAL_REGION_EXIT();
+    BENCH_END(BENCH_STAGE_TX_COMPLETE);
+
+    if (steering > 0)
+    {
+        evt_send(p_cus, BLE_CUS_EVT_STEERING_SENT, p_link->conn_handle);
+    }
+}
+
+/**@brief Function for reading the steering CCCD of a link.
+ *
+ * @details Bonded centrals get their CCCD restored without a write event, so
+ * the stored value is read when the handshake completes.
+ *
+ * @param[in]   p_cus       Custom Service structure.
+ * @param[in]   p_link      Link to read the CCCD for.
+ */
+static void cccd_read(ble_cus_t *p_cus, ble_cus_link_t *p_link)
+{
+    uint8_t           cccd[BLE_CCCD_VALUE_LEN];
+    ble_gatts_value_t gatts_value;
+
+    memset(&gatts_value, 0, sizeof(gatts_value));
+
+    gatts_value.len = sizeof(cccd);
+    gatts_value.offset = 0;
+    gatts_value.p_value = cccd;
+
+    if (sd_ble_gatts_value_get(p_link->conn_handle,
+                               p_cus->steerer_handles.cccd_handle,
+                               &gatts_value) == NRF_SUCCESS)
+    {
+        p_link->notify_enabled = ble_srv_is_notification_enabled(cccd);
+    }
 }
 
 static uint8_t challengeRequest[] = {0x03, 0x10, 0x12, 0x34};
 static uint8_t someOtherThing[] = {0x03, 0x11, 0xff, 0xff};
 
 /**@brief Function for handling the Write event.
+ *
+ * @details Each link runs its own handshake, a second central does not disturb
+ * the first one.
  *
  * @param[in]   p_cus       Custom Service structure.
  * @param[in]   p_ble_evt   Event received from the BLE stack.
  */
 static void on_write(ble_cus_t *p_cus, ble_evt_t const *p_ble_evt)
 {
+    uint16_t conn_handle = p_ble_evt->evt.gatts_evt.conn_handle;
     ble_gatts_evt_write_t const *p_evt_write =
         &p_ble_evt->evt.gatts_evt.params.write;
+    ble_cus_link_t *p_link = link_get(p_cus, conn_handle);
+
+    if (p_link == NULL)
+    {
+        return;
+    }
+
+    if (p_evt_write->handle == p_cus->steerer_handles.cccd_handle &&
+        p_evt_write->len == BLE_CCCD_VALUE_LEN)
+    {
+        p_link->notify_enabled =
+            ble_srv_is_notification_enabled(p_evt_write->data);
+        if (!p_link->notify_enabled)
+        {
+            evt_send(p_cus, BLE_CUS_EVT_NOTIFICATION_DISABLED, conn_handle);
+        }
+        else if (p_link->handshake == BLE_CUS_HANDSHAKE_DONE)
+        {
+            // Resumed bonded central, stream as soon as it subscribes
+            evt_send(p_cus, BLE_CUS_START_SENDING_STEERING_DATA, conn_handle);
+        }
+    }
+
+    if (p_evt_write->handle == p_cus->diag_handles.cccd_handle &&
+        p_evt_write->len == BLE_CCCD_VALUE_LEN)
+    {
+        p_link->diag_notify_enabled =
+            ble_srv_is_notification_enabled(p_evt_write->data);
+    }
+
+    if (p_evt_write->handle == p_cus->curve_handles.value_handle)
+    {
+        ble_cus_evt_t evt;
+
+        evt.evt_type = BLE_CUS_EVT_CURVE_WRITE;
+        evt.conn_handle = conn_handle;
+        evt.p_data = p_evt_write->data;
+        evt.len = p_evt_write->len;
+
+        p_cus->evt_handler(p_cus, &evt);
+    }
+
+    if (p_evt_write->handle == p_cus->config_handles.value_handle)
+    {
+        ble_cus_evt_t evt;
+
+        evt.evt_type = BLE_CUS_EVT_CONFIG_WRITE;
+        evt.conn_handle = conn_handle;
+        evt.p_data = p_evt_write->data;
+        evt.len = p_evt_write->len;
+
+        p_cus->evt_handler(p_cus, &evt);
+    }
+
     // Custom Value Characteristic Written to.
-    if (p_evt_write->handle == p_cus->rx_handles.value_handle)
+    if (p_evt_write->handle == p_cus->rx_handles.value_handle &&
+        p_evt_write->len >= 2)
     {
         // if we got 0x0310
         if (p_evt_write->data[0] == 0x03 && p_evt_write->data[1] == 0x10)
         {
             // issue the challenge of 0x0310yyyy on 0x0032
             NRF_LOG_INFO("got request for challenge");
-            ble_cus_tx_value_update(p_cus, challengeRequest, 4);
-            // APP_ERROR_CHECK(app_sched_event_put(NULL, 0,
-            // send_challenge_response));
+            // A resumed link keeps streaming while the central repeats it
+            if (p_link->handshake != BLE_CUS_HANDSHAKE_DONE)
+            {
+                p_link->handshake = BLE_CUS_HANDSHAKE_CHALLENGED;
+            }
+            ble_cus_tx_value_update(p_cus, conn_handle, challengeRequest, 4);
         }
         if (p_evt_write->data[0] == 0x03 && p_evt_write->data[1] == 0x11)
         {
             // emit 0x0311ffff on 0x0032
             NRF_LOG_INFO("got thing2");
-            ble_cus_tx_value_update(p_cus, someOtherThing, 4);
-            // tell app to start firing off steering data
-            ble_cus_evt_t evt;
-            evt.evt_type = BLE_CUS_START_SENDING_STEERING_DATA;
+            ble_cus_tx_value_update(p_cus, conn_handle, someOtherThing, 4);
+            p_link->handshake = BLE_CUS_HANDSHAKE_DONE;
+            cccd_read(p_cus, p_link);
 
-            // Call the application event handler.
-            p_cus->evt_handler(p_cus, &evt);
+            // tell app to start firing off steering data
+            evt_send(p_cus, BLE_CUS_START_SENDING_STEERING_DATA, conn_handle);
+        }
+        if (p_evt_write->data[0] == (BLE_CUS_CMD_STATS_RESET >> 8) &&
+            p_evt_write->data[1] == (BLE_CUS_CMD_STATS_RESET & 0xFF))
+        {
+            CRITICAL_REGION_ENTER();
+            memset(&p_cus->steering_stats, 0, sizeof(p_cus->steering_stats));
+            CRITICAL_REGION_EXIT();
+            latency_reset();
         }
     }
 }
@@ -82,13 +467,14 @@ void ble_cus_on_ble_evt(ble_evt_t const *p_ble_evt, void *p_context)
 {
     ble_cus_t *p_cus = (ble_cus_t *)p_context;
 
-    NRF_LOG_INFO("BLE event received. Event type = %d\r\n",
-                 p_ble_evt->header.evt_id);
     if (p_cus == NULL || p_ble_evt == NULL)
     {
         return;
     }
 
+    TRACE(TRACE_EVT_BLE, p_ble_evt->header.evt_id,
+          p_ble_evt->evt.common_evt.conn_handle);
+
     switch (p_ble_evt->header.evt_id)
     {
         case BLE_GAP_EVT_CONNECTED:
@@ -99,9 +485,17 @@ void ble_cus_on_ble_evt(ble_evt_t const *p_ble_evt, void *p_context)
             on_disconnect(p_cus, p_ble_evt);
             break;
 
+        case BLE_GAP_EVT_CONN_PARAM_UPDATE:
+            on_conn_param_update(p_cus, p_ble_evt);
+            break;
+
         case BLE_GATTS_EVT_WRITE:
             on_write(p_cus, p_ble_evt);
             break;
+
+        case BLE_GATTS_EVT_HVN_TX_COMPLETE:
+            on_hvn_tx_complete(p_cus, p_ble_evt);
+            break;
             /* Handling this event is not necessary
                     case BLE_GATTS_EVT_EXCHANGE_MTU_REQUEST:
                         NRF_LOG_INFO("EXCHANGE_MTU_REQUEST event
@@ -156,7 +550,7 @@ static uint32_t custom_value_char_add(ble_cus_t *           p_cus,
 
     attr_md.read_perm = p_cus_init->custom_value_char_attr_md.read_perm;
     attr_md.write_perm = p_cus_init->custom_value_char_attr_md.write_perm;
-    attr_md.vloc = BLE_GATTS_VLOC_STACK;
+    attr_md.vloc = BLE_GATTS_VLOC_USER;
     attr_md.rd_auth = 0;
     attr_md.wr_auth = 0;
     attr_md.vlen = 0;
@@ -168,6 +562,7 @@ static uint32_t custom_value_char_add(ble_cus_t *           p_cus,
     attr_char_value.init_len = sizeof(float);
     attr_char_value.init_offs = 0;
     attr_char_value.max_len = sizeof(float);
+    attr_char_value.p_value = (uint8_t *)&p_cus->steering_value;
 
     err_code = sd_ble_gatts_characteristic_add(p_cus->service_handle, &char_md,
                                                &attr_char_value,
@@ -310,6 +705,157 @@ static uint32_t rx_char_add(ble_cus_t *p_cus, const ble_cus_init_t *p_cus_init)
     return NRF_SUCCESS;
 }
 
+/**@brief Function for adding the diagnostics characteristic.
+ *
+ * @param[in]   p_cus        Custom Service structure.
+ * @param[in]   p_cus_init   Information needed to initialize the service.
+ *
+ * @return      NRF_SUCCESS on success, otherwise an error code.
+ */
+static uint32_t diag_char_add(ble_cus_t *            p_cus,
+                              const ble_cus_init_t *p_cus_init)
+{
+    uint32_t            err_code;
+    ble_gatts_char_md_t char_md;
+    ble_gatts_attr_md_t cccd_md;
+    ble_gatts_attr_t    attr_char_value;
+    ble_uuid_t          ble_uuid;
+    ble_gatts_attr_md_t attr_md;
+    ble_cus_diag_t      diag;
+
+    memset(&cccd_md, 0, sizeof(cccd_md));
+
+    BLE_GAP_CONN_SEC_MODE_SET_OPEN(&cccd_md.read_perm);
+    cccd_md.write_perm = p_cus_init->custom_value_char_attr_md.cccd_write_perm;
+    cccd_md.vloc = BLE_GATTS_VLOC_STACK;
+
+    memset(&char_md, 0, sizeof(char_md));
+
+    char_md.char_props.read = 1;
+    char_md.char_props.notify = 1;
+    char_md.p_cccd_md = &cccd_md;
+
+    ble_uuid.type = p_cus->uuid_type;
+    ble_uuid.uuid = DIAG_CHAR_UUID;
+
+    memset(&attr_md, 0, sizeof(attr_md));
+
+    attr_md.read_perm = p_cus_init->custom_value_char_attr_md.read_perm;
+    BLE_GAP_CONN_SEC_MODE_SET_NO_ACCESS(&attr_md.write_perm);
+    attr_md.vloc = BLE_GATTS_VLOC_STACK;
+
+    memset(&diag, 0, sizeof(diag));
+    diag.version = BLE_CUS_DIAG_VERSION;
+
+    memset(&attr_char_value, 0, sizeof(attr_char_value));
+
+    attr_char_value.p_uuid = &ble_uuid;
+    attr_char_value.p_attr_md = &attr_md;
+    attr_char_value.init_len = sizeof(diag);
+    attr_char_value.init_offs = 0;
+    attr_char_value.max_len = sizeof(diag);
+    attr_char_value.p_value = (uint8_t *)&diag;
+
+    err_code = sd_ble_gatts_characteristic_add(
+        p_cus->service_handle, &char_md, &attr_char_value, &p_cus->diag_handles);
+    if (err_code != NRF_SUCCESS)
+    {
+        return err_code;
+    }
+
+    return NRF_SUCCESS;
+}
+
+static uint32_t curve_char_add(ble_cus_t *            p_cus,
+                               const ble_cus_init_t *p_cus_init)
+{
+    uint32_t            err_code;
+    ble_gatts_char_md_t char_md;
+    ble_gatts_attr_t    attr_char_value;
+    ble_uuid_t          ble_uuid;
+    ble_gatts_attr_md_t attr_md;
+    uint8_t             initial[2] = {0}; // status, no knots
+
+    memset(&char_md, 0, sizeof(char_md));
+
+    char_md.char_props.read = 1;
+    char_md.char_props.write = 1;
+
+    ble_uuid.type = p_cus->uuid_type;
+    ble_uuid.uuid = CURVE_CHAR_UUID;
+
+    memset(&attr_md, 0, sizeof(attr_md));
+
+    attr_md.read_perm = p_cus_init->custom_value_char_attr_md.read_perm;
+    attr_md.write_perm = p_cus_init->custom_value_char_attr_md.write_perm;
+    attr_md.vloc = BLE_GATTS_VLOC_STACK;
+    attr_md.vlen = 1;
+
+    memset(&attr_char_value, 0, sizeof(attr_char_value));
+
+    attr_char_value.p_uuid = &ble_uuid;
+    attr_char_value.p_attr_md = &attr_md;
+    attr_char_value.init_len = sizeof(initial);
+    attr_char_value.init_offs = 0;
+    attr_char_value.max_len = BLE_CUS_CURVE_MAX_LEN;
+    attr_char_value.p_value = initial;
+
+    err_code = sd_ble_gatts_characteristic_add(p_cus->service_handle, &char_md,
+                                               &attr_char_value,
+                                               &p_cus->curve_handles);
+    if (err_code != NRF_SUCCESS)
+    {
+        return err_code;
+    }
+
+    return NRF_SUCCESS;
+}
+
+static uint32_t config_char_add(ble_cus_t *            p_cus,
+                                const ble_cus_init_t *p_cus_init)
+{
+    uint32_t            err_code;
+    ble_gatts_char_md_t char_md;
+    ble_gatts_attr_t    attr_char_value;
+    ble_uuid_t          ble_uuid;
+    ble_gatts_attr_md_t attr_md;
+    uint8_t             initial = 0; // status, no parameters
+
+    memset(&char_md, 0, sizeof(char_md));
+
+    char_md.char_props.read = 1;
+    char_md.char_props.write = 1;
+
+    ble_uuid.type = p_cus->uuid_type;
+    ble_uuid.uuid = CONFIG_CHAR_UUID;
+
+    memset(&attr_md, 0, sizeof(attr_md));
+
+    attr_md.read_perm = p_cus_init->custom_value_char_attr_md.read_perm;
+    attr_md.write_perm = p_cus_init->custom_value_char_attr_md.write_perm;
+    attr_md.vloc = BLE_GATTS_VLOC_STACK;
+    attr_md.vlen = 1;
+
+    memset(&attr_char_value, 0, sizeof(attr_char_value));
+
+    attr_char_value.p_uuid = &ble_uuid;
+    attr_char_value.p_attr_md = &attr_md;
+    attr_char_value.init_len = sizeof(initial);
+    attr_char_value.init_offs = 0;
+    attr_char_value.max_len = BLE_CUS_CONFIG_MAX_LEN;
+    attr_char_value.p_value = &initial;
+
+    err_code = sd_ble_gatts_characteristic_add(p_cus->service_handle, &char_md,
+                                               &attr_char_value,
+                                               &p_cus->config_handles);
+    if (err_code != NRF_SUCCESS)
+    {
+        return err_code;
+    }
+
+    return NRF_SUCCESS;
+}
+
 uint32_t ble_cus_init(ble_cus_t *p_cus, const ble_cus_init_t *p_cus_init)
 {
     if (p_cus == NULL || p_cus_init == NULL)
@@ -322,7 +868,14 @@ uint32_t ble_cus_init(ble_cus_t *p_cus, const ble_cus_init_t *p_cus_init)
 
     // Initialize service structure
     p_cus->evt_handler = p_cus_init->evt_handler;
-    p_cus->conn_handle = BLE_CONN_HANDLE_INVALID;
+    p_cus->steering_value = 0;
+    p_cus->steering_timestamp = 0;
+    p_cus->steering_changed = false;
+    for (uint8_t i = 0; i < BLE_CUS_MAX_LINKS; i++)
+    {
+        link_reset(&p_cus->links[i], BLE_CONN_HANDLE_INVALID);
+    }
+    memset(&p_cus->steering_stats, 0, sizeof(p_cus->steering_stats));
 
     // Add Custom Service UUID
     ble_uuid128_t base_uuid = {STEERER_SERVICE_UUID_BASE};
@@ -344,10 +897,17 @@ uint32_t ble_cus_init(ble_cus_t *p_cus, const ble_cus_init_t *p_cus_init)
     custom_value_char_add(p_cus, p_cus_init);
     rx_char_add(p_cus, p_cus_init);
     tx_char_add(p_cus, p_cus_init);
+    err_code = diag_char_add(p_cus, p_cus_init);
+    VERIFY_SUCCESS(err_code);
+
+    err_code = curve_char_add(p_cus, p_cus_init);
+    VERIFY_SUCCESS(err_code);
+
+    return config_char_add(p_cus, p_cus_init);
 }
 
-uint32_t ble_cus_tx_value_update(ble_cus_t *p_cus, uint8_t *custom_value,
-                                 uint8_t data_len)
+uint32_t ble_cus_tx_value_update(ble_cus_t *p_cus, uint16_t conn_handle,
+                                 uint8_t *custom_value, uint8_t data_len)
 {
     if (p_cus == NULL)
     {
@@ -365,15 +925,15 @@ uint32_t ble_cus_tx_value_update(ble_cus_t *p_cus, uint8_t *custom_value,
     gatts_value.p_value = custom_value;
 
     // Update database.
-    err_code = sd_ble_gatts_value_set(
-        p_cus->conn_handle, p_cus->tx_handles.value_handle, &gatts_value);
+    err_code = sd_ble_gatts_value_set(conn_handle, p_cus->tx_handles.value_handle,
+                                      &gatts_value);
     if (err_code != NRF_SUCCESS)
     {
         return err_code;
     }
 
     // Send value if connected and notifying.
-    if ((p_cus->conn_handle != BLE_CONN_HANDLE_INVALID))
+    if (conn_handle != BLE_CONN_HANDLE_INVALID)
     {
         ble_gatts_hvx_params_t hvx_params;
 
@@ -385,62 +945,216 @@ uint32_t ble_cus_tx_value_update(ble_cus_t *p_cus, uint8_t *custom_value,
         hvx_params.p_len = &gatts_value.len;
         hvx_params.p_data = gatts_value.p_value;
 
-        err_code = sd_ble_gatts_hvx(p_cus->conn_handle, &hvx_params);
+        err_code = sd_ble_gatts_hvx(conn_handle, &hvx_params);
     }
     else
     {
         err_code = NRF_ERROR_INVALID_STATE;
-        NRF_LOG_INFO("sd_ble_gatts_hvx result: NRF_ERROR_INVALID_STATE. \r\n");
     }
 
     return err_code;
 }
 
-uint32_t ble_cus_steering_value_update(ble_cus_t *p_cus, float angle)
+uint32_t ble_cus_steering_value_update(ble_cus_t *p_cus, int16_t angle_cdeg,
+                                       uint32_t sample_timestamp,
+                                       bool     changed)
 {
     if (p_cus == NULL)
     {
         return NRF_ERROR_NULL;
     }
 
-    uint32_t          err_code = NRF_SUCCESS;
+    uint32_t err_code = NRF_ERROR_INVALID_STATE;
+
+    CRITICAL_REGION_ENTER();
+    // Zwift expects a little endian IEEE float in degrees. The value is
+    // shared by all links, each hvx picks up whatever is newest.
+    p_cus->steering_value = angle_cdeg / 100.0f;
+    p_cus->steering_timestamp = sample_timestamp;
+    p_cus->steering_changed = changed;
+
+    for (uint8_t i = 0; i < BLE_CUS_MAX_LINKS; i++)
+    {
+        ble_cus_link_t *p_link = &p_cus->links[i];
+
+        if (!steering_subscribed(p_link))
+        {
+            continue;
+        }
+
+        // One slow link must not hold back the others
+        if (steering_send(p_cus, p_link) == NRF_SUCCESS)
+        {
+            err_code = NRF_SUCCESS;
+        }
+        else if (err_code != NRF_SUCCESS)
+        {
+            err_code = NRF_ERROR_BUSY;
+        }
+    }
+    CRITICAL_REGION_EXIT();
+
+    return err_code;
+}
+
+uint8_t ble_cus_steering_link_count(ble_cus_t const *p_cus)
+{
+    uint8_t count = 0;
+
+    for (uint8_t i = 0; i < BLE_CUS_MAX_LINKS; i++)
+    {
+        if (steering_subscribed(&p_cus->links[i]))
+        {
+            count++;
+        }
+    }
+
+    return count;
+}
+
+bool ble_cus_conn_evt_get(ble_cus_t *p_cus, uint32_t *p_timestamp,
+                          uint16_t *p_conn_interval)
+{
+    uint32_t now = app_timer_cnt_get();
+    uint32_t newest_age = UINT32_MAX;
+
+    CRITICAL_REGION_ENTER();
+    for (uint8_t i = 0; i < BLE_CUS_MAX_LINKS; i++)
+    {
+        ble_cus_link_t const *p_link = &p_cus->links[i];
+        uint32_t              age;
+
+        if (!steering_subscribed(p_link) || !p_link->conn_evt_known ||
+            p_link->conn_interval == 0)
+        {
+            continue;
+        }
+
+        age = app_timer_cnt_diff_compute(now, p_link->conn_evt_timestamp);
+        if (age < newest_age)
+        {
+            newest_age = age;
+            *p_timestamp = p_link->conn_evt_timestamp;
+            *p_conn_interval = p_link->conn_interval;
+        }
+    }
+    CRITICAL_REGION_EXIT();
+
+    return newest_age != UINT32_MAX;
+}
+
+void ble_cus_handshake_resume(ble_cus_t *p_cus, uint16_t conn_handle)
+{
+    ble_cus_link_t *p_link = link_get(p_cus, conn_handle);
+
+    if (p_link == NULL || p_link->handshake == BLE_CUS_HANDSHAKE_DONE)
+    {
+        return;
+    }
+
+    p_link->handshake = BLE_CUS_HANDSHAKE_DONE;
+    cccd_read(p_cus, p_link);
+
+    if (p_link->notify_enabled)
+    {
+        evt_send(p_cus, BLE_CUS_START_SENDING_STEERING_DATA, conn_handle);
+    }
+}
+
+uint32_t ble_cus_curve_value_set(ble_cus_t *p_cus, uint8_t const *p_data,
+                                 uint16_t len)
+{
+    if (p_cus == NULL || p_data == NULL)
+    {
+        return NRF_ERROR_NULL;
+    }
+
     ble_gatts_value_t gatts_value;
 
-    // Initialize value struct.
     memset(&gatts_value, 0, sizeof(gatts_value));
 
-    gatts_value.len = 4;
+    gatts_value.len = len;
     gatts_value.offset = 0;
-    gatts_value.p_value = &angle;
+    gatts_value.p_value = (uint8_t *)p_data;
 
-    // Update database.
-    err_code = sd_ble_gatts_value_set(
-        p_cus->conn_handle, p_cus->steerer_handles.value_handle, &gatts_value);
+    return sd_ble_gatts_value_set(BLE_CONN_HANDLE_INVALID,
+                                  p_cus->curve_handles.value_handle,
+                                  &gatts_value);
+}
+
+uint32_t ble_cus_config_value_set(ble_cus_t *p_cus, uint8_t const *p_data,
+                                  uint16_t len)
+{
+    if (p_cus == NULL || p_data == NULL)
+    {
+        return NRF_ERROR_NULL;
+    }
+
+    ble_gatts_value_t gatts_value;
+
+    memset(&gatts_value, 0, sizeof(gatts_value));
+
+    gatts_value.len = len;
+    gatts_value.offset = 0;
+    gatts_value.p_value = (uint8_t *)p_data;
+
+    return sd_ble_gatts_value_set(BLE_CONN_HANDLE_INVALID,
+                                  p_cus->config_handles.value_handle,
+                                  &gatts_value);
+}
+
+uint32_t ble_cus_diag_update(ble_cus_t *p_cus, ble_cus_diag_t const *p_diag)
+{
+    if (p_cus == NULL || p_diag == NULL)
+    {
+        return NRF_ERROR_NULL;
+    }
+
+    uint32_t          err_code;
+    uint16_t          len = sizeof(*p_diag);
+    ble_gatts_value_t gatts_value;
+
+    memset(&gatts_value, 0, sizeof(gatts_value));
+
+    gatts_value.len = sizeof(*p_diag);
+    gatts_value.offset = 0;
+    gatts_value.p_value = (uint8_t *)p_diag;
+
+    err_code = sd_ble_gatts_value_set(BLE_CONN_HANDLE_INVALID,
+                                      p_cus->diag_handles.value_handle,
+                                      &gatts_value);
     if (err_code != NRF_SUCCESS)
     {
         return err_code;
     }
 
-    // Send value if connected and notifying.
-    if ((p_cus->conn_handle != BLE_CONN_HANDLE_INVALID))
+    for (uint8_t i = 0; i < BLE_CUS_MAX_LINKS; i++)
     {
+        ble_cus_link_t *       p_link = &p_cus->links[i];
         ble_gatts_hvx_params_t hvx_params;
 
+        if (p_link->conn_handle == BLE_CONN_HANDLE_INVALID ||
+            !p_link->diag_notify_enabled)
+        {
+            continue;
+        }
+
         memset(&hvx_params, 0, sizeof(hvx_params));
 
-        hvx_params.handle = p_cus->steerer_handles.value_handle;
+        hvx_params.handle = p_cus->diag_handles.value_handle;
         hvx_params.type = BLE_GATT_HVX_NOTIFICATION;
-        hvx_params.offset = gatts_value.offset;
-        hvx_params.p_len = &gatts_value.len;
-        hvx_params.p_data = gatts_value.p_value;
+        hvx_params.p_len = &len;
+        hvx_params.p_data = NULL;
 
-        err_code = sd_ble_gatts_hvx(p_cus->conn_handle, &hvx_params);
-    }
-    else
-    {
-        err_code = NRF_ERROR_INVALID_STATE;
-        NRF_LOG_INFO("sd_ble_gatts_hvx result: NRF_ERROR_INVALID_STATE. \r\n");
+        // Out of buffers or MTU too small, the central can still read it.
+        // Counted so its TX complete is not taken for a steering one.
+        CRITICAL_REGION_ENTER();
+        if (sd_ble_gatts_hvx(p_link->conn_handle, &hvx_params) == NRF_SUCCESS)
+        {
+            p_link->diag_in_flight++;
+        }
+        CRITICAL_REGION_EXIT();
     }
 
-    return err_code;
+    return NRF_SUCCESS;
 }
@@ -6,6 +6,8 @@
 
 #include "ble.h"
 #include "ble_srv_common.h"
+#include "compiler_abstraction.h"
+#include "nrf_sdh_ble.h"
 
 /**@brief   Macro for defining a ble_hrs instance.
  *
@@ -29,6 +31,27 @@
 #define STEERER_CHAR_UUID 0x0030
 #define RX_CHAR_UUID 0x0031
 #define TX_CHAR_UUID 0x0032
+#define DIAG_CHAR_UUID 0x0033
+#define CURVE_CHAR_UUID 0x0034
+#define CONFIG_CHAR_UUID 0x0035
+
+// Longest value of the curve characteristic, the payload of the default
+// 23 byte ATT MTU, so a curve goes up without an MTU exchange
+#define BLE_CUS_CURVE_MAX_LEN 20
+
+// Longest value of the config characteristic, one ATT payload
+#define BLE_CUS_CONFIG_MAX_LEN (NRF_SDH_BLE_GATT_MAX_MTU_SIZE - 3)
+
+// Written to the rx characteristic, clears the steering counters and the
+// latency histograms
+#define BLE_CUS_CMD_STATS_RESET 0xF001
+
+// Steering notifications handed to the SoftDevice at once, 1 sends at most one
+// per connection event
+#define BLE_CUS_STEERING_MAX_IN_FLIGHT 1
+
+// Centrals that can stream steering data at the same time
+#define BLE_CUS_MAX_LINKS NRF_SDH_BLE_PERIPHERAL_LINK_COUNT
 
 /**@brief Custom Service event type. */
 typedef enum
@@ -37,15 +60,100 @@ typedef enum
     BLE_CUS_EVT_NOTIFICATION_DISABLED, /**< Custom value notification disabled
                                           event. */
     BLE_CUS_EVT_DISCONNECTED,
-    BLE_CUS_EVT_CONNECTED
+    BLE_CUS_EVT_CONNECTED,
+    BLE_CUS_EVT_CURVE_WRITE, /**< Curve characteristic written. */
+    BLE_CUS_EVT_CONFIG_WRITE, /**< Config characteristic written. */
+    BLE_CUS_EVT_STEERING_SENT /**< Steering notifications went out on the
+                                 link, from the SoftDevice interrupt. */
 } ble_cus_evt_type_t;
 
 /**@brief Custom Service event. */
 typedef struct
 {
     ble_cus_evt_type_t evt_type; /**< Type of event. */
+    uint16_t conn_handle; /**< Connection the event belongs to. */
+    uint8_t const *p_data; /**< Written value, BLE_CUS_EVT_CURVE_WRITE and
+                              BLE_CUS_EVT_CONFIG_WRITE only. */
+    uint16_t len; /**< Length of the written value. */
 } ble_cus_evt_t;
 
+/**@brief Progress of the Zwift handshake on a link. */
+typedef enum
+{
+    BLE_CUS_HANDSHAKE_NONE,       /**< Nothing written to the rx characteristic
+                                     yet. */
+    BLE_CUS_HANDSHAKE_CHALLENGED, /**< Challenge sent, waiting for 0x0311. */
+    BLE_CUS_HANDSHAKE_DONE        /**< Steering data may be sent. */
+} ble_cus_handshake_t;
+
+/**@brief Per-connection state of the Custom Service. */
+typedef struct
+{
+    uint16_t conn_handle; /**< Handle of the connection, BLE_CONN_HANDLE_INVALID
+                             if the slot is free. */
+    ble_cus_handshake_t handshake; /**< Zwift handshake progress. */
+    bool notify_enabled; /**< Steering CCCD has notifications enabled. */
+    uint8_t steering_in_flight; /**< Notifications waiting for
+                                   BLE_GATTS_EVT_HVN_TX_COMPLETE. */
+    uint8_t diag_in_flight; /**< Diagnostics notifications waiting for
+                               BLE_GATTS_EVT_HVN_TX_COMPLETE, they share
+                               the link's buffers. */
+    bool steering_pending; /**< Set when the newest value still has to be sent
+                              on this link. */
+    uint32_t hvx_timestamp; /**< app_timer ticks when the oldest notification
+                               in flight was queued. */
+    bool conn_evt_known; /**< Set once a notification went out on the link. */
+    uint32_t conn_evt_timestamp; /**< app_timer ticks of the latest
+                                    BLE_GATTS_EVT_HVN_TX_COMPLETE, right after
+                                    a connection event. */
+    uint16_t conn_interval; /**< Negotiated connection interval, in 1.25 ms
+                               units. */
+    bool diag_notify_enabled; /**< Diagnostics CCCD has notifications
+                                 enabled. */
+} ble_cus_link_t;
+
+/**@brief Steering hvx errors, counted per kind. */
+typedef enum
+{
+    BLE_CUS_HVX_ERR_RESOURCES,        /**< SoftDevice out of buffers. */
+    BLE_CUS_HVX_ERR_INVALID_STATE,    /**< CCCD not enabled or link busy. */
+    BLE_CUS_HVX_ERR_SYS_ATTR_MISSING, /**< System attributes not set yet. */
+    BLE_CUS_HVX_ERR_CONN_HANDLE,      /**< Link already gone. */
+    BLE_CUS_HVX_ERR_OTHER,            /**< Anything else. */
+    BLE_CUS_HVX_ERR_COUNT
+} ble_cus_hvx_err_t;
+
+/**@brief Steering notification counters. */
+typedef struct
+{
+    uint32_t queued;    /**< Notifications accepted by the SoftDevice. */
+    uint32_t coalesced; /**< Pending angles replaced by a newer one. */
+    uint32_t dropped;   /**< Angles lost to an hvx error. */
+    uint16_t hvx_errors[BLE_CUS_HVX_ERR_COUNT]; /**< Errors returned by
+                                                   sd_ble_gatts_hvx. */
+} ble_cus_steering_stats_t;
+
+/**@brief Value of the diagnostics characteristic, little endian. */
+typedef struct __PACKED
+{
+    uint8_t  version;        /**< BLE_CUS_DIAG_VERSION. */
+    uint8_t  cpu_busy_pct;   /**< CPU busy over the last update interval. */
+    uint16_t wakeups_per_s;  /**< Main loop wake-ups per second. */
+    uint16_t conn_interval;  /**< Connection interval in use, 1.25 ms units. */
+    uint16_t stack_used;     /**< Stack high-water mark in bytes. */
+    uint32_t samples;        /**< ADC samples taken since boot. */
+    uint32_t queued;         /**< Steering notifications queued. */
+    uint32_t coalesced;      /**< Steering angles coalesced. */
+    uint32_t dropped;        /**< Steering angles dropped. */
+    uint16_t hvx_errors[BLE_CUS_HVX_ERR_COUNT]; /**< By ble_cus_hvx_err_t. */
+    uint16_t boot_advertising_ms; /**< From main to advertising. */
+    uint16_t boot_first_angle_ms; /**< From main to the first angle. */
+    uint8_t  boot_slowest;        /**< Slowest boot stage, diag_boot_stage_t. */
+    uint16_t boot_slowest_ms;     /**< Its duration. */
+} ble_cus_diag_t;
+
+#define BLE_CUS_DIAG_VERSION 2
+
 // Forward declaration of the ble_cus_t type.
 typedef struct ble_cus_s ble_cus_t;
 
@@ -80,10 +188,24 @@ struct ble_cus_s
         rx_handles; /**< Handles related to the Custom Value characteristic. */
     ble_gatts_char_handles_t
              tx_handles; /**< Handles related to the Custom Value characteristic. */
-    uint16_t conn_handle; /**< Handle of the current connection (as provided by
-                             the BLE stack, is BLE_CONN_HANDLE_INVALID if not in
-                             a connection). */
+    ble_gatts_char_handles_t
+        diag_handles; /**< Handles related to the diagnostics characteristic. */
+    ble_gatts_char_handles_t
+        curve_handles; /**< Handles related to the calibration curve
+                          characteristic. */
+    ble_gatts_char_handles_t
+        config_handles; /**< Handles related to the config characteristic. */
+    ble_cus_link_t links[BLE_CUS_MAX_LINKS]; /**< State of each connected
+                                                central. */
     uint8_t uuid_type;
+    float   steering_value; /**< User located value of the steering
+                               characteristic, sent without a value_set. */
+    uint32_t steering_timestamp; /**< app_timer ticks when the sample behind
+                                    steering_value was captured. */
+    bool steering_changed; /**< steering_value was sent because it changed,
+                              not resent as a keep-alive. */
+    ble_cus_steering_stats_t steering_stats; /**< Steering notification
+                                                counters. */
 };
 
 /**@brief Function for initializing the Custom Service.
@@ -119,14 +241,116 @@ void ble_cus_on_ble_evt(ble_evt_t const *p_ble_evt, void *p_context);
  * @note
  *
  * @param[in]   p_bas          Custom Service structure.
+ * @param[in]   conn_handle    Connection to indicate the value on.
  * @param[in]   Custom value
  *
  * @return      NRF_SUCCESS on success, otherwise an error code.
  */
 
-uint32_t ble_cus_tx_value_update(ble_cus_t *p_cus, uint8_t *custom_value,
-                                 uint8_t data_len);
+uint32_t ble_cus_tx_value_update(ble_cus_t *p_cus, uint16_t conn_handle,
+                                 uint8_t *custom_value, uint8_t data_len);
+
+/**@brief Function for sending a steering angle.
+ *
+ * @details The angle is converted to the float Zwift expects right before it
+ * is handed to the SoftDevice, and sent to every central that finished the
+ * handshake and enabled notifications. If BLE_CUS_STEERING_MAX_IN_FLIGHT
+ * notifications are already queued on a link, or the SoftDevice is out of
+ * buffers, that link is marked pending and gets the newest angle on its next
+ * BLE_GATTS_EVT_HVN_TX_COMPLETE.
+ *
+ * Every queued notification of a changed angle adds to the
+ * LATENCY_SAMPLE_TO_HVX histogram, every TX complete to LATENCY_HVX_TO_TX.
+ * A resend of an angle that did not change carries a sample as old as the
+ * stick has been still, it would only bury the latencies that matter.
+ *
+ * @param[in]   p_cus             Custom Service structure.
+ * @param[in]   angle_cdeg        Steering angle in hundredths of a degree.
+ * @param[in]   sample_timestamp  app_timer ticks when the sample was captured.
+ * @param[in]   changed           false for a keep-alive or the first angle of
+ *                                a link.
+ *
+ * @return      NRF_SUCCESS if at least one link took the angle,
+ * NRF_ERROR_INVALID_STATE if no central is subscribed, otherwise an error
+ * code.
+ */
+uint32_t ble_cus_steering_value_update(ble_cus_t *p_cus, int16_t angle_cdeg,
+                                       uint32_t sample_timestamp,
+                                       bool     changed);
 
-uint32_t ble_cus_steering_value_update(ble_cus_t *p_cus, float angle);
+/**@brief Function for getting when a connection event of a streaming link
+ * ended.
+ *
+ * @details The SoftDevice reports BLE_GATTS_EVT_HVN_TX_COMPLETE right after
+ * the connection event that sent the notifications, the next events follow
+ * every connection interval from there. Of the links steering data is sent
+ * to, the one that completed a connection event last is taken, the
+ * timestamp and the interval both belong to it.
+ *
+ * @param[in]   p_cus            Custom Service structure.
+ * @param[out]  p_timestamp      app_timer ticks of the latest one.
+ * @param[out]  p_conn_interval  Connection interval of that link, in 1.25 ms
+ *                               units.
+ *
+ * @return      false if nothing was sent on a streaming link yet.
+ */
+bool ble_cus_conn_evt_get(ble_cus_t *p_cus, uint32_t *p_timestamp,
+                          uint16_t *p_conn_interval);
+
+/**@brief Function for counting the centrals steering data is sent to.
+ *
+ * @param[in]   p_cus          Custom Service structure.
+ *
+ * @return      Links that finished the handshake with notifications enabled.
+ */
+uint8_t ble_cus_steering_link_count(ble_cus_t const *p_cus);
+
+/**@brief Function for publishing the diagnostics counters.
+ *
+ * @details Sets the value read by centrals and notifies every link that
+ * subscribed. Links whose ATT MTU is too small for the whole value can still
+ * read it.
+ *
+ * @param[in]   p_cus          Custom Service structure.
+ * @param[in]   p_diag         Counters to publish.
+ *
+ * @return      NRF_SUCCESS on success, otherwise an error code.
+ */
+uint32_t ble_cus_diag_update(ble_cus_t *p_cus, ble_cus_diag_t const *p_diag);
+
+/**@brief Function for setting the value read from the curve characteristic.
+ *
+ * @param[in]   p_cus          Custom Service structure.
+ * @param[in]   p_data         New value.
+ * @param[in]   len            Length of the value, at most
+ * BLE_CUS_CURVE_MAX_LEN.
+ *
+ * @return      NRF_SUCCESS on success, otherwise an error code.
+ */
+uint32_t ble_cus_curve_value_set(ble_cus_t *p_cus, uint8_t const *p_data,
+                                 uint16_t len);
+
+/**@brief Function for setting the value read from the config characteristic.
+ *
+ * @param[in]   p_cus          Custom Service structure.
+ * @param[in]   p_data         New value.
+ * @param[in]   len            Length of the value, at most
+ * BLE_CUS_CONFIG_MAX_LEN.
+ *
+ * @return      NRF_SUCCESS on success, otherwise an error code.
+ */
+uint32_t ble_cus_config_value_set(ble_cus_t *p_cus, uint8_t const *p_data,
+                                  uint16_t len);
+
+/**@brief Function for skipping the handshake of a known central.
+ *
+ * @details Used for bonded centrals that finished the handshake on an earlier
+ * connection. Steering starts as soon as notifications are enabled, or right
+ * away if the bond restored them.
+ *
+ * @param[in]   p_cus          Custom Service structure.
+ * @param[in]   conn_handle    Connection of the bonded central.
+ */
+void ble_cus_handshake_resume(ble_cus_t *p_cus, uint16_t conn_handle);
 
 #endif  // BLE_CUS_H__
@@ -0,0 +1,803 @@
+/**
+ * Copyright (c) 2018 Keith Wakeham
+ *
+ * All rights reserved.
+ *
+ *
+ */
+
+#include "calibration.h"
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include "app_error.h"
+#include "app_scheduler.h"
+#include "app_timer.h"
+#include "app_util.h"
+#include "app_util_platform.h"
+#include "crc16.h"
+#include "fds.h"
+#include "nrf_atomic.h"
+#include "nrf_log.h"
+#include "nrf_soc.h"
+#include "steer-adc.h"
+#include "storage.h"
+
+#define CALIBRATION_VERSION 1
+
+// Records in STORAGE_FILE_CALIBRATION
+#define CALIBRATION_RECORD_KEY 0x0001
+#define CURVE_RECORD_KEY 0x0002
+
+// The nominal scale, the centre maps to NOMINAL_SPAN and each endpoint
+// NOMINAL_SPAN away from it
+#define NOMINAL_SPAN (MAX_ADC_RESOLUTION / 2)
+
+// Samples in a rest window, about 2 s at 25 buffers a second
+#define REST_WINDOW 50
+// Largest spread of the codes within a rest window
+#define REST_NOISE 24
+// A rest position further than this from the centre is a held turn
+#define REST_GATE 512
+// The centre is the median of this many rest positions
+#define REST_HISTORY 5
+
+// An endpoint only moves out after this many samples in a row beyond it
+#define EXTREME_HOLD 4
+// Endpoints closer than this to the centre are not used for scaling yet
+#define MIN_SPAN (MAX_ADC_RESOLUTION / 4)
+
+// Flash writes are coalesced: at most one per SAVE_INTERVAL, only after a
+// change of SAVE_MIN_DELTA codes, and no more than SAVE_MAX_PER_BOOT
+#define SAVE_INTERVAL APP_TIMER_TICKS(300000)
+#define SAVE_MIN_DELTA 8
+#define SAVE_MAX_PER_BOOT 8
+
+#define SCALE_SHIFT 12
+
+// log2 of MAX_ADC_RESOLUTION
+#define RESOLUTION_BITS 14
+STATIC_ASSERT((1 << RESOLUTION_BITS) == MAX_ADC_RESOLUTION);
+
+// Marks a retained copy, changed whenever retained_t changes. A layout from
+// another firmware fails this or the CRC.
+#define RETAINED_MAGIC 0x43414C31 // "CAL1"
+
+// nRF52832 RAM, blocks of two 4 kB sections each
+#define RAM_BASE_ADDRESS 0x20000000
+#define RAM_SECTION_SIZE 0x1000
+#define RAM_SECTIONS_PER_BLOCK 2
+
+/**
+ * @brief Calibration kept in RAM through resets and system off
+ *
+ */
+typedef struct
+{
+    uint32_t            magic;
+    calibration_t       cal;
+    calibration_curve_t curve;   // count 0 for the straight line
+    uint8_t             learned; // the centre came from a rest window
+    uint16_t            crc;     // over everything before it
+} retained_t;
+
+APP_TIMER_DEF(m_save_timer);
+
+// The startup code leaves .non_init alone, a warm reset finds it as it was
+static retained_t m_retained __attribute__((section(".non_init")));
+
+// Must stay valid until the flash write is done
+static calibration_t       m_record_data;
+static calibration_curve_t m_curve_record_data;
+
+/**
+ * @brief Correction curve ready for evaluation
+ *
+ */
+typedef struct
+{
+    uint8_t shift; // nominal code to knot index
+    uint8_t count;
+    int16_t y[CALIBRATION_CURVE_MAX_KNOTS];
+} curve_t;
+
+// Written in turns, the one not in use is filled while main context keeps
+// reading the other
+static curve_t          m_curves[2];
+static curve_t *volatile m_p_curve; // NULL for the straight line
+
+static struct
+{
+    calibration_curve_t curve;
+    uint32_t            received; // bit per knot
+    bool                begun;
+} m_upload;
+
+static nrf_atomic_flag_t m_curve_write_pending;
+
+// First knot calibration_curve_encode() reads back
+static volatile uint8_t m_read_first;
+
+static struct
+{
+    bool          valid;          // the centre is known
+    bool          centre_learned; // from a rest window, flash or before a reset
+    bool          retained;       // taken over from before the reset
+    calibration_t cal;
+    int32_t       scale_left;     // Q12, nominal codes per raw code
+    int32_t       scale_right;
+
+    uint8_t window_count;
+    int16_t window_min;
+    int16_t window_max;
+    int16_t history[REST_HISTORY];
+    uint8_t history_count;
+    uint8_t history_next;
+
+    uint8_t low_run;  // samples in a row below min
+    int16_t low_run_extreme;
+    uint8_t high_run; // samples in a row above max
+    int16_t high_run_extreme;
+
+    bool          stored;         // saved holds what is in flash
+    calibration_t saved;
+    volatile bool write_pending;
+    uint8_t       writes;
+} m_cal = {.cal.version = CALIBRATION_VERSION,
+           .scale_left = 1 << SCALE_SHIFT,
+           .scale_right = 1 << SCALE_SHIFT};
+
+/**
+ * @brief Copy the calibration in use to retained RAM
+ *
+ * @details Also called from the SoftDevice event context for the curve, the
+ * copy has to match its CRC whenever a reset comes.
+ */
+static void retained_update(void)
+{
+    curve_t const *p_curve = m_p_curve;
+
+    CRITICAL_REGION_ENTER();
+    memset(&m_retained, 0, sizeof(m_retained));
+    m_retained.magic = RETAINED_MAGIC;
+    m_retained.cal = m_cal.cal;
+    m_retained.curve.version = CALIBRATION_CURVE_VERSION;
+    if (p_curve != NULL)
+    {
+        m_retained.curve.count = p_curve->count;
+        memcpy(m_retained.curve.y, p_curve->y,
+               p_curve->count * sizeof(p_curve->y[0]));
+    }
+    m_retained.learned = m_cal.centre_learned;
+    m_retained.crc = crc16_compute((uint8_t const *)&m_retained,
+                                   offsetof(retained_t, crc), NULL);
+    CRITICAL_REGION_EXIT();
+}
+
+/**
+ * @brief Recompute the scale of each side from the endpoints
+ *
+ */
+static void scales_update(void)
+{
+    int32_t span_left = m_cal.cal.centre - m_cal.cal.min;
+    int32_t span_right = m_cal.cal.max - m_cal.cal.centre;
+
+    m_cal.scale_left = (span_left >= MIN_SPAN)
+                           ? (NOMINAL_SPAN << SCALE_SHIFT) / span_left
+                           : (1 << SCALE_SHIFT);
+    m_cal.scale_right = (span_right >= MIN_SPAN)
+                            ? (NOMINAL_SPAN << SCALE_SHIFT) / span_right
+                            : (1 << SCALE_SHIFT);
+
+    retained_update();
+}
+
+/**
+ * @brief Move the centre, the endpoints always enclose it
+ *
+ */
+static void centre_set(int16_t centre)
+{
+    m_cal.cal.centre = centre;
+    m_cal.cal.min = MIN(m_cal.cal.min, centre);
+    m_cal.cal.max = MAX(m_cal.cal.max, centre);
+    scales_update();
+}
+
+/**
+ * @brief Median of the rest history
+ *
+ */
+static int16_t history_median(void)
+{
+    int16_t sorted[REST_HISTORY];
+    uint8_t count = m_cal.history_count;
+
+    memcpy(sorted, m_cal.history, sizeof(sorted));
+
+    for (uint8_t i = 1; i < count; i++)
+    {
+        int16_t value = sorted[i];
+        uint8_t j = i;
+
+        for (; j > 0 && sorted[j - 1] > value; j--)
+        {
+            sorted[j] = sorted[j - 1];
+        }
+        sorted[j] = value;
+    }
+
+    return sorted[count / 2];
+}
+
+/**
+ * @brief Find rest positions and let the centre follow them
+ *
+ * @details A window of REST_WINDOW samples that stays within REST_NOISE is a
+ * rest position. Ones far from the centre are the rider holding a turn and
+ * are dropped, the median takes care of the odd one that gets through.
+ */
+static void rest_update(int16_t code)
+{
+    int16_t rest;
+
+    if (m_cal.window_count == 0)
+    {
+        m_cal.window_min = code;
+        m_cal.window_max = code;
+    }
+    m_cal.window_min = MIN(m_cal.window_min, code);
+    m_cal.window_max = MAX(m_cal.window_max, code);
+
+    if (m_cal.window_max - m_cal.window_min > REST_NOISE)
+    {
+        // Moving, start over from here
+        m_cal.window_count = 1;
+        m_cal.window_min = code;
+        m_cal.window_max = code;
+        return;
+    }
+
+    if (++m_cal.window_count < REST_WINDOW)
+    {
+        return;
+    }
+    m_cal.window_count = 0;
+
+    rest = (m_cal.window_min + m_cal.window_max) / 2;
+    // Until the first rest position the centre is whatever the first sample
+    // was, maybe a turn
+    if (m_cal.centre_learned &&
+        (rest - m_cal.cal.centre > REST_GATE ||
+         m_cal.cal.centre - rest > REST_GATE))
+    {
+        return;
+    }
+    m_cal.centre_learned = true;
+
+    m_cal.history[m_cal.history_next] = rest;
+    m_cal.history_next = (m_cal.history_next + 1) % REST_HISTORY;
+    m_cal.history_count = MIN(m_cal.history_count + 1, REST_HISTORY);
+
+    centre_set(history_median());
+}
+
+/**
+ * @brief Widen the endpoints to where the stick was held
+ *
+ * @details A single spike does not count, the stick has to stay beyond an
+ * endpoint for EXTREME_HOLD samples. The endpoint moves to the least extreme
+ * of those.
+ */
+static void extremes_update(int16_t code)
+{
+    if (code < m_cal.cal.min)
+    {
+        m_cal.low_run_extreme =
+            (m_cal.low_run == 0) ? code : MAX(m_cal.low_run_extreme, code);
+        if (++m_cal.low_run >= EXTREME_HOLD)
+        {
+            m_cal.low_run = 0;
+            m_cal.cal.min = m_cal.low_run_extreme;
+            scales_update();
+        }
+    }
+    else
+    {
+        m_cal.low_run = 0;
+    }
+
+    if (code > m_cal.cal.max)
+    {
+        m_cal.high_run_extreme =
+            (m_cal.high_run == 0) ? code : MIN(m_cal.high_run_extreme, code);
+        if (++m_cal.high_run >= EXTREME_HOLD)
+        {
+            m_cal.high_run = 0;
+            m_cal.cal.max = m_cal.high_run_extreme;
+            scales_update();
+        }
+    }
+    else
+    {
+        m_cal.high_run = 0;
+    }
+}
+
+/**
+ * @brief Check a calibration read from flash
+ *
+ */
+static bool calibration_sane(calibration_t const *p_cal)
+{
+    return p_cal->version == CALIBRATION_VERSION && p_cal->min >= 0 &&
+           p_cal->min <= p_cal->centre && p_cal->centre <= p_cal->max &&
+           p_cal->max < MAX_ADC_RESOLUTION;
+}
+
+/**
+ * @brief Check a curve and prepare it for evaluation
+ *
+ * @param p_curve curve as uploaded or stored
+ * @param p_out filled in if the curve is fine, may be NULL
+ * @return true if the curve may be used
+ */
+static bool curve_check(calibration_curve_t const *p_curve, curve_t *p_out)
+{
+    uint8_t segments;
+    uint8_t shift = RESOLUTION_BITS;
+
+    if (p_curve->version != CALIBRATION_CURVE_VERSION || p_curve->count < 2 ||
+        p_curve->count > CALIBRATION_CURVE_MAX_KNOTS)
+    {
+        return false;
+    }
+
+    segments = p_curve->count - 1;
+    if ((segments & (segments - 1)) != 0)
+    {
+        return false;
+    }
+    for (; segments > 1; segments >>= 1)
+    {
+        shift--;
+    }
+
+    // Rising, or the angle would run backwards somewhere
+    for (uint8_t i = 0; i < p_curve->count; i++)
+    {
+        if (p_curve->y[i] < 0 || p_curve->y[i] >= MAX_ADC_RESOLUTION ||
+            (i > 0 && p_curve->y[i] < p_curve->y[i - 1]))
+        {
+            return false;
+        }
+    }
+
+    if (p_out != NULL)
+    {
+        p_out->shift = shift;
+        p_out->count = p_curve->count;
+        memcpy(p_out->y, p_curve->y, p_curve->count * sizeof(p_curve->y[0]));
+    }
+
+    return true;
+}
+
+/**
+ * @brief Start using a curve, or the straight line for NULL
+ *
+ */
+static void curve_use(calibration_curve_t const *p_curve)
+{
+    curve_t *p_next;
+
+    if (p_curve == NULL || p_curve->count == 0)
+    {
+        m_p_curve = NULL;
+    }
+    else
+    {
+        p_next = (m_p_curve == &m_curves[0]) ? &m_curves[1] : &m_curves[0];
+        if (curve_check(p_curve, p_next))
+        {
+            m_p_curve = p_next;
+        }
+    }
+    m_read_first = 0;
+
+    retained_update();
+}
+
+/**
+ * @brief Check if the calibration moved enough to be worth a flash write
+ *
+ */
+static bool save_needed(void)
+{
+    if (!m_cal.stored)
+    {
+        return true;
+    }
+
+    return abs(m_cal.cal.centre - m_cal.saved.centre) >= SAVE_MIN_DELTA ||
+           abs(m_cal.cal.min - m_cal.saved.min) >= SAVE_MIN_DELTA ||
+           abs(m_cal.cal.max - m_cal.saved.max) >= SAVE_MIN_DELTA;
+}
+
+static void save_timeout_handler(void *p_context)
+{
+    ret_code_t err_code;
+
+    UNUSED_PARAMETER(p_context);
+
+    if (!m_cal.centre_learned || m_cal.write_pending ||
+        m_cal.writes >= SAVE_MAX_PER_BOOT || !save_needed())
+    {
+        return;
+    }
+
+    m_record_data = m_cal.cal;
+    err_code = storage_record_save(STORAGE_FILE_CALIBRATION,
+                                   CALIBRATION_RECORD_KEY, &m_record_data,
+                                   sizeof(m_record_data));
+    if (err_code == FDS_ERR_NO_SPACE_IN_QUEUES)
+    {
+        // Next interval
+        return;
+    }
+    APP_ERROR_CHECK(err_code);
+
+    m_cal.write_pending = true;
+    m_cal.writes++;
+}
+
+/**
+ * @brief Load the stored calibration, in main context
+ *
+ */
+static void load_evt(void *p_event_data, uint16_t event_size)
+{
+    calibration_t       stored;
+    calibration_curve_t curve;
+
+    UNUSED_PARAMETER(p_event_data);
+    UNUSED_PARAMETER(event_size);
+
+    // The retained curve is the one that was in use
+    if (!m_cal.retained &&
+        storage_record_load(STORAGE_FILE_CALIBRATION, CURVE_RECORD_KEY,
+                            &curve, sizeof(curve)))
+    {
+        if (curve.count == 0 || curve_check(&curve, NULL))
+        {
+            curve_use(&curve);
+            NRF_LOG_INFO("Curve of %d knots", curve.count);
+        }
+        else
+        {
+            NRF_LOG_WARNING("Stored curve ignored");
+        }
+    }
+
+    if (!storage_record_load(STORAGE_FILE_CALIBRATION,
+                             CALIBRATION_RECORD_KEY, &stored, sizeof(stored)))
+    {
+        NRF_LOG_INFO("No stored calibration");
+        return;
+    }
+
+    if (!calibration_sane(&stored))
+    {
+        NRF_LOG_WARNING("Stored calibration ignored");
+        return;
+    }
+    m_cal.saved = stored;
+    m_cal.stored = true;
+
+    if (m_cal.retained)
+    {
+        // Learned up to right before the reset, fresher than flash
+        return;
+    }
+
+    m_cal.cal.min = stored.min;
+    m_cal.cal.max = stored.max;
+    m_cal.centre_learned = true;
+    centre_set(stored.centre);
+    m_cal.valid = true;
+
+    NRF_LOG_INFO("Calibration centre %d, %d to %d", m_cal.cal.centre,
+                 m_cal.cal.min, m_cal.cal.max);
+}
+
+static void fds_evt_handler(fds_evt_t const *p_evt)
+{
+    ret_code_t err_code;
+
+    switch (p_evt->id)
+    {
+        case FDS_EVT_INIT:
+            if (p_evt->result == NRF_SUCCESS)
+            {
+                err_code = app_sched_event_put(NULL, 0, load_evt);
+                APP_ERROR_CHECK(err_code);
+            }
+            break;
+
+        case FDS_EVT_WRITE:
+        case FDS_EVT_UPDATE:
+            if (p_evt->write.file_id != STORAGE_FILE_CALIBRATION)
+            {
+                break;
+            }
+            if (p_evt->write.record_key == CURVE_RECORD_KEY)
+            {
+                nrf_atomic_flag_clear(&m_curve_write_pending);
+                NRF_LOG_INFO("Curve saved, result %d", p_evt->result);
+                break;
+            }
+            m_cal.write_pending = false;
+            if (p_evt->result == NRF_SUCCESS)
+            {
+                m_cal.saved = m_record_data;
+                m_cal.stored = true;
+                NRF_LOG_INFO("Calibration saved");
+            }
+            break;
+
+        default:
+            break;
+    }
+}
+
+/**
+ * @brief Take the calibration over from before the reset
+ *
+ * @details RAM keeps its content through every reset but a power cycle or
+ * brown out, and through system off in the sections calibration_retain()
+ * asked for. What a power cycle leaves there fails the CRC.
+ */
+static void retained_restore(void)
+{
+    uint16_t   crc = crc16_compute((uint8_t const *)&m_retained,
+                                 offsetof(retained_t, crc), NULL);
+    retained_t retained = m_retained;
+
+    if (retained.magic != RETAINED_MAGIC || retained.crc != crc ||
+        !calibration_sane(&retained.cal) ||
+        (retained.curve.count != 0 && !curve_check(&retained.curve, NULL)))
+    {
+        NRF_LOG_INFO("No retained calibration");
+        return;
+    }
+
+    m_cal.cal = retained.cal;
+    m_cal.valid = true;
+    m_cal.centre_learned = retained.learned;
+    m_cal.retained = true;
+    scales_update();
+    curve_use(&retained.curve);
+
+    NRF_LOG_INFO("Retained calibration centre %d, %d to %d", m_cal.cal.centre,
+                 m_cal.cal.min, m_cal.cal.max);
+}
+
+void calibration_init(void)
+{
+    ret_code_t err_code;
+
+    retained_restore();
+
+    err_code = fds_register(fds_evt_handler);
+    APP_ERROR_CHECK(err_code);
+
+    err_code = app_timer_create(&m_save_timer, APP_TIMER_MODE_REPEATED,
+                                save_timeout_handler);
+    APP_ERROR_CHECK(err_code);
+
+    err_code = app_timer_start(m_save_timer, SAVE_INTERVAL, NULL);
+    APP_ERROR_CHECK(err_code);
+}
+
+bool calibration_valid(void) { return m_cal.valid; }
+
+void calibration_retain(void)
+{
+    ret_code_t err_code;
+    uintptr_t  start = (uintptr_t)&m_retained - RAM_BASE_ADDRESS;
+    uint32_t   first = (uint32_t)(start / RAM_SECTION_SIZE);
+    uint32_t   last =
+        (uint32_t)((start + sizeof(m_retained) - 1) / RAM_SECTION_SIZE);
+
+    for (uint32_t section = first; section <= last; section++)
+    {
+        uint32_t bit = section % RAM_SECTIONS_PER_BLOCK;
+
+        err_code = sd_power_ram_power_set(
+            (uint8_t)(section / RAM_SECTIONS_PER_BLOCK),
+            ((POWER_RAM_POWER_S0POWER_On << POWER_RAM_POWER_S0POWER_Pos) |
+             (POWER_RAM_POWER_S0RETENTION_On
+              << POWER_RAM_POWER_S0RETENTION_Pos))
+                << bit);
+        APP_ERROR_CHECK(err_code);
+    }
+}
+
+void calibration_update(int16_t code)
+{
+    if (!m_cal.valid)
+    {
+        // Best guess until the stick comes to rest
+        m_cal.cal.min = code;
+        m_cal.cal.max = code;
+        centre_set(code);
+        m_cal.valid = true;
+        NRF_LOG_INFO("Zero %d", code);
+        return;
+    }
+
+    rest_update(code);
+    extremes_update(code);
+}
+
+int32_t calibration_map(int16_t code)
+{
+    int32_t        offset = code - m_cal.cal.centre;
+    int32_t        scale = (offset < 0) ? m_cal.scale_left : m_cal.scale_right;
+    int32_t        x = NOMINAL_SPAN + (offset * scale) / (1 << SCALE_SHIFT);
+    curve_t const *p_curve = m_p_curve;
+    uint32_t       index;
+    int32_t        fraction;
+
+    if (p_curve == NULL)
+    {
+        return x;
+    }
+
+    x = MAX(x, 0);
+    x = MIN(x, MAX_ADC_RESOLUTION - 1);
+
+    // Knots are evenly spaced, no search
+    index = (uint32_t)x >> p_curve->shift;
+    fraction = x & ((1 << p_curve->shift) - 1);
+
+    return p_curve->y[index] +
+           (((p_curve->y[index + 1] - p_curve->y[index]) * fraction) >>
+            p_curve->shift);
+}
+
+ret_code_t calibration_curve_write(uint8_t const *p_data, uint16_t len)
+{
+    ret_code_t err_code;
+    uint8_t    first;
+    uint8_t    count;
+
+    if (len < 1)
+    {
+        return NRF_ERROR_INVALID_LENGTH;
+    }
+
+    switch (p_data[0])
+    {
+        case CALIBRATION_CURVE_OP_BEGIN:
+            if (len != 2)
+            {
+                return NRF_ERROR_INVALID_LENGTH;
+            }
+            if (p_data[1] < 2 || p_data[1] > CALIBRATION_CURVE_MAX_KNOTS)
+            {
+                return NRF_ERROR_INVALID_PARAM;
+            }
+            memset(&m_upload, 0, sizeof(m_upload));
+            m_upload.curve.version = CALIBRATION_CURVE_VERSION;
+            m_upload.curve.count = p_data[1];
+            m_upload.begun = true;
+            return NRF_SUCCESS;
+
+        case CALIBRATION_CURVE_OP_KNOTS:
+            if (len < 4 || (len & 1) != 0)
+            {
+                return NRF_ERROR_INVALID_LENGTH;
+            }
+            first = p_data[1];
+            count = (len - 2) / 2;
+            if (!m_upload.begun || first + count > m_upload.curve.count)
+            {
+                return NRF_ERROR_INVALID_PARAM;
+            }
+            for (uint8_t i = 0; i < count; i++)
+            {
+                m_upload.curve.y[first + i] =
+                    (int16_t)uint16_decode(&p_data[2 + 2 * i]);
+                m_upload.received |= 1UL << (first + i);
+            }
+            return NRF_SUCCESS;
+
+        case CALIBRATION_CURVE_OP_COMMIT:
+            if (!m_upload.begun ||
+                m_upload.received != (1UL << m_upload.curve.count) - 1)
+            {
+                return NRF_ERROR_INVALID_PARAM;
+            }
+            if (!curve_check(&m_upload.curve, NULL))
+            {
+                return NRF_ERROR_INVALID_DATA;
+            }
+            break;
+
+        case CALIBRATION_CURVE_OP_CLEAR:
+            memset(&m_upload, 0, sizeof(m_upload));
+            m_upload.curve.version = CALIBRATION_CURVE_VERSION;
+            break;
+
+        case CALIBRATION_CURVE_OP_READ:
+            if (len != 2)
+            {
+                return NRF_ERROR_INVALID_LENGTH;
+            }
+            // The straight line has no knots, only its first index is fine
+            if (p_data[1] != 0 &&
+                (m_p_curve == NULL || p_data[1] >= m_p_curve->count))
+            {
+                return NRF_ERROR_INVALID_PARAM;
+            }
+            m_read_first = p_data[1];
+            return NRF_SUCCESS;
+
+        default:
+            return NRF_ERROR_INVALID_PARAM;
+    }
+
+    // Commit or clear, the flash record has to stay put until written
+    if (nrf_atomic_flag_set_fetch(&m_curve_write_pending))
+    {
+        return NRF_ERROR_BUSY;
+    }
+
+    m_curve_record_data = m_upload.curve;
+    m_upload.begun = false;
+    curve_use(&m_curve_record_data);
+
+    err_code = storage_record_save(STORAGE_FILE_CALIBRATION, CURVE_RECORD_KEY,
+                                   &m_curve_record_data,
+                                   sizeof(m_curve_record_data));
+    if (err_code != NRF_SUCCESS)
+    {
+        // In use until the next reset, the upload may be repeated
+        nrf_atomic_flag_clear(&m_curve_write_pending);
+        NRF_LOG_WARNING("Curve not saved, error 0x%x", err_code);
+    }
+
+    return NRF_SUCCESS;
+}
+
+uint16_t calibration_curve_encode(ret_code_t status, uint8_t *p_buffer,
+                                  uint16_t size)
+{
+    curve_t const *p_curve = m_p_curve;
+    uint8_t        count = (p_curve == NULL) ? 0 : p_curve->count;
+    uint8_t        first = MIN(m_read_first, count);
+    uint8_t        last = MIN(count, first + CALIBRATION_CURVE_KNOTS_PER_READ);
+    uint16_t       len = 0;
+
+    if (size < 3 + 2 * (last - first))
+    {
+        return 0;
+    }
+
+    p_buffer[len++] = (uint8_t)status;
+    p_buffer[len++] = count;
+    p_buffer[len++] = first;
+    for (uint8_t i = first; i < last; i++)
+    {
+        len += uint16_encode((uint16_t)p_curve->y[i], &p_buffer[len]);
+    }
+
+    return len;
+}
+
+void calibration_get(calibration_t *p_calibration)
+{
+    *p_calibration = m_cal.cal;
+}
@@ -0,0 +1,167 @@
+/**
+ * Copyright (c) 2018 Keith Wakeham
+ *
+ * All rights reserved.
+ *
+ *
+ */
+
+#ifndef CALIBRATION_H
+#define CALIBRATION_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "sdk_errors.h"
+
+// Knots of the correction curve, evenly spread over the nominal range. The
+// count minus one has to be a power of two so a knot is found with a shift.
+#define CALIBRATION_CURVE_MAX_KNOTS 17
+
+#define CALIBRATION_CURVE_VERSION 1
+
+// Knots calibration_curve_encode() reads back at a time
+#define CALIBRATION_CURVE_KNOTS_PER_READ 8
+
+// Longest value calibration_curve_encode() produces
+#define CALIBRATION_CURVE_ENCODED_MAX \
+    (3 + 2 * CALIBRATION_CURVE_KNOTS_PER_READ)
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+    /**
+     * @brief Calibration of one unit, in raw ADC codes
+     *
+     * @details Stored in flash as is, keep it a multiple of 4 bytes.
+     */
+    typedef struct
+    {
+        uint16_t version;
+        int16_t  centre; // where the stick rests
+        int16_t  min;    // furthest seen to the left, centre if none yet
+        int16_t  max;    // furthest seen to the right, centre if none yet
+    } calibration_t;
+
+    /**
+     * @brief Correction curve, stored in flash as is
+     *
+     * @details Knot i sits at nominal code i * MAX_ADC_RESOLUTION / (count -
+     * 1) and holds the code that is looked up instead. Codes in between are
+     * interpolated. A count of 0 turns the curve off.
+     */
+    typedef struct
+    {
+        uint8_t version;
+        uint8_t count;
+        int16_t y[CALIBRATION_CURVE_MAX_KNOTS];
+    } calibration_curve_t;
+
+    /**
+     * @brief Operations written to the curve characteristic
+     *
+     * @details Every write starts with the operation:
+     * BEGIN count, KNOTS first_index y..., COMMIT, CLEAR, READ first_index.
+     * The y values are little endian int16.
+     */
+    typedef enum
+    {
+        CALIBRATION_CURVE_OP_BEGIN = 0x01,  // start a curve of count knots
+        CALIBRATION_CURVE_OP_KNOTS = 0x02,  // knots from first_index on
+        CALIBRATION_CURVE_OP_COMMIT = 0x03, // check, use and store it
+        CALIBRATION_CURVE_OP_CLEAR = 0x04,  // back to the straight line
+        CALIBRATION_CURVE_OP_READ = 0x05,   // knots read back from first_index
+    } calibration_curve_op_t;
+
+    /**
+     * @brief Init the calibrator
+     *
+     * @details Takes the calibration over from retained RAM after a reset
+     * or system off, so steering works before FDS is ready. Otherwise the
+     * stored one is loaded once FDS is. Registers with FDS, call before
+     * peer_manager_init, which starts FDS.
+     */
+    void calibration_init(void);
+
+    /**
+     * @brief Check if the centre is known
+     *
+     * @return false until the first sample, a stored or a retained
+     * calibration set it
+     */
+    bool calibration_valid(void);
+
+    /**
+     * @brief Keep the retained calibration through system off
+     *
+     * @details RAM is only retained in system off for the sections asked
+     * for. Call right before sd_power_system_off().
+     */
+    void calibration_retain(void);
+
+    /**
+     * @brief Learn from a filtered sample, main context only
+     *
+     * @details The first sample becomes the centre if none is known yet.
+     * Afterwards the centre follows the median of recent rest positions and
+     * the endpoints widen to what the stick held for a few samples.
+     *
+     * @param code filtered ADC code
+     */
+    void calibration_update(int16_t code);
+
+    /**
+     * @brief Map a raw code onto the nominal range
+     *
+     * @details The centre ends up at MAX_ADC_RESOLUTION / 2 and each learned
+     * endpoint at the matching end of the range. A side without one is
+     * shifted only. The correction curve, if any, is applied last.
+     *
+     * @param code filtered ADC code
+     * @return code on the nominal scale, may lie outside of it
+     */
+    int32_t calibration_map(int16_t code);
+
+    /**
+     * @brief Handle a write to the curve characteristic
+     *
+     * @details Safe from the SoftDevice event context, the curve in use is
+     * swapped only once a complete one passed the checks.
+     *
+     * @param p_data written value, operation first
+     * @param len length of the value
+     * @return NRF_SUCCESS, NRF_ERROR_INVALID_LENGTH,
+     * NRF_ERROR_INVALID_PARAM for a bad operation or index,
+     * NRF_ERROR_INVALID_DATA for a curve that failed the checks or
+     * NRF_ERROR_BUSY while the previous one is written to flash
+     */
+    ret_code_t calibration_curve_write(uint8_t const *p_data, uint16_t len);
+
+    /**
+     * @brief Encode the curve in use for reading back
+     *
+     * @details status, count, first_index, then little endian int16 knots
+     * from first_index on, at most CALIBRATION_CURVE_KNOTS_PER_READ. READ
+     * picks first_index, a new curve starts over from 0.
+     *
+     * @param status result of the last write, the low byte is sent
+     * @param p_buffer where to encode to
+     * @param size room in p_buffer, at least CALIBRATION_CURVE_ENCODED_MAX
+     * @return bytes encoded
+     */
+    uint16_t calibration_curve_encode(ret_code_t status, uint8_t *p_buffer,
+                                      uint16_t size);
+
+    /**
+     * @brief Get the current calibration
+     *
+     * @param p_calibration filled with a copy
+     */
+    void calibration_get(calibration_t *p_calibration);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // CALIBRATION_H
@@ -0,0 +1,425 @@
+/**
+ * Copyright (c) 2018 Keith Wakeham
+ *
+ * All rights reserved.
+ *
+ *
+ */
+
+#include "conn-params.h"
+#include <string.h>
+#include "app_error.h"
+#include "app_timer.h"
+#include "app_util.h"
+#include "ble.h"
+#include "nrf_sdh_ble.h"
+#include "trace.h"
+
+// Parameters while the stick is moving, shortest interval there is
+#define ACTIVE_MIN_CONN_INTERVAL MSEC_TO_UNITS(7.5, UNIT_1_25_MS)
+#define ACTIVE_MAX_CONN_INTERVAL MSEC_TO_UNITS(15, UNIT_1_25_MS)
+#define ACTIVE_SLAVE_LATENCY 0
+
+// Parameters while the stick is still, the same interval but we may skip up
+// to 24 connection events. The first move answers at the next one instead of
+// waiting for a renegotiation.
+#define IDLE_MIN_CONN_INTERVAL ACTIVE_MIN_CONN_INTERVAL
+#define IDLE_MAX_CONN_INTERVAL ACTIVE_MAX_CONN_INTERVAL
+#define IDLE_SLAVE_LATENCY 24
+
+#define CONN_SUP_TIMEOUT MSEC_TO_UNITS(4000, UNIT_10_MS)
+
+// The stick has to be still this long before we ask for the idle parameters
+#define IDLE_TIMEOUT APP_TIMER_TICKS(5000)
+
+// Never ask for new parameters more often than this
+#define MIN_REQUEST_INTERVAL APP_TIMER_TICKS(2000)
+
+// Stop waiting for ble_conn_params after this long. It gives up on its own
+// after three attempts 30 s apart, see main.c, unless an event got lost.
+#define REQUEST_TIMEOUT APP_TIMER_TICKS(100000)
+
+#define TICK_INTERVAL APP_TIMER_TICKS(1000)
+
+#define CONN_PARAMS_MGR_BLE_OBSERVER_PRIO 3
+
+#define TICK_FREQUENCY \
+    (APP_TIMER_CLOCK_FREQ / (APP_TIMER_CONFIG_RTC_FREQUENCY + 1))
+
+APP_TIMER_DEF(m_tick_timer);
+
+/**
+ * @brief Per-connection state, indexed by connection handle
+ *
+ */
+typedef struct
+{
+    bool     connected;
+    bool     tuned;            // steering data streams to the central
+    bool     request_pending;  // waiting for ble_conn_params to finish
+    conn_params_state_t requested; // last asked for
+    conn_params_state_t state;     // of the parameters in use
+    uint32_t last_request;     // app_timer ticks
+    uint16_t conn_interval;    // in use, in 1.25 ms units
+    uint16_t slave_latency;    // in use
+} conn_params_link_t;
+
+static struct
+{
+    conn_params_link_t links[NRF_SDH_BLE_TOTAL_LINK_COUNT];
+    uint8_t  tuned_count;
+    bool     moving;           // activity seen within IDLE_TIMEOUT
+    uint32_t last_activity;    // app_timer ticks
+    uint32_t accounted;        // app_timer ticks, time accounted up to here
+    uint64_t ticks_in_state[CONN_PARAMS_STATE_COUNT];
+    conn_params_stats_t stats;
+} m_mgr;
+
+static conn_params_link_t *link_get(uint16_t conn_handle)
+{
+    if (conn_handle >= NRF_SDH_BLE_TOTAL_LINK_COUNT ||
+        !m_mgr.links[conn_handle].connected)
+    {
+        return NULL;
+    }
+
+    return &m_mgr.links[conn_handle];
+}
+
+/**
+ * @brief Add the time since the last call to the state of each tuned link
+ *
+ */
+static void time_update(void)
+{
+    uint32_t now = app_timer_cnt_get();
+    uint32_t elapsed = app_timer_cnt_diff_compute(now, m_mgr.accounted);
+
+    for (uint8_t i = 0; i < NRF_SDH_BLE_TOTAL_LINK_COUNT; i++)
+    {
+        if (m_mgr.links[i].tuned)
+        {
+            m_mgr.ticks_in_state[m_mgr.links[i].state] += elapsed;
+        }
+    }
+    m_mgr.accounted = now;
+}
+
+/**
+ * @brief Which state negotiated parameters fall in
+ *
+ */
+static conn_params_state_t state_of(ble_gap_conn_params_t const *p_params)
+{
+    return (p_params->max_conn_interval <= ACTIVE_MAX_CONN_INTERVAL &&
+            p_params->slave_latency == ACTIVE_SLAVE_LATENCY)
+               ? CONN_PARAMS_STATE_ACTIVE
+               : CONN_PARAMS_STATE_IDLE;
+}
+
+/**
+ * @brief Take over parameters a link now uses
+ *
+ */
+static void params_in_use(conn_params_link_t *         p_link,
+                          ble_gap_conn_params_t const *p_params)
+{
+    time_update();
+    p_link->state = state_of(p_params);
+    p_link->conn_interval = p_params->max_conn_interval;
+    p_link->slave_latency = p_params->slave_latency;
+}
+
+/**
+ * @brief Ask the central of a link for the parameters of a state
+ *
+ * @param state parameter set to request
+ */
+static void params_request(uint16_t conn_handle, conn_params_state_t state)
+{
+    ret_code_t            err_code;
+    ble_gap_conn_params_t params;
+    conn_params_link_t *  p_link = &m_mgr.links[conn_handle];
+
+    memset(&params, 0, sizeof(params));
+
+    if (state == CONN_PARAMS_STATE_ACTIVE)
+    {
+        params.min_conn_interval = ACTIVE_MIN_CONN_INTERVAL;
+        params.max_conn_interval = ACTIVE_MAX_CONN_INTERVAL;
+        params.slave_latency = ACTIVE_SLAVE_LATENCY;
+    }
+    else
+    {
+        params.min_conn_interval = IDLE_MIN_CONN_INTERVAL;
+        params.max_conn_interval = IDLE_MAX_CONN_INTERVAL;
+        params.slave_latency = IDLE_SLAVE_LATENCY;
+    }
+    params.conn_sup_timeout = CONN_SUP_TIMEOUT;
+
+    err_code = ble_conn_params_change_conn_params(conn_handle, &params);
+    if (err_code != NRF_SUCCESS)
+    {
+        // Busy with a negotiation of its own, the next tick retries
+        m_mgr.stats.rejected++;
+        return;
+    }
+
+    p_link->requested = state;
+    p_link->request_pending = true;
+    p_link->last_request = app_timer_cnt_get();
+    m_mgr.stats.requests++;
+}
+
+/**
+ * @brief Check if a new request would not come too soon after the last one
+ *
+ */
+static bool request_allowed(conn_params_link_t const *p_link)
+{
+    return !p_link->request_pending &&
+           app_timer_cnt_diff_compute(app_timer_cnt_get(),
+                                      p_link->last_request) >=
+               MIN_REQUEST_INTERVAL;
+}
+
+static void tick_timeout_handler(void *p_context)
+{
+    UNUSED_PARAMETER(p_context);
+
+    time_update();
+
+    if (m_mgr.moving &&
+        app_timer_cnt_diff_compute(app_timer_cnt_get(), m_mgr.last_activity) >=
+            IDLE_TIMEOUT)
+    {
+        m_mgr.moving = false;
+    }
+
+    for (uint16_t conn_handle = 0; conn_handle < NRF_SDH_BLE_TOTAL_LINK_COUNT;
+         conn_handle++)
+    {
+        conn_params_link_t *p_link = &m_mgr.links[conn_handle];
+
+        if (!p_link->tuned)
+        {
+            continue;
+        }
+
+        if (p_link->request_pending &&
+            app_timer_cnt_diff_compute(app_timer_cnt_get(),
+                                       p_link->last_request) >= REQUEST_TIMEOUT)
+        {
+            // Never heard back, do not stay stuck in the last state for the
+            // rest of the link
+            p_link->request_pending = false;
+            m_mgr.stats.timed_out++;
+        }
+
+        if (!request_allowed(p_link))
+        {
+            continue;
+        }
+
+        if (m_mgr.moving && p_link->requested != CONN_PARAMS_STATE_ACTIVE)
+        {
+            params_request(conn_handle, CONN_PARAMS_STATE_ACTIVE);
+        }
+        else if (!m_mgr.moving && p_link->requested != CONN_PARAMS_STATE_IDLE)
+        {
+            params_request(conn_handle, CONN_PARAMS_STATE_IDLE);
+        }
+    }
+}
+
+static void ble_evt_handler(ble_evt_t const *p_ble_evt, void *p_context)
+{
+    uint16_t            conn_handle = p_ble_evt->evt.gap_evt.conn_handle;
+    conn_params_link_t *p_link;
+
+    UNUSED_PARAMETER(p_context);
+
+    switch (p_ble_evt->header.evt_id)
+    {
+        case BLE_GAP_EVT_CONNECTED:
+            if (conn_handle >= NRF_SDH_BLE_TOTAL_LINK_COUNT)
+            {
+                break;
+            }
+            p_link = &m_mgr.links[conn_handle];
+            memset(p_link, 0, sizeof(*p_link));
+            p_link->connected = true;
+            params_in_use(p_link,
+                          &p_ble_evt->evt.gap_evt.params.connected.conn_params);
+            break;
+
+        case BLE_GAP_EVT_DISCONNECTED:
+            conn_params_mgr_link_stop(conn_handle);
+            p_link = link_get(conn_handle);
+            if (p_link != NULL)
+            {
+                p_link->connected = false;
+            }
+            break;
+
+        case BLE_GAP_EVT_CONN_PARAM_UPDATE:
+            p_link = link_get(conn_handle);
+            if (p_link == NULL)
+            {
+                break;
+            }
+            params_in_use(
+                p_link,
+                &p_ble_evt->evt.gap_evt.params.conn_param_update.conn_params);
+            TRACE(TRACE_EVT_CONN_PARAMS, p_link->conn_interval,
+                  p_link->slave_latency);
+            break;
+
+        default:
+            break;
+    }
+}
+
+NRF_SDH_BLE_OBSERVER(m_conn_params_mgr_obs, CONN_PARAMS_MGR_BLE_OBSERVER_PRIO,
+                     ble_evt_handler, NULL);
+
+void conn_params_mgr_init(void)
+{
+    ret_code_t err_code;
+
+    err_code = app_timer_create(&m_tick_timer, APP_TIMER_MODE_REPEATED,
+                                tick_timeout_handler);
+    APP_ERROR_CHECK(err_code);
+}
+
+void conn_params_mgr_link_start(uint16_t conn_handle)
+{
+    ret_code_t          err_code;
+    conn_params_link_t *p_link = link_get(conn_handle);
+
+    if (p_link == NULL || p_link->tuned)
+    {
+        return;
+    }
+
+    time_update();
+    p_link->tuned = true;
+    p_link->request_pending = false;
+    p_link->last_request = app_timer_cnt_get() - MIN_REQUEST_INTERVAL;
+    // Whatever the central picked, treat it as idle until we move
+    p_link->requested = CONN_PARAMS_STATE_IDLE;
+
+    if (m_mgr.tuned_count++ == 0)
+    {
+        m_mgr.moving = false;
+        err_code = app_timer_start(m_tick_timer, TICK_INTERVAL, NULL);
+        APP_ERROR_CHECK(err_code);
+    }
+}
+
+void conn_params_mgr_link_stop(uint16_t conn_handle)
+{
+    ret_code_t          err_code;
+    conn_params_link_t *p_link = link_get(conn_handle);
+
+    if (p_link == NULL || !p_link->tuned)
+    {
+        return;
+    }
+
+    time_update();
+    p_link->tuned = false;
+
+    if (--m_mgr.tuned_count == 0)
+    {
+        err_code = app_timer_stop(m_tick_timer);
+        APP_ERROR_CHECK(err_code);
+    }
+}
+
+void conn_params_mgr_activity(void)
+{
+    if (m_mgr.tuned_count == 0)
+    {
+        return;
+    }
+
+    m_mgr.moving = true;
+    m_mgr.last_activity = app_timer_cnt_get();
+
+    // Speed up right away, slowing down waits for the tick
+    for (uint16_t conn_handle = 0; conn_handle < NRF_SDH_BLE_TOTAL_LINK_COUNT;
+         conn_handle++)
+    {
+        conn_params_link_t *p_link = &m_mgr.links[conn_handle];
+
+        if (p_link->tuned && p_link->requested != CONN_PARAMS_STATE_ACTIVE &&
+            request_allowed(p_link))
+        {
+            params_request(conn_handle, CONN_PARAMS_STATE_ACTIVE);
+        }
+    }
+}
+
+void conn_params_mgr_on_conn_params_evt(ble_conn_params_evt_t *p_evt)
+{
+    conn_params_link_t *p_link = link_get(p_evt->conn_handle);
+
+    // ble_conn_params also negotiates on links nobody tuned
+    if (p_link == NULL || !p_link->request_pending)
+    {
+        return;
+    }
+
+    switch (p_evt->evt_type)
+    {
+        case BLE_CONN_PARAMS_EVT_SUCCEEDED:
+            p_link->request_pending = false;
+            m_mgr.stats.succeeded++;
+            break;
+
+        case BLE_CONN_PARAMS_EVT_FAILED:
+            p_link->request_pending = false;
+            m_mgr.stats.failed++;
+            break;
+
+        default:
+            break;
+    }
+}
+
+void conn_params_mgr_stats_get(conn_params_stats_t *p_stats)
+{
+    conn_params_link_t const *p_shown = NULL;
+
+    time_update();
+
+    for (uint8_t i = 0; i < CONN_PARAMS_STATE_COUNT; i++)
+    {
+        m_mgr.stats.time_in_state_ms[i] =
+            (uint32_t)((m_mgr.ticks_in_state[i] * 1000) / TICK_FREQUENCY);
+    }
+
+    // The first tuned link, the first connected one while none is
+    for (uint8_t i = 0; i < NRF_SDH_BLE_TOTAL_LINK_COUNT; i++)
+    {
+        conn_params_link_t const *p_link = &m_mgr.links[i];
+
+        if (p_link->tuned || (p_shown == NULL && p_link->connected))
+        {
+            p_shown = p_link;
+        }
+        if (p_link->tuned)
+        {
+            break;
+        }
+    }
+    if (p_shown != NULL)
+    {
+        m_mgr.stats.conn_interval = p_shown->conn_interval;
+        m_mgr.stats.slave_latency = p_shown->slave_latency;
+        m_mgr.stats.state = p_shown->state;
+    }
+
+    *p_stats = m_mgr.stats;
+}
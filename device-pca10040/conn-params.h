@@ -0,0 +1,98 @@
+/**
+ * Copyright (c) 2018 Keith Wakeham
+ *
+ * All rights reserved.
+ *
+ *
+ */
+
+#ifndef CONN_PARAMS_H
+#define CONN_PARAMS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "ble_conn_params.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+    /**
+     * @brief Connection parameter set, as requested by the manager or as
+     * negotiated
+     *
+     */
+    typedef enum
+    {
+        CONN_PARAMS_STATE_IDLE,   // short interval with slave latency
+        CONN_PARAMS_STATE_ACTIVE, // shortest interval, no latency
+        CONN_PARAMS_STATE_COUNT
+    } conn_params_state_t;
+
+    /**
+     * @brief Connection parameter manager statistics
+     *
+     */
+    typedef struct
+    {
+        // Summed over the tuned links
+        uint32_t time_in_state_ms[CONN_PARAMS_STATE_COUNT];
+        uint32_t requests;          // updates asked for
+        uint32_t succeeded;         // BLE_CONN_PARAMS_EVT_SUCCEEDED
+        uint32_t failed;            // BLE_CONN_PARAMS_EVT_FAILED
+        uint32_t rejected;          // ble_conn_params refused the request
+        uint32_t timed_out;         // no answer within REQUEST_TIMEOUT
+        // Of the first tuned link, or the first connected one while none is
+        uint16_t conn_interval;     // in use, in 1.25 ms units
+        uint16_t slave_latency;     // in use
+        conn_params_state_t state;  // of the parameters in use
+    } conn_params_stats_t;
+
+    /**
+     * @brief Init the connection parameter manager
+     *
+     */
+    void conn_params_mgr_init(void);
+
+    /**
+     * @brief Start tuning a link, once steering data streams to it
+     *
+     * @param conn_handle link that finished the handshake with notifications
+     * enabled
+     */
+    void conn_params_mgr_link_start(uint16_t conn_handle);
+
+    /**
+     * @brief Stop tuning a link, the parameters it has stay
+     *
+     * @param conn_handle link that no longer takes steering data
+     */
+    void conn_params_mgr_link_stop(uint16_t conn_handle);
+
+    /**
+     * @brief Report stick movement, switches the tuned links to the active
+     * parameters
+     *
+     */
+    void conn_params_mgr_activity(void);
+
+    /**
+     * @brief Forward events from the Connection Parameters module
+     *
+     * @param p_evt event received from ble_conn_params
+     */
+    void conn_params_mgr_on_conn_params_evt(ble_conn_params_evt_t *p_evt);
+
+    /**
+     * @brief Get the manager statistics
+     *
+     * @param p_stats filled with a copy of the statistics
+     */
+    void conn_params_mgr_stats_get(conn_params_stats_t *p_stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // CONN_PARAMS_H
@@ -0,0 +1,166 @@
+#!/usr/bin/env python3
+"""Fit the calibration curve knots from a recorded sweep.
+
+Usage: curve-fit.py <steer-adc.h> <sweep.txt> [knots]
+
+Clear the curve first (write 04 to the curve characteristic), then turn the
+bars slowly from lock to lock and record one pair per line: the angle the
+steerer reported in hundredths of a degree, as decoded by trace-decode.py,
+and the true angle in degrees from a protractor or an inclinometer. Commas or
+whitespace separate the columns, lines starting with # are skipped.
+
+knots is 2, 3, 5, 9 or 17 (the default). The knots are printed together with
+the writes to send to the curve characteristic, in hex.
+
+Reading the characteristic back gives the status of the last write, the knot
+count, the first knot shown and up to eight knots from there. Write 05 and a
+knot index to page through the rest.
+"""
+import re
+import sys
+
+DEFAULT_KNOTS = 17
+# Knot values per write, fits the 20 byte payload of the default ATT MTU
+KNOTS_PER_WRITE = 9
+# Pulls knots without samples towards the straight line
+RIDGE = 1e-3
+
+OP_BEGIN = 0x01
+OP_KNOTS = 0x02
+OP_COMMIT = 0x03
+
+
+def read_define(header, name):
+    match = re.search(r"#define\s+%s\s+\(?(\d+)\)?" % name, header)
+    if match is None:
+        raise SystemExit("%s not found" % name)
+    return int(match.group(1))
+
+
+def read_sweep(path):
+    pairs = []
+    with open(path, 'r') as f:
+        for line in f:
+            line = line.strip()
+            if not line or line.startswith('#'):
+                continue
+            fields = re.split(r'[,\s]+', line)
+            pairs.append((float(fields[0]), float(fields[1])))
+    if not pairs:
+        raise SystemExit('no samples in %s' % path)
+    return pairs
+
+
+def angle_to_code(angle_deg, max_angle, resolution):
+    # Inverse of the straight line in steer-angle-lut.py
+    return (angle_deg + max_angle) * resolution / (2 * max_angle)
+
+
+def solve(matrix, rhs):
+    """Gaussian elimination with partial pivoting, the system is tiny."""
+    n = len(rhs)
+    a = [row[:] + [rhs[i]] for i, row in enumerate(matrix)]
+    for col in range(n):
+        pivot = max(range(col, n), key=lambda r: abs(a[r][col]))
+        a[col], a[pivot] = a[pivot], a[col]
+        for row in range(col + 1, n):
+            factor = a[row][col] / a[col][col]
+            for k in range(col, n + 1):
+                a[row][k] -= factor * a[col][k]
+    x = [0.0] * n
+    for row in reversed(range(n)):
+        x[row] = (a[row][n] - sum(a[row][k] * x[k]
+                                  for k in range(row + 1, n))) / a[row][row]
+    return x
+
+
+def fit(points, count, resolution):
+    """Least squares piecewise linear fit on evenly spaced knots."""
+    spacing = resolution / (count - 1)
+    matrix = [[0.0] * count for _ in range(count)]
+    rhs = [0.0] * count
+
+    for x, y in points:
+        index = min(int(x // spacing), count - 2)
+        t = (x - index * spacing) / spacing
+        weights = ((index, 1 - t), (index + 1, t))
+        for i, wi in weights:
+            rhs[i] += wi * y
+            for j, wj in weights:
+                matrix[i][j] += wi * wj
+
+    ridge = RIDGE * len(points) / count
+    for i in range(count):
+        matrix[i][i] += ridge
+        rhs[i] += ridge * i * spacing
+
+    knots = solve(matrix, rhs)
+
+    # Clamp, round and keep them rising, the firmware rejects anything else
+    result = []
+    for value in knots:
+        value = int(round(min(max(value, 0), resolution - 1)))
+        if result:
+            value = max(value, result[-1])
+        result.append(value)
+    return result
+
+
+def evaluate(knots, x, resolution):
+    spacing = resolution / (len(knots) - 1)
+    index = min(int(x // spacing), len(knots) - 2)
+    t = (x - index * spacing) / spacing
+    return knots[index] + (knots[index + 1] - knots[index]) * t
+
+
+def writes(knots):
+    yield bytes([OP_BEGIN, len(knots)])
+    for first in range(0, len(knots), KNOTS_PER_WRITE):
+        chunk = knots[first:first + KNOTS_PER_WRITE]
+        payload = bytes([OP_KNOTS, first])
+        for value in chunk:
+            payload += value.to_bytes(2, 'little', signed=True)
+        yield payload
+    yield bytes([OP_COMMIT])
+
+
+def main():
+    if len(sys.argv) < 3:
+        raise SystemExit(__doc__)
+
+    with open(sys.argv[1], 'r') as f:
+        header = f.read()
+    count = int(sys.argv[3]) if len(sys.argv) > 3 else DEFAULT_KNOTS
+    if count < 2 or count > 17 or (count - 1) & (count - 2):
+        raise SystemExit('knots must be 2, 3, 5, 9 or 17')
+
+    max_angle = read_define(header, 'MAX_STEER_ANGLE')
+    zero_floor = read_define(header, 'ZERO_FLOOR')
+    resolution = read_define(header, 'MAX_ADC_RESOLUTION')
+    scale = read_define(header, 'STEER_ANGLE_SCALE')
+
+    points = []
+    for reported, true_deg in read_sweep(sys.argv[2]):
+        reported_deg = reported / scale
+        # Inside the dead band the reported angle says nothing
+        if abs(reported_deg) < zero_floor:
+            continue
+        points.append((angle_to_code(reported_deg, max_angle, resolution),
+                       angle_to_code(true_deg, max_angle, resolution)))
+    if len(points) < count:
+        raise SystemExit('%d usable samples, need at least %d'
+                         % (len(points), count))
+
+    knots = fit(points, count, resolution)
+
+    worst = max(abs(evaluate(knots, x, resolution) - y) for x, y in points)
+    print('knots: %s' % ' '.join('%d' % k for k in knots))
+    print('worst residual: %.2f degrees'
+          % (worst * 2 * max_angle / resolution))
+    print('writes:')
+    for payload in writes(knots):
+        print('  %s' % payload.hex())
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,186 @@
+/**
+ * Copyright (c) 2018 Keith Wakeham
+ *
+ * All rights reserved.
+ *
+ *
+ */
+
+#include "diag.h"
+#include "app_timer.h"
+#include "app_util.h"
+#include "nrf.h"
+#include "nrf_log.h"
+#include "nrf_pwr_mgmt.h"
+#include "trace.h"
+
+#define STACK_PAINT 0xA5A5A5A5
+
+// Left alone below the stack pointer when painting, diag_init's own frame
+#define STACK_PAINT_MARGIN 64
+
+// Boot stages are timed with TIMER1 at 1 MHz. The RTCs only count once the
+// SoftDevice has started the LFCLK, half way through the boot, and the cycle
+// counter stops while the CPU waits. TIMER1 runs from the HFINT, which is good
+// to a couple of percent, and is stopped again after the first angle.
+#define BOOT_TIMER NRF_TIMER1
+#define BOOT_TIMER_PRESCALER 4 // 16 MHz / 2^4
+
+// Placed by the linker, GCC and SES scripts use the same names
+extern uint32_t __StackLimit;
+extern uint32_t __StackTop;
+
+static uint32_t m_window_start;  // app_timer ticks
+static uint32_t m_ticks_asleep;
+static uint32_t m_wakeups;
+
+static uint32_t m_boot_at_us[DIAG_BOOT_STAGE_COUNT];
+
+static const char *const m_boot_names[DIAG_BOOT_STAGE_COUNT] = {
+    [DIAG_BOOT_EARLY] = "early",
+    [DIAG_BOOT_STORAGE] = "storage",
+    [DIAG_BOOT_SOFTDEVICE] = "softdevice",
+    [DIAG_BOOT_SERVICES] = "services",
+    [DIAG_BOOT_PEER_MANAGER] = "peer manager",
+    [DIAG_BOOT_ADVERTISING] = "advertising",
+    [DIAG_BOOT_DEFERRED] = "deferred",
+    [DIAG_BOOT_FIRST_ANGLE] = "first angle",
+};
+
+static void boot_timer_start(void)
+{
+    BOOT_TIMER->MODE = TIMER_MODE_MODE_Timer;
+    BOOT_TIMER->BITMODE = TIMER_BITMODE_BITMODE_32Bit;
+    BOOT_TIMER->PRESCALER = BOOT_TIMER_PRESCALER;
+    BOOT_TIMER->TASKS_CLEAR = 1;
+    BOOT_TIMER->TASKS_START = 1;
+}
+
+/**
+ * @brief Duration of a stage, from the end of the last one reached before it
+ *
+ */
+static uint32_t boot_stage_us(uint8_t stage)
+{
+    uint32_t start = 0;
+
+    for (uint8_t i = 0; i < stage; i++)
+    {
+        start = MAX(start, m_boot_at_us[i]);
+    }
+
+    return m_boot_at_us[stage] - start;
+}
+
+void diag_init(void)
+{
+    uint32_t *p_word = &__StackLimit;
+    uint32_t *p_end = (uint32_t *)(__get_MSP() - STACK_PAINT_MARGIN);
+
+    while (p_word < p_end)
+    {
+        *p_word++ = STACK_PAINT;
+    }
+
+    boot_timer_start();
+    m_window_start = app_timer_cnt_get();
+}
+
+void diag_idle_run(void)
+{
+    uint32_t start = app_timer_cnt_get();
+
+    nrf_pwr_mgmt_run();
+
+    m_ticks_asleep += app_timer_cnt_diff_compute(app_timer_cnt_get(), start);
+    m_wakeups++;
+}
+
+void diag_cpu_get(diag_cpu_t *p_cpu)
+{
+    uint32_t now = app_timer_cnt_get();
+    uint32_t window = app_timer_cnt_diff_compute(now, m_window_start);
+
+    if (window == 0)
+    {
+        p_cpu->busy_pct = 0;
+        p_cpu->wakeups_per_s = 0;
+        return;
+    }
+
+    m_ticks_asleep = MIN(m_ticks_asleep, window);
+    p_cpu->busy_pct =
+        (uint8_t)(100 - ((uint64_t)m_ticks_asleep * 100) / window);
+    p_cpu->wakeups_per_s = (uint16_t)MIN(
+        ((uint64_t)m_wakeups * APP_TIMER_TICKS(1000)) / window, UINT16_MAX);
+
+    m_window_start = now;
+    m_ticks_asleep = 0;
+    m_wakeups = 0;
+}
+
+uint16_t diag_stack_used(void)
+{
+    uint32_t const *p_word = &__StackLimit;
+
+    while (p_word < &__StackTop && *p_word == STACK_PAINT)
+    {
+        p_word++;
+    }
+
+    return (uint16_t)((uintptr_t)&__StackTop - (uintptr_t)p_word);
+}
+
+void diag_boot_mark(diag_boot_stage_t stage)
+{
+    uint32_t now;
+
+    if (m_boot_at_us[stage] != 0)
+    {
+        return;
+    }
+
+    BOOT_TIMER->TASKS_CAPTURE[0] = 1;
+    now = BOOT_TIMER->CC[0];
+    // 0 means not reached
+    m_boot_at_us[stage] = MAX(now, 1);
+
+    if (stage == DIAG_BOOT_FIRST_ANGLE)
+    {
+        // Keeps the HFINT running through sleep otherwise
+        BOOT_TIMER->TASKS_STOP = 1;
+        BOOT_TIMER->TASKS_SHUTDOWN = 1;
+    }
+
+    TRACE(TRACE_EVT_BOOT, stage, MIN(now / 1000, UINT16_MAX));
+}
+
+void diag_boot_log(void)
+{
+    for (uint8_t stage = 0; stage < DIAG_BOOT_STAGE_COUNT; stage++)
+    {
+        if (m_boot_at_us[stage] == 0)
+        {
+            continue;
+        }
+        NRF_LOG_INFO("Boot %s took %d us, done at %d us", m_boot_names[stage],
+                     boot_stage_us(stage), m_boot_at_us[stage]);
+    }
+}
+
+void diag_boot_get(diag_boot_t *p_boot)
+{
+    p_boot->slowest = 0;
+    p_boot->slowest_us = 0;
+
+    for (uint8_t stage = 0; stage < DIAG_BOOT_STAGE_COUNT; stage++)
+    {
+        p_boot->at_us[stage] = m_boot_at_us[stage];
+        if (m_boot_at_us[stage] != 0 &&
+            boot_stage_us(stage) > p_boot->slowest_us)
+        {
+            p_boot->slowest = stage;
+            p_boot->slowest_us = boot_stage_us(stage);
+        }
+    }
+}
@@ -0,0 +1,115 @@
+/**
+ * Copyright (c) 2018 Keith Wakeham
+ *
+ * All rights reserved.
+ *
+ *
+ */
+
+#ifndef DIAG_H
+#define DIAG_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+    /**
+     * @brief CPU load over the last measurement window
+     *
+     */
+    typedef struct
+    {
+        uint8_t  busy_pct;       // time not spent in nrf_pwr_mgmt_run
+        uint16_t wakeups_per_s;  // returns from nrf_pwr_mgmt_run
+    } diag_cpu_t;
+
+    /**
+     * @brief Boot stages, in the order main() finishes them
+     *
+     */
+    typedef enum
+    {
+        DIAG_BOOT_EARLY,        // logger, timers, buttons and power state
+        DIAG_BOOT_STORAGE,      // FDS users registered, calibration restored
+        DIAG_BOOT_SOFTDEVICE,   // SoftDevice and BLE stack enabled
+        DIAG_BOOT_SERVICES,     // GAP, GATT, services and advertising set up
+        DIAG_BOOT_PEER_MANAGER, // Peer Manager and reconnect policy
+        DIAG_BOOT_ADVERTISING,  // on air
+        DIAG_BOOT_DEFERRED,     // sampler, log backends and timers started
+        DIAG_BOOT_FIRST_ANGLE,  // first angle computed from a sample
+        DIAG_BOOT_STAGE_COUNT
+    } diag_boot_stage_t;
+
+    /**
+     * @brief Boot timing
+     *
+     */
+    typedef struct
+    {
+        uint32_t at_us[DIAG_BOOT_STAGE_COUNT]; // end of each stage since
+                                               // main, 0 if not reached yet
+        uint8_t  slowest;    // stage that took longest
+        uint32_t slowest_us; // its duration
+    } diag_boot_t;
+
+    /**
+     * @brief Fill the unused stack with a pattern for diag_stack_used() and
+     * start the boot timing
+     *
+     * @details Call first thing in main.
+     */
+    void diag_init(void);
+
+    /**
+     * @brief Sleep until the next event, accounting the time asleep
+     *
+     * @details Replaces nrf_pwr_mgmt_run() in the main loop. This is the
+     * same measurement NRF_PWR_MGMT_CONFIG_CPU_USAGE_MONITOR_ENABLED does,
+     * without its periodic log and with a readout.
+     */
+    void diag_idle_run(void);
+
+    /**
+     * @brief Get the CPU load since the last call and start a new window
+     *
+     * @param p_cpu filled with the load
+     */
+    void diag_cpu_get(diag_cpu_t *p_cpu);
+
+    /**
+     * @brief Get the deepest stack use seen since boot
+     *
+     * @return bytes of stack ever written to
+     */
+    uint16_t diag_stack_used(void);
+
+    /**
+     * @brief Record that a boot stage finished
+     *
+     * @details Only the first call for a stage counts. The boot clock stops
+     * with DIAG_BOOT_FIRST_ANGLE.
+     *
+     * @param stage stage that just finished
+     */
+    void diag_boot_mark(diag_boot_stage_t stage);
+
+    /**
+     * @brief Log the time each boot stage took
+     *
+     */
+    void diag_boot_log(void);
+
+    /**
+     * @brief Get the boot timing
+     *
+     * @param p_boot filled with the stages reached so far
+     */
+    void diag_boot_get(diag_boot_t *p_boot);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // DIAG_H
@@ -0,0 +1,139 @@
+/**
+ * Copyright (c) 2018 Keith Wakeham
+ *
+ * All rights reserved.
+ *
+ *
+ */
+
+// The steering hot path timed on the host, the BENCH_BEGIN/BENCH_END probes
+// of the firmware built with BENCH_ENABLED. A central streams at the
+// shortest interval while the bars sweep back and forth, so every stage
+// runs at the rate it does on a busy ride. The fake DWT counts host
+// nanoseconds.
+//
+// Prints a table in the style of Google Benchmark, then the same lines the
+// target prints on RTT for bench-check.py:
+//
+//   _build/benchmark | python3 ../bench-check.py --host ../bench-budget.txt
+
+#include <getopt.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench.h"
+#include "ble_cus.h"
+#include "fake.h"
+#include "params.h"
+#include "steer-adc.h"
+
+#define CENTRE_CODE (MAX_ADC_RESOLUTION / 2)
+#define SWEEP_AMPLITUDE 3000
+#define SWEEP_PERIOD_NS (3 * FAKE_NS_PER_S)
+#define NOISE_CODES 4
+
+static uint32_t m_noise = 1;
+
+static int16_t sweep_input(uint64_t at_ns, void *p_context)
+{
+    double phase = 2 * M_PI * (double)(at_ns % SWEEP_PERIOD_NS) /
+                   SWEEP_PERIOD_NS;
+
+    UNUSED_PARAMETER(p_context);
+
+    // A little noise keeps the filter and the calibration busy
+    m_noise = m_noise * 1103515245 + 12345;
+
+    return (int16_t)(CENTRE_CODE + SWEEP_AMPLITUDE * sin(phase) +
+                     (int32_t)((m_noise >> 16) % (2 * NOISE_CODES + 1)) -
+                     NOISE_CODES);
+}
+
+static bool central_start(void)
+{
+    uint16_t conn_handle = fake_central_connect(7.5);
+
+    if (conn_handle == BLE_CONN_HANDLE_INVALID)
+    {
+        return false;
+    }
+
+    // Fastest sampling and every change sent
+    fake_central_param_set(conn_handle, PARAM_SAMPLE_RATE, 250);
+    fake_central_param_set(conn_handle, PARAM_NOTIFY_DELTA, 1);
+    fake_central_start(conn_handle);
+
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t seconds = 600;
+    int      opt;
+
+    while ((opt = getopt(argc, argv, "s:")) != -1)
+    {
+        if (opt != 's')
+        {
+            fprintf(stderr, "usage: benchmark [-s virtual seconds]\n");
+            return 2;
+        }
+        seconds = (uint32_t)atoi(optarg);
+    }
+
+    fake_log_level_set(FAKE_LOG_WARNING);
+    fake_saadc_input_fn_set(sweep_input, NULL);
+
+    fake_firmware_boot();
+    fake_run_for(200 * FAKE_NS_PER_MS);
+    if (!central_start())
+    {
+        fprintf(stderr, "benchmark: not advertising\n");
+        return 1;
+    }
+    fake_run_for(2 * FAKE_NS_PER_S);
+
+    bench_reset();
+    fake_run_for(seconds * FAKE_NS_PER_S);
+
+    printf("%-24s %10s %10s %10s %12s\n", "Benchmark", "Time", "Min", "Max",
+           "Iterations");
+    printf("-----------------------------------------------------------------"
+           "---\n");
+    for (uint32_t i = 0; i < BENCH_STAGE_COUNT; i++)
+    {
+        bench_stats_t stats;
+        char          name[32];
+
+        bench_stats_get((bench_stage_t)i, &stats);
+        snprintf(name, sizeof(name), "BM_%s", bench_stage_name(i));
+        if (stats.count == 0)
+        {
+            printf("%-24s %10s %10s %10s %12d\n", name, "-", "-", "-", 0);
+            continue;
+        }
+        printf("%-24s %7llu ns %7lu ns %7lu ns %12lu\n", name,
+               (unsigned long long)(stats.sum / stats.count),
+               (unsigned long)stats.min, (unsigned long)stats.max,
+               (unsigned long)stats.count);
+    }
+    printf("\n");
+
+    // What bench_report_rtt() prints on target
+    for (uint32_t i = 0; i < BENCH_STAGE_COUNT; i++)
+    {
+        bench_stats_t stats;
+
+        bench_stats_get((bench_stage_t)i, &stats);
+        if (stats.count > 0)
+        {
+            printf("bench %s %lu %lu %llu %lu\n", bench_stage_name(i),
+                   (unsigned long)stats.count, (unsigned long)stats.min,
+                   (unsigned long long)(stats.sum / stats.count),
+                   (unsigned long)stats.max);
+        }
+    }
+
+    return 0;
+}
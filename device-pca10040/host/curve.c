@@ -0,0 +1,348 @@
+/**
+ * Copyright (c) 2018 Keith Wakeham
+ *
+ * All rights reserved.
+ *
+ *
+ */
+
+// The correction curve of calibration.c uploaded through the curve
+// characteristic, the whole firmware on the fakes. A central writes curves
+// of 17 and 5 knots in writes that fit the default ATT payload, reads them
+// back page by page, sends every kind of broken upload and clears the curve
+// again. The stick rests at the centre all along, so the calibration only
+// shifts and the curve sees nominal codes as they are.
+//
+// Exits 1 when a write that fits is refused or one that does not is taken,
+// when a broken curve is used or answered with the wrong error, when the
+// curve does not go through its knots or is not straight between them, or
+// when what is read back or stored is not the curve in use.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "ble_cus.h"
+#include "calibration.h"
+#include "fake.h"
+#include "steer-adc.h"
+#include "storage.h"
+
+#define CENTRE_CODE (MAX_ADC_RESOLUTION / 2)
+
+// The default ATT MTU leaves this much for a written value
+#define ATT_PAYLOAD 20
+#define KNOTS_PER_WRITE ((ATT_PAYLOAD - 2) / 2)
+
+// calibration.c, the curve record in STORAGE_FILE_CALIBRATION
+#define CURVE_RECORD_KEY 0x0002
+
+// The interpolation rounds down
+#define INTERPOLATION_TOLERANCE 1
+
+static uint16_t m_conn_handle;
+static uint16_t m_curve_handle;
+
+// What the stick maps to without a curve, minus the code
+static int32_t m_shift;
+
+/**
+ * @brief Write the curve characteristic like the central would
+ *
+ * @return false if the stack refused the write
+ */
+static bool central_write(uint8_t const *p_data, uint16_t len)
+{
+    return fake_central_write(m_conn_handle, m_curve_handle, p_data, len);
+}
+
+/**
+ * @brief Read the curve characteristic back
+ *
+ * @return status byte of the last write
+ */
+static uint8_t central_read(uint8_t *p_count, uint8_t *p_first,
+                            int16_t *p_knots, uint8_t *p_knot_count)
+{
+    uint8_t  value[ATT_PAYLOAD];
+    uint16_t len =
+        fake_ble_read(m_conn_handle, m_curve_handle, value, sizeof(value));
+
+    if (len < 3 || (len & 1) == 0)
+    {
+        printf("curve value of %u bytes\n", len);
+        exit(EXIT_FAILURE);
+    }
+    *p_count = value[1];
+    *p_first = value[2];
+    *p_knot_count = (uint8_t)((len - 3) / 2);
+    for (uint8_t i = 0; i < *p_knot_count; i++)
+    {
+        p_knots[i] = (int16_t)uint16_decode(&value[3 + 2 * i]);
+    }
+
+    return value[0];
+}
+
+static uint8_t status_read(void)
+{
+    int16_t knots[CALIBRATION_CURVE_KNOTS_PER_READ];
+    uint8_t count;
+    uint8_t first;
+    uint8_t knot_count;
+
+    return central_read(&count, &first, knots, &knot_count);
+}
+
+/**
+ * @brief Upload a curve the way curve-fit.py writes it
+ *
+ * @param commit false to leave it uncommitted
+ * @return false if the stack refused a write
+ */
+static bool curve_upload(int16_t const *p_y, uint8_t count, bool commit)
+{
+    uint8_t value[ATT_PAYLOAD];
+    uint8_t len;
+    bool    taken;
+
+    value[0] = CALIBRATION_CURVE_OP_BEGIN;
+    value[1] = count;
+    taken = central_write(value, 2);
+
+    for (uint8_t first = 0; first < count; first += KNOTS_PER_WRITE)
+    {
+        value[0] = CALIBRATION_CURVE_OP_KNOTS;
+        value[1] = first;
+        len = 2;
+        for (uint8_t i = first; i < count && i < first + KNOTS_PER_WRITE; i++)
+        {
+            len += uint16_encode((uint16_t)p_y[i], &value[len]);
+        }
+        taken &= central_write(value, len);
+    }
+
+    if (commit)
+    {
+        value[0] = CALIBRATION_CURVE_OP_COMMIT;
+        taken &= central_write(value, 1);
+    }
+
+    return taken;
+}
+
+static int32_t nominal_map(int32_t nominal)
+{
+    return calibration_map((int16_t)(nominal - m_shift));
+}
+
+static bool expect(bool condition, char const *p_what)
+{
+    printf("%-56s%s\n", p_what, condition ? "ok" : "FAILED");
+
+    return condition;
+}
+
+/**
+ * @brief Check a curve is in use, read back and stored as uploaded
+ *
+ */
+static bool curve_expect(int16_t const *p_y, uint8_t count)
+{
+    uint32_t            spacing = MAX_ADC_RESOLUTION / (count - 1);
+    calibration_curve_t stored;
+    int16_t             knots[CALIBRATION_CURVE_KNOTS_PER_READ];
+    uint8_t             read_count;
+    uint8_t             first;
+    uint8_t             knot_count;
+    uint8_t             value[2];
+    uint32_t            wrong = 0;
+
+    // Through every knot but the last, that one is at the end of the range
+    for (uint8_t i = 0; i + 1 < count; i++)
+    {
+        int32_t half = (p_y[i] + p_y[i + 1]) / 2;
+
+        if (nominal_map(i * spacing) != p_y[i] ||
+            abs(nominal_map(i * spacing + spacing / 2) - half) >
+                INTERPOLATION_TOLERANCE)
+        {
+            wrong++;
+        }
+    }
+    if (abs(nominal_map(MAX_ADC_RESOLUTION - 1) - p_y[count - 1]) >
+        (p_y[count - 1] - p_y[count - 2]) / (int32_t)spacing + 1)
+    {
+        wrong++;
+    }
+
+    // Page by page
+    for (uint8_t i = 0; i < count; i += CALIBRATION_CURVE_KNOTS_PER_READ)
+    {
+        value[0] = CALIBRATION_CURVE_OP_READ;
+        value[1] = i;
+        central_write(value, sizeof(value));
+        central_read(&read_count, &first, knots, &knot_count);
+        if (read_count != count || first != i ||
+            knot_count != MIN(count - i, CALIBRATION_CURVE_KNOTS_PER_READ) ||
+            memcmp(knots, &p_y[i], knot_count * sizeof(knots[0])) != 0)
+        {
+            wrong++;
+        }
+    }
+
+    if (!storage_record_load(STORAGE_FILE_CALIBRATION, CURVE_RECORD_KEY,
+                             &stored, sizeof(stored)) ||
+        stored.count != count ||
+        memcmp(stored.y, p_y, count * sizeof(p_y[0])) != 0)
+    {
+        wrong++;
+    }
+
+    return wrong == 0;
+}
+
+static bool straight_expect(void)
+{
+    calibration_curve_t stored;
+    int16_t             knots[CALIBRATION_CURVE_KNOTS_PER_READ];
+    uint8_t             count;
+    uint8_t             first;
+    uint8_t             knot_count;
+
+    central_read(&count, &first, knots, &knot_count);
+
+    return count == 0 && knot_count == 0 && nominal_map(0) == 0 &&
+           nominal_map(CENTRE_CODE + 1234) == CENTRE_CODE + 1234 &&
+           storage_record_load(STORAGE_FILE_CALIBRATION, CURVE_RECORD_KEY,
+                               &stored, sizeof(stored)) &&
+           stored.count == 0;
+}
+
+/**
+ * @brief Send a broken upload, it has to fail and leave the curve alone
+ *
+ */
+static bool broken_expect(uint8_t const *p_data, uint16_t len,
+                          ret_code_t error, int16_t const *p_y,
+                          uint8_t count, char const *p_what)
+{
+    bool refused = central_write(p_data, len) &&
+                   status_read() == (uint8_t)error;
+
+    return expect(refused && curve_expect(p_y, count), p_what);
+}
+
+int main(void)
+{
+    int16_t       y17[17];
+    int16_t const y5[] = {0, 2048, 8192, 14336, MAX_ADC_RESOLUTION - 1};
+    int16_t       broken[5];
+    uint8_t       value[ATT_PAYLOAD + 1];
+    bool          ok = true;
+
+    fake_log_level_set(FAKE_LOG_ERROR);
+    fake_saadc_input_set(CENTRE_CODE);
+
+    fake_firmware_boot();
+    fake_run_for(200 * FAKE_NS_PER_MS);
+    m_conn_handle = fake_central_connect(15);
+    m_curve_handle = fake_ble_value_handle(CURVE_CHAR_UUID);
+    m_shift = calibration_map(CENTRE_CODE) - CENTRE_CODE;
+
+    ok &= expect(status_read() == NRF_SUCCESS && nominal_map(0) == 0 &&
+                     nominal_map(MAX_ADC_RESOLUTION - 1) ==
+                         MAX_ADC_RESOLUTION - 1,
+                 "straight line to start with");
+
+    // Gentle at the centre, steeper towards the ends
+    for (uint8_t i = 0; i < ARRAY_SIZE(y17); i++)
+    {
+        double t = (double)i / (ARRAY_SIZE(y17) - 1) * 2 - 1;
+
+        y17[i] = (int16_t)lround((MAX_ADC_RESOLUTION - 1) *
+                                 (1 + t * fabs(t)) / 2);
+    }
+    ok &= expect(curve_upload(y17, ARRAY_SIZE(y17), true) &&
+                     status_read() == NRF_SUCCESS,
+                 "17 knots in 20 byte writes");
+    ok &= expect(curve_expect(y17, ARRAY_SIZE(y17)),
+                 "through the knots, straight between, read and stored");
+
+    ok &= expect(curve_upload(y5, ARRAY_SIZE(y5), true) &&
+                     status_read() == NRF_SUCCESS &&
+                     curve_expect(y5, ARRAY_SIZE(y5)),
+                 "5 knots replace them");
+
+    // Nothing of these may reach the curve in use
+    memset(value, 0, sizeof(value));
+    value[0] = CALIBRATION_CURVE_OP_KNOTS;
+    ok &= expect(!central_write(value, sizeof(value)) &&
+                     curve_expect(y5, ARRAY_SIZE(y5)),
+                 "a write longer than the ATT payload is refused");
+
+    value[0] = CALIBRATION_CURVE_OP_BEGIN;
+    value[1] = 5;
+    ok &= broken_expect(value, 3, NRF_ERROR_INVALID_LENGTH, y5,
+                        ARRAY_SIZE(y5), "BEGIN of the wrong length");
+    value[1] = CALIBRATION_CURVE_MAX_KNOTS + 1;
+    ok &= broken_expect(value, 2, NRF_ERROR_INVALID_PARAM, y5,
+                        ARRAY_SIZE(y5), "too many knots");
+    value[0] = CALIBRATION_CURVE_OP_COMMIT;
+    ok &= broken_expect(value, 1, NRF_ERROR_INVALID_PARAM, y5,
+                        ARRAY_SIZE(y5), "COMMIT without BEGIN");
+
+    curve_upload(y5, ARRAY_SIZE(y5), false);
+    value[0] = CALIBRATION_CURVE_OP_KNOTS;
+    value[1] = 4;
+    ok &= broken_expect(value, 3, NRF_ERROR_INVALID_LENGTH, y5,
+                        ARRAY_SIZE(y5), "half a knot");
+    ok &= broken_expect(value, 6, NRF_ERROR_INVALID_PARAM, y5,
+                        ARRAY_SIZE(y5), "a knot past the count");
+
+    curve_upload(y5, ARRAY_SIZE(y5) - 1, false);
+    value[0] = CALIBRATION_CURVE_OP_COMMIT;
+    ok &= broken_expect(value, 1, NRF_ERROR_INVALID_DATA, y5,
+                        ARRAY_SIZE(y5), "4 knots, not a power of two apart");
+
+    value[0] = CALIBRATION_CURVE_OP_BEGIN;
+    value[1] = ARRAY_SIZE(y5);
+    central_write(value, 2);
+    value[0] = CALIBRATION_CURVE_OP_KNOTS;
+    value[1] = 0;
+    uint16_encode((uint16_t)y5[0], &value[2]);
+    central_write(value, 4);
+    value[0] = CALIBRATION_CURVE_OP_COMMIT;
+    ok &= broken_expect(value, 1, NRF_ERROR_INVALID_PARAM, y5,
+                        ARRAY_SIZE(y5), "knots missing");
+
+    memcpy(broken, y5, sizeof(broken));
+    broken[2] = broken[1] - 1;
+    curve_upload(broken, ARRAY_SIZE(broken), false);
+    ok &= broken_expect(value, 1, NRF_ERROR_INVALID_DATA, y5,
+                        ARRAY_SIZE(y5), "falling");
+
+    memcpy(broken, y5, sizeof(broken));
+    broken[4] = MAX_ADC_RESOLUTION;
+    curve_upload(broken, ARRAY_SIZE(broken), false);
+    ok &= broken_expect(value, 1, NRF_ERROR_INVALID_DATA, y5,
+                        ARRAY_SIZE(y5), "above the range");
+
+    memcpy(broken, y5, sizeof(broken));
+    broken[0] = -1;
+    curve_upload(broken, ARRAY_SIZE(broken), false);
+    ok &= broken_expect(value, 1, NRF_ERROR_INVALID_DATA, y5,
+                        ARRAY_SIZE(y5), "below it");
+
+    value[0] = CALIBRATION_CURVE_OP_READ;
+    value[1] = ARRAY_SIZE(y5);
+    ok &= broken_expect(value, 2, NRF_ERROR_INVALID_PARAM, y5,
+                        ARRAY_SIZE(y5), "reading past the last knot");
+
+    value[0] = CALIBRATION_CURVE_OP_CLEAR;
+    ok &= expect(central_write(value, 1) && status_read() == NRF_SUCCESS &&
+                     straight_expect(),
+                 "CLEAR goes back to the straight line");
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
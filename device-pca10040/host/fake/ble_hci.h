@@ -0,0 +1,2 @@
+// SDK header name for the host build, see fake-ble.h
+#include "fake-ble.h"
@@ -0,0 +1,277 @@
+/**
+ * Copyright (c) 2018 Keith Wakeham
+ *
+ * All rights reserved.
+ *
+ *
+ */
+
+// app_scheduler, app_error, NRF_LOG, RTT, the cycle counter, crc16 and the
+// call counters.
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "fake.h"
+
+#define SCHED_QUEUE_MAX 32
+#define SCHED_EVENT_MAX 32
+#define CALL_NAMES_MAX 96
+
+typedef struct
+{
+    app_sched_event_handler_t handler;
+    uint16_t                  size;
+    uint8_t                   data[SCHED_EVENT_MAX];
+} sched_event_t;
+
+typedef struct
+{
+    char const *p_name;
+    uint32_t    count;
+} call_count_t;
+
+NRF_POWER_Type fake_power;
+
+static sched_event_t m_sched_queue[SCHED_QUEUE_MAX];
+static uint16_t      m_sched_size;
+static uint16_t      m_sched_max_event_size;
+static uint16_t      m_sched_head;
+static uint16_t      m_sched_count;
+
+static fake_log_level_t m_log_level = FAKE_LOG_INFO;
+
+static call_count_t m_calls[CALL_NAMES_MAX];
+
+static uint8_t m_critical_nesting;
+
+// Call counters
+
+void fake_call_record(char const *p_name)
+{
+    for (uint32_t i = 0; i < CALL_NAMES_MAX; i++)
+    {
+        if (m_calls[i].p_name == NULL)
+        {
+            m_calls[i].p_name = p_name;
+        }
+        if (strcmp(m_calls[i].p_name, p_name) == 0)
+        {
+            m_calls[i].count++;
+            return;
+        }
+    }
+}
+
+uint32_t fake_calls(char const *p_name)
+{
+    for (uint32_t i = 0; i < CALL_NAMES_MAX && m_calls[i].p_name != NULL; i++)
+    {
+        if (strcmp(m_calls[i].p_name, p_name) == 0)
+        {
+            return m_calls[i].count;
+        }
+    }
+
+    return 0;
+}
+
+void fake_calls_reset(void)
+{
+    for (uint32_t i = 0; i < CALL_NAMES_MAX; i++)
+    {
+        m_calls[i].count = 0;
+    }
+}
+
+// app_scheduler.h
+
+uint32_t app_sched_init(uint16_t max_event_size, uint16_t queue_size,
+                        void *p_evt_buffer)
+{
+    UNUSED_PARAMETER(p_evt_buffer);
+    FAKE_CALL();
+
+    if (max_event_size > SCHED_EVENT_MAX || queue_size > SCHED_QUEUE_MAX)
+    {
+        return NRF_ERROR_INVALID_PARAM;
+    }
+    m_sched_max_event_size = max_event_size;
+    m_sched_size = queue_size;
+    m_sched_head = 0;
+    m_sched_count = 0;
+
+    return NRF_SUCCESS;
+}
+
+uint32_t app_sched_event_put(void const *p_event_data, uint16_t event_size,
+                             app_sched_event_handler_t handler)
+{
+    sched_event_t *p_event;
+
+    FAKE_CALL();
+
+    if (event_size > m_sched_max_event_size)
+    {
+        return NRF_ERROR_INVALID_LENGTH;
+    }
+    if (m_sched_count >= m_sched_size)
+    {
+        return NRF_ERROR_NO_MEM;
+    }
+
+    p_event = &m_sched_queue[(m_sched_head + m_sched_count) % m_sched_size];
+    p_event->handler = handler;
+    p_event->size = event_size;
+    if (p_event_data != NULL && event_size > 0)
+    {
+        memcpy(p_event->data, p_event_data, event_size);
+    }
+    m_sched_count++;
+
+    return NRF_SUCCESS;
+}
+
+void app_sched_execute(void)
+{
+    while (m_sched_count > 0)
+    {
+        sched_event_t event = m_sched_queue[m_sched_head];
+
+        m_sched_head = (m_sched_head + 1) % m_sched_size;
+        m_sched_count--;
+
+        event.handler(event.size > 0 ? event.data : NULL, event.size);
+    }
+}
+
+// app_error.h, app_util_platform.h
+
+void app_error_handler(uint32_t error_code, uint32_t line_num,
+                       uint8_t const *p_file_name)
+{
+    fprintf(stderr, "%.3f ms: error 0x%x at %s:%u\n",
+            (double)fake_time_ns() / FAKE_NS_PER_MS, error_code,
+            (char const *)p_file_name, line_num);
+    abort();
+}
+
+void app_util_critical_region_enter(uint8_t *p_nested)
+{
+    *p_nested = m_critical_nesting++;
+}
+
+void app_util_critical_region_exit(uint8_t nested)
+{
+    m_critical_nesting = nested;
+}
+
+// nrf_log.h
+
+void fake_log_level_set(fake_log_level_t level) { m_log_level = level; }
+
+void fake_log(fake_log_level_t level, char const *p_fmt, ...)
+{
+    static char const *const names[] = {
+        [FAKE_LOG_ERROR] = "error",
+        [FAKE_LOG_WARNING] = "warning",
+        [FAKE_LOG_INFO] = "info",
+        [FAKE_LOG_DEBUG] = "debug",
+    };
+    va_list args;
+
+    if (level > m_log_level)
+    {
+        return;
+    }
+
+    printf("%10.3f ms <%s> ", (double)fake_time_ns() / FAKE_NS_PER_MS,
+           names[level]);
+    va_start(args, p_fmt);
+    vprintf(p_fmt, args);
+    va_end(args);
+    printf("\n");
+}
+
+// SEGGER_RTT.h, nobody reads the trace channel on the host
+
+int SEGGER_RTT_ConfigUpBuffer(unsigned BufferIndex, const char *sName,
+                              void *pBuffer, unsigned BufferSize,
+                              unsigned Flags)
+{
+    UNUSED_PARAMETER(BufferIndex);
+    UNUSED_PARAMETER(sName);
+    UNUSED_PARAMETER(pBuffer);
+    UNUSED_PARAMETER(BufferSize);
+    UNUSED_PARAMETER(Flags);
+    FAKE_CALL();
+
+    return 0;
+}
+
+unsigned SEGGER_RTT_WriteNoLock(unsigned BufferIndex, const void *pBuffer,
+                                unsigned NumBytes)
+{
+    UNUSED_PARAMETER(BufferIndex);
+    UNUSED_PARAMETER(pBuffer);
+
+    return NumBytes;
+}
+
+// core_cm4.h
+
+CoreDebug_Type fake_core_debug;
+
+static DWT_Type m_dwt;
+static uint64_t m_dwt_ns;
+
+DWT_Type *fake_dwt(void)
+{
+    struct timespec now;
+    uint64_t        now_ns;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    now_ns = (uint64_t)now.tv_sec * FAKE_NS_PER_S + (uint64_t)now.tv_nsec;
+
+    // Counts only while enabled, a write to CYCCNT sticks
+    if ((fake_core_debug.DEMCR & CoreDebug_DEMCR_TRCENA_Msk) &&
+        (m_dwt.CTRL & DWT_CTRL_CYCCNTENA_Msk))
+    {
+        m_dwt.CYCCNT += (uint32_t)(now_ns - m_dwt_ns);
+    }
+    m_dwt_ns = now_ns;
+
+    return &m_dwt;
+}
+
+// crc16.h, CRC-16-CCITT like the SDK
+
+uint16_t crc16_compute(uint8_t const *p_data, uint32_t size,
+                       uint16_t const *p_crc)
+{
+    uint16_t crc = (p_crc == NULL) ? 0xFFFF : *p_crc;
+
+    for (uint32_t i = 0; i < size; i++)
+    {
+        crc = (uint8_t)(crc >> 8) | (crc << 8);
+        crc ^= p_data[i];
+        crc ^= (uint8_t)(crc & 0xFF) >> 4;
+        crc ^= (crc << 8) << 4;
+        crc ^= ((crc & 0xFF) << 4) << 1;
+    }
+
+    return crc;
+}
+
+// nrf_soc.h
+
+ret_code_t sd_power_ram_power_set(uint8_t index, uint32_t ram_powerset)
+{
+    UNUSED_PARAMETER(index);
+    UNUSED_PARAMETER(ram_powerset);
+    FAKE_CALL();
+
+    return NRF_SUCCESS;
+}
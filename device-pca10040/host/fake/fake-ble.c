@@ -0,0 +1,1791 @@
+/**
+ * Copyright (c) 2018 Keith Wakeham
+ *
+ * All rights reserved.
+ *
+ *
+ */
+
+// The SoftDevice's GAP and GATT server side with the SDK BLE libraries on
+// top.
+//
+// Attributes get handles in the order they are added, a characteristic its
+// declaration, its value and with notify or indicate a CCCD. Values live in
+// the table, or in user memory for BLE_GATTS_VLOC_USER, CCCDs per link.
+//
+// A link has a connection event every interval, the first one an interval
+// after the connect. Each sends what sd_ble_gatts_hvx queued, as many
+// packets as fit, and reports them with BLE_GATTS_EVT_HVN_TX_COMPLETE when
+// the event is over. An indication is confirmed in the event after the one
+// it went out in. Slave latency is not modelled, every event happens. Radio
+// notifications come around connection events only, not advertising ones.
+//
+// The libraries do what the firmware relies on: advertising walks through
+// its modes on timeouts and restarts after a disconnect, ble_conn_params
+// reports whether an update the firmware asked for landed in range but never
+// negotiates by itself, and the Peer Manager has no bonds.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "fake-fds.h"
+#include "fake.h"
+
+#define LINK_COUNT NRF_SDH_BLE_TOTAL_LINK_COUNT
+#define ATTR_MAX 48
+#define ATTR_VALUE_MAX 512 // BLE_GATTS_VAR_ATTR_LEN_MAX
+#define HVN_QUEUE_MAX 16
+#define EVT_POOL_SIZE 32
+#define HVX_LEN_MAX (NRF_SDH_BLE_GATT_MAX_MTU_SIZE - 3)
+
+#define UNIT_1_25_MS_NS (1250 * FAKE_NS_PER_US)
+#define UNIT_10_MS_NS (10 * FAKE_NS_PER_MS)
+
+// A short notification and the empty packet back on the 1M PHY, with both
+// frame spaces
+#define PACKET_NS (550 * FAKE_NS_PER_US)
+#define EVENT_LENGTH_NS (NRF_SDH_BLE_GAP_EVENT_LENGTH * UNIT_1_25_MS_NS)
+
+// Connection events from the update request to its instant
+#define CONN_UPDATE_INSTANT_EVENTS 6
+
+#define DIRECTED_HIGH_DUTY_NS (1280 * FAKE_NS_PER_MS)
+
+typedef enum
+{
+    ATTR_SERVICE,
+    ATTR_CHAR_DECL,
+    ATTR_VALUE,
+    ATTR_CCCD,
+} attr_kind_t;
+
+typedef struct
+{
+    attr_kind_t           kind;
+    ble_uuid_t            uuid;
+    ble_gatt_char_props_t props;
+    uint16_t              value_handle; // characteristic a CCCD belongs to
+    uint8_t *             p_value;      // table or user memory
+    uint16_t              len;
+    uint16_t              max_len;
+    bool                  vlen;
+    uint16_t              cccd[LINK_COUNT];
+} attr_t;
+
+typedef struct
+{
+    bool                   connected;
+    bool                   disconnecting;
+    ble_gap_conn_params_t  params;
+    uint64_t               interval_ns;
+    uint64_t               anchor_ns; // next connection event
+    uint32_t               event_counter;
+    uint32_t               conn_event;
+    uint32_t               end_event;
+    uint32_t               radio_event;
+    fake_ble_link_config_t config;
+    // What the connection event that is on air reports at its end
+    uint8_t                end_hvn_count;
+    bool                   end_hvc;
+    bool                   end_update;
+    // The SoftDevice's queues
+    fake_ble_hvx_t         hvn[HVN_QUEUE_MAX];
+    uint8_t                hvn_head;
+    uint8_t                hvn_count;
+    fake_ble_hvx_t         indication;
+    bool                   indication_queued;
+    bool                   indication_sent;
+    // Parameter update in progress
+    bool                   update_pending;
+    uint32_t               update_instant;
+    ble_gap_conn_params_t  update_params;
+} link_t;
+
+typedef struct
+{
+    bool      in_use;
+    ble_evt_t evt;
+    uint8_t   data[NRF_SDH_BLE_GATT_MAX_MTU_SIZE]; // write data runs on here
+} sd_evt_t;
+
+extern nrf_sdh_ble_evt_observer_t const __start_fake_sdh_ble_observers[];
+extern nrf_sdh_ble_evt_observer_t const __stop_fake_sdh_ble_observers[];
+
+static attr_t   m_attrs[ATTR_MAX];
+static uint8_t  m_values[ATTR_MAX][ATTR_VALUE_MAX];
+static uint16_t m_attr_count;
+static uint8_t  m_vs_uuid_count;
+
+static link_t   m_links[LINK_COUNT];
+static sd_evt_t m_evt_pool[EVT_POOL_SIZE];
+
+static fake_ble_link_config_t      m_link_config = {.hvn_queue_size = 1};
+static fake_ble_hvx_handler_t      m_hvx_handler;
+static void *                      m_p_hvx_context;
+static fake_ble_conn_evt_handler_t m_conn_evt_handler;
+static void *                      m_p_conn_evt_context;
+static bool                        m_conn_param_accept = true;
+
+static ble_gap_conn_params_t m_ppcp;
+
+static struct
+{
+    ble_radio_notification_evt_handler_t handler;
+    uint8_t                              prio;
+    uint64_t                             distance_ns;
+} m_radio;
+
+static struct
+{
+    bool     active;
+    uint32_t timeout_event;
+} m_adv;
+
+static ble_advertising_t *m_p_advertising;
+
+static bool m_conn_state[LINK_COUNT];
+
+static struct
+{
+    ble_conn_params_evt_handler_t evt_handler;
+    ble_srv_error_handler_t       error_handler;
+    ble_gap_conn_params_t         preferred[LINK_COUNT];
+    bool                          pending[LINK_COUNT];
+} m_conn_params;
+
+static pm_evt_handler_t     m_pm_handler;
+static bsp_event_callback_t m_bsp_callback;
+
+static void advertising_on_ble_evt(ble_evt_t const *p_ble_evt);
+static void conn_state_on_ble_evt(ble_evt_t const *p_ble_evt);
+static void conn_params_on_ble_evt(ble_evt_t const *p_ble_evt);
+
+// Attribute table
+
+static attr_t *attr_get(uint16_t handle)
+{
+    if (handle == BLE_GATT_HANDLE_INVALID || handle > m_attr_count)
+    {
+        return NULL;
+    }
+
+    return &m_attrs[handle - 1];
+}
+
+static attr_t *cccd_get(uint16_t value_handle)
+{
+    for (uint16_t i = 0; i < m_attr_count; i++)
+    {
+        if (m_attrs[i].kind == ATTR_CCCD &&
+            m_attrs[i].value_handle == value_handle)
+        {
+            return &m_attrs[i];
+        }
+    }
+
+    return NULL;
+}
+
+static attr_t *attr_add(attr_kind_t kind)
+{
+    attr_t *p_attr = &m_attrs[m_attr_count];
+
+    memset(p_attr, 0, sizeof(*p_attr));
+    p_attr->kind = kind;
+    p_attr->p_value = m_values[m_attr_count];
+    m_attr_count++;
+
+    return p_attr;
+}
+
+static uint16_t attr_handle(attr_t const *p_attr)
+{
+    return (uint16_t)(p_attr - m_attrs) + 1;
+}
+
+static link_t *link_get(uint16_t conn_handle)
+{
+    if (conn_handle >= LINK_COUNT || !m_links[conn_handle].connected)
+    {
+        return NULL;
+    }
+
+    return &m_links[conn_handle];
+}
+
+// SoftDevice events
+
+static sd_evt_t *evt_alloc(uint16_t evt_id, uint16_t conn_handle)
+{
+    for (uint32_t i = 0; i < EVT_POOL_SIZE; i++)
+    {
+        sd_evt_t *p_sd_evt = &m_evt_pool[i];
+
+        if (p_sd_evt->in_use)
+        {
+            continue;
+        }
+        memset(p_sd_evt, 0, sizeof(*p_sd_evt));
+        p_sd_evt->in_use = true;
+        p_sd_evt->evt.header.evt_id = evt_id;
+        p_sd_evt->evt.header.evt_len = sizeof(ble_evt_t);
+        p_sd_evt->evt.evt.common_evt.conn_handle = conn_handle;
+
+        return p_sd_evt;
+    }
+
+    fprintf(stderr, "fake: more than %d pending BLE events\n", EVT_POOL_SIZE);
+    abort();
+}
+
+static void evt_deliver(void *p_context)
+{
+    sd_evt_t *                        p_sd_evt = p_context;
+    ble_evt_t const *                 p_ble_evt = &p_sd_evt->evt;
+    nrf_sdh_ble_evt_observer_t const *p_obs;
+
+    // The SDK libraries observe at the lowest priorities, ahead of the
+    // firmware's own observers
+    conn_state_on_ble_evt(p_ble_evt);
+    advertising_on_ble_evt(p_ble_evt);
+    conn_params_on_ble_evt(p_ble_evt);
+
+    for (uint8_t prio = 0; prio < NRF_SDH_BLE_OBSERVER_PRIO_LEVELS; prio++)
+    {
+        for (p_obs = __start_fake_sdh_ble_observers;
+             p_obs < __stop_fake_sdh_ble_observers; p_obs++)
+        {
+            if (p_obs->prio == prio)
+            {
+                p_obs->handler(p_ble_evt, p_obs->p_context);
+            }
+        }
+    }
+
+    p_sd_evt->in_use = false;
+}
+
+static void evt_post(sd_evt_t *p_sd_evt)
+{
+    UNUSED_RETURN_VALUE(fake_event_at(fake_time_ns(), FAKE_PRIO_SD_EVT,
+                                      evt_deliver, p_sd_evt));
+}
+
+// Radio notification
+
+static void radio_active(void *p_context)
+{
+    UNUSED_PARAMETER(p_context);
+    m_radio.handler(true);
+}
+
+static void radio_inactive(void *p_context)
+{
+    UNUSED_PARAMETER(p_context);
+    m_radio.handler(false);
+}
+
+// Connection events
+
+static void conn_event(void *p_context);
+
+static void link_schedule(link_t *p_link)
+{
+    p_link->conn_event = fake_event_at(p_link->anchor_ns, FAKE_PRIO_RADIO,
+                                       conn_event, p_link);
+    p_link->radio_event = 0;
+    if (m_radio.handler != NULL &&
+        p_link->anchor_ns >= fake_time_ns() + m_radio.distance_ns)
+    {
+        p_link->radio_event =
+            fake_event_at(p_link->anchor_ns - m_radio.distance_ns,
+                          m_radio.prio, radio_active, NULL);
+    }
+}
+
+static void link_params_set(link_t *p_link, ble_gap_conn_params_t const *p)
+{
+    p_link->params = *p;
+    p_link->interval_ns = p->max_conn_interval * UNIT_1_25_MS_NS;
+}
+
+static void link_terminate(uint16_t conn_handle, uint8_t reason)
+{
+    link_t *  p_link = &m_links[conn_handle];
+    sd_evt_t *p_sd_evt;
+
+    fake_event_cancel(p_link->conn_event);
+    fake_event_cancel(p_link->end_event);
+    fake_event_cancel(p_link->radio_event);
+    memset(p_link, 0, sizeof(*p_link));
+
+    p_sd_evt = evt_alloc(BLE_GAP_EVT_DISCONNECTED, conn_handle);
+    p_sd_evt->evt.evt.gap_evt.params.disconnected.reason = reason;
+    evt_post(p_sd_evt);
+}
+
+static void hvx_send(fake_ble_hvx_t *p_hvx, uint64_t at_ns)
+{
+    p_hvx->sent_ns = at_ns;
+    if (m_hvx_handler != NULL)
+    {
+        m_hvx_handler(p_hvx, m_p_hvx_context);
+    }
+}
+
+static void event_end(void *p_context)
+{
+    link_t *  p_link = p_context;
+    uint16_t  conn_handle = (uint16_t)(p_link - m_links);
+    sd_evt_t *p_sd_evt;
+
+    p_link->end_event = 0;
+
+    if (p_link->end_hvn_count > 0)
+    {
+        p_sd_evt = evt_alloc(BLE_GATTS_EVT_HVN_TX_COMPLETE, conn_handle);
+        p_sd_evt->evt.evt.gatts_evt.params.hvn_tx_complete.count =
+            p_link->end_hvn_count;
+        evt_post(p_sd_evt);
+    }
+    if (p_link->end_hvc)
+    {
+        p_sd_evt = evt_alloc(BLE_GATTS_EVT_HVC, conn_handle);
+        p_sd_evt->evt.evt.gatts_evt.params.hvc.handle =
+            p_link->indication.handle;
+        evt_post(p_sd_evt);
+    }
+    if (p_link->end_update)
+    {
+        p_sd_evt = evt_alloc(BLE_GAP_EVT_CONN_PARAM_UPDATE, conn_handle);
+        p_sd_evt->evt.evt.gap_evt.params.conn_param_update.conn_params =
+            p_link->params;
+        evt_post(p_sd_evt);
+    }
+
+    if (m_radio.handler != NULL)
+    {
+        UNUSED_RETURN_VALUE(fake_event_at(fake_time_ns(), m_radio.prio,
+                                          radio_inactive, NULL));
+    }
+}
+
+static void conn_event(void *p_context)
+{
+    link_t * p_link = p_context;
+    uint16_t conn_handle = (uint16_t)(p_link - m_links);
+    uint64_t now_ns = fake_time_ns();
+    uint32_t fit;
+    uint32_t packets = 0;
+
+    p_link->conn_event = 0;
+    p_link->radio_event = 0;
+    p_link->event_counter++;
+
+    if (p_link->disconnecting)
+    {
+        link_terminate(conn_handle, BLE_HCI_LOCAL_HOST_TERMINATED_CONNECTION);
+        return;
+    }
+
+    fit = p_link->config.packets_per_event;
+    if (fit == 0)
+    {
+        fit = (uint32_t)(MIN(EVENT_LENGTH_NS, p_link->interval_ns) / PACKET_NS);
+    }
+
+    if (m_conn_evt_handler != NULL)
+    {
+        fake_ble_conn_evt_t evt = {
+            .at_ns = now_ns,
+            .interval_ns = p_link->interval_ns,
+            .conn_handle = conn_handle,
+            .hvn_queued = p_link->hvn_count,
+            .indication = p_link->indication_queued && fit > 0,
+        };
+
+        evt.hvn_sent =
+            (uint8_t)MIN(p_link->hvn_count, fit - (evt.indication ? 1 : 0));
+        m_conn_evt_handler(&evt, m_p_conn_evt_context);
+    }
+
+    // The central confirms an indication in the event after it got it
+    p_link->end_hvc = p_link->indication_sent;
+    p_link->indication_sent = false;
+
+    if (p_link->indication_queued && packets < fit)
+    {
+        hvx_send(&p_link->indication, now_ns + packets * PACKET_NS);
+        p_link->indication_queued = false;
+        p_link->indication_sent = true;
+        packets++;
+    }
+
+    p_link->end_hvn_count = 0;
+    while (p_link->hvn_count > 0 && packets < fit)
+    {
+        hvx_send(&p_link->hvn[p_link->hvn_head],
+                 now_ns + packets * PACKET_NS);
+        p_link->hvn_head = (p_link->hvn_head + 1) % HVN_QUEUE_MAX;
+        p_link->hvn_count--;
+        p_link->end_hvn_count++;
+        packets++;
+    }
+
+    p_link->end_update = false;
+    if (p_link->update_pending &&
+        (int32_t)(p_link->event_counter - p_link->update_instant) >= 0)
+    {
+        p_link->update_pending = false;
+        p_link->end_update = true;
+        link_params_set(p_link, &p_link->update_params);
+    }
+
+    p_link->end_event = fake_event_at(now_ns + MAX(packets, 1) * PACKET_NS,
+                                      FAKE_PRIO_RADIO, event_end, p_link);
+
+    p_link->anchor_ns += p_link->interval_ns;
+    link_schedule(p_link);
+}
+
+// Control
+
+void fake_ble_link_config_set(fake_ble_link_config_t const *p_config)
+{
+    m_link_config = *p_config;
+    m_link_config.hvn_queue_size =
+        MAX(1, MIN(m_link_config.hvn_queue_size, HVN_QUEUE_MAX));
+}
+
+void fake_ble_hvx_handler_set(fake_ble_hvx_handler_t handler,
+                              void *                 p_context)
+{
+    m_hvx_handler = handler;
+    m_p_hvx_context = p_context;
+}
+
+void fake_ble_conn_evt_handler_set(fake_ble_conn_evt_handler_t handler,
+                                   void *                      p_context)
+{
+    m_conn_evt_handler = handler;
+    m_p_conn_evt_context = p_context;
+}
+
+void fake_ble_conn_param_accept_set(bool accept)
+{
+    m_conn_param_accept = accept;
+}
+
+static void adv_sd_stop(void);
+
+uint16_t fake_ble_connect(ble_gap_conn_params_t const *p_params)
+{
+    uint16_t  conn_handle;
+    link_t *  p_link;
+    sd_evt_t *p_sd_evt;
+
+    if (!m_adv.active)
+    {
+        return BLE_CONN_HANDLE_INVALID;
+    }
+    for (conn_handle = 0; conn_handle < LINK_COUNT; conn_handle++)
+    {
+        if (!m_links[conn_handle].connected)
+        {
+            break;
+        }
+    }
+    if (conn_handle == LINK_COUNT)
+    {
+        return BLE_CONN_HANDLE_INVALID;
+    }
+
+    // The central picks one interval, reported as both bounds
+    p_link = &m_links[conn_handle];
+    memset(p_link, 0, sizeof(*p_link));
+    p_link->connected = true;
+    p_link->config = m_link_config;
+    link_params_set(p_link, p_params);
+    p_link->params.min_conn_interval = p_params->max_conn_interval;
+    p_link->anchor_ns = fake_time_ns() + p_link->interval_ns;
+    link_schedule(p_link);
+
+    for (uint16_t i = 0; i < m_attr_count; i++)
+    {
+        m_attrs[i].cccd[conn_handle] = 0;
+    }
+
+    // Connecting ends advertising
+    adv_sd_stop();
+
+    p_sd_evt = evt_alloc(BLE_GAP_EVT_CONNECTED, conn_handle);
+    p_sd_evt->evt.evt.gap_evt.params.connected.role = BLE_GAP_ROLE_PERIPH;
+    p_sd_evt->evt.evt.gap_evt.params.connected.conn_params = p_link->params;
+    p_sd_evt->evt.evt.gap_evt.params.connected.peer_addr.addr[0] =
+        (uint8_t)(conn_handle + 1);
+    evt_post(p_sd_evt);
+
+    return conn_handle;
+}
+
+void fake_ble_disconnect(uint16_t conn_handle, uint8_t reason)
+{
+    if (link_get(conn_handle) != NULL)
+    {
+        link_terminate(conn_handle, reason);
+    }
+}
+
+bool fake_ble_write(uint16_t conn_handle, uint16_t handle,
+                    uint8_t const *p_data, uint16_t len)
+{
+    attr_t *  p_attr = attr_get(handle);
+    sd_evt_t *p_sd_evt;
+
+    if (link_get(conn_handle) == NULL || p_attr == NULL ||
+        (p_attr->kind != ATTR_VALUE && p_attr->kind != ATTR_CCCD))
+    {
+        fprintf(stderr, "fake: write to 0x%04x on link %u not possible\n",
+                handle, conn_handle);
+        abort();
+    }
+
+    len = MIN(len, HVX_LEN_MAX);
+    if (p_attr->kind == ATTR_CCCD)
+    {
+        len = MIN(len, BLE_CCCD_VALUE_LEN);
+        p_attr->cccd[conn_handle] = (len == BLE_CCCD_VALUE_LEN)
+                                        ? uint16_decode(p_data)
+                                        : p_data[0];
+    }
+    else
+    {
+        if (len > p_attr->max_len)
+        {
+            // Invalid attribute value length to the central
+            return false;
+        }
+        memcpy(p_attr->p_value, p_data, len);
+        if (p_attr->vlen)
+        {
+            p_attr->len = len;
+        }
+    }
+
+    p_sd_evt = evt_alloc(BLE_GATTS_EVT_WRITE, conn_handle);
+    p_sd_evt->evt.evt.gatts_evt.params.write.handle = handle;
+    p_sd_evt->evt.evt.gatts_evt.params.write.uuid = p_attr->uuid;
+    p_sd_evt->evt.evt.gatts_evt.params.write.op = BLE_GATT_OP_WRITE_REQ;
+    p_sd_evt->evt.evt.gatts_evt.params.write.len = len;
+    memcpy(p_sd_evt->evt.evt.gatts_evt.params.write.data, p_data, len);
+    evt_post(p_sd_evt);
+
+    return true;
+}
+
+uint16_t fake_ble_read(uint16_t conn_handle, uint16_t handle, uint8_t *p_data,
+                       uint16_t max_len)
+{
+    attr_t const *p_attr = attr_get(handle);
+    uint16_t      len;
+
+    if (link_get(conn_handle) == NULL || p_attr == NULL)
+    {
+        return 0;
+    }
+
+    switch (p_attr->kind)
+    {
+        case ATTR_VALUE:
+            len = MIN(p_attr->len, max_len);
+            memcpy(p_data, p_attr->p_value, len);
+            return len;
+
+        case ATTR_CCCD:
+            if (max_len < BLE_CCCD_VALUE_LEN)
+            {
+                return 0;
+            }
+            return uint16_encode(p_attr->cccd[conn_handle], p_data);
+
+        default:
+            return 0;
+    }
+}
+
+uint16_t fake_ble_value_handle(uint16_t uuid)
+{
+    for (uint16_t i = 0; i < m_attr_count; i++)
+    {
+        if (m_attrs[i].kind == ATTR_VALUE && m_attrs[i].uuid.uuid == uuid)
+        {
+            return attr_handle(&m_attrs[i]);
+        }
+    }
+
+    return BLE_GATT_HANDLE_INVALID;
+}
+
+uint16_t fake_ble_cccd_handle(uint16_t uuid)
+{
+    attr_t const *p_cccd = cccd_get(fake_ble_value_handle(uuid));
+
+    return (p_cccd != NULL) ? attr_handle(p_cccd) : BLE_GATT_HANDLE_INVALID;
+}
+
+uint32_t fake_ble_conn_interval_us(uint16_t conn_handle)
+{
+    link_t const *p_link = link_get(conn_handle);
+
+    return (p_link != NULL) ? (uint32_t)(p_link->interval_ns / FAKE_NS_PER_US)
+                            : 0;
+}
+
+// ble_gap.h
+
+ret_code_t sd_ble_gap_adv_stop(uint8_t adv_handle)
+{
+    UNUSED_PARAMETER(adv_handle);
+    FAKE_CALL();
+
+    if (!m_adv.active)
+    {
+        return NRF_ERROR_INVALID_STATE;
+    }
+    adv_sd_stop();
+
+    return NRF_SUCCESS;
+}
+
+ret_code_t sd_ble_gap_appearance_set(uint16_t appearance)
+{
+    UNUSED_PARAMETER(appearance);
+    FAKE_CALL();
+
+    return NRF_SUCCESS;
+}
+
+ret_code_t sd_ble_gap_conn_param_update(
+    uint16_t conn_handle, ble_gap_conn_params_t const *p_conn_params)
+{
+    link_t *p_link = link_get(conn_handle);
+
+    FAKE_CALL();
+
+    if (p_link == NULL)
+    {
+        return BLE_ERROR_INVALID_CONN_HANDLE;
+    }
+    if (p_link->update_pending)
+    {
+        return NRF_ERROR_BUSY;
+    }
+    if (p_conn_params == NULL)
+    {
+        p_conn_params = &m_ppcp;
+    }
+
+    if (m_conn_param_accept)
+    {
+        // The central grants the shortest interval asked for
+        p_link->update_params = *p_conn_params;
+        p_link->update_params.max_conn_interval =
+            p_conn_params->min_conn_interval;
+    }
+    else
+    {
+        // It answers with what it already has
+        p_link->update_params = p_link->params;
+    }
+    p_link->update_pending = true;
+    p_link->update_instant =
+        p_link->event_counter + CONN_UPDATE_INSTANT_EVENTS;
+
+    return NRF_SUCCESS;
+}
+
+ret_code_t sd_ble_gap_device_name_set(
+    ble_gap_conn_sec_mode_t const *p_write_perm, uint8_t const *p_dev_name,
+    uint16_t len)
+{
+    UNUSED_PARAMETER(p_write_perm);
+    UNUSED_PARAMETER(p_dev_name);
+    UNUSED_PARAMETER(len);
+    FAKE_CALL();
+
+    return NRF_SUCCESS;
+}
+
+ret_code_t sd_ble_gap_disconnect(uint16_t conn_handle, uint8_t hci_status_code)
+{
+    link_t *p_link = link_get(conn_handle);
+
+    UNUSED_PARAMETER(hci_status_code);
+    FAKE_CALL();
+
+    if (p_link == NULL)
+    {
+        return BLE_ERROR_INVALID_CONN_HANDLE;
+    }
+    if (p_link->disconnecting)
+    {
+        return NRF_ERROR_INVALID_STATE;
+    }
+    // Goes down at the next connection event
+    p_link->disconnecting = true;
+
+    return NRF_SUCCESS;
+}
+
+ret_code_t sd_ble_gap_phy_update(uint16_t              conn_handle,
+                                 ble_gap_phys_t const *p_gap_phys)
+{
+    UNUSED_PARAMETER(p_gap_phys);
+    FAKE_CALL();
+
+    return (link_get(conn_handle) != NULL) ? NRF_SUCCESS
+                                           : BLE_ERROR_INVALID_CONN_HANDLE;
+}
+
+ret_code_t sd_ble_gap_ppcp_set(ble_gap_conn_params_t const *p_conn_params)
+{
+    FAKE_CALL();
+
+    m_ppcp = *p_conn_params;
+
+    return NRF_SUCCESS;
+}
+
+// ble_gatts.h
+
+ret_code_t sd_ble_uuid_vs_add(ble_uuid128_t const *p_vs_uuid,
+                              uint8_t *            p_uuid_type)
+{
+    UNUSED_PARAMETER(p_vs_uuid);
+    FAKE_CALL();
+
+    *p_uuid_type = BLE_UUID_TYPE_VENDOR_BEGIN + m_vs_uuid_count++;
+
+    return NRF_SUCCESS;
+}
+
+ret_code_t sd_ble_gatts_service_add(uint8_t type, ble_uuid_t const *p_uuid,
+                                    uint16_t *p_handle)
+{
+    attr_t *p_attr;
+
+    UNUSED_PARAMETER(type);
+    FAKE_CALL();
+
+    if (m_attr_count >= ATTR_MAX)
+    {
+        return NRF_ERROR_NO_MEM;
+    }
+
+    p_attr = attr_add(ATTR_SERVICE);
+    p_attr->uuid = *p_uuid;
+    *p_handle = attr_handle(p_attr);
+
+    return NRF_SUCCESS;
+}
+
+ret_code_t sd_ble_gatts_characteristic_add(
+    uint16_t service_handle, ble_gatts_char_md_t const *p_char_md,
+    ble_gatts_attr_t const *p_attr_char_value,
+    ble_gatts_char_handles_t *p_handles)
+{
+    ble_gatts_attr_md_t const *p_attr_md = p_attr_char_value->p_attr_md;
+    attr_t *                   p_value;
+    attr_t *                   p_cccd;
+
+    UNUSED_PARAMETER(service_handle);
+    FAKE_CALL();
+
+    if (m_attr_count + 3 > ATTR_MAX)
+    {
+        return NRF_ERROR_NO_MEM;
+    }
+    if (p_attr_char_value->max_len > ATTR_VALUE_MAX ||
+        p_attr_char_value->init_len > p_attr_char_value->max_len ||
+        (p_attr_md->vloc == BLE_GATTS_VLOC_USER &&
+         p_attr_char_value->p_value == NULL))
+    {
+        return NRF_ERROR_INVALID_PARAM;
+    }
+
+    attr_add(ATTR_CHAR_DECL)->uuid = *p_attr_char_value->p_uuid;
+
+    p_value = attr_add(ATTR_VALUE);
+    p_value->uuid = *p_attr_char_value->p_uuid;
+    p_value->props = p_char_md->char_props;
+    p_value->len = p_attr_char_value->init_len;
+    p_value->max_len = p_attr_char_value->max_len;
+    p_value->vlen = p_attr_md->vlen;
+    if (p_attr_md->vloc == BLE_GATTS_VLOC_USER)
+    {
+        p_value->p_value = p_attr_char_value->p_value;
+    }
+    else if (p_attr_char_value->p_value != NULL)
+    {
+        memcpy(p_value->p_value, p_attr_char_value->p_value,
+               p_attr_char_value->init_len);
+    }
+
+    memset(p_handles, 0, sizeof(*p_handles));
+    p_handles->value_handle = attr_handle(p_value);
+
+    // The CCCD comes with the property, p_cccd_md only sets its permissions
+    if (p_char_md->char_props.notify || p_char_md->char_props.indicate)
+    {
+        p_cccd = attr_add(ATTR_CCCD);
+        p_cccd->uuid.uuid = BLE_UUID_DESCRIPTOR_CLIENT_CHAR_CONFIG;
+        p_cccd->uuid.type = BLE_UUID_TYPE_BLE;
+        p_cccd->value_handle = p_handles->value_handle;
+        p_cccd->len = BLE_CCCD_VALUE_LEN;
+        p_cccd->max_len = BLE_CCCD_VALUE_LEN;
+        p_handles->cccd_handle = attr_handle(p_cccd);
+    }
+
+    return NRF_SUCCESS;
+}
+
+ret_code_t sd_ble_gatts_value_set(uint16_t conn_handle, uint16_t handle,
+                                  ble_gatts_value_t *p_value)
+{
+    attr_t *p_attr = attr_get(handle);
+
+    FAKE_CALL();
+
+    if (p_attr == NULL)
+    {
+        return BLE_ERROR_INVALID_ATTR_HANDLE;
+    }
+    if (p_attr->kind == ATTR_CCCD)
+    {
+        if (link_get(conn_handle) == NULL)
+        {
+            return BLE_ERROR_INVALID_CONN_HANDLE;
+        }
+        if (p_value->offset != 0 || p_value->len != BLE_CCCD_VALUE_LEN)
+        {
+            return NRF_ERROR_INVALID_PARAM;
+        }
+        p_attr->cccd[conn_handle] = uint16_decode(p_value->p_value);
+        return NRF_SUCCESS;
+    }
+    if (p_attr->kind != ATTR_VALUE)
+    {
+        return NRF_ERROR_FORBIDDEN;
+    }
+    if (p_value->offset + p_value->len > p_attr->max_len)
+    {
+        return NRF_ERROR_INVALID_PARAM;
+    }
+
+    if (p_value->p_value != NULL)
+    {
+        memcpy(p_attr->p_value + p_value->offset, p_value->p_value,
+               p_value->len);
+    }
+    if (p_attr->vlen)
+    {
+        p_attr->len = p_value->offset + p_value->len;
+    }
+
+    return NRF_SUCCESS;
+}
+
+ret_code_t sd_ble_gatts_value_get(uint16_t conn_handle, uint16_t handle,
+                                  ble_gatts_value_t *p_value)
+{
+    attr_t const *p_attr = attr_get(handle);
+    uint8_t       cccd[BLE_CCCD_VALUE_LEN];
+    uint8_t const *p_src;
+    uint16_t      len;
+    uint16_t      total;
+
+    FAKE_CALL();
+
+    if (p_attr == NULL)
+    {
+        return BLE_ERROR_INVALID_ATTR_HANDLE;
+    }
+    if (p_attr->kind == ATTR_CCCD)
+    {
+        if (link_get(conn_handle) == NULL)
+        {
+            return BLE_ERROR_INVALID_CONN_HANDLE;
+        }
+        UNUSED_RETURN_VALUE(uint16_encode(p_attr->cccd[conn_handle], cccd));
+        p_src = cccd;
+    }
+    else if (p_attr->kind == ATTR_VALUE)
+    {
+        p_src = p_attr->p_value;
+    }
+    else
+    {
+        return NRF_ERROR_FORBIDDEN;
+    }
+    if (p_value->offset > p_attr->len)
+    {
+        return NRF_ERROR_INVALID_PARAM;
+    }
+
+    // len comes back as all there is from the offset on
+    total = p_attr->len - p_value->offset;
+    len = MIN(p_value->len, total);
+    if (p_value->p_value != NULL)
+    {
+        memcpy(p_value->p_value, p_src + p_value->offset, len);
+    }
+    p_value->len = total;
+
+    return NRF_SUCCESS;
+}
+
+ret_code_t sd_ble_gatts_hvx(uint16_t                      conn_handle,
+                            ble_gatts_hvx_params_t const *p_hvx_params)
+{
+    link_t *        p_link = link_get(conn_handle);
+    attr_t *        p_attr;
+    attr_t const *  p_cccd;
+    fake_ble_hvx_t *p_hvx;
+    uint16_t        len;
+
+    FAKE_CALL();
+
+    if (p_link == NULL)
+    {
+        return BLE_ERROR_INVALID_CONN_HANDLE;
+    }
+    p_attr = attr_get(p_hvx_params->handle);
+    if (p_attr == NULL || p_attr->kind != ATTR_VALUE)
+    {
+        return BLE_ERROR_INVALID_ATTR_HANDLE;
+    }
+    p_cccd = cccd_get(p_hvx_params->handle);
+    if (p_cccd == NULL ||
+        (p_cccd->cccd[conn_handle] & p_hvx_params->type) == 0)
+    {
+        return NRF_ERROR_INVALID_STATE;
+    }
+
+    if (p_hvx_params->type == BLE_GATT_HVX_INDICATION)
+    {
+        if (p_link->indication_queued || p_link->indication_sent)
+        {
+            return NRF_ERROR_BUSY;
+        }
+        p_hvx = &p_link->indication;
+    }
+    else
+    {
+        if (p_link->hvn_count >= p_link->config.hvn_queue_size)
+        {
+            return NRF_ERROR_RESOURCES;
+        }
+        p_hvx = &p_link->hvn[(p_link->hvn_head + p_link->hvn_count) %
+                             HVN_QUEUE_MAX];
+    }
+
+    len = (p_hvx_params->p_len != NULL) ? *p_hvx_params->p_len : p_attr->len;
+    if (p_hvx_params->p_data != NULL)
+    {
+        // The attribute takes the new value as well
+        if (p_hvx_params->offset + len > p_attr->max_len)
+        {
+            return NRF_ERROR_DATA_SIZE;
+        }
+        memcpy(p_attr->p_value + p_hvx_params->offset, p_hvx_params->p_data,
+               len);
+        if (p_attr->vlen)
+        {
+            p_attr->len = p_hvx_params->offset + len;
+        }
+    }
+    // Whatever the attribute holds now goes out, cut to the MTU
+    len = MIN(MIN(len, p_attr->len), HVX_LEN_MAX);
+
+    memset(p_hvx, 0, sizeof(*p_hvx));
+    p_hvx->queued_ns = fake_time_ns();
+    p_hvx->conn_handle = conn_handle;
+    p_hvx->handle = p_hvx_params->handle;
+    p_hvx->type = p_hvx_params->type;
+    p_hvx->len = len;
+    memcpy(p_hvx->data, p_attr->p_value, len);
+
+    if (p_hvx_params->type == BLE_GATT_HVX_INDICATION)
+    {
+        p_link->indication_queued = true;
+    }
+    else
+    {
+        p_link->hvn_count++;
+    }
+    if (p_hvx_params->p_len != NULL)
+    {
+        *p_hvx_params->p_len = len;
+    }
+
+    return NRF_SUCCESS;
+}
+
+// nrf_sdh.h, nrf_sdh_ble.h
+
+ret_code_t nrf_sdh_enable_request(void)
+{
+    FAKE_CALL();
+    return NRF_SUCCESS;
+}
+
+ret_code_t nrf_sdh_ble_default_cfg_set(uint8_t conn_cfg_tag,
+                                       uint32_t *p_ram_start)
+{
+    UNUSED_PARAMETER(conn_cfg_tag);
+    UNUSED_PARAMETER(p_ram_start);
+    FAKE_CALL();
+
+    return NRF_SUCCESS;
+}
+
+ret_code_t nrf_sdh_ble_enable(uint32_t *p_app_ram_start)
+{
+    UNUSED_PARAMETER(p_app_ram_start);
+    FAKE_CALL();
+
+    return NRF_SUCCESS;
+}
+
+// ble_radio_notification.h
+
+ret_code_t ble_radio_notification_init(
+    uint32_t irq_priority, uint8_t distance,
+    ble_radio_notification_evt_handler_t evt_handler)
+{
+    static uint16_t const distance_us[] = {0, 800, 1740, 2680, 3620, 4560,
+                                           5500};
+
+    FAKE_CALL();
+
+    if (distance >= ARRAY_SIZE(distance_us))
+    {
+        return NRF_ERROR_INVALID_PARAM;
+    }
+    m_radio.handler = evt_handler;
+    m_radio.prio = (uint8_t)irq_priority;
+    m_radio.distance_ns = distance_us[distance] * FAKE_NS_PER_US;
+
+    return NRF_SUCCESS;
+}
+
+// nrf_ble_gatt.h, nrf_ble_qwr.h
+
+ret_code_t nrf_ble_gatt_init(nrf_ble_gatt_t *           p_gatt,
+                             nrf_ble_gatt_evt_handler_t evt_handler)
+{
+    UNUSED_PARAMETER(p_gatt);
+    UNUSED_PARAMETER(evt_handler);
+    FAKE_CALL();
+
+    return NRF_SUCCESS;
+}
+
+ret_code_t nrf_ble_qwr_init(nrf_ble_qwr_t *           p_qwr,
+                            nrf_ble_qwr_init_t const *p_qwr_init)
+{
+    FAKE_CALL();
+
+    p_qwr->conn_handle = BLE_CONN_HANDLE_INVALID;
+    p_qwr->error_handler = p_qwr_init->error_handler;
+
+    return NRF_SUCCESS;
+}
+
+ret_code_t nrf_ble_qwr_conn_handle_assign(nrf_ble_qwr_t *p_qwr,
+                                          uint16_t       conn_handle)
+{
+    FAKE_CALL();
+
+    p_qwr->conn_handle = conn_handle;
+
+    return NRF_SUCCESS;
+}
+
+// ble_advertising.h
+
+static void adv_timeout(void *p_context);
+
+static void adv_sd_start(uint64_t timeout_ns)
+{
+    m_adv.active = true;
+    if (timeout_ns > 0)
+    {
+        m_adv.timeout_event =
+            fake_event_at(fake_time_ns() + timeout_ns, FAKE_PRIO_SD_EVT,
+                          adv_timeout, NULL);
+    }
+}
+
+static void adv_sd_stop(void)
+{
+    fake_event_cancel(m_adv.timeout_event);
+    m_adv.timeout_event = 0;
+    m_adv.active = false;
+}
+
+static void adv_evt_send(ble_advertising_t *p_advertising, ble_adv_evt_t evt)
+{
+    if (p_advertising->evt_handler != NULL)
+    {
+        p_advertising->evt_handler(evt);
+    }
+}
+
+static void adv_timeout(void *p_context)
+{
+    ble_advertising_t *p_advertising = m_p_advertising;
+    ret_code_t         err_code;
+
+    UNUSED_PARAMETER(p_context);
+
+    m_adv.timeout_event = 0;
+    m_adv.active = false;
+
+    // IDLE follows SLOW
+    err_code = ble_advertising_start(
+        p_advertising,
+        (ble_adv_mode_t)((p_advertising->adv_mode_current + 1) %
+                         (BLE_ADV_MODE_SLOW + 1)));
+    if (err_code != NRF_SUCCESS && p_advertising->error_handler != NULL)
+    {
+        p_advertising->error_handler(err_code);
+    }
+}
+
+static void advertising_on_ble_evt(ble_evt_t const *p_ble_evt)
+{
+    ble_advertising_t *p_advertising = m_p_advertising;
+    uint16_t           conn_handle = p_ble_evt->evt.gap_evt.conn_handle;
+    ret_code_t         err_code;
+
+    if (p_advertising == NULL)
+    {
+        return;
+    }
+
+    switch (p_ble_evt->header.evt_id)
+    {
+        case BLE_GAP_EVT_CONNECTED:
+            if (p_ble_evt->evt.gap_evt.params.connected.role ==
+                BLE_GAP_ROLE_PERIPH)
+            {
+                p_advertising->current_slave_link_conn_handle = conn_handle;
+            }
+            break;
+
+        case BLE_GAP_EVT_DISCONNECTED:
+            p_advertising->whitelist_temporarily_disabled = false;
+            if (conn_handle ==
+                    p_advertising->current_slave_link_conn_handle &&
+                !p_advertising->adv_modes_config
+                     .ble_adv_on_disconnect_disabled)
+            {
+                err_code = ble_advertising_start(
+                    p_advertising, BLE_ADV_MODE_DIRECTED_HIGH_DUTY);
+                if (err_code != NRF_SUCCESS &&
+                    p_advertising->error_handler != NULL)
+                {
+                    p_advertising->error_handler(err_code);
+                }
+            }
+            break;
+
+        default:
+            break;
+    }
+}
+
+ret_code_t ble_advertising_init(ble_advertising_t *           p_advertising,
+                                ble_advertising_init_t const *p_init)
+{
+    FAKE_CALL();
+
+    memset(p_advertising, 0, sizeof(*p_advertising));
+    p_advertising->initialized = true;
+    p_advertising->adv_mode_current = BLE_ADV_MODE_IDLE;
+    p_advertising->adv_modes_config = p_init->config;
+    p_advertising->adv_handle = 0;
+    p_advertising->current_slave_link_conn_handle = BLE_CONN_HANDLE_INVALID;
+    p_advertising->evt_handler = p_init->evt_handler;
+    p_advertising->error_handler = p_init->error_handler;
+    m_p_advertising = p_advertising;
+
+    return NRF_SUCCESS;
+}
+
+void ble_advertising_conn_cfg_tag_set(ble_advertising_t *p_advertising,
+                                      uint8_t            ble_cfg_tag)
+{
+    FAKE_CALL();
+    p_advertising->conn_cfg_tag = ble_cfg_tag;
+}
+
+// Like the SDK the whitelist is asked for with the mode the caller wanted,
+// the peer address only when a directed mode is tried, and a mode that
+// cannot run falls through to the next one
+ret_code_t ble_advertising_start(ble_advertising_t *p_advertising,
+                                 ble_adv_mode_t     advertising_mode)
+{
+    ble_adv_modes_config_t const *p_config = &p_advertising->adv_modes_config;
+    ble_adv_evt_t                 evt;
+    uint64_t                      timeout_ns;
+
+    FAKE_CALL();
+
+    if (!p_advertising->initialized || m_adv.active)
+    {
+        return NRF_ERROR_INVALID_STATE;
+    }
+
+    p_advertising->adv_mode_current = advertising_mode;
+    p_advertising->peer_address_valid = false;
+
+    if ((advertising_mode == BLE_ADV_MODE_FAST ||
+         advertising_mode == BLE_ADV_MODE_SLOW) &&
+        p_config->ble_adv_whitelist_enabled &&
+        !p_advertising->whitelist_temporarily_disabled)
+    {
+        p_advertising->whitelist_in_use = false;
+        p_advertising->whitelist_reply_expected = true;
+        adv_evt_send(p_advertising, BLE_ADV_EVT_WHITELIST_REQUEST);
+        p_advertising->whitelist_reply_expected = false;
+    }
+
+    if ((advertising_mode == BLE_ADV_MODE_DIRECTED_HIGH_DUTY &&
+         p_config->ble_adv_directed_high_duty_enabled) ||
+        (advertising_mode == BLE_ADV_MODE_DIRECTED &&
+         p_config->ble_adv_directed_enabled))
+    {
+        p_advertising->peer_addr_reply_expected = true;
+        adv_evt_send(p_advertising, BLE_ADV_EVT_PEER_ADDR_REQUEST);
+        p_advertising->peer_addr_reply_expected = false;
+    }
+
+    if (advertising_mode == BLE_ADV_MODE_DIRECTED_HIGH_DUTY &&
+        !(p_config->ble_adv_directed_high_duty_enabled &&
+          p_advertising->peer_address_valid))
+    {
+        advertising_mode = BLE_ADV_MODE_DIRECTED;
+    }
+    if (advertising_mode == BLE_ADV_MODE_DIRECTED &&
+        !(p_config->ble_adv_directed_enabled &&
+          p_advertising->peer_address_valid))
+    {
+        advertising_mode = BLE_ADV_MODE_FAST;
+    }
+    if (advertising_mode == BLE_ADV_MODE_FAST &&
+        !p_config->ble_adv_fast_enabled)
+    {
+        advertising_mode = BLE_ADV_MODE_SLOW;
+    }
+    if (advertising_mode == BLE_ADV_MODE_SLOW &&
+        !p_config->ble_adv_slow_enabled)
+    {
+        advertising_mode = BLE_ADV_MODE_IDLE;
+    }
+    p_advertising->adv_mode_current = advertising_mode;
+
+    switch (advertising_mode)
+    {
+        case BLE_ADV_MODE_DIRECTED_HIGH_DUTY:
+            evt = BLE_ADV_EVT_DIRECTED_HIGH_DUTY;
+            timeout_ns = DIRECTED_HIGH_DUTY_NS;
+            break;
+
+        case BLE_ADV_MODE_DIRECTED:
+            evt = BLE_ADV_EVT_DIRECTED;
+            timeout_ns = p_config->ble_adv_directed_timeout * UNIT_10_MS_NS;
+            break;
+
+        case BLE_ADV_MODE_FAST:
+            evt = p_advertising->whitelist_in_use ? BLE_ADV_EVT_FAST_WHITELIST
+                                                  : BLE_ADV_EVT_FAST;
+            timeout_ns = p_config->ble_adv_fast_timeout * UNIT_10_MS_NS;
+            break;
+
+        case BLE_ADV_MODE_SLOW:
+            evt = p_advertising->whitelist_in_use ? BLE_ADV_EVT_SLOW_WHITELIST
+                                                  : BLE_ADV_EVT_SLOW;
+            timeout_ns = p_config->ble_adv_slow_timeout * UNIT_10_MS_NS;
+            break;
+
+        default:
+            adv_evt_send(p_advertising, BLE_ADV_EVT_IDLE);
+            return NRF_SUCCESS;
+    }
+
+    adv_sd_start(timeout_ns);
+    adv_evt_send(p_advertising, evt);
+
+    return NRF_SUCCESS;
+}
+
+ret_code_t ble_advertising_restart_without_whitelist(
+    ble_advertising_t *p_advertising)
+{
+    ret_code_t err_code;
+
+    FAKE_CALL();
+
+    adv_sd_stop();
+    p_advertising->whitelist_temporarily_disabled = true;
+    p_advertising->whitelist_in_use = false;
+
+    err_code =
+        ble_advertising_start(p_advertising, p_advertising->adv_mode_current);
+    if (err_code != NRF_SUCCESS && p_advertising->error_handler != NULL)
+    {
+        p_advertising->error_handler(err_code);
+    }
+
+    return NRF_SUCCESS;
+}
+
+ret_code_t ble_advertising_whitelist_reply(
+    ble_advertising_t *p_advertising, ble_gap_addr_t const *p_gap_addrs,
+    uint32_t addr_cnt, ble_gap_irk_t const *p_gap_irks, uint32_t irk_cnt)
+{
+    UNUSED_PARAMETER(p_gap_addrs);
+    UNUSED_PARAMETER(p_gap_irks);
+    FAKE_CALL();
+
+    if (!p_advertising->whitelist_reply_expected)
+    {
+        return NRF_ERROR_INVALID_STATE;
+    }
+    p_advertising->whitelist_reply_expected = false;
+    p_advertising->whitelist_in_use = addr_cnt > 0 || irk_cnt > 0;
+
+    return NRF_SUCCESS;
+}
+
+ret_code_t ble_advertising_peer_addr_reply(ble_advertising_t *p_advertising,
+                                           ble_gap_addr_t *   p_peer_addr)
+{
+    UNUSED_PARAMETER(p_peer_addr);
+    FAKE_CALL();
+
+    if (!p_advertising->peer_addr_reply_expected)
+    {
+        return NRF_ERROR_INVALID_STATE;
+    }
+    p_advertising->peer_addr_reply_expected = false;
+    p_advertising->peer_address_valid = true;
+
+    return NRF_SUCCESS;
+}
+
+// ble_conn_params.h
+
+static void conn_params_on_ble_evt(ble_evt_t const *p_ble_evt)
+{
+    uint16_t conn_handle = p_ble_evt->evt.gap_evt.conn_handle;
+    ble_gap_conn_params_t const *p_params;
+    ble_gap_conn_params_t const *p_preferred;
+    ble_conn_params_evt_t        evt;
+
+    if (conn_handle >= LINK_COUNT)
+    {
+        return;
+    }
+
+    switch (p_ble_evt->header.evt_id)
+    {
+        case BLE_GAP_EVT_CONNECTED:
+            m_conn_params.preferred[conn_handle] = m_ppcp;
+            m_conn_params.pending[conn_handle] = false;
+            break;
+
+        case BLE_GAP_EVT_CONN_PARAM_UPDATE:
+            if (!m_conn_params.pending[conn_handle] ||
+                m_conn_params.evt_handler == NULL)
+            {
+                break;
+            }
+            m_conn_params.pending[conn_handle] = false;
+
+            p_params = &p_ble_evt->evt.gap_evt.params.conn_param_update
+                            .conn_params;
+            p_preferred = &m_conn_params.preferred[conn_handle];
+
+            evt.conn_handle = conn_handle;
+            evt.evt_type =
+                (p_params->max_conn_interval >=
+                     p_preferred->min_conn_interval &&
+                 p_params->max_conn_interval <= p_preferred->max_conn_interval)
+                    ? BLE_CONN_PARAMS_EVT_SUCCEEDED
+                    : BLE_CONN_PARAMS_EVT_FAILED;
+            m_conn_params.evt_handler(&evt);
+            break;
+
+        default:
+            break;
+    }
+}
+
+ret_code_t ble_conn_params_init(ble_conn_params_init_t const *p_init)
+{
+    FAKE_CALL();
+
+    m_conn_params.evt_handler = p_init->evt_handler;
+    m_conn_params.error_handler = p_init->error_handler;
+    if (p_init->p_conn_params != NULL)
+    {
+        m_ppcp = *p_init->p_conn_params;
+    }
+
+    return NRF_SUCCESS;
+}
+
+ret_code_t ble_conn_params_change_conn_params(
+    uint16_t conn_handle, ble_gap_conn_params_t *p_new_params)
+{
+    ret_code_t err_code;
+
+    FAKE_CALL();
+
+    if (conn_handle >= LINK_COUNT || !m_conn_state[conn_handle])
+    {
+        return BLE_ERROR_INVALID_CONN_HANDLE;
+    }
+    if (p_new_params == NULL)
+    {
+        p_new_params = &m_ppcp;
+    }
+
+    err_code = sd_ble_gap_conn_param_update(conn_handle, p_new_params);
+    if (err_code == NRF_SUCCESS)
+    {
+        m_conn_params.preferred[conn_handle] = *p_new_params;
+        m_conn_params.pending[conn_handle] = true;
+    }
+
+    return err_code;
+}
+
+// ble_conn_state.h, what the library saw of the links
+
+static void conn_state_on_ble_evt(ble_evt_t const *p_ble_evt)
+{
+    uint16_t conn_handle = p_ble_evt->evt.gap_evt.conn_handle;
+
+    if (conn_handle >= LINK_COUNT)
+    {
+        return;
+    }
+    if (p_ble_evt->header.evt_id == BLE_GAP_EVT_CONNECTED)
+    {
+        m_conn_state[conn_handle] = true;
+    }
+    else if (p_ble_evt->header.evt_id == BLE_GAP_EVT_DISCONNECTED)
+    {
+        m_conn_state[conn_handle] = false;
+    }
+}
+
+uint32_t ble_conn_state_for_each_connected(
+    ble_conn_state_user_function_t user_function, void *p_context)
+{
+    bool     connected[LINK_COUNT];
+    uint32_t count = 0;
+
+    FAKE_CALL();
+
+    // The function may disconnect
+    memcpy(connected, m_conn_state, sizeof(connected));
+    for (uint16_t i = 0; i < LINK_COUNT; i++)
+    {
+        if (connected[i])
+        {
+            user_function(i, p_context);
+            count++;
+        }
+    }
+
+    return count;
+}
+
+uint32_t ble_conn_state_peripheral_conn_count(void)
+{
+    uint32_t count = 0;
+
+    for (uint16_t i = 0; i < LINK_COUNT; i++)
+    {
+        count += m_conn_state[i] ? 1 : 0;
+    }
+
+    return count;
+}
+
+uint8_t ble_conn_state_role(uint16_t conn_handle)
+{
+    return (conn_handle < LINK_COUNT && m_conn_state[conn_handle])
+               ? BLE_GAP_ROLE_PERIPH
+               : BLE_GAP_ROLE_INVALID;
+}
+
+// peer_manager.h
+
+static void pm_fds_evt_handler(fds_evt_t const *p_evt)
+{
+    UNUSED_PARAMETER(p_evt);
+}
+
+static void pm_peers_deleted(void *p_context)
+{
+    pm_evt_t evt;
+
+    UNUSED_PARAMETER(p_context);
+
+    memset(&evt, 0, sizeof(evt));
+    evt.evt_id = PM_EVT_PEERS_DELETE_SUCCEEDED;
+    evt.conn_handle = BLE_CONN_HANDLE_INVALID;
+    evt.peer_id = PM_PEER_ID_INVALID;
+    if (m_pm_handler != NULL)
+    {
+        m_pm_handler(&evt);
+    }
+}
+
+ret_code_t pm_init(void)
+{
+    ret_code_t err_code;
+
+    FAKE_CALL();
+
+    // The Peer Manager is who starts FDS
+    err_code = fds_register(pm_fds_evt_handler);
+    VERIFY_SUCCESS(err_code);
+
+    return fds_init();
+}
+
+ret_code_t pm_sec_params_set(ble_gap_sec_params_t *p_sec_params)
+{
+    UNUSED_PARAMETER(p_sec_params);
+    FAKE_CALL();
+
+    return NRF_SUCCESS;
+}
+
+ret_code_t pm_register(pm_evt_handler_t event_handler)
+{
+    FAKE_CALL();
+
+    m_pm_handler = event_handler;
+
+    return NRF_SUCCESS;
+}
+
+ret_code_t pm_peers_delete(void)
+{
+    FAKE_CALL();
+
+    UNUSED_RETURN_VALUE(fake_event_at(fake_time_ns(), FAKE_PRIO_SD_EVT,
+                                      pm_peers_deleted, NULL));
+
+    return NRF_SUCCESS;
+}
+
+ret_code_t pm_conn_handle_get(pm_peer_id_t peer_id, uint16_t *p_conn_handle)
+{
+    UNUSED_PARAMETER(peer_id);
+    FAKE_CALL();
+
+    *p_conn_handle = BLE_CONN_HANDLE_INVALID;
+
+    return NRF_SUCCESS;
+}
+
+void pm_conn_sec_config_reply(uint16_t              conn_handle,
+                              pm_conn_sec_config_t *p_conn_sec_config)
+{
+    UNUSED_PARAMETER(conn_handle);
+    UNUSED_PARAMETER(p_conn_sec_config);
+    FAKE_CALL();
+}
+
+ret_code_t pm_device_identities_list_set(pm_peer_id_t const *p_peers,
+                                         uint32_t            peer_cnt)
+{
+    UNUSED_PARAMETER(p_peers);
+    UNUSED_PARAMETER(peer_cnt);
+    FAKE_CALL();
+
+    // The SoftDevice resolves against the list while advertising
+    return m_adv.active ? BLE_ERROR_GAP_DEVICE_IDENTITIES_IN_USE : NRF_SUCCESS;
+}
+
+pm_peer_id_t pm_next_peer_id_get(pm_peer_id_t prev_peer_id)
+{
+    UNUSED_PARAMETER(prev_peer_id);
+    FAKE_CALL();
+
+    return PM_PEER_ID_INVALID;
+}
+
+ret_code_t pm_peer_data_app_data_load(pm_peer_id_t peer_id, void *p_data,
+                                      uint32_t *p_len)
+{
+    UNUSED_PARAMETER(peer_id);
+    UNUSED_PARAMETER(p_data);
+    UNUSED_PARAMETER(p_len);
+    FAKE_CALL();
+
+    return NRF_ERROR_NOT_FOUND;
+}
+
+ret_code_t pm_peer_data_app_data_store(pm_peer_id_t peer_id,
+                                       void const *p_data, uint32_t len,
+                                       void *p_token)
+{
+    UNUSED_PARAMETER(peer_id);
+    UNUSED_PARAMETER(p_data);
+    UNUSED_PARAMETER(len);
+    UNUSED_PARAMETER(p_token);
+    FAKE_CALL();
+
+    return NRF_ERROR_INVALID_PARAM;
+}
+
+ret_code_t pm_peer_data_bonding_load(pm_peer_id_t            peer_id,
+                                     pm_peer_data_bonding_t *p_data)
+{
+    UNUSED_PARAMETER(peer_id);
+    UNUSED_PARAMETER(p_data);
+    FAKE_CALL();
+
+    return NRF_ERROR_NOT_FOUND;
+}
+
+ret_code_t pm_peer_id_get(uint16_t conn_handle, pm_peer_id_t *p_peer_id)
+{
+    UNUSED_PARAMETER(conn_handle);
+    FAKE_CALL();
+
+    *p_peer_id = PM_PEER_ID_INVALID;
+
+    return NRF_SUCCESS;
+}
+
+ret_code_t pm_peer_rank_highest(pm_peer_id_t peer_id)
+{
+    UNUSED_PARAMETER(peer_id);
+    FAKE_CALL();
+
+    return NRF_ERROR_INVALID_PARAM;
+}
+
+ret_code_t pm_peer_ranks_get(pm_peer_id_t *p_highest_ranked_peer,
+                             uint32_t *    p_highest_rank,
+                             pm_peer_id_t *p_lowest_ranked_peer,
+                             uint32_t *    p_lowest_rank)
+{
+    UNUSED_PARAMETER(p_highest_rank);
+    UNUSED_PARAMETER(p_lowest_rank);
+    FAKE_CALL();
+
+    *p_highest_ranked_peer = PM_PEER_ID_INVALID;
+    *p_lowest_ranked_peer = PM_PEER_ID_INVALID;
+
+    return NRF_ERROR_NOT_FOUND;
+}
+
+ret_code_t pm_whitelist_get(ble_gap_addr_t *p_addrs, uint32_t *p_addr_cnt,
+                            ble_gap_irk_t *p_irks, uint32_t *p_irk_cnt)
+{
+    UNUSED_PARAMETER(p_addrs);
+    UNUSED_PARAMETER(p_irks);
+    FAKE_CALL();
+
+    *p_addr_cnt = 0;
+    *p_irk_cnt = 0;
+
+    return NRF_SUCCESS;
+}
+
+ret_code_t pm_whitelist_set(pm_peer_id_t const *p_peers, uint32_t peer_cnt)
+{
+    UNUSED_PARAMETER(p_peers);
+    UNUSED_PARAMETER(peer_cnt);
+    FAKE_CALL();
+
+    return m_adv.active ? BLE_ERROR_GAP_WHITELIST_IN_USE : NRF_SUCCESS;
+}
+
+// bsp.h, bsp_btn_ble.h. app_button hands a press over from an app_timer, so
+// it arrives through the scheduler.
+
+static void bsp_sched_handler(void *p_event_data, uint16_t event_size)
+{
+    UNUSED_PARAMETER(event_size);
+
+    if (m_bsp_callback != NULL)
+    {
+        m_bsp_callback(*(bsp_event_t const *)p_event_data);
+    }
+}
+
+static void bsp_button(void *p_context)
+{
+    bsp_event_t event = (bsp_event_t)(uintptr_t)p_context;
+    ret_code_t  err_code;
+
+    err_code = app_sched_event_put(&event, sizeof(event), bsp_sched_handler);
+    APP_ERROR_CHECK(err_code);
+}
+
+void fake_bsp_event(bsp_event_t event)
+{
+    UNUSED_RETURN_VALUE(fake_event_at(fake_time_ns(), FAKE_PRIO_RTC1,
+                                      bsp_button, (void *)(uintptr_t)event));
+}
+
+ret_code_t bsp_init(uint32_t type, bsp_event_callback_t callback)
+{
+    UNUSED_PARAMETER(type);
+    FAKE_CALL();
+
+    m_bsp_callback = callback;
+
+    return NRF_SUCCESS;
+}
+
+ret_code_t bsp_indication_set(bsp_indication_t indicate)
+{
+    UNUSED_PARAMETER(indicate);
+    FAKE_CALL();
+
+    return NRF_SUCCESS;
+}
+
+ret_code_t bsp_btn_ble_init(void (*error_handler)(uint32_t nrf_error),
+                            bsp_event_t *p_startup_bsp_evt)
+{
+    UNUSED_PARAMETER(error_handler);
+    FAKE_CALL();
+
+    if (p_startup_bsp_evt != NULL)
+    {
+        *p_startup_bsp_evt = BSP_EVENT_NOTHING;
+    }
+
+    return NRF_SUCCESS;
+}
+
+ret_code_t bsp_btn_ble_sleep_mode_prepare(void)
+{
+    FAKE_CALL();
+    return NRF_SUCCESS;
+}
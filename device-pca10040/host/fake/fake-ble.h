@@ -0,0 +1,781 @@
+/**
+ * Copyright (c) 2018 Keith Wakeham
+ *
+ * All rights reserved.
+ *
+ *
+ */
+
+#ifndef FAKE_BLE_H
+#define FAKE_BLE_H
+
+// Host stand-ins for the S132 API and the SDK BLE libraries: GAP and GATTS
+// types and calls, the SoftDevice handler, advertising, connection
+// parameters, connection state, the Queued Write and GATT modules, the Peer
+// Manager and the BSP. The fake SoftDevice in fake-ble.c keeps an attribute
+// table and a notification queue per link, the libraries around it do as
+// little as the firmware needs.
+
+#include "fake-sdk.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define BLE_CONN_HANDLE_INVALID 0xFFFF
+#define BLE_GATT_HANDLE_INVALID 0x0000
+
+#define BLE_ERROR_INVALID_CONN_HANDLE (NRF_ERROR_STK_BASE_NUM + 0x001)
+#define BLE_ERROR_INVALID_ATTR_HANDLE (NRF_ERROR_STK_BASE_NUM + 0x101)
+#define BLE_ERROR_GATTS_SYS_ATTR_MISSING (NRF_ERROR_STK_BASE_NUM + 0x401)
+#define BLE_ERROR_GAP_WHITELIST_IN_USE (NRF_ERROR_STK_BASE_NUM + 0x203)
+#define BLE_ERROR_GAP_DEVICE_IDENTITIES_IN_USE (NRF_ERROR_STK_BASE_NUM + 0x204)
+
+#define BLE_HCI_REMOTE_USER_TERMINATED_CONNECTION 0x13
+#define BLE_HCI_CONNECTION_TIMEOUT 0x08
+#define BLE_HCI_LOCAL_HOST_TERMINATED_CONNECTION 0x16
+
+// ble_types.h
+
+#define BLE_UUID_TYPE_UNKNOWN 0x00
+#define BLE_UUID_TYPE_BLE 0x01
+#define BLE_UUID_TYPE_VENDOR_BEGIN 0x02
+
+#define BLE_UUID_DESCRIPTOR_CLIENT_CHAR_CONFIG 0x2902
+
+typedef struct
+{
+    uint16_t uuid;
+    uint8_t  type;
+} ble_uuid_t;
+
+typedef struct
+{
+    uint8_t uuid128[16];
+} ble_uuid128_t;
+
+// ble_gap.h
+
+#define BLE_GAP_ROLE_INVALID 0x0
+#define BLE_GAP_ROLE_PERIPH 0x1
+
+#define BLE_GAP_PHY_AUTO 0x00
+
+#define BLE_GAP_IO_CAPS_NONE 0x03
+
+#define BLE_GAP_ADV_FLAGS_LE_ONLY_GENERAL_DISC_MODE 0x06
+
+#define BLE_GAP_WHITELIST_ADDR_MAX_COUNT 8
+
+#define BLE_GAP_ADV_SET_HANDLE_NOT_SET 0xFF
+
+typedef struct
+{
+    uint8_t sm : 4;
+    uint8_t lv : 4;
+} ble_gap_conn_sec_mode_t;
+
+#define BLE_GAP_CONN_SEC_MODE_SET_NO_ACCESS(ptr) \
+    do                                           \
+    {                                            \
+        (ptr)->sm = 0;                           \
+        (ptr)->lv = 0;                           \
+    } while (0)
+#define BLE_GAP_CONN_SEC_MODE_SET_OPEN(ptr) \
+    do                                      \
+    {                                       \
+        (ptr)->sm = 1;                      \
+        (ptr)->lv = 1;                      \
+    } while (0)
+
+typedef struct
+{
+    uint16_t min_conn_interval; // 1.25 ms units
+    uint16_t max_conn_interval; // 1.25 ms units
+    uint16_t slave_latency;
+    uint16_t conn_sup_timeout; // 10 ms units
+} ble_gap_conn_params_t;
+
+typedef struct
+{
+    uint8_t tx_phys;
+    uint8_t rx_phys;
+} ble_gap_phys_t;
+
+typedef struct
+{
+    uint8_t addr_id_peer : 1;
+    uint8_t addr_type : 7;
+    uint8_t addr[6];
+} ble_gap_addr_t;
+
+typedef struct
+{
+    uint8_t irk[16];
+} ble_gap_irk_t;
+
+typedef struct
+{
+    uint8_t enc : 1;
+    uint8_t id : 1;
+    uint8_t sign : 1;
+    uint8_t link : 1;
+} ble_gap_sec_kdist_t;
+
+typedef struct
+{
+    uint8_t             bond : 1;
+    uint8_t             mitm : 1;
+    uint8_t             lesc : 1;
+    uint8_t             keypress : 1;
+    uint8_t             io_caps : 3;
+    uint8_t             oob : 1;
+    uint8_t             min_key_size;
+    uint8_t             max_key_size;
+    ble_gap_sec_kdist_t kdist_own;
+    ble_gap_sec_kdist_t kdist_peer;
+} ble_gap_sec_params_t;
+
+typedef struct
+{
+    ble_gap_irk_t  id_info;
+    ble_gap_addr_t id_addr_info;
+} ble_gap_id_key_t;
+
+enum
+{
+    BLE_GAP_EVT_CONNECTED = 0x10,
+    BLE_GAP_EVT_DISCONNECTED = 0x11,
+    BLE_GAP_EVT_CONN_PARAM_UPDATE = 0x12,
+    BLE_GAP_EVT_PHY_UPDATE_REQUEST = 0x21,
+    BLE_GAP_EVT_PHY_UPDATE = 0x22,
+};
+
+typedef struct
+{
+    uint16_t conn_handle;
+    union
+    {
+        struct
+        {
+            ble_gap_addr_t        peer_addr;
+            uint8_t               role;
+            ble_gap_conn_params_t conn_params;
+            uint8_t               adv_handle;
+        } connected;
+        struct
+        {
+            uint8_t reason;
+        } disconnected;
+        struct
+        {
+            ble_gap_conn_params_t conn_params;
+        } conn_param_update;
+        struct
+        {
+            ble_gap_phys_t peer_preferred_phys;
+        } phy_update_request;
+    } params;
+} ble_gap_evt_t;
+
+ret_code_t sd_ble_gap_adv_stop(uint8_t adv_handle);
+ret_code_t sd_ble_gap_appearance_set(uint16_t appearance);
+ret_code_t sd_ble_gap_conn_param_update(
+    uint16_t conn_handle, ble_gap_conn_params_t const *p_conn_params);
+ret_code_t sd_ble_gap_device_name_set(
+    ble_gap_conn_sec_mode_t const *p_write_perm, uint8_t const *p_dev_name,
+    uint16_t len);
+ret_code_t sd_ble_gap_disconnect(uint16_t conn_handle, uint8_t hci_status_code);
+ret_code_t sd_ble_gap_phy_update(uint16_t              conn_handle,
+                                 ble_gap_phys_t const *p_gap_phys);
+ret_code_t sd_ble_gap_ppcp_set(ble_gap_conn_params_t const *p_conn_params);
+
+// ble_gatt.h, ble_gatts.h
+
+#define BLE_GATT_HVX_NOTIFICATION 0x01
+#define BLE_GATT_HVX_INDICATION 0x02
+
+#define BLE_GATTS_SRVC_TYPE_PRIMARY 0x01
+
+#define BLE_GATTS_VLOC_STACK 0x01
+#define BLE_GATTS_VLOC_USER 0x02
+
+#define BLE_GATT_OP_WRITE_REQ 0x01
+#define BLE_GATT_OP_WRITE_CMD 0x02
+
+typedef struct
+{
+    uint8_t broadcast : 1;
+    uint8_t read : 1;
+    uint8_t write_wo_resp : 1;
+    uint8_t write : 1;
+    uint8_t notify : 1;
+    uint8_t indicate : 1;
+    uint8_t auth_signed_wr : 1;
+} ble_gatt_char_props_t;
+
+typedef struct
+{
+    ble_gap_conn_sec_mode_t read_perm;
+    ble_gap_conn_sec_mode_t write_perm;
+    uint8_t                 vlen : 1;
+    uint8_t                 vloc : 2;
+    uint8_t                 rd_auth : 1;
+    uint8_t                 wr_auth : 1;
+} ble_gatts_attr_md_t;
+
+typedef struct
+{
+    ble_uuid_t const *         p_uuid;
+    ble_gatts_attr_md_t const *p_attr_md;
+    uint16_t                   init_len;
+    uint16_t                   init_offs;
+    uint16_t                   max_len;
+    uint8_t *                  p_value;
+} ble_gatts_attr_t;
+
+typedef struct
+{
+    ble_gatt_char_props_t      char_props;
+    uint8_t const *            p_char_user_desc;
+    uint16_t                   char_user_desc_max_size;
+    uint16_t                   char_user_desc_size;
+    void const *               p_char_pf;
+    ble_gatts_attr_md_t const *p_user_desc_md;
+    ble_gatts_attr_md_t const *p_cccd_md;
+    ble_gatts_attr_md_t const *p_sccd_md;
+} ble_gatts_char_md_t;
+
+typedef struct
+{
+    uint16_t value_handle;
+    uint16_t user_desc_handle;
+    uint16_t cccd_handle;
+    uint16_t sccd_handle;
+} ble_gatts_char_handles_t;
+
+typedef struct
+{
+    uint16_t       len;
+    uint16_t       offset;
+    uint8_t *      p_value;
+} ble_gatts_value_t;
+
+typedef struct
+{
+    uint16_t       handle;
+    uint8_t        type;
+    uint16_t       offset;
+    uint16_t *     p_len;
+    uint8_t const *p_data;
+} ble_gatts_hvx_params_t;
+
+enum
+{
+    BLE_GATTC_EVT_TIMEOUT = 0x3B,
+};
+
+enum
+{
+    BLE_GATTS_EVT_WRITE = 0x50,
+    BLE_GATTS_EVT_SYS_ATTR_MISSING = 0x52,
+    BLE_GATTS_EVT_HVC = 0x53,
+    BLE_GATTS_EVT_EXCHANGE_MTU_REQUEST = 0x55,
+    BLE_GATTS_EVT_TIMEOUT = 0x56,
+    BLE_GATTS_EVT_HVN_TX_COMPLETE = 0x57,
+};
+
+typedef struct
+{
+    uint16_t   handle;
+    ble_uuid_t uuid;
+    uint8_t    op;
+    uint8_t    auth_required;
+    uint16_t   offset;
+    uint16_t   len;
+    uint8_t    data[1]; // len bytes
+} ble_gatts_evt_write_t;
+
+typedef struct
+{
+    uint16_t conn_handle;
+    union
+    {
+        ble_gatts_evt_write_t write;
+        struct
+        {
+            uint16_t handle;
+        } hvc;
+        struct
+        {
+            uint8_t count;
+        } hvn_tx_complete;
+    } params;
+} ble_gatts_evt_t;
+
+typedef struct
+{
+    uint16_t conn_handle;
+} ble_gattc_evt_t;
+
+ret_code_t sd_ble_uuid_vs_add(ble_uuid128_t const *p_vs_uuid,
+                              uint8_t *            p_uuid_type);
+ret_code_t sd_ble_gatts_service_add(uint8_t type, ble_uuid_t const *p_uuid,
+                                    uint16_t *p_handle);
+ret_code_t sd_ble_gatts_characteristic_add(
+    uint16_t service_handle, ble_gatts_char_md_t const *p_char_md,
+    ble_gatts_attr_t const *p_attr_char_value,
+    ble_gatts_char_handles_t *p_handles);
+ret_code_t sd_ble_gatts_value_set(uint16_t conn_handle, uint16_t handle,
+                                  ble_gatts_value_t *p_value);
+ret_code_t sd_ble_gatts_value_get(uint16_t conn_handle, uint16_t handle,
+                                  ble_gatts_value_t *p_value);
+ret_code_t sd_ble_gatts_hvx(uint16_t                      conn_handle,
+                            ble_gatts_hvx_params_t const *p_hvx_params);
+
+// ble.h
+
+typedef struct
+{
+    uint16_t evt_id;
+    uint16_t evt_len;
+} ble_evt_hdr_t;
+
+typedef struct
+{
+    ble_evt_hdr_t header;
+    union
+    {
+        struct
+        {
+            uint16_t conn_handle;
+        } common_evt;
+        ble_gap_evt_t   gap_evt;
+        ble_gattc_evt_t gattc_evt;
+        ble_gatts_evt_t gatts_evt;
+    } evt;
+} __attribute__((aligned(4))) ble_evt_t;
+
+// nrf_sdh.h, nrf_sdh_ble.h. Observers are collected in a linker section like
+// on target, the GNU linker provides its bounds.
+
+typedef void (*nrf_sdh_ble_evt_handler_t)(ble_evt_t const *p_ble_evt,
+                                          void *           p_context);
+
+typedef struct
+{
+    nrf_sdh_ble_evt_handler_t handler;
+    void *                    p_context;
+    uint8_t                   prio;
+} nrf_sdh_ble_evt_observer_t;
+
+#define NRF_SDH_BLE_OBSERVER(_name, _prio, _handler, _context)          \
+    STATIC_ASSERT((_prio) < NRF_SDH_BLE_OBSERVER_PRIO_LEVELS);          \
+    static nrf_sdh_ble_evt_observer_t const _name                       \
+        __attribute__((section("fake_sdh_ble_observers"), used,         \
+                       aligned(sizeof(void *)))) = {                    \
+            .handler = (_handler),                                      \
+            .p_context = (_context),                                    \
+            .prio = (_prio)}
+
+ret_code_t nrf_sdh_enable_request(void);
+ret_code_t nrf_sdh_ble_default_cfg_set(uint8_t conn_cfg_tag,
+                                       uint32_t *p_ram_start);
+ret_code_t nrf_sdh_ble_enable(uint32_t *p_app_ram_start);
+
+// nrf_soc.h
+
+typedef enum
+{
+    NRF_RADIO_NOTIFICATION_DISTANCE_NONE = 0,
+    NRF_RADIO_NOTIFICATION_DISTANCE_800US,
+    NRF_RADIO_NOTIFICATION_DISTANCE_1740US,
+    NRF_RADIO_NOTIFICATION_DISTANCE_2680US,
+    NRF_RADIO_NOTIFICATION_DISTANCE_3620US,
+    NRF_RADIO_NOTIFICATION_DISTANCE_4560US,
+    NRF_RADIO_NOTIFICATION_DISTANCE_5500US
+} nrf_radio_notification_distance_t;
+
+ret_code_t sd_power_system_off(void);
+ret_code_t sd_power_ram_power_set(uint8_t index, uint32_t ram_powerset);
+
+// ble_radio_notification.h
+
+typedef void (*ble_radio_notification_evt_handler_t)(bool radio_active);
+
+ret_code_t ble_radio_notification_init(
+    uint32_t irq_priority, uint8_t distance,
+    ble_radio_notification_evt_handler_t evt_handler);
+
+// ble_srv_common.h
+
+#define BLE_CCCD_VALUE_LEN 2
+
+typedef void (*ble_srv_error_handler_t)(uint32_t nrf_error);
+
+typedef struct
+{
+    ble_gap_conn_sec_mode_t cccd_write_perm;
+    ble_gap_conn_sec_mode_t read_perm;
+    ble_gap_conn_sec_mode_t write_perm;
+} ble_srv_cccd_security_mode_t;
+
+static inline bool ble_srv_is_notification_enabled(
+    uint8_t const *p_encoded_data)
+{
+    return (uint16_decode(p_encoded_data) & BLE_GATT_HVX_NOTIFICATION) != 0;
+}
+
+// nrf_ble_gatt.h, nrf_ble_qwr.h
+
+typedef struct
+{
+    uint16_t att_mtu_desired_periph;
+} nrf_ble_gatt_t;
+
+typedef void (*nrf_ble_gatt_evt_handler_t)(nrf_ble_gatt_t *p_gatt,
+                                           void const *    p_evt);
+
+#define NRF_BLE_GATT_DEF(_name) static nrf_ble_gatt_t _name
+
+ret_code_t nrf_ble_gatt_init(nrf_ble_gatt_t *           p_gatt,
+                             nrf_ble_gatt_evt_handler_t evt_handler);
+
+typedef void (*nrf_ble_qwr_error_handler_t)(uint32_t nrf_error);
+
+typedef struct
+{
+    nrf_ble_qwr_error_handler_t error_handler;
+} nrf_ble_qwr_init_t;
+
+typedef struct
+{
+    uint16_t                    conn_handle;
+    nrf_ble_qwr_error_handler_t error_handler;
+} nrf_ble_qwr_t;
+
+#define NRF_BLE_QWRS_DEF(_name, _cnt) static nrf_ble_qwr_t _name[_cnt]
+
+ret_code_t nrf_ble_qwr_init(nrf_ble_qwr_t *           p_qwr,
+                            nrf_ble_qwr_init_t const *p_qwr_init);
+ret_code_t nrf_ble_qwr_conn_handle_assign(nrf_ble_qwr_t *p_qwr,
+                                          uint16_t       conn_handle);
+
+// ble_advdata.h, ble_advertising.h
+
+typedef enum
+{
+    BLE_ADVDATA_NO_NAME,
+    BLE_ADVDATA_SHORT_NAME,
+    BLE_ADVDATA_FULL_NAME
+} ble_advdata_name_type_t;
+
+typedef struct
+{
+    uint16_t    uuid_cnt;
+    ble_uuid_t *p_uuids;
+} ble_advdata_uuid_list_t;
+
+typedef struct
+{
+    ble_advdata_name_type_t name_type;
+    uint8_t                 short_name_len;
+    bool                    include_appearance;
+    uint8_t                 flags;
+    ble_advdata_uuid_list_t uuids_complete;
+} ble_advdata_t;
+
+typedef enum
+{
+    BLE_ADV_MODE_IDLE,
+    BLE_ADV_MODE_DIRECTED_HIGH_DUTY,
+    BLE_ADV_MODE_DIRECTED,
+    BLE_ADV_MODE_FAST,
+    BLE_ADV_MODE_SLOW,
+} ble_adv_mode_t;
+
+typedef enum
+{
+    BLE_ADV_EVT_IDLE,
+    BLE_ADV_EVT_DIRECTED_HIGH_DUTY,
+    BLE_ADV_EVT_DIRECTED,
+    BLE_ADV_EVT_FAST,
+    BLE_ADV_EVT_SLOW,
+    BLE_ADV_EVT_FAST_WHITELIST,
+    BLE_ADV_EVT_SLOW_WHITELIST,
+    BLE_ADV_EVT_WHITELIST_REQUEST,
+    BLE_ADV_EVT_PEER_ADDR_REQUEST,
+} ble_adv_evt_t;
+
+typedef struct
+{
+    bool     ble_adv_on_disconnect_disabled;
+    bool     ble_adv_whitelist_enabled;
+    bool     ble_adv_directed_high_duty_enabled;
+    bool     ble_adv_directed_enabled;
+    bool     ble_adv_fast_enabled;
+    bool     ble_adv_slow_enabled;
+    uint32_t ble_adv_directed_interval;
+    uint32_t ble_adv_directed_timeout;
+    uint32_t ble_adv_fast_interval;
+    uint32_t ble_adv_fast_timeout;
+    uint32_t ble_adv_slow_interval;
+    uint32_t ble_adv_slow_timeout;
+} ble_adv_modes_config_t;
+
+typedef void (*ble_adv_evt_handler_t)(ble_adv_evt_t const adv_evt);
+typedef void (*ble_adv_error_handler_t)(uint32_t nrf_error);
+
+typedef struct
+{
+    ble_advdata_t           advdata;
+    ble_advdata_t           srdata;
+    ble_adv_modes_config_t  config;
+    ble_adv_evt_handler_t   evt_handler;
+    ble_adv_error_handler_t error_handler;
+} ble_advertising_init_t;
+
+typedef struct
+{
+    bool                    initialized;
+    bool                    advertising;
+    ble_adv_mode_t          adv_mode_current;
+    ble_adv_modes_config_t  adv_modes_config;
+    uint8_t                 conn_cfg_tag;
+    uint8_t                 adv_handle;
+    uint16_t                current_slave_link_conn_handle;
+    bool                    whitelist_temporarily_disabled;
+    bool                    whitelist_in_use;
+    bool                    whitelist_reply_expected;
+    bool                    peer_addr_reply_expected;
+    bool                    peer_address_valid;
+    ble_adv_evt_handler_t   evt_handler;
+    ble_adv_error_handler_t error_handler;
+} ble_advertising_t;
+
+#define BLE_ADVERTISING_DEF(_name) static ble_advertising_t _name
+
+ret_code_t ble_advertising_init(ble_advertising_t *           p_advertising,
+                                ble_advertising_init_t const *p_init);
+void       ble_advertising_conn_cfg_tag_set(ble_advertising_t *p_advertising,
+                                            uint8_t            ble_cfg_tag);
+ret_code_t ble_advertising_start(ble_advertising_t *p_advertising,
+                                 ble_adv_mode_t     advertising_mode);
+ret_code_t ble_advertising_restart_without_whitelist(
+    ble_advertising_t *p_advertising);
+ret_code_t ble_advertising_whitelist_reply(
+    ble_advertising_t *p_advertising, ble_gap_addr_t const *p_gap_addrs,
+    uint32_t addr_cnt, ble_gap_irk_t const *p_gap_irks, uint32_t irk_cnt);
+ret_code_t ble_advertising_peer_addr_reply(ble_advertising_t *p_advertising,
+                                           ble_gap_addr_t *   p_peer_addr);
+
+// ble_conn_params.h
+
+typedef enum
+{
+    BLE_CONN_PARAMS_EVT_FAILED,
+    BLE_CONN_PARAMS_EVT_SUCCEEDED
+} ble_conn_params_evt_type_t;
+
+typedef struct
+{
+    ble_conn_params_evt_type_t evt_type;
+    uint16_t                   conn_handle;
+} ble_conn_params_evt_t;
+
+typedef void (*ble_conn_params_evt_handler_t)(ble_conn_params_evt_t *p_evt);
+
+typedef struct
+{
+    ble_gap_conn_params_t *       p_conn_params;
+    uint32_t                      first_conn_params_update_delay;
+    uint32_t                      next_conn_params_update_delay;
+    uint8_t                       max_conn_params_update_count;
+    uint16_t                      start_on_notify_cccd_handle;
+    bool                          disconnect_on_fail;
+    ble_conn_params_evt_handler_t evt_handler;
+    ble_srv_error_handler_t       error_handler;
+} ble_conn_params_init_t;
+
+ret_code_t ble_conn_params_init(ble_conn_params_init_t const *p_init);
+ret_code_t ble_conn_params_change_conn_params(
+    uint16_t conn_handle, ble_gap_conn_params_t *p_new_params);
+
+// ble_conn_state.h
+
+typedef void (*ble_conn_state_user_function_t)(uint16_t conn_handle,
+                                               void *   p_context);
+
+uint32_t ble_conn_state_for_each_connected(
+    ble_conn_state_user_function_t user_function, void *p_context);
+uint32_t ble_conn_state_peripheral_conn_count(void);
+uint8_t  ble_conn_state_role(uint16_t conn_handle);
+
+// peer_manager.h, without bonds. Every peer lookup comes back empty.
+
+typedef uint16_t pm_peer_id_t;
+
+#define PM_PEER_ID_INVALID 0xFFFF
+
+typedef enum
+{
+    PM_PEER_DATA_ID_BONDING = 7,
+    PM_PEER_DATA_ID_APPLICATION = 9,
+} pm_peer_data_id_t;
+
+typedef enum
+{
+    PM_CONN_SEC_PROCEDURE_ENCRYPTION,
+    PM_CONN_SEC_PROCEDURE_BONDING,
+    PM_CONN_SEC_PROCEDURE_PAIRING,
+} pm_conn_sec_procedure_t;
+
+typedef enum
+{
+    PM_EVT_BONDED_PEER_CONNECTED,
+    PM_EVT_CONN_SEC_START,
+    PM_EVT_CONN_SEC_SUCCEEDED,
+    PM_EVT_CONN_SEC_FAILED,
+    PM_EVT_CONN_SEC_CONFIG_REQ,
+    PM_EVT_CONN_SEC_PARAMS_REQ,
+    PM_EVT_STORAGE_FULL,
+    PM_EVT_ERROR_UNEXPECTED,
+    PM_EVT_PEER_DATA_UPDATE_SUCCEEDED,
+    PM_EVT_PEER_DATA_UPDATE_FAILED,
+    PM_EVT_PEER_DELETE_SUCCEEDED,
+    PM_EVT_PEER_DELETE_FAILED,
+    PM_EVT_PEERS_DELETE_SUCCEEDED,
+    PM_EVT_PEERS_DELETE_FAILED,
+    PM_EVT_LOCAL_DB_CACHE_APPLIED,
+    PM_EVT_LOCAL_DB_CACHE_APPLY_FAILED,
+    PM_EVT_SERVICE_CHANGED_IND_SENT,
+    PM_EVT_SERVICE_CHANGED_IND_CONFIRMED,
+} pm_evt_id_t;
+
+typedef struct
+{
+    pm_evt_id_t  evt_id;
+    uint16_t     conn_handle;
+    pm_peer_id_t peer_id;
+    union
+    {
+        struct
+        {
+            pm_conn_sec_procedure_t procedure;
+        } conn_sec_succeeded;
+        struct
+        {
+            pm_peer_data_id_t data_id;
+            bool              flash_changed;
+        } peer_data_update_succeeded;
+        struct
+        {
+            ret_code_t error;
+        } peer_data_update_failed;
+        struct
+        {
+            ret_code_t error;
+        } peer_delete_failed;
+        struct
+        {
+            ret_code_t error;
+        } peers_delete_failed_evt;
+        struct
+        {
+            ret_code_t error;
+        } error_unexpected;
+    } params;
+} pm_evt_t;
+
+typedef void (*pm_evt_handler_t)(pm_evt_t const *p_event);
+
+typedef struct
+{
+    bool allow_repairing;
+} pm_conn_sec_config_t;
+
+typedef struct
+{
+    ble_gap_id_key_t peer_ble_id;
+} pm_peer_data_bonding_t;
+
+ret_code_t pm_init(void);
+ret_code_t pm_sec_params_set(ble_gap_sec_params_t *p_sec_params);
+ret_code_t pm_register(pm_evt_handler_t event_handler);
+ret_code_t pm_peers_delete(void);
+ret_code_t pm_conn_handle_get(pm_peer_id_t peer_id, uint16_t *p_conn_handle);
+void       pm_conn_sec_config_reply(uint16_t              conn_handle,
+                                    pm_conn_sec_config_t *p_conn_sec_config);
+ret_code_t pm_device_identities_list_set(pm_peer_id_t const *p_peers,
+                                         uint32_t            peer_cnt);
+pm_peer_id_t pm_next_peer_id_get(pm_peer_id_t prev_peer_id);
+ret_code_t   pm_peer_data_app_data_load(pm_peer_id_t peer_id, void *p_data,
+                                        uint32_t *p_len);
+ret_code_t   pm_peer_data_app_data_store(pm_peer_id_t peer_id,
+                                         void const *p_data, uint32_t len,
+                                         void *p_token);
+ret_code_t   pm_peer_data_bonding_load(pm_peer_id_t            peer_id,
+                                       pm_peer_data_bonding_t *p_data);
+ret_code_t   pm_peer_id_get(uint16_t conn_handle, pm_peer_id_t *p_peer_id);
+ret_code_t   pm_peer_rank_highest(pm_peer_id_t peer_id);
+ret_code_t   pm_peer_ranks_get(pm_peer_id_t *p_highest_ranked_peer,
+                               uint32_t *    p_highest_rank,
+                               pm_peer_id_t *p_lowest_ranked_peer,
+                               uint32_t *    p_lowest_rank);
+ret_code_t   pm_whitelist_get(ble_gap_addr_t *p_addrs, uint32_t *p_addr_cnt,
+                              ble_gap_irk_t *p_irks, uint32_t *p_irk_cnt);
+ret_code_t   pm_whitelist_set(pm_peer_id_t const *p_peers, uint32_t peer_cnt);
+
+// bsp.h, bsp_btn_ble.h
+
+#define BSP_INIT_LEDS (1 << 0)
+#define BSP_INIT_BUTTONS (1 << 1)
+
+typedef enum
+{
+    BSP_EVENT_NOTHING = 0,
+    BSP_EVENT_DEFAULT,
+    BSP_EVENT_CLEAR_BONDING_DATA,
+    BSP_EVENT_CLEAR_ALERT,
+    BSP_EVENT_DISCONNECT,
+    BSP_EVENT_ADVERTISING_START,
+    BSP_EVENT_ADVERTISING_STOP,
+    BSP_EVENT_WHITELIST_OFF,
+    BSP_EVENT_BOND,
+    BSP_EVENT_RESET,
+    BSP_EVENT_SLEEP,
+    BSP_EVENT_WAKEUP,
+    BSP_EVENT_SYSOFF,
+    BSP_EVENT_DFU,
+    BSP_EVENT_KEY_0,
+    BSP_EVENT_KEY_1,
+    BSP_EVENT_KEY_2,
+    BSP_EVENT_KEY_3,
+} bsp_event_t;
+
+typedef enum
+{
+    BSP_INDICATE_IDLE,
+    BSP_INDICATE_SCANNING,
+    BSP_INDICATE_ADVERTISING,
+    BSP_INDICATE_ADVERTISING_WHITELIST,
+    BSP_INDICATE_ADVERTISING_SLOW,
+    BSP_INDICATE_ADVERTISING_DIRECTED,
+    BSP_INDICATE_BONDING,
+    BSP_INDICATE_CONNECTED,
+} bsp_indication_t;
+
+typedef void (*bsp_event_callback_t)(bsp_event_t event);
+
+ret_code_t bsp_init(uint32_t type, bsp_event_callback_t callback);
+ret_code_t bsp_indication_set(bsp_indication_t indicate);
+ret_code_t bsp_btn_ble_init(void (*error_handler)(uint32_t nrf_error),
+                            bsp_event_t *p_startup_bsp_evt);
+ret_code_t bsp_btn_ble_sleep_mode_prepare(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // FAKE_BLE_H
@@ -0,0 +1,93 @@
+/**
+ * Copyright (c) 2018 Keith Wakeham
+ *
+ * All rights reserved.
+ *
+ *
+ */
+
+// A central on top of fake-ble.c that talks to the steering service the way
+// Zwift does: it connects at a fixed interval, subscribes to the steering
+// characteristic and answers the 0x0310 challenge with 0x0311. Every write
+// is followed by 20 ms on the clock, the firmware has taken it by then.
+
+#include <math.h>
+
+#include "ble_cus.h"
+#include "fake.h"
+#include "params.h"
+
+#define WRITE_SETTLE_NS (20 * FAKE_NS_PER_MS)
+#define CONNECT_SETTLE_NS (100 * FAKE_NS_PER_MS)
+
+bool fake_central_write(uint16_t conn_handle, uint16_t handle,
+                        uint8_t const *p_data, uint16_t len)
+{
+    bool taken = fake_ble_write(conn_handle, handle, p_data, len);
+
+    fake_run_for(WRITE_SETTLE_NS);
+
+    return taken;
+}
+
+uint16_t fake_central_connect(double interval_ms)
+{
+    uint16_t const interval =
+        (uint16_t)lround(interval_ms * 1000 / UNIT_1_25_MS);
+    ble_gap_conn_params_t const params = {
+        .min_conn_interval = interval,
+        .max_conn_interval = interval,
+        .slave_latency = 0,
+        .conn_sup_timeout = MSEC_TO_UNITS(4000, UNIT_10_MS),
+    };
+    uint16_t conn_handle = fake_ble_connect(&params);
+
+    if (conn_handle != BLE_CONN_HANDLE_INVALID)
+    {
+        fake_run_for(CONNECT_SETTLE_NS);
+    }
+
+    return conn_handle;
+}
+
+bool fake_central_param_set(uint16_t conn_handle, uint8_t id, uint16_t value)
+{
+    uint8_t const op[] = {PARAMS_OP_SET, id, (uint8_t)value,
+                          (uint8_t)(value >> 8)};
+    uint8_t       answer[PARAMS_ENCODED_MAX];
+    uint16_t      handle = fake_ble_value_handle(CONFIG_CHAR_UUID);
+
+    fake_central_write(conn_handle, handle, op, sizeof(op));
+
+    // Status of the batch first
+    return fake_ble_read(conn_handle, handle, answer, sizeof(answer)) > 0 &&
+           answer[0] == NRF_SUCCESS;
+}
+
+void fake_central_subscribe(uint16_t conn_handle, bool enable)
+{
+    uint8_t const cccd[] = {enable ? BLE_GATT_HVX_NOTIFICATION : 0x00, 0x00};
+
+    fake_central_write(conn_handle, fake_ble_cccd_handle(STEERER_CHAR_UUID),
+                       cccd, sizeof(cccd));
+}
+
+void fake_central_handshake(uint16_t conn_handle)
+{
+    uint8_t const indicate[] = {BLE_GATT_HVX_INDICATION, 0x00};
+    uint8_t const challenge[] = {0x03, 0x10, 0x12, 0x34};
+    uint8_t const reply[] = {0x03, 0x11, 0xff, 0xff};
+
+    fake_central_write(conn_handle, fake_ble_cccd_handle(TX_CHAR_UUID),
+                       indicate, sizeof(indicate));
+    fake_central_write(conn_handle, fake_ble_value_handle(RX_CHAR_UUID),
+                       challenge, sizeof(challenge));
+    fake_central_write(conn_handle, fake_ble_value_handle(RX_CHAR_UUID), reply,
+                       sizeof(reply));
+}
+
+void fake_central_start(uint16_t conn_handle)
+{
+    fake_central_subscribe(conn_handle, true);
+    fake_central_handshake(conn_handle);
+}
@@ -0,0 +1,430 @@
+/**
+ * Copyright (c) 2018 Keith Wakeham
+ *
+ * All rights reserved.
+ *
+ *
+ */
+
+// Virtual time: the event queue, RTC1 and app_timer on top of it, and the
+// firmware's own stack it sleeps on.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <ucontext.h>
+
+#include "fake.h"
+
+#define FAKE_EVENT_MAX 128
+
+// The firmware stack, bigger than on target since host frames are
+#define FAKE_STACK_SIZE 0x10000
+
+#define STRINGIFY_(x) #x
+#define STRINGIFY(x) STRINGIFY_(x)
+
+typedef struct
+{
+    uint64_t             at_ns;
+    uint32_t             id; // 0 for a free slot
+    uint32_t             seq;
+    uint8_t              prio;
+    fake_event_handler_t handler;
+    void *               p_context;
+} fake_event_t;
+
+NRF_TIMER_Type fake_timer1;
+NRF_RTC_Type   fake_rtc1;
+
+static fake_event_t m_events[FAKE_EVENT_MAX];
+static uint32_t     m_next_id = 1;
+static uint32_t     m_next_seq;
+static uint64_t     m_now_ns;
+static uint64_t     m_cpu_ns[FAKE_PRIO_HOST + 1];
+
+uint32_t fake_stack[FAKE_STACK_SIZE / sizeof(uint32_t)]
+    __attribute__((aligned(16)));
+
+// diag.c paints and measures the stack between these, like the linker script
+// symbols on target
+__asm__(".globl __StackLimit\n"
+        ".set __StackLimit, fake_stack\n"
+        ".globl __StackTop\n"
+        ".set __StackTop, fake_stack + " STRINGIFY(FAKE_STACK_SIZE) "\n");
+
+static ucontext_t m_host_context;
+static ucontext_t m_firmware_context;
+static bool       m_in_firmware;
+static bool       m_system_off;
+static uint64_t   m_until_ns;
+
+int firmware_main(void);
+
+uint64_t fake_lfclk_ticks(uint64_t ns)
+{
+    return (ns / FAKE_NS_PER_S) * APP_TIMER_CLOCK_FREQ +
+           ((ns % FAKE_NS_PER_S) * APP_TIMER_CLOCK_FREQ) / FAKE_NS_PER_S;
+}
+
+uint64_t fake_lfclk_ns(uint64_t ticks)
+{
+    return (ticks / APP_TIMER_CLOCK_FREQ) * FAKE_NS_PER_S +
+           ((ticks % APP_TIMER_CLOCK_FREQ) * FAKE_NS_PER_S +
+            APP_TIMER_CLOCK_FREQ - 1) /
+               APP_TIMER_CLOCK_FREQ;
+}
+
+static void time_set(uint64_t now_ns)
+{
+    m_now_ns = now_ns;
+    fake_rtc1.COUNTER =
+        (uint32_t)fake_lfclk_ticks(now_ns) & RTC_COUNTER_COUNTER_Msk;
+    // TIMER1 free runs at 1 MHz from boot until stopped, diag.c only
+    // captures it
+    if (!fake_timer1.TASKS_STOP)
+    {
+        fake_timer1.CC[0] = (uint32_t)(now_ns / FAKE_NS_PER_US);
+    }
+}
+
+uint64_t fake_time_ns(void) { return m_now_ns; }
+
+uint32_t fake_event_at(uint64_t at_ns, uint8_t prio,
+                       fake_event_handler_t handler, void *p_context)
+{
+    for (uint32_t i = 0; i < FAKE_EVENT_MAX; i++)
+    {
+        fake_event_t *p_event = &m_events[i];
+
+        if (p_event->id != 0)
+        {
+            continue;
+        }
+        p_event->at_ns = MAX(at_ns, m_now_ns);
+        p_event->id = m_next_id++;
+        p_event->seq = m_next_seq++;
+        p_event->prio = prio;
+        p_event->handler = handler;
+        p_event->p_context = p_context;
+        if (m_next_id == 0)
+        {
+            m_next_id = 1;
+        }
+        return p_event->id;
+    }
+
+    fprintf(stderr, "fake: more than %d pending events\n", FAKE_EVENT_MAX);
+    abort();
+}
+
+void fake_event_cancel(uint32_t id)
+{
+    for (uint32_t i = 0; i < FAKE_EVENT_MAX && id != 0; i++)
+    {
+        if (m_events[i].id == id)
+        {
+            m_events[i].id = 0;
+            return;
+        }
+    }
+}
+
+// Events that fell due while the CPU was busy are pending and count as due
+// now, among those the priority decides like in the NVIC
+static fake_event_t *event_next(void)
+{
+    fake_event_t *p_next = NULL;
+    uint64_t      next_ns = 0;
+
+    for (uint32_t i = 0; i < FAKE_EVENT_MAX; i++)
+    {
+        fake_event_t *p_event = &m_events[i];
+        uint64_t      at_ns = MAX(p_event->at_ns, m_now_ns);
+
+        if (p_event->id == 0)
+        {
+            continue;
+        }
+        if (p_next == NULL || at_ns < next_ns ||
+            (at_ns == next_ns &&
+             (p_event->prio < p_next->prio ||
+              (p_event->prio == p_next->prio &&
+               (int32_t)(p_event->seq - p_next->seq) < 0))))
+        {
+            p_next = p_event;
+            next_ns = at_ns;
+        }
+    }
+
+    return p_next;
+}
+
+bool fake_run_next(void)
+{
+    fake_event_t *p_next = event_next();
+    fake_event_t  event;
+
+    if (p_next == NULL)
+    {
+        return false;
+    }
+
+    // Freed first, the handler may add events
+    event = *p_next;
+    p_next->id = 0;
+
+    time_set(MAX(event.at_ns, m_now_ns));
+    event.handler(event.p_context);
+    // Runs to completion, whatever falls due meanwhile waits for it
+    if (event.prio <= FAKE_PRIO_HOST && m_cpu_ns[event.prio] > 0)
+    {
+        time_set(m_now_ns + m_cpu_ns[event.prio]);
+    }
+
+    return true;
+}
+
+void fake_cpu_time_set(uint8_t prio, uint64_t ns)
+{
+    if (prio <= FAKE_PRIO_HOST)
+    {
+        m_cpu_ns[prio] = ns;
+    }
+}
+
+// Firmware context
+
+static void firmware_entry(void)
+{
+    firmware_main();
+
+    fprintf(stderr, "fake: firmware_main returned\n");
+    abort();
+}
+
+static void firmware_resume(void)
+{
+    m_in_firmware = true;
+    swapcontext(&m_host_context, &m_firmware_context);
+    m_in_firmware = false;
+
+    if (!m_system_off && m_until_ns > m_now_ns)
+    {
+        time_set(m_until_ns);
+    }
+}
+
+void fake_firmware_boot(void)
+{
+    getcontext(&m_firmware_context);
+    m_firmware_context.uc_stack.ss_sp = fake_stack;
+    m_firmware_context.uc_stack.ss_size = sizeof(fake_stack);
+    m_firmware_context.uc_link = NULL;
+    makecontext(&m_firmware_context, firmware_entry, 0);
+
+    m_until_ns = m_now_ns;
+    firmware_resume();
+}
+
+void fake_run_until(uint64_t at_ns)
+{
+    if (m_system_off)
+    {
+        return;
+    }
+    m_until_ns = at_ns;
+    firmware_resume();
+}
+
+void fake_run_for(uint64_t ns) { fake_run_until(m_now_ns + ns); }
+
+bool fake_system_off(void) { return m_system_off; }
+
+uintptr_t __get_MSP(void) { return (uintptr_t)__builtin_frame_address(0); }
+
+// nrf_pwr_mgmt.h, nrf_delay.h
+
+ret_code_t nrf_pwr_mgmt_init(void)
+{
+    FAKE_CALL();
+    return NRF_SUCCESS;
+}
+
+void nrf_pwr_mgmt_run(void)
+{
+    fake_event_t const *p_next = event_next();
+
+    FAKE_CALL();
+
+    if (!m_in_firmware)
+    {
+        // A host program calling modules directly
+        UNUSED_RETURN_VALUE(fake_run_next());
+        return;
+    }
+    if (p_next != NULL && p_next->at_ns <= m_until_ns)
+    {
+        UNUSED_RETURN_VALUE(fake_run_next());
+        return;
+    }
+
+    // Nothing due before the host wants control back, main loop resumes
+    // from here on the next fake_run_until()
+    swapcontext(&m_firmware_context, &m_host_context);
+}
+
+void nrf_delay_us(uint32_t us)
+{
+    FAKE_CALL();
+    time_set(m_now_ns + us * FAKE_NS_PER_US);
+}
+
+// nrf_soc.h
+
+ret_code_t sd_power_system_off(void)
+{
+    FAKE_CALL();
+
+    m_system_off = true;
+    if (m_in_firmware)
+    {
+        // Never resumed
+        swapcontext(&m_firmware_context, &m_host_context);
+    }
+
+    return NRF_SUCCESS;
+}
+
+// app_timer.h
+
+static void timer_expired(void *p_context);
+
+static void timer_schedule(app_timer_t *p_timer)
+{
+    p_timer->event = fake_event_at(fake_lfclk_ns(p_timer->expiry),
+                                   FAKE_PRIO_RTC1, timer_expired, p_timer);
+}
+
+static void timer_sched_handler(void *p_event_data, uint16_t event_size)
+{
+    app_timer_event_t const *p_timer_event = p_event_data;
+
+    UNUSED_PARAMETER(event_size);
+
+    p_timer_event->timeout_handler(p_timer_event->p_context);
+}
+
+static void timer_expired(void *p_context)
+{
+    app_timer_t *     p_timer = p_context;
+    app_timer_event_t timer_event;
+    ret_code_t        err_code;
+
+    p_timer->event = 0;
+    if (p_timer->mode == APP_TIMER_MODE_REPEATED)
+    {
+        // From the previous expiry, a late run does not drift
+        p_timer->expiry += p_timer->period;
+        timer_schedule(p_timer);
+    }
+
+    timer_event.timeout_handler = p_timer->handler;
+    timer_event.p_context = p_timer->p_context;
+
+#if APP_TIMER_CONFIG_USE_SCHEDULER
+    err_code = app_sched_event_put(&timer_event, sizeof(timer_event),
+                                   timer_sched_handler);
+    APP_ERROR_CHECK(err_code);
+#else
+    UNUSED_VARIABLE(err_code);
+    timer_sched_handler(&timer_event, sizeof(timer_event));
+#endif
+}
+
+ret_code_t app_timer_init(void)
+{
+    FAKE_CALL();
+    return NRF_SUCCESS;
+}
+
+ret_code_t app_timer_create(app_timer_id_t const *     p_timer_id,
+                            app_timer_mode_t            mode,
+                            app_timer_timeout_handler_t timeout_handler)
+{
+    app_timer_t *p_timer = *p_timer_id;
+
+    FAKE_CALL();
+
+    if (timeout_handler == NULL)
+    {
+        return NRF_ERROR_INVALID_PARAM;
+    }
+    if (p_timer->event != 0)
+    {
+        return NRF_ERROR_INVALID_STATE;
+    }
+    p_timer->handler = timeout_handler;
+    p_timer->mode = mode;
+
+    return NRF_SUCCESS;
+}
+
+ret_code_t app_timer_start(app_timer_id_t timer_id, uint32_t timeout_ticks,
+                           void *p_context)
+{
+    FAKE_CALL();
+
+    if (timeout_ticks < APP_TIMER_MIN_TIMEOUT_TICKS)
+    {
+        return NRF_ERROR_INVALID_PARAM;
+    }
+    if (timer_id->handler == NULL)
+    {
+        return NRF_ERROR_INVALID_STATE;
+    }
+    if (timer_id->event != 0)
+    {
+        // Like the SDK, a running timer keeps going, stop it first to restart
+        return NRF_SUCCESS;
+    }
+
+    timer_id->p_context = p_context;
+    timer_id->period = timeout_ticks;
+    timer_id->expiry = fake_lfclk_ticks(m_now_ns) + timeout_ticks;
+    timer_schedule(timer_id);
+
+    return NRF_SUCCESS;
+}
+
+ret_code_t app_timer_stop(app_timer_id_t timer_id)
+{
+    FAKE_CALL();
+
+    fake_event_cancel(timer_id->event);
+    timer_id->event = 0;
+
+    return NRF_SUCCESS;
+}
+
+ret_code_t app_timer_stop_all(void)
+{
+    FAKE_CALL();
+
+    for (uint32_t i = 0; i < FAKE_EVENT_MAX; i++)
+    {
+        if (m_events[i].id != 0 && m_events[i].handler == timer_expired)
+        {
+            ((app_timer_t *)m_events[i].p_context)->event = 0;
+            m_events[i].id = 0;
+        }
+    }
+
+    return NRF_SUCCESS;
+}
+
+uint32_t app_timer_cnt_get(void) { return fake_rtc1.COUNTER; }
+
+uint32_t app_timer_cnt_diff_compute(uint32_t ticks_to, uint32_t ticks_from)
+{
+    return (ticks_to - ticks_from) & RTC_COUNTER_COUNTER_Msk;
+}
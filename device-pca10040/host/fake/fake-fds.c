@@ -0,0 +1,318 @@
+/**
+ * Copyright (c) 2018 Keith Wakeham
+ *
+ * All rights reserved.
+ *
+ *
+ */
+
+// Flash Data Storage in RAM. Operations queue up to FDS_OP_QUEUE_SIZE and
+// run one at a time, taking about as long as the flash would. Like FDS the
+// data is only read when the operation runs, so the caller keeps it until
+// the event. Space is accounted in words including the records an update
+// left behind, which only garbage collection gives back.
+
+#include "fake-fds.h"
+#include "fake.h"
+
+#define RECORDS_MAX 32
+#define RECORD_WORDS_MAX 128
+#define HEADER_WORDS 3
+#define USERS_MAX FDS_MAX_USERS
+
+// One page is kept for garbage collection, each page has a two word header
+#define FLASH_WORDS \
+    ((FDS_VIRTUAL_PAGES - 1) * (FDS_VIRTUAL_PAGE_SIZE - 2))
+
+#define WRITE_BASE_NS (100 * FAKE_NS_PER_US)
+#define WRITE_WORD_NS (42 * FAKE_NS_PER_US)
+#define GC_NS (85 * FAKE_NS_PER_MS)
+
+typedef struct
+{
+    bool         in_use;
+    fds_header_t header;
+    uint32_t     data[RECORD_WORDS_MAX];
+} record_t;
+
+typedef struct
+{
+    fds_evt_id_t id;
+    uint32_t     index; // record an update replaces
+    uint32_t     record_id;
+    fds_record_t record;
+} op_t;
+
+static record_t m_records[RECORDS_MAX];
+static uint32_t m_next_record_id = 1;
+static uint32_t m_words_used;
+static uint32_t m_words_dirty;
+
+static fds_cb_t m_users[USERS_MAX];
+static uint8_t  m_user_count;
+
+static bool     m_initialized;
+static op_t     m_ops[FDS_OP_QUEUE_SIZE];
+static uint8_t  m_op_head;
+static uint8_t  m_op_count;
+static uint32_t m_op_event;
+
+static void event_send(fds_evt_t const *p_evt)
+{
+    for (uint8_t i = 0; i < m_user_count; i++)
+    {
+        m_users[i](p_evt);
+    }
+}
+
+static void init_done(void *p_context)
+{
+    fds_evt_t evt = {.id = FDS_EVT_INIT, .result = NRF_SUCCESS};
+
+    UNUSED_PARAMETER(p_context);
+
+    m_initialized = true;
+    event_send(&evt);
+}
+
+static void op_next(void);
+
+static void op_done(void *p_context)
+{
+    op_t *    p_op = &m_ops[m_op_head];
+    fds_evt_t evt;
+
+    UNUSED_PARAMETER(p_context);
+
+    memset(&evt, 0, sizeof(evt));
+    evt.id = p_op->id;
+    evt.result = NRF_SUCCESS;
+
+    if (p_op->id == FDS_EVT_GC)
+    {
+        m_words_used -= m_words_dirty;
+        m_words_dirty = 0;
+    }
+    else
+    {
+        record_t *p_record = NULL;
+        uint32_t  words = p_op->record.data.length_words;
+
+        for (uint32_t i = 0; i < RECORDS_MAX && p_record == NULL; i++)
+        {
+            if (!m_records[i].in_use)
+            {
+                p_record = &m_records[i];
+            }
+        }
+        if (p_record == NULL)
+        {
+            evt.result = FDS_ERR_NO_SPACE_IN_FLASH;
+        }
+        else
+        {
+            if (p_op->id == FDS_EVT_UPDATE &&
+                m_records[p_op->index].in_use &&
+                m_records[p_op->index].header.record_id == p_op->record_id)
+            {
+                // The old copy stays in flash until garbage collection
+                m_records[p_op->index].in_use = false;
+                m_words_dirty +=
+                    HEADER_WORDS + m_records[p_op->index].header.length_words;
+            }
+            p_record->in_use = true;
+            p_record->header.file_id = p_op->record.file_id;
+            p_record->header.record_key = p_op->record.key;
+            p_record->header.length_words = (uint16_t)words;
+            p_record->header.record_id = m_next_record_id++;
+            memcpy(p_record->data, p_op->record.data.p_data,
+                   words * sizeof(uint32_t));
+
+            evt.write.record_id = p_record->header.record_id;
+            evt.write.file_id = p_record->header.file_id;
+            evt.write.record_key = p_record->header.record_key;
+            evt.write.is_record_updated = p_op->id == FDS_EVT_UPDATE;
+        }
+    }
+
+    m_op_event = 0;
+    m_op_head = (m_op_head + 1) % FDS_OP_QUEUE_SIZE;
+    m_op_count--;
+    op_next();
+
+    event_send(&evt);
+}
+
+static void op_next(void)
+{
+    op_t const *p_op = &m_ops[m_op_head];
+    uint64_t    duration;
+
+    if (m_op_event != 0 || m_op_count == 0)
+    {
+        return;
+    }
+
+    if (p_op->id == FDS_EVT_GC)
+    {
+        duration = GC_NS;
+    }
+    else
+    {
+        duration = WRITE_BASE_NS +
+                   (HEADER_WORDS + p_op->record.data.length_words) *
+                       WRITE_WORD_NS;
+    }
+    // FDS events come through the SoftDevice's SoC event handler
+    m_op_event = fake_event_at(fake_time_ns() + duration, FAKE_PRIO_SD_EVT,
+                               op_done, NULL);
+}
+
+static ret_code_t op_queue(fds_evt_id_t id, fds_record_desc_t const *p_desc,
+                           fds_record_t const *p_record)
+{
+    op_t *p_op;
+
+    if (!m_initialized)
+    {
+        return FDS_ERR_NOT_INITIALIZED;
+    }
+    if (m_op_count >= FDS_OP_QUEUE_SIZE)
+    {
+        return FDS_ERR_NO_SPACE_IN_QUEUES;
+    }
+    if (p_record != NULL)
+    {
+        uint32_t words = HEADER_WORDS + p_record->data.length_words;
+
+        if (p_record->data.length_words > RECORD_WORDS_MAX)
+        {
+            return FDS_ERR_RECORD_TOO_LARGE;
+        }
+        if (m_words_used + words > FLASH_WORDS)
+        {
+            return FDS_ERR_NO_SPACE_IN_FLASH;
+        }
+        // Reserved now like FDS does
+        m_words_used += words;
+    }
+
+    p_op = &m_ops[(m_op_head + m_op_count) % FDS_OP_QUEUE_SIZE];
+    p_op->id = id;
+    p_op->index = (p_desc != NULL) ? p_desc->index : 0;
+    p_op->record_id = (p_desc != NULL) ? p_desc->record_id : 0;
+    if (p_record != NULL)
+    {
+        p_op->record = *p_record;
+    }
+    m_op_count++;
+    op_next();
+
+    return NRF_SUCCESS;
+}
+
+ret_code_t fds_register(fds_cb_t cb)
+{
+    FAKE_CALL();
+
+    if (m_user_count >= USERS_MAX)
+    {
+        return FDS_ERR_USER_LIMIT_REACHED;
+    }
+    m_users[m_user_count++] = cb;
+
+    return NRF_SUCCESS;
+}
+
+ret_code_t fds_init(void)
+{
+    FAKE_CALL();
+
+    UNUSED_RETURN_VALUE(
+        fake_event_at(fake_time_ns(), FAKE_PRIO_SD_EVT, init_done, NULL));
+
+    return NRF_SUCCESS;
+}
+
+ret_code_t fds_record_find(uint16_t file_id, uint16_t record_key,
+                           fds_record_desc_t *p_desc,
+                           fds_find_token_t * p_token)
+{
+    FAKE_CALL();
+
+    if (!m_initialized)
+    {
+        return FDS_ERR_NOT_INITIALIZED;
+    }
+
+    for (uint32_t i = p_token->index; i < RECORDS_MAX; i++)
+    {
+        record_t const *p_record = &m_records[i];
+
+        if (p_record->in_use && p_record->header.file_id == file_id &&
+            p_record->header.record_key == record_key)
+        {
+            p_desc->record_id = p_record->header.record_id;
+            p_desc->index = i;
+            p_token->index = i + 1;
+            return NRF_SUCCESS;
+        }
+    }
+
+    return FDS_ERR_NOT_FOUND;
+}
+
+ret_code_t fds_record_open(fds_record_desc_t *const  p_desc,
+                           fds_flash_record_t *const p_flash_record)
+{
+    record_t const *p_record = &m_records[p_desc->index];
+
+    FAKE_CALL();
+
+    if (!p_record->in_use || p_record->header.record_id != p_desc->record_id)
+    {
+        return FDS_ERR_NOT_FOUND;
+    }
+    p_flash_record->p_header = &p_record->header;
+    p_flash_record->p_data = p_record->data;
+
+    return NRF_SUCCESS;
+}
+
+ret_code_t fds_record_close(fds_record_desc_t *const p_desc)
+{
+    UNUSED_PARAMETER(p_desc);
+    FAKE_CALL();
+
+    return NRF_SUCCESS;
+}
+
+ret_code_t fds_record_write(fds_record_desc_t *const  p_desc,
+                            fds_record_t const *const p_record)
+{
+    UNUSED_PARAMETER(p_desc);
+    FAKE_CALL();
+
+    return op_queue(FDS_EVT_WRITE, NULL, p_record);
+}
+
+ret_code_t fds_record_update(fds_record_desc_t *const  p_desc,
+                             fds_record_t const *const p_record)
+{
+    FAKE_CALL();
+
+    if (!m_records[p_desc->index].in_use ||
+        m_records[p_desc->index].header.record_id != p_desc->record_id)
+    {
+        return FDS_ERR_NOT_FOUND;
+    }
+
+    return op_queue(FDS_EVT_UPDATE, p_desc, p_record);
+}
+
+ret_code_t fds_gc(void)
+{
+    FAKE_CALL();
+
+    return op_queue(FDS_EVT_GC, NULL, NULL);
+}
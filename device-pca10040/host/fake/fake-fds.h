@@ -0,0 +1,132 @@
+/**
+ * Copyright (c) 2018 Keith Wakeham
+ *
+ * All rights reserved.
+ *
+ *
+ */
+
+#ifndef FAKE_FDS_H
+#define FAKE_FDS_H
+
+// Host stand-in for Flash Data Storage. Records live in RAM, operations are
+// queued and finish one at a time on the fake clock, each with its event.
+
+#include "fake-sdk.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define NRF_ERROR_FDS_ERR_BASE 0x8600
+
+enum
+{
+    FDS_ERR_OPERATION_TIMEOUT = NRF_ERROR_FDS_ERR_BASE,
+    FDS_ERR_NOT_INITIALIZED,
+    FDS_ERR_UNALIGNED_ADDR,
+    FDS_ERR_INVALID_ARG,
+    FDS_ERR_NULL_ARG,
+    FDS_ERR_NO_OPEN_RECORDS,
+    FDS_ERR_NO_SPACE_IN_FLASH,
+    FDS_ERR_NO_SPACE_IN_QUEUES,
+    FDS_ERR_RECORD_TOO_LARGE,
+    FDS_ERR_NOT_FOUND,
+    FDS_ERR_NO_PAGES,
+    FDS_ERR_USER_LIMIT_REACHED,
+    FDS_ERR_CRC_CHECK_FAILED,
+    FDS_ERR_BUSY,
+    FDS_ERR_INTERNAL,
+};
+
+typedef struct
+{
+    uint16_t record_key;
+    uint16_t length_words;
+    uint16_t file_id;
+    uint16_t crc16;
+    uint32_t record_id;
+} fds_header_t;
+
+typedef struct
+{
+    uint32_t record_id;
+    uint32_t index; // slot in the fake store
+} fds_record_desc_t;
+
+typedef struct
+{
+    uint32_t index; // next slot to look at
+} fds_find_token_t;
+
+typedef struct
+{
+    fds_header_t const *p_header;
+    void const *        p_data;
+} fds_flash_record_t;
+
+typedef struct
+{
+    uint16_t file_id;
+    uint16_t key;
+    struct
+    {
+        void const *p_data;
+        uint32_t    length_words;
+    } data;
+} fds_record_t;
+
+typedef enum
+{
+    FDS_EVT_INIT,
+    FDS_EVT_WRITE,
+    FDS_EVT_UPDATE,
+    FDS_EVT_DEL_RECORD,
+    FDS_EVT_DEL_FILE,
+    FDS_EVT_GC
+} fds_evt_id_t;
+
+typedef struct
+{
+    fds_evt_id_t id;
+    ret_code_t   result;
+    union
+    {
+        struct
+        {
+            uint32_t record_id;
+            uint16_t file_id;
+            uint16_t record_key;
+            bool     is_record_updated;
+        } write;
+        struct
+        {
+            uint32_t record_id;
+            uint16_t file_id;
+            uint16_t record_key;
+        } del;
+    };
+} fds_evt_t;
+
+typedef void (*fds_cb_t)(fds_evt_t const *p_evt);
+
+ret_code_t fds_register(fds_cb_t cb);
+ret_code_t fds_init(void);
+ret_code_t fds_record_find(uint16_t file_id, uint16_t record_key,
+                           fds_record_desc_t *p_desc,
+                           fds_find_token_t * p_token);
+ret_code_t fds_record_open(fds_record_desc_t *const p_desc,
+                           fds_flash_record_t *const p_flash_record);
+ret_code_t fds_record_close(fds_record_desc_t *const p_desc);
+ret_code_t fds_record_write(fds_record_desc_t *const  p_desc,
+                            fds_record_t const *const p_record);
+ret_code_t fds_record_update(fds_record_desc_t *const  p_desc,
+                             fds_record_t const *const p_record);
+ret_code_t fds_gc(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // FAKE_FDS_H
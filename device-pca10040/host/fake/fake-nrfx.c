@@ -0,0 +1,684 @@
+/**
+ * Copyright (c) 2018 Keith Wakeham
+ *
+ * All rights reserved.
+ *
+ *
+ */
+
+// SAADC with its nrfx driver, RTC2, PPI and LPCOMP.
+//
+// The SAADC is modelled at the register level the firmware relies on:
+// RESULT.PTR and MAXCNT are latched by START, a conversion that finds no
+// buffer started is lost, a full buffer raises END and stops EasyDMA until
+// the next START. The driver on top keeps the primary and secondary buffer
+// like nrfx does and restarts on END from its interrupt handler. Tasks and
+// events have their nRF52832 addresses and PPI connects them.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "fake.h"
+
+#define PPI_CHANNEL_COUNT 20
+
+#define SAADC_EVENT_LIMIT_NONE 0xFF
+
+#define RTC2_BASE 0x40024000UL
+
+typedef struct
+{
+    bool     allocated;
+    bool     enabled;
+    uint32_t eep;
+    uint32_t tep;
+    uint32_t fork_tep;
+} ppi_channel_t;
+
+static struct
+{
+    // nrfx_saadc driver
+    nrfx_saadc_event_handler_t handler;
+    bool                       busy;
+    nrf_saadc_value_t *        p_buffer;
+    uint16_t                   buffer_size;
+    nrf_saadc_value_t *        p_secondary;
+    uint16_t                   secondary_size;
+    // RESULT.PTR and RESULT.MAXCNT, what the next START latches
+    nrf_saadc_value_t *p_result_ptr;
+    uint32_t           result_maxcnt;
+    // EasyDMA
+    bool               started;
+    nrf_saadc_value_t *p_dma;
+    uint32_t           dma_size;
+    uint32_t           dma_count;
+    // INTEN and the channel 0 limits
+    uint32_t int_mask;
+    int16_t  limit_low;
+    int16_t  limit_high;
+    bool     limit_low_enabled;
+    bool     limit_high_enabled;
+    // The conversion in progress
+    uint32_t           conversion_event;
+    uint64_t           conversion_mid_ns;
+    uint64_t           conversion_ns;
+    bool               conversion_ns_set;
+    int16_t            input_code;
+    fake_saadc_input_t input;
+    void *             p_input_context;
+    uint32_t           conversions;
+} m_saadc;
+
+static struct
+{
+    nrfx_rtc_handler_t handler;
+    bool               running;
+    uint32_t           prescaler;
+    uint32_t           cc;
+    bool               cc_irq;
+    uint64_t           base_tick; // 32768 Hz tick at which COUNTER was 0
+    uint32_t           compare_event;
+} m_rtc2;
+
+static ppi_channel_t m_ppi[PPI_CHANNEL_COUNT];
+
+static void ppi_event(uint32_t eep);
+
+// SAADC
+
+static void saadc_start(void)
+{
+    // EasyDMA takes the buffer set up by the last nrf_saadc_buffer_init()
+    m_saadc.started = true;
+    m_saadc.p_dma = m_saadc.p_result_ptr;
+    m_saadc.dma_size = m_saadc.result_maxcnt;
+    m_saadc.dma_count = 0;
+}
+
+static void saadc_stop(void)
+{
+    m_saadc.started = false;
+    fake_event_cancel(m_saadc.conversion_event);
+    m_saadc.conversion_event = 0;
+}
+
+/**
+ * @brief What the driver's interrupt handler does on END
+ *
+ */
+static void saadc_driver_end(void)
+{
+    nrfx_saadc_evt_t evt;
+
+    evt.type = NRFX_SAADC_EVT_DONE;
+    evt.data.done.p_buffer = m_saadc.p_buffer;
+    evt.data.done.size = m_saadc.buffer_size;
+
+    if (m_saadc.p_secondary == NULL)
+    {
+        m_saadc.busy = false;
+    }
+    else
+    {
+        m_saadc.p_buffer = m_saadc.p_secondary;
+        m_saadc.buffer_size = m_saadc.secondary_size;
+        m_saadc.p_secondary = NULL;
+        saadc_start();
+    }
+
+    if (m_saadc.handler != NULL)
+    {
+        m_saadc.handler(&evt);
+    }
+}
+
+static void saadc_driver_limit(nrf_saadc_limit_t limit_type)
+{
+    nrfx_saadc_evt_t evt;
+
+    evt.type = NRFX_SAADC_EVT_LIMIT;
+    evt.data.limit.channel = 0;
+    evt.data.limit.limit_type = limit_type;
+
+    if (m_saadc.handler != NULL)
+    {
+        m_saadc.handler(&evt);
+    }
+}
+
+static void saadc_result(int16_t code)
+{
+    uint8_t limit = SAADC_EVENT_LIMIT_NONE;
+
+    if (m_saadc.limit_high_enabled && code >= m_saadc.limit_high)
+    {
+        limit = NRF_SAADC_LIMIT_HIGH;
+    }
+    else if (m_saadc.limit_low_enabled && code <= m_saadc.limit_low)
+    {
+        limit = NRF_SAADC_LIMIT_LOW;
+    }
+
+    if (!m_saadc.started || m_saadc.p_dma == NULL)
+    {
+        // Nowhere to put it
+        return;
+    }
+
+    m_saadc.p_dma[m_saadc.dma_count++] = code;
+    m_saadc.conversions++;
+
+    if (m_saadc.dma_count >= m_saadc.dma_size)
+    {
+        m_saadc.started = false;
+        ppi_event(nrf_saadc_event_address_get(NRF_SAADC_EVENT_END));
+        if (m_saadc.int_mask & NRF_SAADC_INT_END)
+        {
+            saadc_driver_end();
+        }
+    }
+
+    // The driver looks at the limit events after END
+    if (limit != SAADC_EVENT_LIMIT_NONE)
+    {
+        saadc_driver_limit((nrf_saadc_limit_t)limit);
+    }
+}
+
+static void saadc_conversion_done(void *p_context)
+{
+    int16_t code = m_saadc.input_code;
+
+    UNUSED_PARAMETER(p_context);
+
+    m_saadc.conversion_event = 0;
+    if (m_saadc.input != NULL)
+    {
+        code =
+            m_saadc.input(m_saadc.conversion_mid_ns, m_saadc.p_input_context);
+    }
+    saadc_result(code);
+}
+
+static void saadc_injected_done(void *p_context)
+{
+    saadc_result((int16_t)(intptr_t)p_context);
+}
+
+static void saadc_sample(void)
+{
+    uint64_t now = fake_time_ns();
+
+    if (m_saadc.conversion_event != 0)
+    {
+        // Still busy with the burst, the trigger is lost
+        return;
+    }
+    m_saadc.conversion_mid_ns = now + m_saadc.conversion_ns / 2;
+    m_saadc.conversion_event =
+        fake_event_at(now + m_saadc.conversion_ns, FAKE_PRIO_SAADC,
+                      saadc_conversion_done, NULL);
+}
+
+static void saadc_conversion_time_reset(nrf_saadc_oversample_t oversample)
+{
+    if (!m_saadc.conversion_ns_set)
+    {
+        // Acquisition of 10 us plus up to 2 us per oversampled conversion
+        m_saadc.conversion_ns = (1ULL << oversample) * 12 * FAKE_NS_PER_US;
+    }
+}
+
+void fake_saadc_input_set(int16_t code)
+{
+    m_saadc.input_code = code;
+    m_saadc.input = NULL;
+}
+
+void fake_saadc_input_fn_set(fake_saadc_input_t input, void *p_context)
+{
+    m_saadc.input = input;
+    m_saadc.p_input_context = p_context;
+}
+
+void fake_saadc_conversion_time_set(uint64_t ns)
+{
+    m_saadc.conversion_ns = ns;
+    m_saadc.conversion_ns_set = true;
+}
+
+void fake_saadc_convert(int16_t code)
+{
+    UNUSED_RETURN_VALUE(fake_event_at(fake_time_ns(), FAKE_PRIO_SAADC,
+                                      saadc_injected_done,
+                                      (void *)(intptr_t)code));
+}
+
+uint32_t fake_saadc_conversions(void) { return m_saadc.conversions; }
+
+// nrf_saadc.h
+
+void nrf_saadc_buffer_init(nrf_saadc_value_t *p_buffer, uint32_t num)
+{
+    FAKE_CALL();
+    m_saadc.p_result_ptr = p_buffer;
+    m_saadc.result_maxcnt = num;
+}
+
+void nrf_saadc_oversample_set(nrf_saadc_oversample_t oversample)
+{
+    FAKE_CALL();
+    saadc_conversion_time_reset(oversample);
+}
+
+void nrf_saadc_event_clear(nrf_saadc_event_t event)
+{
+    // Events are not latched, an interrupt runs when they happen
+    UNUSED_PARAMETER(event);
+    FAKE_CALL();
+}
+
+void nrf_saadc_int_enable(uint32_t saadc_int_mask)
+{
+    FAKE_CALL();
+    m_saadc.int_mask |= saadc_int_mask;
+}
+
+void nrf_saadc_int_disable(uint32_t saadc_int_mask)
+{
+    FAKE_CALL();
+    m_saadc.int_mask &= ~saadc_int_mask;
+}
+
+void nrf_saadc_task_trigger(nrf_saadc_task_t task)
+{
+    FAKE_CALL();
+
+    switch (task)
+    {
+        case NRF_SAADC_TASK_START:
+            saadc_start();
+            break;
+
+        case NRF_SAADC_TASK_SAMPLE:
+            saadc_sample();
+            break;
+
+        case NRF_SAADC_TASK_STOP:
+            saadc_stop();
+            break;
+
+        default:
+            break;
+    }
+}
+
+// nrfx_saadc.h
+
+ret_code_t nrfx_saadc_init(nrfx_saadc_config_t const *p_config,
+                           nrfx_saadc_event_handler_t event_handler)
+{
+    FAKE_CALL();
+
+    if (m_saadc.handler != NULL)
+    {
+        return NRF_ERROR_INVALID_STATE;
+    }
+    m_saadc.handler = event_handler;
+    m_saadc.busy = false;
+    m_saadc.p_secondary = NULL;
+    m_saadc.int_mask = NRF_SAADC_INT_END;
+    m_saadc.limit_low_enabled = false;
+    m_saadc.limit_high_enabled = false;
+    saadc_conversion_time_reset(p_config->oversample);
+
+    return NRF_SUCCESS;
+}
+
+void nrfx_saadc_uninit(void)
+{
+    FAKE_CALL();
+
+    saadc_stop();
+    m_saadc.int_mask = 0;
+    m_saadc.handler = NULL;
+    m_saadc.busy = false;
+}
+
+ret_code_t nrfx_saadc_channel_init(uint8_t channel,
+                                   nrf_saadc_channel_config_t const *p_config)
+{
+    UNUSED_PARAMETER(p_config);
+    FAKE_CALL();
+
+    return (channel == 0) ? NRF_SUCCESS : NRF_ERROR_INVALID_PARAM;
+}
+
+ret_code_t nrfx_saadc_buffer_convert(nrf_saadc_value_t *buffer, uint16_t size)
+{
+    FAKE_CALL();
+
+    if (m_saadc.busy)
+    {
+        if (m_saadc.p_secondary != NULL)
+        {
+            return NRF_ERROR_BUSY;
+        }
+        m_saadc.p_secondary = buffer;
+        m_saadc.secondary_size = size;
+        nrf_saadc_buffer_init(buffer, size);
+        return NRF_SUCCESS;
+    }
+
+    nrf_saadc_int_enable(NRF_SAADC_INT_END);
+    m_saadc.busy = true;
+    m_saadc.p_buffer = buffer;
+    m_saadc.buffer_size = size;
+    m_saadc.p_secondary = NULL;
+    nrf_saadc_buffer_init(buffer, size);
+    nrf_saadc_task_trigger(NRF_SAADC_TASK_START);
+
+    return NRF_SUCCESS;
+}
+
+ret_code_t nrfx_saadc_sample(void)
+{
+    FAKE_CALL();
+
+    if (!m_saadc.busy)
+    {
+        return NRF_ERROR_INVALID_STATE;
+    }
+    nrf_saadc_task_trigger(NRF_SAADC_TASK_SAMPLE);
+
+    return NRF_SUCCESS;
+}
+
+void nrfx_saadc_abort(void)
+{
+    FAKE_CALL();
+
+    saadc_stop();
+    m_saadc.busy = false;
+    m_saadc.p_buffer = NULL;
+    m_saadc.p_secondary = NULL;
+}
+
+void nrfx_saadc_limits_set(uint8_t channel, int16_t limit_low,
+                           int16_t limit_high)
+{
+    UNUSED_PARAMETER(channel);
+    FAKE_CALL();
+
+    m_saadc.limit_low = limit_low;
+    m_saadc.limit_high = limit_high;
+    m_saadc.limit_low_enabled = limit_low != NRFX_SAADC_LIMITL_DISABLED;
+    m_saadc.limit_high_enabled = limit_high != NRFX_SAADC_LIMITH_DISABLED;
+}
+
+// RTC2, only COMPARE0 is used. CLEAR takes effect on the next tick, so
+// COMPARE0 clearing the counter through PPI gives a period of CC + 1.
+
+static void rtc2_compare(void *p_context);
+
+static void rtc2_schedule(void)
+{
+    uint64_t at_tick;
+
+    fake_event_cancel(m_rtc2.compare_event);
+    m_rtc2.compare_event = 0;
+    if (!m_rtc2.running)
+    {
+        return;
+    }
+
+    at_tick = m_rtc2.base_tick + (uint64_t)m_rtc2.cc * (m_rtc2.prescaler + 1);
+    if (fake_lfclk_ns(at_tick) < fake_time_ns())
+    {
+        // Already past, only after the 24 bit counter wraps
+        at_tick += (RTC_COUNTER_COUNTER_Msk + 1ULL) * (m_rtc2.prescaler + 1);
+    }
+    m_rtc2.compare_event = fake_event_at(fake_lfclk_ns(at_tick),
+                                         FAKE_PRIO_SAADC, rtc2_compare, NULL);
+}
+
+static void rtc2_clear(void)
+{
+    m_rtc2.base_tick =
+        fake_lfclk_ticks(fake_time_ns()) + (m_rtc2.prescaler + 1);
+    rtc2_schedule();
+}
+
+static void rtc2_compare(void *p_context)
+{
+    UNUSED_PARAMETER(p_context);
+
+    m_rtc2.compare_event = 0;
+    // Next match after a full counter period unless something clears it
+    m_rtc2.base_tick += (RTC_COUNTER_COUNTER_Msk + 1ULL) *
+                        (m_rtc2.prescaler + 1);
+    rtc2_schedule();
+
+    ppi_event(RTC2_BASE + NRF_RTC_EVENT_COMPARE_0);
+    if (m_rtc2.cc_irq && m_rtc2.handler != NULL)
+    {
+        m_rtc2.handler(NRFX_RTC_INT_COMPARE0);
+    }
+}
+
+ret_code_t nrfx_rtc_init(nrfx_rtc_t const *p_instance,
+                         nrfx_rtc_config_t const *p_config,
+                         nrfx_rtc_handler_t handler)
+{
+    FAKE_CALL();
+
+    if (p_instance->base != RTC2_BASE)
+    {
+        // RTC0 belongs to the SoftDevice, RTC1 to app_timer
+        return NRF_ERROR_INVALID_PARAM;
+    }
+    m_rtc2.handler = handler;
+    m_rtc2.prescaler = p_config->prescaler;
+    m_rtc2.running = false;
+    m_rtc2.base_tick = fake_lfclk_ticks(fake_time_ns());
+
+    return NRF_SUCCESS;
+}
+
+void nrfx_rtc_enable(nrfx_rtc_t const *p_instance)
+{
+    UNUSED_PARAMETER(p_instance);
+    FAKE_CALL();
+
+    if (!m_rtc2.running)
+    {
+        m_rtc2.running = true;
+        // Counts on from where it stopped, close enough from zero
+        m_rtc2.base_tick = fake_lfclk_ticks(fake_time_ns());
+        rtc2_schedule();
+    }
+}
+
+void nrfx_rtc_disable(nrfx_rtc_t const *p_instance)
+{
+    UNUSED_PARAMETER(p_instance);
+    FAKE_CALL();
+
+    m_rtc2.running = false;
+    rtc2_schedule();
+}
+
+ret_code_t nrfx_rtc_cc_set(nrfx_rtc_t const *p_instance, uint32_t channel,
+                           uint32_t val, bool enable_irq)
+{
+    UNUSED_PARAMETER(p_instance);
+    FAKE_CALL();
+
+    if (channel != 0)
+    {
+        return NRF_ERROR_INVALID_PARAM;
+    }
+    m_rtc2.cc = val & RTC_COUNTER_COUNTER_Msk;
+    m_rtc2.cc_irq = enable_irq;
+    rtc2_schedule();
+
+    return NRF_SUCCESS;
+}
+
+void nrfx_rtc_counter_clear(nrfx_rtc_t const *p_instance)
+{
+    UNUSED_PARAMETER(p_instance);
+    FAKE_CALL();
+
+    rtc2_clear();
+}
+
+// PPI
+
+static void task_trigger(uint32_t tep)
+{
+    if (tep == nrf_saadc_task_address_get(NRF_SAADC_TASK_START))
+    {
+        saadc_start();
+    }
+    else if (tep == nrf_saadc_task_address_get(NRF_SAADC_TASK_SAMPLE))
+    {
+        saadc_sample();
+    }
+    else if (tep == nrf_saadc_task_address_get(NRF_SAADC_TASK_STOP))
+    {
+        saadc_stop();
+    }
+    else if (tep == RTC2_BASE + NRF_RTC_TASK_CLEAR)
+    {
+        rtc2_clear();
+    }
+    else if (tep != 0)
+    {
+        fprintf(stderr, "fake: PPI task 0x%08x not modelled\n", tep);
+        abort();
+    }
+}
+
+static void ppi_event(uint32_t eep)
+{
+    for (uint32_t i = 0; i < PPI_CHANNEL_COUNT; i++)
+    {
+        ppi_channel_t const *p_channel = &m_ppi[i];
+
+        if (p_channel->enabled && p_channel->eep == eep)
+        {
+            task_trigger(p_channel->tep);
+            task_trigger(p_channel->fork_tep);
+        }
+    }
+}
+
+ret_code_t nrfx_ppi_channel_alloc(nrf_ppi_channel_t *p_channel)
+{
+    FAKE_CALL();
+
+    for (uint32_t i = 0; i < PPI_CHANNEL_COUNT; i++)
+    {
+        if (!m_ppi[i].allocated)
+        {
+            memset(&m_ppi[i], 0, sizeof(m_ppi[i]));
+            m_ppi[i].allocated = true;
+            *p_channel = (nrf_ppi_channel_t)i;
+            return NRF_SUCCESS;
+        }
+    }
+
+    return NRF_ERROR_NO_MEM;
+}
+
+ret_code_t nrfx_ppi_channel_assign(nrf_ppi_channel_t channel, uint32_t eep,
+                                   uint32_t tep)
+{
+    FAKE_CALL();
+
+    if (channel >= PPI_CHANNEL_COUNT || !m_ppi[channel].allocated)
+    {
+        return NRF_ERROR_INVALID_STATE;
+    }
+    m_ppi[channel].eep = eep;
+    m_ppi[channel].tep = tep;
+
+    return NRF_SUCCESS;
+}
+
+ret_code_t nrfx_ppi_channel_fork_assign(nrf_ppi_channel_t channel,
+                                        uint32_t          fork_tep)
+{
+    FAKE_CALL();
+
+    if (channel >= PPI_CHANNEL_COUNT || !m_ppi[channel].allocated)
+    {
+        return NRF_ERROR_INVALID_STATE;
+    }
+    m_ppi[channel].fork_tep = fork_tep;
+
+    return NRF_SUCCESS;
+}
+
+ret_code_t nrfx_ppi_channel_enable(nrf_ppi_channel_t channel)
+{
+    FAKE_CALL();
+
+    if (channel >= PPI_CHANNEL_COUNT || !m_ppi[channel].allocated)
+    {
+        return NRF_ERROR_INVALID_STATE;
+    }
+    m_ppi[channel].enabled = true;
+
+    return NRF_SUCCESS;
+}
+
+ret_code_t nrfx_ppi_channel_disable(nrf_ppi_channel_t channel)
+{
+    FAKE_CALL();
+
+    if (channel >= PPI_CHANNEL_COUNT || !m_ppi[channel].allocated)
+    {
+        return NRF_ERROR_INVALID_STATE;
+    }
+    m_ppi[channel].enabled = false;
+
+    return NRF_SUCCESS;
+}
+
+// LPCOMP, only armed before system off
+
+void nrf_lpcomp_configure(nrf_lpcomp_config_t const *p_config)
+{
+    UNUSED_PARAMETER(p_config);
+    FAKE_CALL();
+}
+
+void nrf_lpcomp_input_select(nrf_lpcomp_input_t input)
+{
+    UNUSED_PARAMETER(input);
+    FAKE_CALL();
+}
+
+void nrf_lpcomp_enable(void) { FAKE_CALL(); }
+
+void nrf_lpcomp_task_trigger(nrf_lpcomp_task_t task)
+{
+    UNUSED_PARAMETER(task);
+    FAKE_CALL();
+}
+
+bool nrf_lpcomp_event_check(nrf_lpcomp_event_t event)
+{
+    FAKE_CALL();
+
+    // Ready right away, nothing crosses
+    return event == NRF_LPCOMP_EVENT_READY;
+}
+
+void nrf_lpcomp_event_clear(nrf_lpcomp_event_t event)
+{
+    UNUSED_PARAMETER(event);
+    FAKE_CALL();
+}
@@ -0,0 +1,396 @@
+/**
+ * Copyright (c) 2018 Keith Wakeham
+ *
+ * All rights reserved.
+ *
+ *
+ */
+
+#ifndef FAKE_NRFX_H
+#define FAKE_NRFX_H
+
+// Host stand-ins for the nrfx drivers and HAL the sampler uses: SAADC, RTC,
+// PPI and LPCOMP. Event and task addresses are the nRF52832 ones, PPI in
+// fake-nrfx.c connects them the way the hardware would.
+
+#include "fake-sdk.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+// nrf_saadc.h
+
+#define NRF_SAADC_BASE 0x40007000UL
+
+typedef int16_t nrf_saadc_value_t;
+
+typedef enum
+{
+    NRF_SAADC_RESOLUTION_8BIT = 0,
+    NRF_SAADC_RESOLUTION_10BIT = 1,
+    NRF_SAADC_RESOLUTION_12BIT = 2,
+    NRF_SAADC_RESOLUTION_14BIT = 3
+} nrf_saadc_resolution_t;
+
+typedef enum
+{
+    NRF_SAADC_OVERSAMPLE_DISABLED = 0,
+    NRF_SAADC_OVERSAMPLE_2X,
+    NRF_SAADC_OVERSAMPLE_4X,
+    NRF_SAADC_OVERSAMPLE_8X,
+    NRF_SAADC_OVERSAMPLE_16X,
+    NRF_SAADC_OVERSAMPLE_32X,
+    NRF_SAADC_OVERSAMPLE_64X,
+    NRF_SAADC_OVERSAMPLE_128X,
+    NRF_SAADC_OVERSAMPLE_256X
+} nrf_saadc_oversample_t;
+
+typedef enum
+{
+    NRF_SAADC_INPUT_DISABLED = 0,
+    NRF_SAADC_INPUT_AIN0,
+    NRF_SAADC_INPUT_AIN1,
+    NRF_SAADC_INPUT_AIN2,
+    NRF_SAADC_INPUT_AIN3,
+    NRF_SAADC_INPUT_AIN4,
+    NRF_SAADC_INPUT_AIN5,
+    NRF_SAADC_INPUT_AIN6,
+    NRF_SAADC_INPUT_AIN7,
+    NRF_SAADC_INPUT_VDD
+} nrf_saadc_input_t;
+
+typedef enum
+{
+    NRF_SAADC_RESISTOR_DISABLED,
+    NRF_SAADC_RESISTOR_PULLDOWN,
+    NRF_SAADC_RESISTOR_PULLUP,
+    NRF_SAADC_RESISTOR_VDD1_2
+} nrf_saadc_resistor_t;
+
+typedef enum
+{
+    NRF_SAADC_GAIN1_6,
+    NRF_SAADC_GAIN1_5,
+    NRF_SAADC_GAIN1_4,
+    NRF_SAADC_GAIN1_3,
+    NRF_SAADC_GAIN1_2,
+    NRF_SAADC_GAIN1,
+    NRF_SAADC_GAIN2,
+    NRF_SAADC_GAIN4
+} nrf_saadc_gain_t;
+
+typedef enum
+{
+    NRF_SAADC_REFERENCE_INTERNAL,
+    NRF_SAADC_REFERENCE_VDD4
+} nrf_saadc_reference_t;
+
+typedef enum
+{
+    NRF_SAADC_ACQTIME_3US,
+    NRF_SAADC_ACQTIME_5US,
+    NRF_SAADC_ACQTIME_10US,
+    NRF_SAADC_ACQTIME_15US,
+    NRF_SAADC_ACQTIME_20US,
+    NRF_SAADC_ACQTIME_40US
+} nrf_saadc_acqtime_t;
+
+typedef enum
+{
+    NRF_SAADC_MODE_SINGLE_ENDED,
+    NRF_SAADC_MODE_DIFFERENTIAL
+} nrf_saadc_mode_t;
+
+typedef enum
+{
+    NRF_SAADC_BURST_DISABLED,
+    NRF_SAADC_BURST_ENABLED
+} nrf_saadc_burst_t;
+
+typedef struct
+{
+    nrf_saadc_resistor_t  resistor_p;
+    nrf_saadc_resistor_t  resistor_n;
+    nrf_saadc_gain_t      gain;
+    nrf_saadc_reference_t reference;
+    nrf_saadc_acqtime_t   acq_time;
+    nrf_saadc_mode_t      mode;
+    nrf_saadc_burst_t     burst;
+    nrf_saadc_input_t     pin_p;
+    nrf_saadc_input_t     pin_n;
+} nrf_saadc_channel_config_t;
+
+typedef enum
+{
+    NRF_SAADC_LIMIT_LOW,
+    NRF_SAADC_LIMIT_HIGH
+} nrf_saadc_limit_t;
+
+// Register offsets
+typedef enum
+{
+    NRF_SAADC_TASK_START = 0x000,
+    NRF_SAADC_TASK_SAMPLE = 0x004,
+    NRF_SAADC_TASK_STOP = 0x008,
+    NRF_SAADC_TASK_CALIBRATEOFFSET = 0x00C
+} nrf_saadc_task_t;
+
+typedef enum
+{
+    NRF_SAADC_EVENT_STARTED = 0x100,
+    NRF_SAADC_EVENT_END = 0x104,
+    NRF_SAADC_EVENT_DONE = 0x108,
+    NRF_SAADC_EVENT_RESULTDONE = 0x10C,
+    NRF_SAADC_EVENT_CALIBRATEDONE = 0x110,
+    NRF_SAADC_EVENT_STOPPED = 0x114
+} nrf_saadc_event_t;
+
+typedef enum
+{
+    NRF_SAADC_INT_STARTED = (1UL << 0),
+    NRF_SAADC_INT_END = (1UL << 1),
+    NRF_SAADC_INT_DONE = (1UL << 2),
+    NRF_SAADC_INT_RESULTDONE = (1UL << 3),
+    NRF_SAADC_INT_CALIBRATEDONE = (1UL << 4),
+    NRF_SAADC_INT_STOPPED = (1UL << 5)
+} nrf_saadc_int_mask_t;
+
+void nrf_saadc_buffer_init(nrf_saadc_value_t *p_buffer, uint32_t num);
+void nrf_saadc_event_clear(nrf_saadc_event_t event);
+void nrf_saadc_int_enable(uint32_t saadc_int_mask);
+void nrf_saadc_int_disable(uint32_t saadc_int_mask);
+void nrf_saadc_task_trigger(nrf_saadc_task_t task);
+void nrf_saadc_oversample_set(nrf_saadc_oversample_t oversample);
+
+static inline uint32_t nrf_saadc_event_address_get(nrf_saadc_event_t event)
+{
+    return NRF_SAADC_BASE + (uint32_t)event;
+}
+
+static inline uint32_t nrf_saadc_task_address_get(nrf_saadc_task_t task)
+{
+    return NRF_SAADC_BASE + (uint32_t)task;
+}
+
+// nrfx_saadc.h
+
+#define NRFX_SAADC_LIMITH_DISABLED (2047)
+#define NRFX_SAADC_LIMITL_DISABLED (-2048)
+
+#define NRFX_SAADC_DEFAULT_CHANNEL_CONFIG_SE(PIN_P) \
+    {                                               \
+        .resistor_p = NRF_SAADC_RESISTOR_DISABLED,  \
+        .resistor_n = NRF_SAADC_RESISTOR_DISABLED,  \
+        .gain = NRF_SAADC_GAIN1_6,                  \
+        .reference = NRF_SAADC_REFERENCE_INTERNAL,  \
+        .acq_time = NRF_SAADC_ACQTIME_10US,         \
+        .mode = NRF_SAADC_MODE_SINGLE_ENDED,        \
+        .burst = NRF_SAADC_BURST_DISABLED,          \
+        .pin_p = (nrf_saadc_input_t)(PIN_P),        \
+        .pin_n = NRF_SAADC_INPUT_DISABLED           \
+    }
+
+typedef struct
+{
+    nrf_saadc_resolution_t resolution;
+    nrf_saadc_oversample_t oversample;
+    uint8_t                interrupt_priority;
+    bool                   low_power_mode;
+} nrfx_saadc_config_t;
+
+typedef enum
+{
+    NRFX_SAADC_EVT_DONE,
+    NRFX_SAADC_EVT_LIMIT,
+    NRFX_SAADC_EVT_CALIBRATEDONE
+} nrfx_saadc_evt_type_t;
+
+typedef struct
+{
+    nrfx_saadc_evt_type_t type;
+    union
+    {
+        struct
+        {
+            nrf_saadc_value_t *p_buffer;
+            uint16_t           size;
+        } done;
+        struct
+        {
+            uint8_t           channel;
+            nrf_saadc_limit_t limit_type;
+        } limit;
+    } data;
+} nrfx_saadc_evt_t;
+
+typedef void (*nrfx_saadc_event_handler_t)(nrfx_saadc_evt_t const *p_event);
+
+ret_code_t nrfx_saadc_init(nrfx_saadc_config_t const *p_config,
+                           nrfx_saadc_event_handler_t event_handler);
+void       nrfx_saadc_uninit(void);
+ret_code_t nrfx_saadc_channel_init(uint8_t channel,
+                                   nrf_saadc_channel_config_t const *p_config);
+ret_code_t nrfx_saadc_buffer_convert(nrf_saadc_value_t *buffer, uint16_t size);
+ret_code_t nrfx_saadc_sample(void);
+void       nrfx_saadc_abort(void);
+void       nrfx_saadc_limits_set(uint8_t channel, int16_t limit_low,
+                                 int16_t limit_high);
+
+static inline uint32_t nrfx_saadc_sample_task_get(void)
+{
+    return nrf_saadc_task_address_get(NRF_SAADC_TASK_SAMPLE);
+}
+
+// nrf_rtc.h, nrfx_rtc.h
+
+#define RTC_INPUT_FREQ 32768
+#define RTC_FREQ_TO_PRESCALER(FREQ) (uint16_t)(((RTC_INPUT_FREQ) / (FREQ)) - 1)
+
+typedef enum
+{
+    NRF_RTC_TASK_START = 0x000,
+    NRF_RTC_TASK_STOP = 0x004,
+    NRF_RTC_TASK_CLEAR = 0x008,
+    NRF_RTC_TASK_TRIGGER_OVERFLOW = 0x00C
+} nrf_rtc_task_t;
+
+typedef enum
+{
+    NRF_RTC_EVENT_TICK = 0x100,
+    NRF_RTC_EVENT_OVERFLOW = 0x104,
+    NRF_RTC_EVENT_COMPARE_0 = 0x140,
+    NRF_RTC_EVENT_COMPARE_1 = 0x144,
+    NRF_RTC_EVENT_COMPARE_2 = 0x148,
+    NRF_RTC_EVENT_COMPARE_3 = 0x14C
+} nrf_rtc_event_t;
+
+typedef enum
+{
+    NRFX_RTC_INT_COMPARE0 = 0,
+    NRFX_RTC_INT_COMPARE1 = 1,
+    NRFX_RTC_INT_COMPARE2 = 2,
+    NRFX_RTC_INT_COMPARE3 = 3,
+    NRFX_RTC_INT_TICK = 4,
+    NRFX_RTC_INT_OVERFLOW = 5
+} nrfx_rtc_int_type_t;
+
+typedef struct
+{
+    uint32_t base;
+    uint8_t  instance_id;
+    uint8_t  cc_channel_count;
+} nrfx_rtc_t;
+
+#define NRFX_RTC_INSTANCE(id)                                          \
+    {                                                                  \
+        .base = ((id) == 0)   ? 0x4000B000UL                           \
+                : ((id) == 1) ? 0x40011000UL                           \
+                              : 0x40024000UL,                          \
+        .instance_id = (id), .cc_channel_count = ((id) == 0) ? 3 : 4   \
+    }
+
+typedef struct
+{
+    uint16_t prescaler;
+    uint8_t  interrupt_priority;
+    uint8_t  tick_latency;
+    bool     reliable;
+} nrfx_rtc_config_t;
+
+#define NRFX_RTC_DEFAULT_CONFIG                                   \
+    {                                                             \
+        .prescaler = RTC_FREQ_TO_PRESCALER(32768),                \
+        .interrupt_priority = 6, .tick_latency = 0, .reliable = false \
+    }
+
+typedef void (*nrfx_rtc_handler_t)(nrfx_rtc_int_type_t int_type);
+
+ret_code_t nrfx_rtc_init(nrfx_rtc_t const *p_instance,
+                         nrfx_rtc_config_t const *p_config,
+                         nrfx_rtc_handler_t handler);
+void       nrfx_rtc_enable(nrfx_rtc_t const *p_instance);
+void       nrfx_rtc_disable(nrfx_rtc_t const *p_instance);
+ret_code_t nrfx_rtc_cc_set(nrfx_rtc_t const *p_instance, uint32_t channel,
+                           uint32_t val, bool enable_irq);
+void       nrfx_rtc_counter_clear(nrfx_rtc_t const *p_instance);
+
+static inline uint32_t nrfx_rtc_event_address_get(nrfx_rtc_t const *p_instance,
+                                                  nrf_rtc_event_t   event)
+{
+    return p_instance->base + (uint32_t)event;
+}
+
+static inline uint32_t nrfx_rtc_task_address_get(nrfx_rtc_t const *p_instance,
+                                                 nrf_rtc_task_t    task)
+{
+    return p_instance->base + (uint32_t)task;
+}
+
+// nrfx_ppi.h
+
+typedef enum
+{
+    NRF_PPI_CHANNEL0 = 0,
+    NRF_PPI_CHANNEL19 = 19
+} nrf_ppi_channel_t;
+
+ret_code_t nrfx_ppi_channel_alloc(nrf_ppi_channel_t *p_channel);
+ret_code_t nrfx_ppi_channel_assign(nrf_ppi_channel_t channel, uint32_t eep,
+                                   uint32_t tep);
+ret_code_t nrfx_ppi_channel_fork_assign(nrf_ppi_channel_t channel,
+                                        uint32_t          fork_tep);
+ret_code_t nrfx_ppi_channel_enable(nrf_ppi_channel_t channel);
+ret_code_t nrfx_ppi_channel_disable(nrf_ppi_channel_t channel);
+
+// nrf_lpcomp.h
+
+typedef enum
+{
+    NRF_LPCOMP_INPUT_0 = 0,
+    NRF_LPCOMP_INPUT_7 = 7
+} nrf_lpcomp_input_t;
+
+typedef uint32_t nrf_lpcomp_ref_t;
+
+typedef enum
+{
+    NRF_LPCOMP_DETECT_CROSS,
+    NRF_LPCOMP_DETECT_UP,
+    NRF_LPCOMP_DETECT_DOWN
+} nrf_lpcomp_detect_t;
+
+typedef enum
+{
+    NRF_LPCOMP_TASK_START = 0x000,
+    NRF_LPCOMP_TASK_STOP = 0x004,
+    NRF_LPCOMP_TASK_SAMPLE = 0x008
+} nrf_lpcomp_task_t;
+
+typedef enum
+{
+    NRF_LPCOMP_EVENT_READY = 0x100,
+    NRF_LPCOMP_EVENT_DOWN = 0x104,
+    NRF_LPCOMP_EVENT_UP = 0x108,
+    NRF_LPCOMP_EVENT_CROSS = 0x10C
+} nrf_lpcomp_event_t;
+
+typedef struct
+{
+    nrf_lpcomp_ref_t    reference;
+    nrf_lpcomp_detect_t detection;
+} nrf_lpcomp_config_t;
+
+void nrf_lpcomp_configure(nrf_lpcomp_config_t const *p_config);
+void nrf_lpcomp_input_select(nrf_lpcomp_input_t input);
+void nrf_lpcomp_enable(void);
+void nrf_lpcomp_task_trigger(nrf_lpcomp_task_t task);
+bool nrf_lpcomp_event_check(nrf_lpcomp_event_t event);
+void nrf_lpcomp_event_clear(nrf_lpcomp_event_t event);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // FAKE_NRFX_H
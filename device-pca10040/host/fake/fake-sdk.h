@@ -0,0 +1,508 @@
+/**
+ * Copyright (c) 2018 Keith Wakeham
+ *
+ * All rights reserved.
+ *
+ *
+ */
+
+#ifndef FAKE_SDK_H
+#define FAKE_SDK_H
+
+// Host stand-ins for the nRF5 SDK headers the firmware includes: error codes,
+// utility macros, the CMSIS intrinsics, the few registers read directly,
+// app_timer, app_scheduler, atomics and NRF_LOG. Only what the firmware uses
+// is here, with the SDK names and, where it matters, the SDK values.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "sdk_config.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+// sdk_errors.h, nrf_error.h
+
+typedef uint32_t ret_code_t;
+
+#define NRF_SUCCESS 0
+#define NRF_ERROR_SVC_HANDLER_MISSING 1
+#define NRF_ERROR_SOFTDEVICE_NOT_ENABLED 2
+#define NRF_ERROR_INTERNAL 3
+#define NRF_ERROR_NO_MEM 4
+#define NRF_ERROR_NOT_FOUND 5
+#define NRF_ERROR_NOT_SUPPORTED 6
+#define NRF_ERROR_INVALID_PARAM 7
+#define NRF_ERROR_INVALID_STATE 8
+#define NRF_ERROR_INVALID_LENGTH 9
+#define NRF_ERROR_INVALID_FLAGS 10
+#define NRF_ERROR_INVALID_DATA 11
+#define NRF_ERROR_DATA_SIZE 12
+#define NRF_ERROR_TIMEOUT 13
+#define NRF_ERROR_NULL 14
+#define NRF_ERROR_FORBIDDEN 15
+#define NRF_ERROR_INVALID_ADDR 16
+#define NRF_ERROR_BUSY 17
+#define NRF_ERROR_CONN_COUNT 18
+#define NRF_ERROR_RESOURCES 19
+
+#define NRF_ERROR_STK_BASE_NUM 0x3000
+
+// nordic_common.h, app_util.h
+
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#define MAX(a, b) ((a) < (b) ? (b) : (a))
+
+#define CONCAT_2(p1, p2) CONCAT_2_(p1, p2)
+#define CONCAT_2_(p1, p2) p1##p2
+
+#define UNUSED_VARIABLE(X) ((void)(X))
+#define UNUSED_PARAMETER(X) UNUSED_VARIABLE(X)
+#define UNUSED_RETURN_VALUE(X) UNUSED_VARIABLE(X)
+
+#define STATIC_ASSERT(EXPR) _Static_assert((EXPR), #EXPR)
+
+#define ARRAY_SIZE(arr) (sizeof(arr) / sizeof((arr)[0]))
+
+#define ROUNDED_DIV(A, B) (((A) + ((B) / 2)) / (B))
+#define CEIL_DIV(A, B) (((A) + (B)-1) / (B))
+#define BYTES_TO_WORDS(n_bytes) (((n_bytes) + 3) >> 2)
+
+#define VERIFY_SUCCESS(statement)         \
+    do                                    \
+    {                                     \
+        uint32_t _err_code = (statement); \
+        if (_err_code != NRF_SUCCESS)     \
+        {                                 \
+            return _err_code;             \
+        }                                 \
+    } while (0)
+
+#define IS_POWER_OF_TWO(A) (((A) != 0) && ((((A)-1) & (A)) == 0))
+
+enum
+{
+    UNIT_0_625_MS = 625,
+    UNIT_1_25_MS = 1250,
+    UNIT_10_MS = 10000
+};
+
+#define MSEC_TO_UNITS(TIME, RESOLUTION) (((TIME)*1000) / (RESOLUTION))
+
+static inline uint8_t uint16_encode(uint16_t value, uint8_t *p_encoded_data)
+{
+    p_encoded_data[0] = (uint8_t)(value & 0x00FF);
+    p_encoded_data[1] = (uint8_t)((value & 0xFF00) >> 8);
+    return sizeof(uint16_t);
+}
+
+static inline uint16_t uint16_decode(const uint8_t *p_encoded_data)
+{
+    return (uint16_t)((uint16_t)p_encoded_data[0] |
+                      ((uint16_t)p_encoded_data[1] << 8));
+}
+
+static inline uint8_t uint32_encode(uint32_t value, uint8_t *p_encoded_data)
+{
+    p_encoded_data[0] = (uint8_t)(value & 0x000000FF);
+    p_encoded_data[1] = (uint8_t)((value & 0x0000FF00) >> 8);
+    p_encoded_data[2] = (uint8_t)((value & 0x00FF0000) >> 16);
+    p_encoded_data[3] = (uint8_t)((value & 0xFF000000) >> 24);
+    return sizeof(uint32_t);
+}
+
+static inline uint32_t uint32_decode(const uint8_t *p_encoded_data)
+{
+    return ((uint32_t)p_encoded_data[0] << 0) |
+           ((uint32_t)p_encoded_data[1] << 8) |
+           ((uint32_t)p_encoded_data[2] << 16) |
+           ((uint32_t)p_encoded_data[3] << 24);
+}
+
+// compiler_abstraction.h
+
+#define __STATIC_INLINE static inline
+#define __WEAK __attribute__((weak))
+#define __ALIGN(n) __attribute__((aligned(n)))
+
+// app_error.h
+
+#define APP_ERROR_HANDLER(ERR_CODE) \
+    app_error_handler((ERR_CODE), __LINE__, (uint8_t const *)__FILE__)
+
+#define APP_ERROR_CHECK(ERR_CODE)                           \
+    do                                                      \
+    {                                                       \
+        const uint32_t LOCAL_ERR_CODE = (ERR_CODE);         \
+        if (LOCAL_ERR_CODE != NRF_SUCCESS)                  \
+        {                                                   \
+            APP_ERROR_HANDLER(LOCAL_ERR_CODE);              \
+        }                                                   \
+    } while (0)
+
+#define APP_ERROR_CHECK_BOOL(BOOLEAN_VALUE)                 \
+    do                                                      \
+    {                                                       \
+        if (!(BOOLEAN_VALUE))                               \
+        {                                                   \
+            APP_ERROR_HANDLER(0);                           \
+        }                                                   \
+    } while (0)
+
+/**
+ * @brief Reports the error and aborts, the target would reset
+ *
+ */
+void app_error_handler(uint32_t error_code, uint32_t line_num,
+                       uint8_t const *p_file_name);
+
+// app_util_platform.h
+
+typedef enum
+{
+    APP_IRQ_PRIORITY_HIGHEST = 2,
+    APP_IRQ_PRIORITY_HIGH = 2,
+    APP_IRQ_PRIORITY_MID = 3,
+    APP_IRQ_PRIORITY_LOW_MID = 5,
+    APP_IRQ_PRIORITY_LOW = 6,
+    APP_IRQ_PRIORITY_LOWEST = 7,
+    APP_IRQ_PRIORITY_THREAD = 15
+} app_irq_priority_t;
+
+void app_util_critical_region_enter(uint8_t *p_nested);
+void app_util_critical_region_exit(uint8_t nested);
+
+#define CRITICAL_REGION_ENTER()                      \
+    {                                                \
+        uint8_t __CR_NESTED = 0;                     \
+        app_util_critical_region_enter(&__CR_NESTED);
+#define CRITICAL_REGION_EXIT()                       \
+    app_util_critical_region_exit(__CR_NESTED);      \
+    }
+
+// CMSIS intrinsics. Nothing preempts the host, an exclusive store always
+// succeeds.
+
+static inline uint32_t __LDREXW(volatile uint32_t *addr) { return *addr; }
+
+static inline uint32_t __STREXW(uint32_t value, volatile uint32_t *addr)
+{
+    *addr = value;
+    return 0;
+}
+
+static inline uint8_t __CLZ(uint32_t value)
+{
+    return (uint8_t)((value == 0) ? 32 : __builtin_clz(value));
+}
+
+// Dual 16 bit multiply with 32 bit accumulate, wraps like the instruction
+static inline uint32_t __SMLAD(uint32_t op1, uint32_t op2, uint32_t op3)
+{
+    int32_t low = (int32_t)(int16_t)op1 * (int16_t)op2;
+    int32_t high = (int32_t)(int16_t)(op1 >> 16) * (int16_t)(op2 >> 16);
+
+    return op3 + (uint32_t)low + (uint32_t)high;
+}
+
+#define __DMB() __sync_synchronize()
+#define __DSB() __sync_synchronize()
+#define __ISB() __sync_synchronize()
+#define __WFE()
+#define __SEV()
+#define __NOP()
+
+/**
+ * @brief Top of the fake main stack, an address like the Cortex-M one but
+ * pointer sized
+ *
+ */
+uintptr_t __get_MSP(void);
+
+// nrf.h, only the registers and fields the firmware touches
+
+typedef struct
+{
+    volatile uint32_t TASKS_START;
+    volatile uint32_t TASKS_STOP;
+    volatile uint32_t TASKS_COUNT;
+    volatile uint32_t TASKS_CLEAR;
+    volatile uint32_t TASKS_SHUTDOWN;
+    volatile uint32_t TASKS_CAPTURE[6];
+    volatile uint32_t MODE;
+    volatile uint32_t BITMODE;
+    volatile uint32_t PRESCALER;
+    volatile uint32_t CC[6];
+} NRF_TIMER_Type;
+
+typedef struct
+{
+    volatile uint32_t COUNTER;
+    volatile uint32_t PRESCALER;
+} NRF_RTC_Type;
+
+typedef struct
+{
+    volatile uint32_t RESETREAS;
+} NRF_POWER_Type;
+
+extern NRF_TIMER_Type fake_timer1;
+extern NRF_RTC_Type   fake_rtc1;
+extern NRF_POWER_Type fake_power;
+
+#define NRF_TIMER1 (&fake_timer1)
+#define NRF_RTC1 (&fake_rtc1)
+#define NRF_POWER (&fake_power)
+
+#define TIMER_MODE_MODE_Timer 0UL
+#define TIMER_BITMODE_BITMODE_32Bit 3UL
+
+#define RTC_COUNTER_COUNTER_Msk 0xFFFFFFUL
+
+// core_cm4.h, the cycle counter. It runs on the host's monotonic clock, not
+// on virtual time, one cycle per nanosecond.
+
+typedef struct
+{
+    volatile uint32_t CTRL;
+    volatile uint32_t CYCCNT;
+} DWT_Type;
+
+typedef struct
+{
+    volatile uint32_t DEMCR;
+} CoreDebug_Type;
+
+extern CoreDebug_Type fake_core_debug;
+
+/**
+ * @brief Bring CYCCNT up to date and return the DWT, every access to DWT
+ * goes through here
+ *
+ */
+DWT_Type *fake_dwt(void);
+
+#define DWT (fake_dwt())
+#define CoreDebug (&fake_core_debug)
+
+#define DWT_CTRL_CYCCNTENA_Msk (0x1UL << 0)
+#define CoreDebug_DEMCR_TRCENA_Msk (0x1UL << 24)
+
+#define POWER_RESETREAS_RESETPIN_Msk (0x1UL << 0)
+#define POWER_RESETREAS_DOG_Msk (0x1UL << 1)
+#define POWER_RESETREAS_SREQ_Msk (0x1UL << 2)
+#define POWER_RESETREAS_LOCKUP_Msk (0x1UL << 3)
+#define POWER_RESETREAS_OFF_Msk (0x1UL << 16)
+#define POWER_RESETREAS_LPCOMP_Msk (0x1UL << 17)
+
+#define POWER_RAM_POWER_S0POWER_Pos 0UL
+#define POWER_RAM_POWER_S0POWER_On 1UL
+#define POWER_RAM_POWER_S0RETENTION_Pos 16UL
+#define POWER_RAM_POWER_S0RETENTION_On 1UL
+
+#define LPCOMP_REFSEL_REFSEL_Ref1_8 0UL
+#define LPCOMP_REFSEL_REFSEL_Ref1_16 8UL
+
+// app_timer.h, RTC1 runs at 32768 Hz
+
+#define APP_TIMER_CLOCK_FREQ 32768
+#define APP_TIMER_MIN_TIMEOUT_TICKS 5
+
+#define APP_TIMER_TICKS(MS)                                  \
+    ((uint32_t)ROUNDED_DIV((MS) * (uint64_t)APP_TIMER_CLOCK_FREQ, \
+                           1000 * (APP_TIMER_CONFIG_RTC_FREQUENCY + 1)))
+
+typedef void (*app_timer_timeout_handler_t)(void *p_context);
+
+typedef enum
+{
+    APP_TIMER_MODE_SINGLE_SHOT,
+    APP_TIMER_MODE_REPEATED
+} app_timer_mode_t;
+
+typedef struct
+{
+    app_timer_timeout_handler_t handler;
+    app_timer_mode_t            mode;
+    void *                      p_context;
+    uint32_t                    period; // ticks, repeated timers only
+    uint64_t                    expiry; // ticks since boot
+    uint32_t                    event;  // fake clock event, 0 if stopped
+} app_timer_t;
+
+typedef app_timer_t *app_timer_id_t;
+
+/**
+ * @brief What a timeout puts on the scheduler queue
+ *
+ */
+typedef struct
+{
+    app_timer_timeout_handler_t timeout_handler;
+    void *                      p_context;
+} app_timer_event_t;
+
+#define APP_TIMER_SCHED_EVENT_DATA_SIZE sizeof(app_timer_event_t)
+
+#define APP_TIMER_DEF(timer_id)                          \
+    static app_timer_t CONCAT_2(timer_id, _data) = {0};  \
+    static const app_timer_id_t timer_id = &CONCAT_2(timer_id, _data)
+
+ret_code_t app_timer_init(void);
+ret_code_t app_timer_create(app_timer_id_t const *     p_timer_id,
+                            app_timer_mode_t            mode,
+                            app_timer_timeout_handler_t timeout_handler);
+ret_code_t app_timer_start(app_timer_id_t timer_id, uint32_t timeout_ticks,
+                           void *p_context);
+ret_code_t app_timer_stop(app_timer_id_t timer_id);
+ret_code_t app_timer_stop_all(void);
+uint32_t   app_timer_cnt_get(void);
+uint32_t   app_timer_cnt_diff_compute(uint32_t ticks_to, uint32_t ticks_from);
+
+// app_scheduler.h
+
+typedef void (*app_sched_event_handler_t)(void *p_event_data,
+                                          uint16_t event_size);
+
+#define APP_SCHED_INIT(EVENT_SIZE, QUEUE_SIZE)                        \
+    do                                                                \
+    {                                                                 \
+        uint32_t ERR_CODE = app_sched_init((EVENT_SIZE), (QUEUE_SIZE), \
+                                           NULL);                     \
+        APP_ERROR_CHECK(ERR_CODE);                                    \
+    } while (0)
+
+uint32_t app_sched_init(uint16_t max_event_size, uint16_t queue_size,
+                        void *p_evt_buffer);
+void     app_sched_execute(void);
+uint32_t app_sched_event_put(void const *p_event_data, uint16_t event_size,
+                             app_sched_event_handler_t handler);
+
+// nrf_atomic.h
+
+typedef volatile uint32_t nrf_atomic_u32_t;
+typedef volatile uint32_t nrf_atomic_flag_t;
+
+static inline uint32_t nrf_atomic_u32_fetch_store(nrf_atomic_u32_t *p_data,
+                                                  uint32_t          value)
+{
+    return __atomic_exchange_n(p_data, value, __ATOMIC_SEQ_CST);
+}
+
+static inline uint32_t nrf_atomic_u32_store(nrf_atomic_u32_t *p_data,
+                                            uint32_t          value)
+{
+    __atomic_store_n(p_data, value, __ATOMIC_SEQ_CST);
+    return value;
+}
+
+static inline uint32_t nrf_atomic_u32_or(nrf_atomic_u32_t *p_data,
+                                         uint32_t          value)
+{
+    return __atomic_or_fetch(p_data, value, __ATOMIC_SEQ_CST);
+}
+
+static inline uint32_t nrf_atomic_u32_and(nrf_atomic_u32_t *p_data,
+                                          uint32_t          value)
+{
+    return __atomic_and_fetch(p_data, value, __ATOMIC_SEQ_CST);
+}
+
+static inline uint32_t nrf_atomic_u32_add(nrf_atomic_u32_t *p_data,
+                                          uint32_t          value)
+{
+    return __atomic_add_fetch(p_data, value, __ATOMIC_SEQ_CST);
+}
+
+static inline uint32_t nrf_atomic_flag_set_fetch(nrf_atomic_flag_t *p_data)
+{
+    return __atomic_exchange_n(p_data, 1, __ATOMIC_SEQ_CST);
+}
+
+static inline uint32_t nrf_atomic_flag_set(nrf_atomic_flag_t *p_data)
+{
+    __atomic_store_n(p_data, 1, __ATOMIC_SEQ_CST);
+    return 1;
+}
+
+static inline uint32_t nrf_atomic_flag_clear(nrf_atomic_flag_t *p_data)
+{
+    __atomic_store_n(p_data, 0, __ATOMIC_SEQ_CST);
+    return 0;
+}
+
+static inline uint32_t nrf_atomic_flag_clear_fetch(nrf_atomic_flag_t *p_data)
+{
+    return __atomic_exchange_n(p_data, 0, __ATOMIC_SEQ_CST);
+}
+
+// nrf_log.h, printed right away instead of deferred
+
+typedef enum
+{
+    FAKE_LOG_ERROR = 1,
+    FAKE_LOG_WARNING,
+    FAKE_LOG_INFO,
+    FAKE_LOG_DEBUG
+} fake_log_level_t;
+
+// Not format checked, NRF_LOG passes every argument as a uint32_t
+void fake_log(fake_log_level_t level, char const *p_fmt, ...);
+
+#define NRF_LOG_ERROR(...) fake_log(FAKE_LOG_ERROR, __VA_ARGS__)
+#define NRF_LOG_WARNING(...) fake_log(FAKE_LOG_WARNING, __VA_ARGS__)
+#define NRF_LOG_INFO(...) fake_log(FAKE_LOG_INFO, __VA_ARGS__)
+#define NRF_LOG_DEBUG(...) fake_log(FAKE_LOG_DEBUG, __VA_ARGS__)
+#define NRF_LOG_PUSH(_str) (_str)
+
+#define NRF_LOG_INIT(timestamp_func) \
+    (UNUSED_VARIABLE(timestamp_func), NRF_SUCCESS)
+#define NRF_LOG_DEFAULT_BACKENDS_INIT()
+#define NRF_LOG_PROCESS() false
+#define NRF_LOG_FLUSH()
+#define NRF_LOG_FINAL_FLUSH()
+
+// nrf_pwr_mgmt.h, nrf_delay.h
+
+ret_code_t nrf_pwr_mgmt_init(void);
+
+/**
+ * @brief Sleep until the next event of the fake clock
+ *
+ * @details This is where virtual time passes, see fake_idle_handler_set().
+ */
+void nrf_pwr_mgmt_run(void);
+
+/**
+ * @brief Busy wait, time passes without anything running meanwhile
+ *
+ */
+void nrf_delay_us(uint32_t us);
+
+static inline void nrf_delay_ms(uint32_t ms) { nrf_delay_us(ms * 1000); }
+
+// SEGGER_RTT.h
+
+#define SEGGER_RTT_MODE_NO_BLOCK_SKIP 0
+
+int      SEGGER_RTT_ConfigUpBuffer(unsigned BufferIndex, const char *sName,
+                                   void *pBuffer, unsigned BufferSize,
+                                   unsigned Flags);
+unsigned SEGGER_RTT_WriteNoLock(unsigned BufferIndex, const void *pBuffer,
+                                unsigned NumBytes);
+
+// crc16.h
+
+uint16_t crc16_compute(uint8_t const *p_data, uint32_t size,
+                       uint16_t const *p_crc);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // FAKE_SDK_H
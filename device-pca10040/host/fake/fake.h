@@ -0,0 +1,376 @@
+/**
+ * Copyright (c) 2018 Keith Wakeham
+ *
+ * All rights reserved.
+ *
+ *
+ */
+
+#ifndef FAKE_H
+#define FAKE_H
+
+// Control side of the host fakes, for the program that runs the firmware.
+//
+// The firmware runs on its own stack from firmware_main(), main.c built with
+// -Dmain=firmware_main. Time is virtual. Nothing the firmware does in main
+// context or in a handler takes any unless fake_cpu_time_set() says so, it
+// only passes when the firmware sleeps in nrf_pwr_mgmt_run(): the clock jumps
+// to the earliest pending event and runs it, the way WFE returns on the next
+// interrupt. Events at the same time run in order of priority, then in the
+// order they were added.
+//
+// Everything the host injects, a connection, a write, a SAADC conversion, is
+// queued as such an event for the current time, so the firmware always sees
+// it from an "interrupt" on its own stack, never from the host's.
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "fake-ble.h"
+#include "fake-nrfx.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define FAKE_NS_PER_US 1000ULL
+#define FAKE_NS_PER_MS 1000000ULL
+#define FAKE_NS_PER_S 1000000000ULL
+
+// Event priorities, lower runs first. The SoftDevice ones come before the
+// application interrupts like on target.
+enum
+{
+    FAKE_PRIO_RADIO = 0,     // connection events, SoftDevice internal
+    FAKE_PRIO_SD_EVT = 4,    // SD_EVT_IRQn, BLE and SoC events to observers
+    FAKE_PRIO_SAADC = 6,     // NRFX_SAADC_CONFIG_IRQ_PRIORITY and peripherals
+    FAKE_PRIO_RTC1 = 7,      // app_timer
+    FAKE_PRIO_HOST = 15,     // host actions, after everything else
+};
+
+typedef void (*fake_event_handler_t)(void *p_context);
+
+// fake-clock.c
+
+/**
+ * @brief Current virtual time in nanoseconds since boot
+ *
+ */
+uint64_t fake_time_ns(void);
+
+/**
+ * @brief 32768 Hz ticks since boot at a time, what RTC1 and RTC2 count
+ *
+ */
+uint64_t fake_lfclk_ticks(uint64_t at_ns);
+
+/**
+ * @brief First nanosecond at which the 32768 Hz clock shows this tick
+ *
+ */
+uint64_t fake_lfclk_ns(uint64_t ticks);
+
+/**
+ * @brief Add an event to the clock
+ *
+ * @param at_ns when to run it, not before the current time
+ * @param prio lower runs first among events at the same time
+ * @return id for fake_event_cancel(), never 0
+ */
+uint32_t fake_event_at(uint64_t at_ns, uint8_t prio,
+                       fake_event_handler_t handler, void *p_context);
+
+/**
+ * @brief Remove an event that has not run yet, unknown ids are ignored
+ *
+ */
+void fake_event_cancel(uint32_t id);
+
+/**
+ * @brief Let every event of a priority keep the CPU for a while
+ *
+ * @details 0 by default, handlers take no time. Otherwise the clock moves on
+ * by ns after the handler and events that fall due meanwhile run late, the
+ * highest priority first. An event is not preempted, one of a higher
+ * priority waits for it as well.
+ *
+ * @param prio FAKE_PRIO_RADIO for the SoftDevice's share of a connection
+ * event, or the priority of an application interrupt
+ */
+void fake_cpu_time_set(uint8_t prio, uint64_t ns);
+
+/**
+ * @brief Advance to the earliest event and run it
+ *
+ * @return false if there was none
+ */
+bool fake_run_next(void);
+
+/**
+ * @brief Start firmware_main() on its own stack
+ *
+ * @details Returns when the firmware first goes to sleep with nothing due.
+ */
+void fake_firmware_boot(void);
+
+/**
+ * @brief Let the firmware run until the clock reaches at_ns
+ *
+ * @details The main loop gets to run between events, like on target. Returns
+ * early if the firmware went to system off.
+ */
+void fake_run_until(uint64_t at_ns);
+
+/**
+ * @brief Let the firmware run for another ns nanoseconds
+ *
+ */
+void fake_run_for(uint64_t ns);
+
+/**
+ * @brief Check if the firmware called sd_power_system_off()
+ *
+ */
+bool fake_system_off(void);
+
+// fake-app.c
+
+/**
+ * @brief Only print log lines up to this level, FAKE_LOG_INFO by default
+ *
+ */
+void fake_log_level_set(fake_log_level_t level);
+
+/**
+ * @brief Number of calls to an SDK function since the last reset
+ *
+ * @param p_name function name, e.g. "sd_ble_gatts_hvx"
+ */
+uint32_t fake_calls(char const *p_name);
+
+void fake_calls_reset(void);
+
+/**
+ * @brief Count a call, used by every fake SDK function
+ *
+ */
+void fake_call_record(char const *p_name);
+
+#define FAKE_CALL() fake_call_record(__func__)
+
+// fake-nrfx.c
+
+typedef int16_t (*fake_saadc_input_t)(uint64_t at_ns, void *p_context);
+
+/**
+ * @brief Hold the SAADC input at a fixed code from now on
+ *
+ */
+void fake_saadc_input_set(int16_t code);
+
+/**
+ * @brief Sample the SAADC input from a waveform instead
+ *
+ * @details Called with the time of the middle of each conversion.
+ */
+void fake_saadc_input_fn_set(fake_saadc_input_t input, void *p_context);
+
+/**
+ * @brief Time from a SAMPLE task to the conversion result
+ *
+ * @details (2^oversample) * 12 us by default, the burst the firmware assumes.
+ */
+void fake_saadc_conversion_time_set(uint64_t ns);
+
+/**
+ * @brief Finish a conversion with this code right away, as if SAMPLE had been
+ * triggered a conversion time ago
+ *
+ */
+void fake_saadc_convert(int16_t code);
+
+/**
+ * @brief Number of SAADC conversions that completed into a buffer
+ *
+ */
+uint32_t fake_saadc_conversions(void);
+
+// fake-ble.c
+
+typedef struct
+{
+    uint8_t hvn_queue_size;    // notifications the SoftDevice holds per link
+    uint8_t packets_per_event; // notifications sent per connection event
+} fake_ble_link_config_t;
+
+/**
+ * @brief A notification or indication the central received
+ *
+ */
+typedef struct
+{
+    uint64_t queued_ns; // when sd_ble_gatts_hvx accepted it
+    uint64_t sent_ns;   // connection event it went out in
+    uint16_t conn_handle;
+    uint16_t handle;
+    uint8_t  type;
+    uint16_t len;
+    uint8_t  data[NRF_SDH_BLE_GATT_MAX_MTU_SIZE - 3];
+} fake_ble_hvx_t;
+
+typedef void (*fake_ble_hvx_handler_t)(fake_ble_hvx_t const *p_hvx,
+                                       void *                p_context);
+
+/**
+ * @brief A connection event as it starts
+ *
+ */
+typedef struct
+{
+    uint64_t at_ns;
+    uint64_t interval_ns;
+    uint16_t conn_handle;
+    uint8_t  hvn_queued; // notifications waiting in the SoftDevice
+    uint8_t  hvn_sent;   // how many of them this event sends
+    bool     indication; // an indication goes out as well
+} fake_ble_conn_evt_t;
+
+typedef void (*fake_ble_conn_evt_handler_t)(fake_ble_conn_evt_t const *p_evt,
+                                            void *p_context);
+
+/**
+ * @brief Link settings for connections made from now on
+ *
+ * @details The default is the S132 one, a queue of 1 and as many packets as
+ * fit in the event.
+ */
+void fake_ble_link_config_set(fake_ble_link_config_t const *p_config);
+
+/**
+ * @brief Get every notification and indication as it goes on air
+ *
+ */
+void fake_ble_hvx_handler_set(fake_ble_hvx_handler_t handler,
+                              void *                 p_context);
+
+/**
+ * @brief Get every connection event, before the hvx handler sees what it
+ * sends
+ *
+ */
+void fake_ble_conn_evt_handler_set(fake_ble_conn_evt_handler_t handler,
+                                   void *                      p_context);
+
+/**
+ * @brief Whether the central takes parameter update requests, true by
+ * default
+ *
+ */
+void fake_ble_conn_param_accept_set(bool accept);
+
+/**
+ * @brief Connect a central with the given parameters
+ *
+ * @details Connection events start one interval later and repeat by
+ * themselves, each sends what the SoftDevice has queued.
+ *
+ * @return the connection handle, BLE_CONN_HANDLE_INVALID if every link is in
+ * use or not advertising
+ */
+uint16_t fake_ble_connect(ble_gap_conn_params_t const *p_params);
+
+void fake_ble_disconnect(uint16_t conn_handle, uint8_t reason);
+
+/**
+ * @brief Write an attribute from the central
+ *
+ * @details A CCCD keeps its value per connection, like the SoftDevice does.
+ * A value longer than the attribute takes is refused like the SoftDevice
+ * refuses it, the firmware sees nothing of it.
+ *
+ * @return false if it was refused
+ */
+bool fake_ble_write(uint16_t conn_handle, uint16_t handle,
+                    uint8_t const *p_data, uint16_t len);
+
+/**
+ * @brief Read an attribute like the central would
+ *
+ * @return its length, 0 for an unknown handle
+ */
+uint16_t fake_ble_read(uint16_t conn_handle, uint16_t handle, uint8_t *p_data,
+                       uint16_t max_len);
+
+/**
+ * @brief Value handle of the first characteristic with this 16-bit UUID
+ *
+ */
+uint16_t fake_ble_value_handle(uint16_t uuid);
+
+/**
+ * @brief CCCD handle of the first characteristic with this 16-bit UUID
+ *
+ */
+uint16_t fake_ble_cccd_handle(uint16_t uuid);
+
+/**
+ * @brief Connection interval of a link in microseconds, 0 if not connected
+ *
+ */
+uint32_t fake_ble_conn_interval_us(uint16_t conn_handle);
+
+/**
+ * @brief Press a button, delivered to the BSP event handler
+ *
+ */
+void fake_bsp_event(bsp_event_t event);
+
+// fake-central.c
+
+/**
+ * @brief Write an attribute from the central, then run the clock for 20 ms
+ *
+ * @return false if it was refused, see fake_ble_write()
+ */
+bool fake_central_write(uint16_t conn_handle, uint16_t handle,
+                        uint8_t const *p_data, uint16_t len);
+
+/**
+ * @brief Connect a central at a fixed interval, without slave latency
+ *
+ * @return the connection handle, BLE_CONN_HANDLE_INVALID if not advertising
+ */
+uint16_t fake_central_connect(double interval_ms);
+
+/**
+ * @brief Set a parameter through the config characteristic
+ *
+ * @param id a param_id_t
+ * @return true if the firmware took it
+ */
+bool fake_central_param_set(uint16_t conn_handle, uint8_t id, uint16_t value);
+
+/**
+ * @brief Turn steering notifications on or off
+ *
+ */
+void fake_central_subscribe(uint16_t conn_handle, bool enable);
+
+/**
+ * @brief Go through the handshake Zwift does before it takes steering data
+ *
+ */
+void fake_central_handshake(uint16_t conn_handle);
+
+/**
+ * @brief Subscribe and go through the handshake, steering data streams after
+ *
+ */
+void fake_central_start(uint16_t conn_handle);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // FAKE_H
@@ -0,0 +1,2 @@
+// SDK header name for the host build, see fake-fds.h
+#include "fake-fds.h"
@@ -0,0 +1,2 @@
+// SDK header name for the host build, see fake-nrfx.h
+#include "fake-nrfx.h"
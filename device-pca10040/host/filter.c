@@ -0,0 +1,278 @@
+/**
+ * Copyright (c) 2018 Keith Wakeham
+ *
+ * All rights reserved.
+ *
+ *
+ */
+
+// The One Euro smoothing of steer-adc.c fed synthetic steps and ramps
+// through the fake SAADC, once with the default PARAM_FILTER_BETA and once
+// with 0, which leaves a plain low pass at PARAM_FILTER_MIN_CUTOFF. Each run
+// holds the stick still with noise on it, steps it and ramps it back.
+//
+// Times are taken from the sample timestamps, the decimator's delay is not
+// part of them. The smoothed code is read from sample, the global the
+// firmware keeps it in.
+//
+// Exits 1 when the default filter lets the noise through at rest, or takes
+// much longer than it should to follow the step or the ramp, or is no faster
+// than the plain low pass at either.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "app_scheduler.h"
+#include "fake.h"
+#include "fds.h"
+#include "params.h"
+#include "steer-adc.h"
+#include "storage.h"
+
+#define CENTRE_CODE (MAX_ADC_RESOLUTION / 2)
+// Noise at rest, held for NOISE_HOLD_NS so the decimator lets some of it
+// through
+#define NOISE_CODES 24
+#define NOISE_HOLD_NS (20 * FAKE_NS_PER_MS)
+
+#define REST_NS (2 * FAKE_NS_PER_S)
+#define STEP_CODES 2000
+#define STEP_NS (2 * FAKE_NS_PER_S)
+// Back to the centre at this many codes per second
+#define RAMP_CODES_PER_S 4000
+
+// Within this much of the target the step counts as followed
+#define SETTLE_CODES (STEP_CODES / 20)
+
+// What the default filter has to do. A first order low pass lags a ramp by
+// 1 / (2 pi cutoff), the default parameters put the cutoff at 2.5 Hz at the
+// ramp's speed, 64 ms. The step also waits for the decimator's taps.
+#define MAX_JITTER_CODES (2 * NOISE_CODES / 4)
+#define MAX_SETTLE_MS 200
+#define MAX_RAMP_LAG_MS 80
+// and how much faster than the plain low pass, 1 Hz lags by 159 ms
+#define MIN_SPEED_UP 2
+
+#define SCHED_QUEUE_SIZE 10
+
+extern int16_t sample;
+
+typedef enum
+{
+    SHAPE_REST,
+    SHAPE_STEP,
+    SHAPE_RAMP,
+} shape_t;
+
+typedef struct
+{
+    int32_t min;  // at rest, the last second
+    int32_t max;
+    double  settle_ms;
+    double  ramp_lag_ms;
+} response_t;
+
+static struct
+{
+    shape_t  shape;
+    uint64_t start_ns;  // of the current shape
+} m_input;
+
+static uint32_t noise_hash(uint64_t slot)
+{
+    uint32_t x = (uint32_t)slot * 2654435761u;
+
+    x ^= x >> 15;
+    x *= 0x2c1b3c6dU;
+    x ^= x >> 12;
+
+    return x;
+}
+
+/**
+ * @brief The code on the pin at a time, without noise
+ *
+ */
+static double input_level(uint64_t at_ns)
+{
+    double since_s;
+
+    switch (m_input.shape)
+    {
+        case SHAPE_STEP:
+            return (at_ns >= m_input.start_ns) ? CENTRE_CODE + STEP_CODES
+                                               : CENTRE_CODE;
+
+        case SHAPE_RAMP:
+            since_s = (at_ns > m_input.start_ns)
+                          ? (double)(at_ns - m_input.start_ns) / FAKE_NS_PER_S
+                          : 0;
+            return MAX(CENTRE_CODE,
+                       CENTRE_CODE + STEP_CODES - RAMP_CODES_PER_S * since_s);
+
+        default:
+            return CENTRE_CODE;
+    }
+}
+
+static int16_t synthetic_input(uint64_t at_ns, void *p_context)
+{
+    double level = input_level(at_ns);
+
+    UNUSED_PARAMETER(p_context);
+
+    if (m_input.shape == SHAPE_REST)
+    {
+        level += (int32_t)(noise_hash(at_ns / NOISE_HOLD_NS) %
+                           (2 * NOISE_CODES + 1)) -
+                 NOISE_CODES;
+    }
+
+    return (int16_t)lround(level);
+}
+
+static double ticks_to_ms(uint32_t ticks)
+{
+    return (double)ticks * 1000 / 32768;
+}
+
+/**
+ * @brief Run the clock like the firmware's main loop would
+ *
+ * @param handler called for every smoothed sample, with its timestamp
+ */
+static void run_for(uint64_t ns, void (*handler)(uint32_t timestamp))
+{
+    uint64_t until = fake_time_ns() + ns;
+
+    while (fake_time_ns() < until && fake_run_next())
+    {
+        app_sched_execute();
+        if (steering_process() && handler != NULL)
+        {
+            handler(get_sample_timestamp());
+        }
+    }
+}
+
+static response_t m_response;
+static uint32_t   m_start_tick;
+static uint32_t   m_rest_from_tick;
+static bool       m_settled;
+
+static void rest_sample(uint32_t timestamp)
+{
+    if (app_timer_cnt_diff_compute(timestamp, m_start_tick) >=
+        m_rest_from_tick)
+    {
+        m_response.min = MIN(m_response.min, sample);
+        m_response.max = MAX(m_response.max, sample);
+    }
+}
+
+static void step_sample(uint32_t timestamp)
+{
+    bool within = abs(sample - (CENTRE_CODE + STEP_CODES)) <= SETTLE_CODES;
+
+    // The first sample that is within and stays there
+    if (within && !m_settled)
+    {
+        m_response.settle_ms =
+            ticks_to_ms(app_timer_cnt_diff_compute(timestamp, m_start_tick));
+    }
+    m_settled = within;
+}
+
+static void ramp_sample(uint32_t timestamp)
+{
+    uint32_t since = app_timer_cnt_diff_compute(timestamp, m_start_tick);
+    double   level;
+
+    // Only while the ramp runs, well clear of its ends
+    if (ticks_to_ms(since) < 100 ||
+        ticks_to_ms(since) > 1000.0 * STEP_CODES / RAMP_CODES_PER_S - 100)
+    {
+        return;
+    }
+    level = CENTRE_CODE + STEP_CODES - RAMP_CODES_PER_S * ticks_to_ms(since) /
+                                           1000;
+    m_response.ramp_lag_ms =
+        MAX(m_response.ramp_lag_ms,
+            (sample - level) * 1000 / RAMP_CODES_PER_S);
+}
+
+static void shape_start(shape_t shape)
+{
+    m_input.shape = shape;
+    m_input.start_ns = fake_time_ns();
+    m_start_tick = app_timer_cnt_get();
+}
+
+static response_t response_measure(void)
+{
+    memset(&m_response, 0, sizeof(m_response));
+    m_response.min = INT32_MAX;
+    m_response.max = INT32_MIN;
+    m_response.settle_ms = INFINITY;
+
+    shape_start(SHAPE_REST);
+    m_rest_from_tick = (uint32_t)((REST_NS / 2) * 32768 / FAKE_NS_PER_S);
+    run_for(REST_NS, rest_sample);
+
+    shape_start(SHAPE_STEP);
+    m_settled = false;
+    run_for(STEP_NS, step_sample);
+
+    shape_start(SHAPE_RAMP);
+    run_for(FAKE_NS_PER_S * STEP_CODES / RAMP_CODES_PER_S + FAKE_NS_PER_S,
+            ramp_sample);
+
+    return m_response;
+}
+
+static void response_print(char const *p_name, response_t const *p_response)
+{
+    printf("%-12s at rest %d codes peak to peak, step within %d codes after "
+           "%.1f ms, ramp lag %.1f ms\n",
+           p_name, p_response->max - p_response->min, SETTLE_CODES,
+           p_response->settle_ms, p_response->ramp_lag_ms);
+}
+
+int main(void)
+{
+    ret_code_t err_code;
+    response_t one_euro;
+    response_t low_pass;
+    bool       ok;
+
+    APP_SCHED_INIT(APP_TIMER_SCHED_EVENT_DATA_SIZE, SCHED_QUEUE_SIZE);
+
+    fake_saadc_input_fn_set(synthetic_input, NULL);
+
+    params_init(NULL);
+    storage_init();
+    err_code = fds_init();
+    APP_ERROR_CHECK(err_code);
+    steering_init(NULL);
+
+    one_euro = response_measure();
+
+    err_code = params_set(PARAM_FILTER_BETA, 0);
+    APP_ERROR_CHECK(err_code);
+    low_pass = response_measure();
+
+    printf("input        at rest %d codes peak to peak, step of %d codes, "
+           "ramp at %d codes/s\n",
+           2 * NOISE_CODES, STEP_CODES, RAMP_CODES_PER_S);
+    response_print("One Euro", &one_euro);
+    response_print("low pass", &low_pass);
+
+    ok = one_euro.max - one_euro.min <= MAX_JITTER_CODES &&
+         one_euro.settle_ms <= MAX_SETTLE_MS &&
+         one_euro.ramp_lag_ms <= MAX_RAMP_LAG_MS &&
+         one_euro.settle_ms * MIN_SPEED_UP <= low_pass.settle_ms &&
+         one_euro.ramp_lag_ms * MIN_SPEED_UP <= low_pass.ramp_lag_ms;
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
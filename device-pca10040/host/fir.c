@@ -0,0 +1,265 @@
+/**
+ * Copyright (c) 2018 Keith Wakeham
+ *
+ * All rights reserved.
+ *
+ *
+ */
+
+// The SMLAD decimator in steer-fir.c against its scalar reference. Both get
+// the same blocks, random codes over the whole 14 bit range and restarts
+// included, and have to give the same output every time. A still input has
+// to come out unchanged.
+//
+// Then prints what the filter does to a sine at a few multiples of the
+// output rate next to the plain average of a block, and what a block costs
+// either way. Exits 1 on any mismatch.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "fake.h"
+#include "steer-adc.h"
+#include "steer-fir.h"
+
+#define RANDOM_BLOCKS 200000
+// Chance in 1/65536 that a random block starts over from steer_fir_init()
+#define RESTART_CHANCE 200
+#define TIMED_BLOCKS 1000000
+#define SINE_BLOCKS 2000
+#define SINE_AMPLITUDE 4000
+#define CENTRE_CODE (MAX_ADC_RESOLUTION / 2)
+// Of a uniform error of up to half a code
+#define ROUNDING_VARIANCE (1.0 / 12)
+
+static uint64_t m_random_state = 0x2545f4914f6cdd1dULL;
+
+static uint32_t random_next(void)
+{
+    m_random_state ^= m_random_state >> 12;
+    m_random_state ^= m_random_state << 25;
+    m_random_state ^= m_random_state >> 27;
+
+    return (uint32_t)((m_random_state * 0x2545f4914f6cdd1dULL) >> 32);
+}
+
+static int16_t random_code(void)
+{
+    // Signed 14 bit, a single ended input can read a little below 0
+    return (int16_t)((int32_t)(random_next() % MAX_ADC_RESOLUTION * 2) -
+                     MAX_ADC_RESOLUTION);
+}
+
+static uint64_t monotonic_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * FAKE_NS_PER_S + (uint64_t)ts.tv_nsec;
+}
+
+static uint32_t check_random(void)
+{
+    steer_fir_t           fir;
+    steer_fir_reference_t reference;
+    int16_t               block[STEER_FIR_DECIMATION];
+    uint32_t              mismatches = 0;
+
+    steer_fir_init(&fir);
+    steer_fir_reference_init(&reference);
+    for (uint32_t n = 0; n < RANDOM_BLOCKS; n++)
+    {
+        int16_t out;
+        int16_t expected;
+
+        if ((random_next() & 0xffff) < RESTART_CHANCE)
+        {
+            steer_fir_init(&fir);
+            steer_fir_reference_init(&reference);
+        }
+        for (uint32_t i = 0; i < STEER_FIR_DECIMATION; i++)
+        {
+            block[i] = random_code();
+        }
+        // Every so often a block at one end of the range
+        if ((n % 97) == 0)
+        {
+            int16_t code = (n & 1) ? MAX_ADC_RESOLUTION - 1
+                                   : -MAX_ADC_RESOLUTION;
+
+            for (uint32_t i = 0; i < STEER_FIR_DECIMATION; i++)
+            {
+                block[i] = code;
+            }
+        }
+
+        out = steer_fir_decimate(&fir, block);
+        expected = steer_fir_reference_decimate(&reference, block);
+        if (out != expected)
+        {
+            if (mismatches < 10)
+            {
+                printf("block %u: decimate %d, reference %d\n", n, out,
+                       expected);
+            }
+            mismatches++;
+        }
+    }
+    printf("%u random blocks, %u mismatches\n", RANDOM_BLOCKS, mismatches);
+
+    return mismatches;
+}
+
+static uint32_t check_still(void)
+{
+    static int16_t const codes[] = {0, 1, 4095, CENTRE_CODE, 12345,
+                                    MAX_ADC_RESOLUTION - 1};
+    uint32_t             errors = 0;
+
+    for (uint32_t c = 0; c < ARRAY_SIZE(codes); c++)
+    {
+        steer_fir_t fir;
+        int16_t     block[STEER_FIR_DECIMATION];
+
+        for (uint32_t i = 0; i < STEER_FIR_DECIMATION; i++)
+        {
+            block[i] = codes[c];
+        }
+        steer_fir_init(&fir);
+        // The first output is primed with the same block
+        for (uint32_t n = 0; n < STEER_FIR_BLOCKS + 1; n++)
+        {
+            int16_t out = steer_fir_decimate(&fir, block);
+
+            if (out != codes[c])
+            {
+                printf("still at %d: block %u gives %d\n", codes[c], n, out);
+                errors++;
+            }
+        }
+    }
+    printf("still input: %u errors\n", errors);
+
+    return errors;
+}
+
+/**
+ * @brief RMS of the output around its mean over the RMS of the input, for a
+ * sine at a multiple of the output rate
+ *
+ */
+static void sine_gain(double cycles_per_block, double *p_fir_db,
+                      double *p_average_db)
+{
+    steer_fir_t fir;
+    int16_t     block[STEER_FIR_DECIMATION];
+    double      fir_sum = 0, fir_sum2 = 0;
+    double      avg_sum = 0, avg_sum2 = 0;
+    uint32_t    count = 0;
+
+    steer_fir_init(&fir);
+    for (uint32_t n = 0; n < SINE_BLOCKS; n++)
+    {
+        int32_t sum = 0;
+        double  out;
+
+        for (uint32_t i = 0; i < STEER_FIR_DECIMATION; i++)
+        {
+            double t = n + (double)i / STEER_FIR_DECIMATION;
+
+            block[i] = (int16_t)lrint(
+                CENTRE_CODE +
+                SINE_AMPLITUDE * sin(2 * M_PI * cycles_per_block * t));
+            sum += block[i];
+        }
+        out = steer_fir_decimate(&fir, block);
+        // Skip the start up
+        if (n < STEER_FIR_BLOCKS)
+        {
+            continue;
+        }
+        fir_sum += out;
+        fir_sum2 += out * out;
+        out = (double)sum / STEER_FIR_DECIMATION;
+        avg_sum += out;
+        avg_sum2 += out * out;
+        count++;
+    }
+
+    // Rounding to whole codes is the floor, what is left below that reads 0
+    *p_fir_db = 10 * log10(MAX(fir_sum2 / count - pow(fir_sum / count, 2),
+                               ROUNDING_VARIANCE) /
+                           (SINE_AMPLITUDE * SINE_AMPLITUDE / 2.0));
+    *p_average_db = 10 * log10(MAX(avg_sum2 / count - pow(avg_sum / count, 2),
+                                   ROUNDING_VARIANCE) /
+                               (SINE_AMPLITUDE * SINE_AMPLITUDE / 2.0));
+}
+
+static void print_response(void)
+{
+    // Off the multiples of the output rate, those alias to a constant
+    static double const rates[] = {0.05, 0.1, 0.2, 0.3, 0.45, 0.7,
+                                   1.3,  2.3, 4.7, 9.7, 19.3};
+
+    printf("\n%-22s %10s %10s\n", "sine / output rate", "fir dB",
+           "average dB");
+    for (uint32_t r = 0; r < ARRAY_SIZE(rates); r++)
+    {
+        double fir_db;
+        double average_db;
+
+        sine_gain(rates[r], &fir_db, &average_db);
+        printf("%-22.2f %10.1f %10.1f\n", rates[r], fir_db, average_db);
+    }
+}
+
+static void print_cost(void)
+{
+    steer_fir_t           fir;
+    steer_fir_reference_t reference;
+    int16_t               block[STEER_FIR_DECIMATION];
+    volatile int16_t      sink;
+    uint64_t              start;
+    double                fir_ns;
+    double                reference_ns;
+
+    for (uint32_t i = 0; i < STEER_FIR_DECIMATION; i++)
+    {
+        block[i] = random_code();
+    }
+
+    steer_fir_init(&fir);
+    start = monotonic_ns();
+    for (uint32_t n = 0; n < TIMED_BLOCKS; n++)
+    {
+        sink = steer_fir_decimate(&fir, block);
+    }
+    fir_ns = (double)(monotonic_ns() - start) / TIMED_BLOCKS;
+
+    steer_fir_reference_init(&reference);
+    start = monotonic_ns();
+    for (uint32_t n = 0; n < TIMED_BLOCKS; n++)
+    {
+        sink = steer_fir_reference_decimate(&reference, block);
+    }
+    reference_ns = (double)(monotonic_ns() - start) / TIMED_BLOCKS;
+    UNUSED_VARIABLE(sink);
+
+    printf("\n%u taps, %u conversions per block: decimate %.0f ns, "
+           "reference %.0f ns per block on the host\n",
+           STEER_FIR_TAPS, STEER_FIR_DECIMATION, fir_ns, reference_ns);
+}
+
+int main(void)
+{
+    uint32_t failures = 0;
+
+    failures += check_random();
+    failures += check_still();
+    print_response();
+    print_cost();
+
+    return (failures == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,317 @@
+/**
+ * Copyright (c) 2018 Keith Wakeham
+ *
+ * All rights reserved.
+ *
+ *
+ */
+
+// The flash maintenance of storage.c on the fake FDS, without the rest of
+// the firmware. Records are saved in bursts, while held back as if a central
+// was streaming, until the flash is full, and flushed the way the firmware
+// does before system off. fds_record_write(), fds_record_update() and
+// fds_gc() are wrapped to see every operation storage.c hands to FDS.
+//
+// Exits 1 when two operations are in flight at once, when a held back one
+// goes out or a small write does not, when a write that found the flash
+// full is not retried after a garbage collection, when storage_flush() calls
+// back before everything is done, or when a record does not read back as
+// saved last or its length is not told right.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "app_scheduler.h"
+#include "fake.h"
+#include "fds.h"
+#include "storage.h"
+
+// storage.c, writes up to this many words go out while held back
+#define SMALL_WRITE_WORDS 4
+
+#define SMALL_WORDS 2
+#define LARGE_WORDS 32
+// The largest record the fake FDS takes, the flash fills after a few
+#define FULL_WORDS 128
+#define FULL_SAVES 40
+
+#define KEY_FIRST 0x0100
+
+#define SCHED_QUEUE_SIZE 10
+
+ret_code_t __real_fds_record_write(fds_record_desc_t *const  p_desc,
+                                   fds_record_t const *const p_record);
+ret_code_t __real_fds_record_update(fds_record_desc_t *const  p_desc,
+                                    fds_record_t const *const p_record);
+ret_code_t __real_fds_gc(void);
+
+static struct
+{
+    uint32_t in_flight;
+    uint32_t in_flight_max;
+    uint32_t writes;
+    uint32_t large_writes;
+    uint32_t gc_runs;
+    uint32_t full;  // writes FDS refused for lack of room
+    uint32_t idle_calls;
+    bool     idle_early; // the idle handler came with work left
+} m_test;
+
+static uint32_t m_small[SMALL_WORDS];
+static uint32_t m_large[LARGE_WORDS];
+static uint32_t m_full[2][FULL_WORDS];
+
+static void op_issued(ret_code_t err_code)
+{
+    if (err_code == FDS_ERR_NO_SPACE_IN_FLASH)
+    {
+        m_test.full++;
+    }
+    if (err_code != NRF_SUCCESS)
+    {
+        return;
+    }
+    m_test.in_flight++;
+    m_test.in_flight_max = MAX(m_test.in_flight_max, m_test.in_flight);
+}
+
+static void record_issued(fds_record_t const *p_record, ret_code_t err_code)
+{
+    op_issued(err_code);
+    if (err_code == NRF_SUCCESS &&
+        p_record->data.length_words > SMALL_WRITE_WORDS)
+    {
+        m_test.large_writes++;
+    }
+}
+
+ret_code_t __wrap_fds_record_write(fds_record_desc_t *const  p_desc,
+                                   fds_record_t const *const p_record)
+{
+    ret_code_t err_code = __real_fds_record_write(p_desc, p_record);
+
+    record_issued(p_record, err_code);
+
+    return err_code;
+}
+
+ret_code_t __wrap_fds_record_update(fds_record_desc_t *const  p_desc,
+                                    fds_record_t const *const p_record)
+{
+    ret_code_t err_code = __real_fds_record_update(p_desc, p_record);
+
+    record_issued(p_record, err_code);
+
+    return err_code;
+}
+
+ret_code_t __wrap_fds_gc(void)
+{
+    ret_code_t err_code = __real_fds_gc();
+
+    op_issued(err_code);
+
+    return err_code;
+}
+
+static void fds_evt_handler(fds_evt_t const *p_evt)
+{
+    switch (p_evt->id)
+    {
+        case FDS_EVT_WRITE:
+        case FDS_EVT_UPDATE:
+            m_test.in_flight--;
+            m_test.writes++;
+            break;
+
+        case FDS_EVT_GC:
+            m_test.in_flight--;
+            m_test.gc_runs++;
+            break;
+
+        default:
+            break;
+    }
+}
+
+static void idle_handler(void)
+{
+    storage_stats_t stats;
+
+    storage_stats_get(&stats);
+    m_test.idle_early |= m_test.in_flight > 0 || stats.pending > 0;
+    m_test.idle_calls++;
+}
+
+/**
+ * @brief Run the clock like the firmware's main loop would
+ *
+ * @details The scheduler goes first, work may wait there with nothing on
+ * the clock.
+ */
+static void run_for(uint64_t ns)
+{
+    uint64_t until = fake_time_ns() + ns;
+
+    do
+    {
+        app_sched_execute();
+    } while (fake_time_ns() < until && fake_run_next());
+}
+
+static void save(uint16_t key, void const *p_data, uint32_t size)
+{
+    ret_code_t err_code =
+        storage_record_save(STORAGE_FILE_CALIBRATION, key, p_data, size);
+
+    APP_ERROR_CHECK(err_code);
+}
+
+static bool stored(uint16_t key, void const *p_data, uint32_t size)
+{
+    uint32_t record[FULL_WORDS];
+
+    return storage_record_load(STORAGE_FILE_CALIBRATION, key, record, size) &&
+           memcmp(record, p_data, size) == 0;
+}
+
+static void fill(uint32_t *p_words, uint32_t count, uint32_t seed)
+{
+    for (uint32_t i = 0; i < count; i++)
+    {
+        p_words[i] = seed * 0x10001 + i;
+    }
+}
+
+static bool expect(bool condition, char const *p_what)
+{
+    storage_stats_t stats;
+
+    storage_stats_get(&stats);
+    printf("%-48s %3u writes, %2u gc, %2u deferred, %u pending%s\n", p_what,
+           stats.writes, stats.gc_runs, stats.deferred, stats.pending,
+           condition ? "" : "  FAILED");
+
+    return condition;
+}
+
+int main(void)
+{
+    ret_code_t      err_code;
+    storage_stats_t stats;
+    uint32_t        writes;
+    uint32_t        large_writes;
+    uint32_t        gc_runs;
+    uint32_t        saves = 0;
+    uint32_t        landed = 0;
+    bool            ok = true;
+
+    APP_SCHED_INIT(APP_TIMER_SCHED_EVENT_DATA_SIZE, SCHED_QUEUE_SIZE);
+    fake_log_level_set(FAKE_LOG_ERROR);
+
+    storage_init();
+    err_code = fds_register(fds_evt_handler);
+    APP_ERROR_CHECK(err_code);
+    err_code = fds_init();
+    APP_ERROR_CHECK(err_code);
+    run_for(10 * FAKE_NS_PER_MS);
+
+    // A burst, the second save of a key before it went out replaces the
+    // first
+    fill(m_small, SMALL_WORDS, 1);
+    fill(m_large, LARGE_WORDS, 2);
+    fill(m_full[0], FULL_WORDS, 3);
+    fill(m_full[1], FULL_WORDS, 4);
+    save(KEY_FIRST, m_small, sizeof(m_small));
+    save(KEY_FIRST + 1, m_large, sizeof(m_large));
+    save(KEY_FIRST + 2, m_full[0], sizeof(m_full[0]));
+    save(KEY_FIRST + 2, m_full[1], sizeof(m_full[1]));
+    run_for(FAKE_NS_PER_S);
+    storage_stats_get(&stats);
+    ok &= expect(m_test.writes == 3 && stats.writes == 3 &&
+                     stats.pending == 0 &&
+                     stored(KEY_FIRST, m_small, sizeof(m_small)) &&
+                     stored(KEY_FIRST + 1, m_large, sizeof(m_large)) &&
+                     stored(KEY_FIRST + 2, m_full[1], sizeof(m_full[1])),
+                 "a burst goes out, one write per record");
+
+    // Read with room for more, as a newer firmware would
+    memset(m_full[0], 0, sizeof(m_full[0]));
+    ok &= expect(storage_record_read(STORAGE_FILE_CALIBRATION, KEY_FIRST,
+                                     m_full[0], sizeof(m_full[0])) ==
+                         sizeof(m_small) &&
+                     memcmp(m_full[0], m_small, sizeof(m_small)) == 0 &&
+                     m_full[0][SMALL_WORDS] == 0 &&
+                     !storage_record_load(STORAGE_FILE_CALIBRATION, KEY_FIRST,
+                                          m_full[0], sizeof(m_full[0])),
+                 "a record reads back with its own length");
+
+    // Held back as while streaming, only the small write goes out
+    storage_hold_set(true);
+    writes = m_test.writes;
+    large_writes = m_test.large_writes;
+    gc_runs = m_test.gc_runs;
+    fill(m_small, SMALL_WORDS, 5);
+    fill(m_large, LARGE_WORDS, 6);
+    save(KEY_FIRST, m_small, sizeof(m_small));
+    save(KEY_FIRST + 1, m_large, sizeof(m_large));
+    storage_gc_request();
+    run_for(5 * FAKE_NS_PER_S);
+    storage_stats_get(&stats);
+    ok &= expect(m_test.writes == writes + 1 &&
+                     m_test.large_writes == large_writes &&
+                     m_test.gc_runs == gc_runs && stats.deferred == 2 &&
+                     stats.pending == 2 &&
+                     stored(KEY_FIRST, m_small, sizeof(m_small)),
+                 "held back, the small write goes out alone");
+
+    storage_hold_set(false);
+    run_for(FAKE_NS_PER_S);
+    storage_stats_get(&stats);
+    ok &= expect(m_test.writes == writes + 2 &&
+                     m_test.gc_runs == gc_runs + 1 && stats.pending == 0 &&
+                     stored(KEY_FIRST + 1, m_large, sizeof(m_large)),
+                 "the rest follows once no longer held");
+
+    // Updates leave the old copies behind until the flash is full
+    for (; saves < FULL_SAVES; saves++)
+    {
+        fill(m_full[saves % 2], FULL_WORDS, 10 + saves);
+        save(KEY_FIRST + 2, m_full[saves % 2], sizeof(m_full[0]));
+        run_for(100 * FAKE_NS_PER_MS);
+        // Each on its own, not only once the next one comes along
+        if (stored(KEY_FIRST + 2, m_full[saves % 2], sizeof(m_full[0])))
+        {
+            landed++;
+        }
+    }
+    storage_stats_get(&stats);
+    ok &= expect(m_test.full > 0 && m_test.gc_runs > gc_runs + 1 &&
+                     stats.failed == 0 && stats.pending == 0 &&
+                     landed == FULL_SAVES,
+                 "a full flash is collected and the write retried");
+
+    // What the firmware does before system off, with work held back
+    storage_hold_set(true);
+    fill(m_large, LARGE_WORDS, 7);
+    save(KEY_FIRST + 1, m_large, sizeof(m_large));
+    storage_gc_request();
+    run_for(FAKE_NS_PER_S);
+    storage_flush(idle_handler);
+    run_for(FAKE_NS_PER_S);
+    storage_stats_get(&stats);
+    ok &= expect(m_test.idle_calls == 1 && !m_test.idle_early &&
+                     stats.pending == 0 &&
+                     stored(KEY_FIRST + 1, m_large, sizeof(m_large)),
+                 "a flush runs what waits, then calls back");
+
+    storage_flush(idle_handler);
+    run_for(FAKE_NS_PER_MS);
+    ok &= expect(m_test.idle_calls == 2 && !m_test.idle_early,
+                 "with nothing waiting it calls back right away");
+
+    ok &= expect(m_test.in_flight_max == 1 && m_test.in_flight == 0,
+                 "one operation in flight at a time");
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
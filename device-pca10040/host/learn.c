@@ -0,0 +1,224 @@
+/**
+ * Copyright (c) 2018 Keith Wakeham
+ *
+ * All rights reserved.
+ *
+ *
+ */
+
+// The calibrator of calibration.c fed filtered codes directly, without the
+// sampler. The stick starts in a turn, comes to rest with noise on it, is
+// held in a turn long enough to look like rest, drifts, and is thrown to
+// both ends with spikes in between. Then the clock runs until the
+// calibration is saved.
+//
+// Exits 1 when the centre does not follow rest, follows a held turn or a
+// lone odd rest position, when a spike moves an endpoint or a held end does
+// not, when a code does not map where it should, or when the flash gets
+// written without a change worth it.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "app_scheduler.h"
+#include "calibration.h"
+#include "fake.h"
+#include "fds.h"
+#include "steer-adc.h"
+#include "storage.h"
+
+#define CENTRE_CODE (MAX_ADC_RESOLUTION / 2)
+// Noise at rest, the spread stays within what calibration.c calls rest
+#define NOISE_CODES 10
+
+// calibration.c, samples in a rest window and in a row beyond an endpoint
+#define REST_WINDOW 50
+#define EXTREME_HOLD 4
+#define SAVE_INTERVAL_NS (300 * FAKE_NS_PER_S)
+
+// Where the stick rests, where a turn is held and where the ends are
+#define REST_CODE (CENTRE_CODE + 100)
+#define TURN_CODE (REST_CODE + 700)
+#define DRIFT_CODE (REST_CODE + 30)
+#define ODD_CODE (REST_CODE + 300)
+#define LEFT_CODE 2000
+#define RIGHT_CODE 14000
+#define SPIKE_CODE 15500
+
+// Rounding of the Q12 scale
+#define MAP_TOLERANCE 2
+
+#define SCHED_QUEUE_SIZE 10
+
+static uint32_t m_samples;
+
+static uint32_t noise_hash(uint32_t slot)
+{
+    uint32_t x = slot * 2654435761u;
+
+    x ^= x >> 15;
+    x *= 0x2c1b3c6dU;
+    x ^= x >> 12;
+
+    return x;
+}
+
+static void feed(int16_t code) { calibration_update(code); }
+
+/**
+ * @brief Hold the stick still with noise on it for a number of samples
+ *
+ */
+static void rest_feed(int16_t code, uint32_t samples)
+{
+    for (uint32_t i = 0; i < samples; i++)
+    {
+        feed((int16_t)(code + (int32_t)(noise_hash(m_samples++) %
+                                        (2 * NOISE_CODES + 1)) -
+                       NOISE_CODES));
+    }
+}
+
+static void run_for(uint64_t ns)
+{
+    uint64_t until = fake_time_ns() + ns;
+
+    while (fake_time_ns() < until && fake_run_next())
+    {
+        app_sched_execute();
+    }
+}
+
+static calibration_t calibration(void)
+{
+    calibration_t cal;
+
+    calibration_get(&cal);
+
+    return cal;
+}
+
+static bool expect(bool condition, char const *p_what)
+{
+    calibration_t cal = calibration();
+
+    printf("%-44s centre %5d, %5d to %5d%s\n", p_what, cal.centre, cal.min,
+           cal.max, condition ? "" : "  FAILED");
+
+    return condition;
+}
+
+static bool near(int32_t value, int32_t target, int32_t tolerance)
+{
+    return abs(value - target) <= tolerance;
+}
+
+static bool map_expect(int16_t code, int32_t nominal, char const *p_what)
+{
+    int32_t mapped = calibration_map(code);
+    bool    ok = near(mapped, nominal, MAP_TOLERANCE);
+
+    printf("%-44s %5d maps to %5d%s\n", p_what, code, mapped,
+           ok ? "" : "  FAILED");
+
+    return ok;
+}
+
+int main(void)
+{
+    ret_code_t      err_code;
+    calibration_t   stored;
+    storage_stats_t stats;
+    uint32_t        writes;
+    bool            ok = true;
+
+    APP_SCHED_INIT(APP_TIMER_SCHED_EVENT_DATA_SIZE, SCHED_QUEUE_SIZE);
+    fake_log_level_set(FAKE_LOG_WARNING);
+
+    storage_init();
+    calibration_init();
+    err_code = fds_init();
+    APP_ERROR_CHECK(err_code);
+    run_for(100 * FAKE_NS_PER_MS);
+    ok &= expect(!calibration_valid(), "nothing stored, nothing known");
+
+    // Switched on in a turn, a guess until the stick rests
+    feed(TURN_CODE);
+    ok &= expect(calibration_valid() && calibration().centre == TURN_CODE,
+                 "first sample is the centre");
+
+    rest_feed(REST_CODE, REST_WINDOW - 2);
+    ok &= expect(calibration().centre == TURN_CODE,
+                 "not yet a whole rest window");
+    rest_feed(REST_CODE, 2);
+    ok &= expect(near(calibration().centre, REST_CODE, NOISE_CODES),
+                 "a rest window moves the centre");
+
+    // Long enough for several windows, too far out to be rest
+    rest_feed(TURN_CODE, 5 * REST_WINDOW);
+    ok &= expect(near(calibration().centre, REST_CODE, NOISE_CODES),
+                 "a held turn does not");
+
+    rest_feed(DRIFT_CODE, 2 * REST_WINDOW);
+    ok &= expect(near(calibration().centre, DRIFT_CODE, NOISE_CODES),
+                 "the centre follows a drift");
+    rest_feed(ODD_CODE, REST_WINDOW);
+    ok &= expect(near(calibration().centre, DRIFT_CODE, NOISE_CODES),
+                 "the median drops an odd rest position");
+    rest_feed(DRIFT_CODE, REST_WINDOW);
+
+    // No endpoint far enough out yet, codes are only shifted
+    ok &= map_expect(calibration().centre, CENTRE_CODE, "centre");
+    ok &= map_expect(RIGHT_CODE, RIGHT_CODE - calibration().centre +
+                                     CENTRE_CODE,
+                     "no right endpoint yet");
+
+    for (uint32_t i = 0; i < EXTREME_HOLD - 1; i++)
+    {
+        feed(RIGHT_CODE);
+    }
+    rest_feed(DRIFT_CODE, 1);
+    ok &= expect(calibration().max < RIGHT_CODE,
+                 "a short spike does not move an endpoint");
+
+    feed(RIGHT_CODE + 200);
+    feed(RIGHT_CODE);
+    feed(RIGHT_CODE + 100);
+    feed(SPIKE_CODE);
+    ok &= expect(calibration().max == RIGHT_CODE,
+                 "a held end moves it to its least extreme");
+    for (uint32_t i = 0; i < EXTREME_HOLD; i++)
+    {
+        feed(LEFT_CODE);
+    }
+    ok &= expect(calibration().min == LEFT_CODE, "and the left one");
+    rest_feed(DRIFT_CODE, REST_WINDOW);
+
+    ok &= map_expect(calibration().centre, CENTRE_CODE, "centre");
+    ok &= map_expect(RIGHT_CODE, MAX_ADC_RESOLUTION - 1, "right endpoint");
+    ok &= map_expect(LEFT_CODE, 0, "left endpoint");
+    ok &= map_expect((calibration().centre + RIGHT_CODE) / 2,
+                     CENTRE_CODE + CENTRE_CODE / 2, "halfway right");
+
+    // Nothing saved before the interval is up, then once
+    storage_stats_get(&stats);
+    ok &= expect(stats.writes == 0, "not saved right away");
+    run_for(SAVE_INTERVAL_NS + FAKE_NS_PER_S);
+    storage_stats_get(&stats);
+    ok &= expect(stats.writes == 1 &&
+                     storage_record_load(STORAGE_FILE_CALIBRATION, 1, &stored,
+                                         sizeof(stored)) &&
+                     stored.centre == calibration().centre &&
+                     stored.min == calibration().min &&
+                     stored.max == calibration().max,
+                 "saved after the interval");
+    writes = stats.writes;
+
+    // Noise around the same rest position is not worth a flash write
+    rest_feed(DRIFT_CODE, 4 * REST_WINDOW);
+    run_for(SAVE_INTERVAL_NS);
+    storage_stats_get(&stats);
+    ok &= expect(stats.writes == writes, "the same again is not saved");
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
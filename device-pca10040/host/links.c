@@ -0,0 +1,200 @@
+/**
+ * Copyright (c) 2018 Keith Wakeham
+ *
+ * All rights reserved.
+ *
+ *
+ */
+
+// Two centrals on the per-link table of ble_cus.c, the whole firmware on the
+// fakes. A fast one streams first, a slow one joins, goes through the
+// handshake on its own, unsubscribes and subscribes again, then the fast one
+// leaves and a new central takes its slot. The bars sweep all along, so
+// every sample is worth a notification. ble_conn_params_change_conn_params()
+// is wrapped to see which links conn-params.c tunes.
+//
+// Exits 1 when a link gets steering data before its own handshake or with
+// notifications off, does not get it after, when the slow link or one
+// coming and going holds the fast one back, or when a link gets new
+// parameters asked for before it streams or none after.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "ble_cus.h"
+#include "fake.h"
+#include "steer-adc.h"
+
+#define CENTRE_CODE (MAX_ADC_RESOLUTION / 2)
+#define SWEEP_AMPLITUDE 3000
+#define SWEEP_PERIOD_NS (2 * FAKE_NS_PER_S)
+
+#define FAST_INTERVAL_MS 7.5
+#define SLOW_INTERVAL_MS 100
+
+// Notifications are counted over this long in every phase
+#define WINDOW_NS (2 * FAKE_NS_PER_S)
+
+// The fast link has to keep this share of what it got on its own, in
+// percent
+#define MIN_SHARE 90
+
+#define CONN_HANDLE_MAX 8
+
+ret_code_t __real_ble_conn_params_change_conn_params(
+    uint16_t conn_handle, ble_gap_conn_params_t *p_new_params);
+
+static uint32_t m_notifications[CONN_HANDLE_MAX];
+static uint32_t m_param_requests[CONN_HANDLE_MAX];
+static uint16_t m_steering_handle;
+
+ret_code_t __wrap_ble_conn_params_change_conn_params(
+    uint16_t conn_handle, ble_gap_conn_params_t *p_new_params)
+{
+    if (conn_handle < CONN_HANDLE_MAX)
+    {
+        m_param_requests[conn_handle]++;
+    }
+
+    return __real_ble_conn_params_change_conn_params(conn_handle,
+                                                     p_new_params);
+}
+
+static int16_t sweep_input(uint64_t at_ns, void *p_context)
+{
+    double phase =
+        2 * M_PI * (double)(at_ns % SWEEP_PERIOD_NS) / SWEEP_PERIOD_NS;
+
+    UNUSED_PARAMETER(p_context);
+
+    return (int16_t)(CENTRE_CODE + SWEEP_AMPLITUDE * sin(phase));
+}
+
+static void hvx_handler(fake_ble_hvx_t const *p_hvx, void *p_context)
+{
+    UNUSED_PARAMETER(p_context);
+
+    if (p_hvx->handle == m_steering_handle &&
+        p_hvx->type == BLE_GATT_HVX_NOTIFICATION &&
+        p_hvx->conn_handle < CONN_HANDLE_MAX)
+    {
+        m_notifications[p_hvx->conn_handle]++;
+    }
+}
+
+static uint16_t central_connect(double interval_ms)
+{
+    uint16_t conn_handle = fake_central_connect(interval_ms);
+
+    if (conn_handle >= CONN_HANDLE_MAX)
+    {
+        fprintf(stderr, "links: not advertising\n");
+        exit(EXIT_FAILURE);
+    }
+
+    return conn_handle;
+}
+
+/**
+ * @brief Count the steering notifications of every link over one window
+ *
+ */
+static void window_run(char const *p_name, uint32_t *p_counts)
+{
+    memset(m_notifications, 0, sizeof(m_notifications));
+    fake_run_for(WINDOW_NS);
+    memcpy(p_counts, m_notifications, sizeof(m_notifications));
+
+    printf("%-28s", p_name);
+    for (uint16_t i = 0; i < CONN_HANDLE_MAX; i++)
+    {
+        if (p_counts[i] > 0)
+        {
+            printf(" link %u: %3u", i, p_counts[i]);
+        }
+    }
+    printf("\n");
+}
+
+static bool expect(bool condition, char const *p_what)
+{
+    if (!condition)
+    {
+        printf("FAILED: %s\n", p_what);
+    }
+
+    return condition;
+}
+
+int main(void)
+{
+    uint32_t alone[CONN_HANDLE_MAX];
+    uint32_t counts[CONN_HANDLE_MAX];
+    uint16_t fast;
+    uint16_t slow;
+    uint16_t next;
+    uint32_t min_fast;
+    bool     ok = true;
+
+    fake_log_level_set(FAKE_LOG_WARNING);
+    fake_saadc_input_fn_set(sweep_input, NULL);
+    fake_ble_hvx_handler_set(hvx_handler, NULL);
+    // Keep the intervals the centrals asked for
+    fake_ble_conn_param_accept_set(false);
+
+    fake_firmware_boot();
+    fake_run_for(200 * FAKE_NS_PER_MS);
+    m_steering_handle = fake_ble_value_handle(STEERER_CHAR_UUID);
+
+    fast = central_connect(FAST_INTERVAL_MS);
+    fake_central_subscribe(fast, true);
+    fake_central_handshake(fast);
+    window_run("fast link alone", alone);
+    ok &= expect(alone[fast] > 0, "the fast link streams");
+    min_fast = alone[fast] * MIN_SHARE / 100;
+
+    slow = central_connect(SLOW_INTERVAL_MS);
+    ok &= expect(slow != fast, "the slow link gets a slot of its own");
+    fake_central_subscribe(slow, true);
+    window_run("slow link before handshake", counts);
+    ok &= expect(counts[slow] == 0, "no data before the handshake");
+    ok &= expect(counts[fast] >= min_fast, "the fast link keeps streaming");
+    ok &= expect(m_param_requests[fast] > 0, "the fast link gets tuned");
+    ok &= expect(m_param_requests[slow] == 0,
+                 "the slow link is not tuned before its handshake");
+
+    fake_central_handshake(slow);
+    window_run("both links", counts);
+    ok &= expect(counts[slow] > 0, "the slow link streams after its handshake");
+    ok &= expect(counts[fast] >= min_fast,
+                 "the slow link does not hold the fast one back");
+    ok &= expect(m_param_requests[slow] > 0,
+                 "the slow link gets tuned after its handshake");
+
+    fake_central_subscribe(slow, false);
+    fake_run_for(SLOW_INTERVAL_MS * FAKE_NS_PER_MS);
+    window_run("slow link unsubscribed", counts);
+    ok &= expect(counts[slow] == 0, "no data with notifications off");
+    ok &= expect(counts[fast] >= min_fast, "the fast link keeps streaming");
+
+    fake_central_subscribe(slow, true);
+    fake_ble_disconnect(fast, BLE_HCI_REMOTE_USER_TERMINATED_CONNECTION);
+    fake_run_for(100 * FAKE_NS_PER_MS);
+    window_run("fast link gone", counts);
+    ok &= expect(counts[slow] > 0, "the slow link streams on its own");
+
+    // The slot of the fast link, nothing of its handshake may be left
+    next = central_connect(FAST_INTERVAL_MS);
+    fake_central_subscribe(next, true);
+    window_run("new link before handshake", counts);
+    ok &= expect(counts[next] == 0, "no data before the new link's handshake");
+    ok &= expect(counts[slow] > 0, "the slow link keeps streaming");
+
+    fake_central_handshake(next);
+    window_run("new link", counts);
+    ok &= expect(counts[next] >= min_fast, "the new link streams");
+    ok &= expect(counts[slow] > 0, "the slow link keeps streaming");
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
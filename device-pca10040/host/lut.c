@@ -0,0 +1,78 @@
+/**
+ * Copyright (c) 2018 Keith Wakeham
+ *
+ * All rights reserved.
+ *
+ *
+ */
+
+// steer-angle-lut.h against the float formula get_angle() used before the
+// table, for every one of the MAX_ADC_RESOLUTION codes. An entry may be off
+// by the rounding to hundredths of a degree and no more. With the default
+// dead band of ZERO_FLOOR degrees the two have to agree on which codes read
+// 0, except within that rounding of its edge.
+//
+// Exits 1 on any code that is further off.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "steer-adc.h"
+#include "steer-angle-lut.h"
+
+// Half a hundredth of a degree, and what the float formula itself is off by
+#define ROUNDING_DEG (0.5 / STEER_ANGLE_SCALE)
+#define FLOAT_DEG 0.0001
+
+/**
+ * @brief The angle as get_angle() computed it in float, before the dead band
+ *
+ */
+static float float_angle(int32_t code)
+{
+    return ((code / (float)MAX_ADC_RESOLUTION) * (MAX_STEER_ANGLE * 2)) -
+           MAX_STEER_ANGLE;
+}
+
+int main(void)
+{
+    uint32_t errors = 0;
+    double   max_error = 0;
+
+    for (int32_t code = 0; code < MAX_ADC_RESOLUTION; code++)
+    {
+        float   expected = float_angle(code);
+        int32_t cdeg = steer_angle_lut[code];
+        double  error = fabs((double)cdeg / STEER_ANGLE_SCALE - expected);
+        bool    float_zero = fabsf(expected) < ZERO_FLOOR;
+        bool    lut_zero = abs(cdeg) < ZERO_FLOOR * STEER_ANGLE_SCALE;
+
+        max_error = MAX(max_error, error);
+        if (error > ROUNDING_DEG + FLOAT_DEG)
+        {
+            if (errors < 10)
+            {
+                printf("code %d: table %d cdeg, float %.4f degrees\n", code,
+                       cdeg, expected);
+            }
+            errors++;
+        }
+        else if (float_zero != lut_zero &&
+                 fabs(fabsf(expected) - ZERO_FLOOR) >
+                     ROUNDING_DEG + FLOAT_DEG)
+        {
+            if (errors < 10)
+            {
+                printf("code %d: dead band, table %d cdeg, float %.4f "
+                       "degrees\n",
+                       code, cdeg, expected);
+            }
+            errors++;
+        }
+    }
+    printf("%d codes, max error %.4f degrees, %u errors\n",
+           MAX_ADC_RESOLUTION, max_error, errors);
+
+    return (errors == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,621 @@
+/**
+ * Copyright (c) 2018 Keith Wakeham
+ *
+ * All rights reserved.
+ *
+ *
+ */
+
+// Turns replayed through the firmware with the steering prediction at a few
+// leads, to weigh what the central sees earlier against how far it swings
+// past where the bars went. The same turns are played for every lead: holds,
+// sweeps, flicks, a slalom and both end stops hit at speed, over and over.
+// A recording replaces them with --file, lines of "seconds code" or the
+// SAMPLE lines trace-decode.py prints, interpolated between samples.
+//
+// Every millisecond the angle the central holds is compared with the angle
+// the firmware maps the noiseless input to right then:
+//
+//   lag        the shift of the truth that fits the central's angle best,
+//              what the rider perceives
+//   rms        error without a shift, and at the best one
+//   overshoot  how far the central's angle lies outside everything the bars
+//              did over the last 250 ms, mean, p99 and max
+//
+//   _build/replay --leads 0,50,100 --passes 3
+
+#include <getopt.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ble_cus.h"
+#include "fake.h"
+#include "params.h"
+#include "steer-adc.h"
+
+#define CENTRE_CODE (MAX_ADC_RESOLUTION / 2)
+
+// Where the stick stops either side of the centre
+#define END_STOP_CODES 6000
+
+#define LEADS_MAX 8
+#define RECORDING_MAX 1000000
+
+#define STEP_NS FAKE_NS_PER_MS
+// Shifts tried for the lag, in steps
+#define SHIFT_MIN (-100)
+#define SHIFT_MAX 300
+// Window the overshoot is measured against, in steps
+#define OVERSHOOT_WINDOW 250
+
+typedef enum
+{
+    SEGMENT_MOVE,   // raised cosine to the offset
+    SEGMENT_SLALOM, // sine of the offset's amplitude around where it is
+} segment_kind_t;
+
+typedef struct
+{
+    segment_kind_t kind;
+    uint16_t       ms;
+    int16_t        offset;    // from the centre, past the end stops to hit
+    uint16_t       period_ms; // slalom only
+} segment_t;
+
+// Starts and ends at the centre, so the passes join up
+static segment_t const m_turns[] = {
+    {SEGMENT_MOVE, 1000, 0, 0},
+    // Sweeps
+    {SEGMENT_MOVE, 500, 2500, 0},
+    {SEGMENT_MOVE, 500, 2500, 0},
+    {SEGMENT_MOVE, 400, -2500, 0},
+    {SEGMENT_MOVE, 500, -2500, 0},
+    {SEGMENT_MOVE, 600, 0, 0},
+    {SEGMENT_MOVE, 500, 0, 0},
+    // Flicks
+    {SEGMENT_MOVE, 100, 1500, 0},
+    {SEGMENT_MOVE, 150, 0, 0},
+    {SEGMENT_MOVE, 400, 0, 0},
+    {SEGMENT_MOVE, 100, -1500, 0},
+    {SEGMENT_MOVE, 150, 0, 0},
+    {SEGMENT_MOVE, 500, 0, 0},
+    {SEGMENT_SLALOM, 3000, 2000, 1000},
+    {SEGMENT_MOVE, 500, 0, 0},
+    // Into the end stops at speed
+    {SEGMENT_MOVE, 350, 8000, 0},
+    {SEGMENT_MOVE, 600, 8000, 0},
+    {SEGMENT_MOVE, 500, 0, 0},
+    {SEGMENT_MOVE, 300, 0, 0},
+    {SEGMENT_MOVE, 350, -8000, 0},
+    {SEGMENT_MOVE, 600, -8000, 0},
+    {SEGMENT_MOVE, 500, 0, 0},
+    {SEGMENT_MOVE, 1000, 0, 0},
+};
+
+typedef struct
+{
+    uint16_t    rate_hz;
+    uint16_t    notify_delta;
+    double      interval_ms;
+    uint8_t     leads[LEADS_MAX];
+    uint8_t     lead_count;
+    int32_t     predict_max_ms; // -1 leaves the default
+    uint32_t    passes;
+    double      noise_codes;
+    uint32_t    seed;
+    char const *p_file;
+} config_t;
+
+static config_t m_config = {
+    .rate_hz = 200,
+    .notify_delta = 25,
+    .interval_ms = 7.5,
+    .leads = {0, 50, 100},
+    .lead_count = 3,
+    .predict_max_ms = -1,
+    .passes = 3,
+    .noise_codes = 2.0,
+    .seed = 1,
+};
+
+// A recording, seconds from its start and codes
+static double * m_recording_s;
+static double * m_recording_code;
+static uint32_t m_recording_count;
+
+static uint64_t m_pass_ns;
+static uint64_t m_start_ns;
+static uint64_t m_rng;
+
+static uint16_t m_steering_handle;
+static bool     m_delivered;
+static int16_t  m_delivered_cdeg;
+static uint32_t m_notifications;
+
+static uint64_t rng_next(void)
+{
+    // xorshift64*, the same noise for the same seed
+    m_rng ^= m_rng >> 12;
+    m_rng ^= m_rng << 25;
+    m_rng ^= m_rng >> 27;
+    return m_rng * 0x2545F4914F6CDD1DULL;
+}
+
+static double rng_uniform(void)
+{
+    return (double)(rng_next() >> 11) / (double)(1ULL << 53);
+}
+
+static double rng_gauss(void)
+{
+    double u = rng_uniform();
+    double v = rng_uniform();
+
+    return sqrt(-2.0 * log(1.0 - u)) * cos(2.0 * M_PI * v);
+}
+
+// The bars
+
+static double end_stop(double offset)
+{
+    return MIN(MAX(offset, -END_STOP_CODES), END_STOP_CODES);
+}
+
+static double turns_code(uint64_t at_ns)
+{
+    double at_ms = (double)(at_ns % m_pass_ns) / FAKE_NS_PER_MS;
+    double from = 0;
+
+    for (uint32_t i = 0; i < ARRAY_SIZE(m_turns); i++)
+    {
+        segment_t const *p_segment = &m_turns[i];
+        double           x = at_ms / p_segment->ms;
+
+        if (x >= 1)
+        {
+            at_ms -= p_segment->ms;
+            if (p_segment->kind == SEGMENT_MOVE)
+            {
+                from = end_stop(p_segment->offset);
+            }
+            continue;
+        }
+        if (p_segment->kind == SEGMENT_SLALOM)
+        {
+            return CENTRE_CODE +
+                   end_stop(from + p_segment->offset *
+                                       sin(2 * M_PI * at_ms /
+                                           p_segment->period_ms));
+        }
+        return CENTRE_CODE +
+               end_stop(from + (p_segment->offset - from) *
+                                   (1.0 - cos(M_PI * x)) / 2.0);
+    }
+
+    return CENTRE_CODE;
+}
+
+static double recording_code(uint64_t at_ns)
+{
+    double   at_s = (double)(at_ns % m_pass_ns) / FAKE_NS_PER_S;
+    uint32_t lo = 0;
+    uint32_t hi = m_recording_count - 1;
+    double   x;
+
+    if (at_s <= m_recording_s[0])
+    {
+        return m_recording_code[0];
+    }
+    if (at_s >= m_recording_s[hi])
+    {
+        return m_recording_code[hi];
+    }
+    while (hi - lo > 1)
+    {
+        uint32_t mid = (lo + hi) / 2;
+
+        if (m_recording_s[mid] <= at_s)
+        {
+            lo = mid;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+    x = (at_s - m_recording_s[lo]) / (m_recording_s[hi] - m_recording_s[lo]);
+
+    return m_recording_code[lo] +
+           (m_recording_code[hi] - m_recording_code[lo]) * x;
+}
+
+/**
+ * @brief Where the bars are, without noise
+ *
+ */
+static double bars_code(uint64_t at_ns)
+{
+    at_ns = (at_ns > m_start_ns) ? at_ns - m_start_ns : 0;
+
+    return (m_recording_count > 0) ? recording_code(at_ns)
+                                   : turns_code(at_ns);
+}
+
+static int16_t bars_input(uint64_t at_ns, void *p_context)
+{
+    double code = bars_code(at_ns) + m_config.noise_codes * rng_gauss();
+
+    UNUSED_PARAMETER(p_context);
+
+    return (int16_t)MIN(MAX(lround(code), 0), MAX_ADC_RESOLUTION - 1);
+}
+
+static bool recording_load(char const *p_path)
+{
+    FILE * p_file = fopen(p_path, "r");
+    char   line[256];
+    double first_s = 0;
+
+    if (p_file == NULL)
+    {
+        perror(p_path);
+        return false;
+    }
+    m_recording_s = malloc(RECORDING_MAX * sizeof(*m_recording_s));
+    m_recording_code = malloc(RECORDING_MAX * sizeof(*m_recording_code));
+    while (fgets(line, sizeof(line), p_file) != NULL &&
+           m_recording_count < RECORDING_MAX)
+    {
+        char const *p_code = strstr(line, "code=");
+        double      at_s;
+        double      code;
+
+        if (p_code != NULL)
+        {
+            // trace-decode.py: seconds, delta, event, arguments
+            if (strstr(line, " SAMPLE ") == NULL ||
+                sscanf(line, "%lf", &at_s) != 1 ||
+                sscanf(p_code, "code=%lf", &code) != 1)
+            {
+                continue;
+            }
+        }
+        else if (sscanf(line, "%lf %lf", &at_s, &code) != 2)
+        {
+            continue;
+        }
+        if (m_recording_count == 0)
+        {
+            first_s = at_s;
+        }
+        if (m_recording_count > 0 &&
+            at_s - first_s <= m_recording_s[m_recording_count - 1])
+        {
+            continue;
+        }
+        m_recording_s[m_recording_count] = at_s - first_s;
+        m_recording_code[m_recording_count] = code;
+        m_recording_count++;
+    }
+    fclose(p_file);
+    if (m_recording_count < 2)
+    {
+        fprintf(stderr, "replay: no samples in %s\n", p_path);
+        return false;
+    }
+    m_pass_ns = (uint64_t)(m_recording_s[m_recording_count - 1] *
+                           FAKE_NS_PER_S) +
+                1;
+
+    return true;
+}
+
+// The central
+
+static void hvx_handler(fake_ble_hvx_t const *p_hvx, void *p_context)
+{
+    float angle;
+
+    UNUSED_PARAMETER(p_context);
+
+    if (p_hvx->handle != m_steering_handle ||
+        p_hvx->type != BLE_GATT_HVX_NOTIFICATION)
+    {
+        return;
+    }
+    memcpy(&angle, p_hvx->data, sizeof(angle));
+    m_delivered = true;
+    m_delivered_cdeg = (int16_t)lroundf(angle * STEER_ANGLE_SCALE);
+    m_notifications++;
+}
+
+static bool central_start(uint16_t *p_conn_handle)
+{
+    uint16_t conn_handle = fake_central_connect(m_config.interval_ms);
+
+    if (conn_handle == BLE_CONN_HANDLE_INVALID)
+    {
+        fprintf(stderr, "replay: not advertising\n");
+        return false;
+    }
+
+    if (!fake_central_param_set(conn_handle, PARAM_SAMPLE_RATE,
+                                m_config.rate_hz) ||
+        !fake_central_param_set(conn_handle, PARAM_NOTIFY_DELTA,
+                                m_config.notify_delta) ||
+        (m_config.predict_max_ms >= 0 &&
+         !fake_central_param_set(conn_handle, PARAM_PREDICT_MAX,
+                                 (uint16_t)m_config.predict_max_ms)))
+    {
+        fprintf(stderr, "replay: the firmware refused a parameter\n");
+        return false;
+    }
+
+    m_steering_handle = fake_ble_value_handle(STEERER_CHAR_UUID);
+    fake_central_start(conn_handle);
+
+    *p_conn_handle = conn_handle;
+    return true;
+}
+
+/**
+ * @brief Wait for the start of the next pass
+ *
+ */
+static void pass_align(void)
+{
+    uint64_t into_ns = (fake_time_ns() - m_start_ns) % m_pass_ns;
+
+    if (into_ns != 0)
+    {
+        fake_run_for(m_pass_ns - into_ns);
+    }
+}
+
+// Scoring
+
+static double rms_at(int16_t const *p_truth, int16_t const *p_central,
+                     uint32_t count, int32_t shift)
+{
+    double   sum = 0;
+    uint32_t n = 0;
+
+    for (uint32_t i = (uint32_t)MAX(shift, 0); i < count; i++)
+    {
+        int32_t j = (int32_t)i - shift;
+        double  e;
+
+        if (j >= (int32_t)count)
+        {
+            break;
+        }
+        e = (double)p_central[i] - p_truth[j];
+        sum += e * e;
+        n++;
+    }
+
+    return (n > 0) ? sqrt(sum / n) : 0;
+}
+
+static int compare_double(void const *p_a, void const *p_b)
+{
+    double a = *(double const *)p_a;
+    double b = *(double const *)p_b;
+
+    return (a > b) - (a < b);
+}
+
+static void score(uint8_t lead, int16_t const *p_truth,
+                  int16_t const *p_central, uint32_t count)
+{
+    double * p_over = malloc(count * sizeof(*p_over));
+    int32_t  best_shift = 0;
+    double   best_rms = INFINITY;
+    double   over_sum = 0;
+    uint32_t over_count = 0;
+
+    for (int32_t shift = SHIFT_MIN; shift <= SHIFT_MAX; shift++)
+    {
+        double rms = rms_at(p_truth, p_central, count, shift);
+
+        if (rms < best_rms)
+        {
+            best_rms = rms;
+            best_shift = shift;
+        }
+    }
+
+    for (uint32_t i = OVERSHOOT_WINDOW; i < count; i++)
+    {
+        int16_t lo = p_truth[i];
+        int16_t hi = p_truth[i];
+
+        for (uint32_t j = i - OVERSHOOT_WINDOW; j < i; j++)
+        {
+            lo = MIN(lo, p_truth[j]);
+            hi = MAX(hi, p_truth[j]);
+        }
+        p_over[over_count] = MAX(MAX(p_central[i] - hi, lo - p_central[i]), 0);
+        over_sum += p_over[over_count];
+        over_count++;
+    }
+    qsort(p_over, over_count, sizeof(*p_over), compare_double);
+
+    printf("%5u %8d %8.1f %8.1f %8.2f %8.1f %8.1f %8u\n", lead, best_shift,
+           rms_at(p_truth, p_central, count, 0), best_rms,
+           over_sum / MAX(over_count, 1),
+           p_over[(uint32_t)(0.99 * (over_count - 1))],
+           p_over[over_count - 1], m_notifications);
+    free(p_over);
+}
+
+static void usage(void)
+{
+    fprintf(stderr,
+            "usage: replay [options]\n"
+            "  --leads L,L,...     PARAM_PREDICT_LEAD values in percent\n"
+            "                      (0,50,100)\n"
+            "  --max MS            PARAM_PREDICT_MAX (firmware default)\n"
+            "  --passes N          turns played per lead (3)\n"
+            "  --file PATH         a recording instead of the turns\n"
+            "  --rate HZ           SAADC samples per second (200)\n"
+            "  --delta CDEG        notify delta (25)\n"
+            "  --interval MS       connection interval, 1.25 ms steps (7.5)\n"
+            "  --noise CODES       ADC noise, standard deviation (2)\n"
+            "  --seed N            noise (1)\n");
+    exit(2);
+}
+
+static void leads_parse(char *p_list)
+{
+    char *p_lead;
+
+    m_config.lead_count = 0;
+    for (p_lead = strtok(p_list, ","); p_lead != NULL;
+         p_lead = strtok(NULL, ","))
+    {
+        if (m_config.lead_count == LEADS_MAX)
+        {
+            usage();
+        }
+        m_config.leads[m_config.lead_count++] = (uint8_t)atoi(p_lead);
+    }
+}
+
+static void options_parse(int argc, char **argv)
+{
+    static struct option const options[] = {
+        {"leads", required_argument, NULL, 'l'},
+        {"max", required_argument, NULL, 'm'},
+        {"passes", required_argument, NULL, 'P'},
+        {"file", required_argument, NULL, 'f'},
+        {"rate", required_argument, NULL, 'r'},
+        {"delta", required_argument, NULL, 'd'},
+        {"interval", required_argument, NULL, 'i'},
+        {"noise", required_argument, NULL, 'N'},
+        {"seed", required_argument, NULL, 's'},
+        {NULL, 0, NULL, 0},
+    };
+    int opt;
+
+    while ((opt = getopt_long(argc, argv, "", options, NULL)) != -1)
+    {
+        switch (opt)
+        {
+            case 'l':
+                leads_parse(optarg);
+                break;
+            case 'm':
+                m_config.predict_max_ms = atoi(optarg);
+                break;
+            case 'P':
+                m_config.passes = (uint32_t)atoi(optarg);
+                break;
+            case 'f':
+                m_config.p_file = optarg;
+                break;
+            case 'r':
+                m_config.rate_hz = (uint16_t)atoi(optarg);
+                break;
+            case 'd':
+                m_config.notify_delta = (uint16_t)atoi(optarg);
+                break;
+            case 'i':
+                m_config.interval_ms = atof(optarg);
+                break;
+            case 'N':
+                m_config.noise_codes = atof(optarg);
+                break;
+            case 's':
+                m_config.seed = (uint32_t)atoi(optarg);
+                break;
+            default:
+                usage();
+        }
+    }
+    if (optind != argc || m_config.lead_count == 0 || m_config.passes == 0 ||
+        m_config.interval_ms < 7.5 || m_config.interval_ms > 4000)
+    {
+        usage();
+    }
+}
+
+int main(int argc, char **argv)
+{
+    uint16_t conn_handle;
+    uint32_t steps;
+    int16_t *p_truth;
+    int16_t *p_central;
+    bool     delivered = true;
+
+    options_parse(argc, argv);
+
+    m_rng = 0x9E3779B97F4A7C15ULL * (m_config.seed + 1);
+    m_pass_ns = 0;
+    for (uint32_t i = 0; i < ARRAY_SIZE(m_turns); i++)
+    {
+        m_pass_ns += m_turns[i].ms * FAKE_NS_PER_MS;
+    }
+    if (m_config.p_file != NULL && !recording_load(m_config.p_file))
+    {
+        return 1;
+    }
+
+    fake_log_level_set(FAKE_LOG_WARNING);
+    fake_ble_hvx_handler_set(hvx_handler, NULL);
+    fake_saadc_input_fn_set(bars_input, NULL);
+
+    fake_firmware_boot();
+    fake_run_for(200 * FAKE_NS_PER_MS);
+    if (!central_start(&conn_handle))
+    {
+        return 1;
+    }
+
+    // One pass to learn the centre and the end stops
+    m_start_ns = fake_time_ns();
+    fake_run_for(m_pass_ns);
+
+    steps = (uint32_t)(m_config.passes * m_pass_ns / STEP_NS);
+    p_truth = malloc(steps * sizeof(*p_truth));
+    p_central = malloc(steps * sizeof(*p_central));
+
+    printf("%u passes of %.1f s, rate %u Hz, notify delta %u cdeg, "
+           "interval %.2f ms, noise %.1f codes\n\n",
+           m_config.passes, (double)m_pass_ns / FAKE_NS_PER_S,
+           m_config.rate_hz, m_config.notify_delta, m_config.interval_ms,
+           m_config.noise_codes);
+    printf("%5s %8s %8s %8s %8s %8s %8s %8s\n", "lead", "lag", "rms",
+           "rms@lag", "over", "over p99", "over max", "notified");
+    printf("%5s %8s %8s %8s %8s %8s %8s %8s\n", "%", "ms", "cdeg", "cdeg",
+           "cdeg", "cdeg", "cdeg", "");
+
+    for (uint32_t l = 0; l < m_config.lead_count; l++)
+    {
+        if (!fake_central_param_set(conn_handle, PARAM_PREDICT_LEAD,
+                                    m_config.leads[l]))
+        {
+            fprintf(stderr, "replay: lead %u%% refused\n", m_config.leads[l]);
+            return 1;
+        }
+        pass_align();
+        m_notifications = 0;
+        for (uint32_t i = 0; i < steps; i++)
+        {
+            fake_run_for(STEP_NS);
+            p_truth[i] = get_code_angle(
+                (int16_t)MIN(MAX(lround(bars_code(fake_time_ns())), 0),
+                             MAX_ADC_RESOLUTION - 1));
+            p_central[i] = m_delivered_cdeg;
+        }
+        score(m_config.leads[l], p_truth, p_central, steps);
+        delivered = delivered && m_delivered && m_notifications > 0;
+    }
+
+    free(p_truth);
+    free(p_central);
+
+    return delivered ? 0 : 1;
+}
@@ -0,0 +1,289 @@
+/**
+ * Copyright (c) 2018 Keith Wakeham
+ *
+ * All rights reserved.
+ *
+ *
+ */
+
+// The calibration kept in retained RAM by calibration.c, across resets on
+// the fakes. Every boot is a child process forked from one that never ran
+// any firmware, so it starts with fresh statics like after a reset. Only
+// .non_init is carried over, fake/non-init.ld places it like the target's
+// linker script and marks where it is.
+//
+// The first boot learns a calibration and takes a curve, the second starts
+// from what the first left in .non_init and an empty flash. Then one boot
+// per bit of the retained copy starts from it with that bit flipped.
+//
+// Exits 1 when the second boot does not map codes like the first did right
+// from calibration_init(), before FDS is up, or when a boot takes over a
+// copy with a flipped bit.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "app_scheduler.h"
+#include "calibration.h"
+#include "fake.h"
+#include "fds.h"
+#include "steer-adc.h"
+#include "storage.h"
+
+// calibration.c, samples in a rest window and in a row beyond an endpoint
+#define REST_WINDOW 50
+#define EXTREME_HOLD 4
+
+#define REST_CODE (MAX_ADC_RESOLUTION / 2 + 100)
+#define LEFT_CODE 2000
+#define RIGHT_CODE 14500
+
+#define RETAINED_MAX 256
+
+#define SCHED_QUEUE_SIZE 10
+
+extern uint8_t __start_non_init[];
+extern uint8_t __stop_non_init[];
+
+static int16_t const m_probes[] = {LEFT_CODE, REST_CODE - 1000, REST_CODE,
+                                   REST_CODE + 1000, RIGHT_CODE};
+
+static int16_t const m_knots[] = {0, 3000, 8192, 13000,
+                                  MAX_ADC_RESOLUTION - 1};
+
+/**
+ * @brief What the first boot leaves for the others, shared between them
+ *
+ */
+typedef struct
+{
+    uint8_t       ram[RETAINED_MAX]; // .non_init as the reset found it
+    uint32_t      size;
+    calibration_t cal;
+    int32_t       mapped[ARRAY_SIZE(m_probes)];
+    uint8_t       curve[CALIBRATION_CURVE_ENCODED_MAX];
+    uint16_t      curve_len;
+} reset_t;
+
+static reset_t *m_p_reset;
+
+static void run_for(uint64_t ns)
+{
+    uint64_t until = fake_time_ns() + ns;
+
+    do
+    {
+        app_sched_execute();
+    } while (fake_time_ns() < until && fake_run_next());
+}
+
+/**
+ * @brief Start the calibrator like main.c does, FDS comes later
+ *
+ */
+static void calibration_start(void)
+{
+    APP_SCHED_INIT(APP_TIMER_SCHED_EVENT_DATA_SIZE, SCHED_QUEUE_SIZE);
+    storage_init();
+    calibration_init();
+}
+
+static void fds_start(void)
+{
+    ret_code_t err_code = fds_init();
+
+    APP_ERROR_CHECK(err_code);
+    run_for(FAKE_NS_PER_S);
+}
+
+static void feed(int16_t code, uint32_t samples)
+{
+    for (uint32_t i = 0; i < samples; i++)
+    {
+        calibration_update(code);
+    }
+}
+
+static void curve_write(uint8_t const *p_data, uint16_t len)
+{
+    ret_code_t err_code = calibration_curve_write(p_data, len);
+
+    APP_ERROR_CHECK(err_code);
+}
+
+/**
+ * @brief Check the calibrator maps like the first boot left it
+ *
+ */
+static bool same_as_before(void)
+{
+    calibration_t cal;
+    uint8_t       curve[CALIBRATION_CURVE_ENCODED_MAX];
+    uint16_t      curve_len;
+    bool          same;
+
+    calibration_get(&cal);
+    curve_len = calibration_curve_encode(NRF_SUCCESS, curve, sizeof(curve));
+    same = calibration_valid() &&
+           memcmp(&cal, &m_p_reset->cal, sizeof(cal)) == 0 &&
+           curve_len == m_p_reset->curve_len &&
+           memcmp(curve, m_p_reset->curve, curve_len) == 0;
+    for (uint8_t i = 0; i < ARRAY_SIZE(m_probes); i++)
+    {
+        same &= calibration_map(m_probes[i]) == m_p_reset->mapped[i];
+    }
+
+    return same;
+}
+
+static bool learn_boot(uint32_t arg)
+{
+    uint8_t value[2 + 2 * ARRAY_SIZE(m_knots)];
+    uint8_t len = 2;
+
+    UNUSED_PARAMETER(arg);
+
+    calibration_start();
+    fds_start();
+
+    feed(REST_CODE, 1 + REST_WINDOW);
+    feed(LEFT_CODE, EXTREME_HOLD);
+    feed(RIGHT_CODE, EXTREME_HOLD);
+    feed(REST_CODE, 1);
+
+    value[0] = CALIBRATION_CURVE_OP_BEGIN;
+    value[1] = ARRAY_SIZE(m_knots);
+    curve_write(value, 2);
+    value[0] = CALIBRATION_CURVE_OP_KNOTS;
+    value[1] = 0;
+    for (uint8_t i = 0; i < ARRAY_SIZE(m_knots); i++)
+    {
+        len += uint16_encode((uint16_t)m_knots[i], &value[len]);
+    }
+    curve_write(value, len);
+    value[0] = CALIBRATION_CURVE_OP_COMMIT;
+    curve_write(value, 1);
+    run_for(FAKE_NS_PER_S);
+
+    calibration_get(&m_p_reset->cal);
+    for (uint8_t i = 0; i < ARRAY_SIZE(m_probes); i++)
+    {
+        m_p_reset->mapped[i] = calibration_map(m_probes[i]);
+    }
+    m_p_reset->curve_len = calibration_curve_encode(
+        NRF_SUCCESS, m_p_reset->curve, sizeof(m_p_reset->curve));
+
+    m_p_reset->size = (uint32_t)(__stop_non_init - __start_non_init);
+    if (m_p_reset->size == 0 || m_p_reset->size > RETAINED_MAX)
+    {
+        printf("%u bytes of .non_init\n", m_p_reset->size);
+        return false;
+    }
+    memcpy(m_p_reset->ram, __start_non_init, m_p_reset->size);
+
+    printf("learned centre %d, %d to %d, a curve of %u knots, %u bytes "
+           "retained\n",
+           m_p_reset->cal.centre, m_p_reset->cal.min, m_p_reset->cal.max,
+           (unsigned)ARRAY_SIZE(m_knots), m_p_reset->size);
+
+    // The curve is worth nothing to the other boots if it is not in use
+    return calibration_valid() && m_p_reset->curve[1] == ARRAY_SIZE(m_knots);
+}
+
+static bool restore_boot(uint32_t arg)
+{
+    bool early;
+
+    UNUSED_PARAMETER(arg);
+
+    memcpy(__start_non_init, m_p_reset->ram, m_p_reset->size);
+    calibration_start();
+    early = same_as_before();
+    // Nothing in flash to override it
+    fds_start();
+
+    return early && same_as_before();
+}
+
+static bool flipped_boot(uint32_t bit)
+{
+    uint8_t curve[CALIBRATION_CURVE_ENCODED_MAX];
+
+    memcpy(__start_non_init, m_p_reset->ram, m_p_reset->size);
+    __start_non_init[bit / 8] ^= (uint8_t)(1 << (bit % 8));
+    calibration_start();
+
+    return !calibration_valid() &&
+           calibration_curve_encode(NRF_SUCCESS, curve, sizeof(curve)) == 3 &&
+           curve[1] == 0;
+}
+
+/**
+ * @brief Run a boot in a fresh process
+ *
+ * @return what the boot returned
+ */
+static bool boot(bool (*p_boot)(uint32_t), uint32_t arg)
+{
+    pid_t pid;
+    int   status;
+
+    fflush(stdout);
+    pid = fork();
+    if (pid < 0)
+    {
+        perror("fork");
+        exit(EXIT_FAILURE);
+    }
+    if (pid == 0)
+    {
+        exit(p_boot(arg) ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+
+    return waitpid(pid, &status, 0) == pid && WIFEXITED(status) &&
+           WEXITSTATUS(status) == EXIT_SUCCESS;
+}
+
+int main(void)
+{
+    uint32_t rejected = 0;
+    bool     restored;
+
+    fake_log_level_set(FAKE_LOG_ERROR);
+
+    m_p_reset = mmap(NULL, sizeof(*m_p_reset), PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (m_p_reset == MAP_FAILED)
+    {
+        perror("mmap");
+        return EXIT_FAILURE;
+    }
+
+    if (!boot(learn_boot, 0))
+    {
+        printf("FAILED: nothing learned\n");
+        return EXIT_FAILURE;
+    }
+
+    restored = boot(restore_boot, 0);
+    printf("after a reset: %s\n",
+           restored ? "same calibration and curve before FDS is up"
+                    : "FAILED");
+
+    for (uint32_t bit = 0; bit < 8 * m_p_reset->size; bit++)
+    {
+        if (boot(flipped_boot, bit))
+        {
+            rejected++;
+        }
+    }
+    printf("one bit flipped: %u of %u copies rejected%s\n", rejected,
+           8 * m_p_reset->size,
+           (rejected == 8 * m_p_reset->size) ? "" : "  FAILED");
+
+    return (restored && rejected == 8 * m_p_reset->size) ? EXIT_SUCCESS
+                                                         : EXIT_FAILURE;
+}
@@ -0,0 +1,181 @@
+/**
+ * Copyright (c) 2018 Keith Wakeham
+ *
+ * All rights reserved.
+ *
+ *
+ */
+
+// sample-ring.h hammered from two threads, a producer standing in for the
+// SAADC interrupt and a consumer for main context. Every push carries the
+// next sequence number in its timestamp and a code derived from it, whether
+// the ring takes it or not. The consumer checks that each entry it pops is
+// whole, comes after the previous one and that the sequence numbers it
+// never saw add up to the ring's dropped count. Both sides stall at random
+// now and then so the ring runs full, empty and everything in between.
+//
+// Exits 1 on any torn, lost or reordered entry, or when the ring never ran
+// full or mostly did, the run did not test much then.
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "sample-ring.h"
+
+#define PUSHES 5000000
+// Chance in 1/65536 that a side stalls before its next call, and how long
+#define STALL_CHANCE 64
+#define STALL_SPINS 2000
+// The producer waits up to this long between pushes, like conversions do
+#define PACE_SPINS 64
+// Chance in 1/65536 that the producer pushes into a full ring instead of
+// letting the consumer catch up first. With one CPU the two threads only
+// take turns when one of them yields or is preempted.
+#define OVERRUN_CHANCE 4096
+
+typedef struct
+{
+    uint64_t random_state;
+    uint32_t popped;
+    uint32_t torn;
+    uint32_t reordered;
+    uint32_t lost;
+} consumer_t;
+
+static sample_ring_t m_ring;
+static volatile bool m_consumer_running;
+static volatile bool m_producer_done;
+
+static uint32_t random_next(uint64_t *p_state)
+{
+    *p_state ^= *p_state >> 12;
+    *p_state ^= *p_state << 25;
+    *p_state ^= *p_state >> 27;
+
+    return (uint32_t)((*p_state * 0x2545f4914f6cdd1dULL) >> 32);
+}
+
+static int16_t code_of(uint32_t sequence)
+{
+    return (int16_t)((sequence * 2654435761u) >> 16);
+}
+
+static void spin(uint32_t spins)
+{
+    for (volatile uint32_t i = 0; i < spins; i++)
+    {
+    }
+}
+
+static void stall_maybe(uint64_t *p_state)
+{
+    if ((random_next(p_state) & 0xffff) < STALL_CHANCE)
+    {
+        spin(STALL_SPINS);
+    }
+}
+
+static void *producer(void *p_context)
+{
+    uint64_t random_state = 0x9e3779b97f4a7c15ULL;
+
+    (void)p_context;
+
+    while (!m_consumer_running)
+    {
+    }
+    for (uint32_t sequence = 0; sequence < PUSHES; sequence++)
+    {
+        sample_ring_entry_t entry = {
+            .code = code_of(sequence),
+            .timestamp = sequence,
+        };
+
+        spin(random_next(&random_state) % PACE_SPINS);
+        stall_maybe(&random_state);
+        while (m_ring.head - m_ring.tail == SAMPLE_RING_SIZE &&
+               (random_next(&random_state) & 0xffff) >= OVERRUN_CHANCE)
+        {
+            sched_yield();
+        }
+        (void)sample_ring_push(&m_ring, &entry);
+    }
+    __DMB();
+    m_producer_done = true;
+
+    return NULL;
+}
+
+static void *consumer(void *p_context)
+{
+    consumer_t *p_consumer = p_context;
+    uint32_t    expected = 0;
+
+    m_consumer_running = true;
+    for (;;)
+    {
+        sample_ring_entry_t entry;
+        bool                done = m_producer_done;
+
+        stall_maybe(&p_consumer->random_state);
+        if (!sample_ring_pop(&m_ring, &entry))
+        {
+            if (done)
+            {
+                // Nothing was left after the last push
+                break;
+            }
+            sched_yield();
+            continue;
+        }
+
+        p_consumer->popped++;
+        if (entry.code != code_of(entry.timestamp))
+        {
+            p_consumer->torn++;
+            continue;
+        }
+        if (entry.timestamp < expected)
+        {
+            p_consumer->reordered++;
+            continue;
+        }
+        p_consumer->lost += entry.timestamp - expected;
+        expected = entry.timestamp + 1;
+    }
+    // Dropped at the very end, after the last entry that got through
+    p_consumer->lost += PUSHES - expected;
+
+    return NULL;
+}
+
+int main(void)
+{
+    consumer_t consumer_state = {.random_state = 0x2545f4914f6cdd1dULL};
+    pthread_t  producer_thread;
+    pthread_t  consumer_thread;
+    bool       ok;
+
+    if (pthread_create(&consumer_thread, NULL, consumer, &consumer_state) !=
+            0 ||
+        pthread_create(&producer_thread, NULL, producer, NULL) != 0)
+    {
+        perror("ring: pthread_create");
+        return EXIT_FAILURE;
+    }
+    pthread_join(producer_thread, NULL);
+    pthread_join(consumer_thread, NULL);
+
+    ok = consumer_state.torn == 0 && consumer_state.reordered == 0 &&
+         consumer_state.lost == m_ring.dropped &&
+         consumer_state.popped + m_ring.dropped == PUSHES &&
+         m_ring.dropped > 0 && consumer_state.popped > PUSHES / 2;
+    printf("%u pushes: %u popped, %u dropped, %u missing, %u torn, "
+           "%u reordered\n",
+           PUSHES, consumer_state.popped, m_ring.dropped, consumer_state.lost,
+           consumer_state.torn, consumer_state.reordered);
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,202 @@
+/**
+ * Copyright (c) 2018 Keith Wakeham
+ *
+ * All rights reserved.
+ *
+ *
+ */
+
+// The SAADC ping-pong of steer-adc.c on the fake nrfx drivers, without the
+// rest of the firmware. RTC2 triggers every conversion through PPI and the
+// input counts up by one per conversion. nrfx_saadc_buffer_convert() is
+// wrapped to look at every buffer saadc_callback() hands back: it has to be
+// the other one of the two in m_buffer_pool than the last time, full, and
+// carry the conversions right after those of the previous buffer. Halfway
+// the sample rate changes under the running sampler.
+//
+// Exits 1 on a buffer out of turn, a lost or repeated conversion, a ring
+// entry missing for a buffer or buffers that did not come at a steady rate.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "fake.h"
+#include "params.h"
+#include "steer-adc.h"
+
+#define PHASE_NS (5 * FAKE_NS_PER_S)
+// Rate of the second half, in PARAM_SAMPLE_RATE units
+#define SLOW_RATE 100
+
+// Buffers come once every so many RTC2 ticks, the clock they come at only
+// resolves that well
+#define JITTER_NS (FAKE_NS_PER_S / 32768 + 1)
+
+ret_code_t __real_nrfx_saadc_buffer_convert(nrf_saadc_value_t *buffer,
+                                            uint16_t           size);
+
+static struct
+{
+    nrf_saadc_value_t *p_pool[2];
+    uint32_t           pool_count;  // buffers given at init
+    bool               running;
+    uint32_t           inputs;      // conversions the input was sampled for
+    uint32_t           checked;     // conversions seen in handed back buffers
+    uint32_t           buffers;
+    uint32_t           out_of_turn;
+    uint32_t           short_buffers;
+    uint32_t           wrong_codes;
+    uint32_t           entries;     // sample handler calls
+    uint32_t           processed;   // steering_process() calls with samples
+    uint64_t           last_ns;
+    uint64_t           interval_min_ns;
+    uint64_t           interval_max_ns;
+    uint32_t           buffer_size;
+} m_test;
+
+static int16_t code_of(uint32_t conversion)
+{
+    return (int16_t)(conversion % MAX_ADC_RESOLUTION);
+}
+
+static int16_t counting_input(uint64_t at_ns, void *p_context)
+{
+    UNUSED_PARAMETER(at_ns);
+    UNUSED_PARAMETER(p_context);
+
+    return code_of(m_test.inputs++);
+}
+
+ret_code_t __wrap_nrfx_saadc_buffer_convert(nrf_saadc_value_t *buffer,
+                                            uint16_t           size)
+{
+    uint64_t now = fake_time_ns();
+
+    if (!m_test.running)
+    {
+        if (m_test.pool_count < ARRAY_SIZE(m_test.p_pool))
+        {
+            m_test.p_pool[m_test.pool_count++] = buffer;
+        }
+        m_test.buffer_size = size;
+        return __real_nrfx_saadc_buffer_convert(buffer, size);
+    }
+
+    // Handed back from saadc_callback() once EasyDMA filled it
+    if (buffer != m_test.p_pool[m_test.buffers % 2])
+    {
+        m_test.out_of_turn++;
+    }
+    if (size != m_test.buffer_size)
+    {
+        m_test.short_buffers++;
+    }
+    for (uint16_t i = 0; i < size; i++)
+    {
+        if (buffer[i] != code_of(m_test.checked + i))
+        {
+            m_test.wrong_codes++;
+        }
+    }
+    m_test.checked += size;
+
+    if (m_test.buffers > 0)
+    {
+        uint64_t interval = now - m_test.last_ns;
+
+        m_test.interval_min_ns = MIN(m_test.interval_min_ns, interval);
+        m_test.interval_max_ns = MAX(m_test.interval_max_ns, interval);
+    }
+    m_test.last_ns = now;
+    m_test.buffers++;
+
+    return __real_nrfx_saadc_buffer_convert(buffer, size);
+}
+
+static void sample_handler(void) { m_test.entries++; }
+
+/**
+ * @brief Run the clock like the firmware's main loop would, processing
+ * samples after every interrupt
+ *
+ */
+static void run_for(uint64_t ns)
+{
+    uint64_t until = fake_time_ns() + ns;
+
+    while (fake_time_ns() < until && fake_run_next())
+    {
+        while (steering_process())
+        {
+            m_test.processed++;
+        }
+    }
+}
+
+/**
+ * @brief Run a phase and check the buffers came at one steady rate
+ *
+ */
+static bool phase_run(char const *p_name)
+{
+    uint32_t buffers = m_test.buffers;
+    bool     steady;
+
+    m_test.interval_min_ns = UINT64_MAX;
+    m_test.interval_max_ns = 0;
+    // The first buffer of a phase may still be one of the last rate
+    run_for(FAKE_NS_PER_S / 2);
+    m_test.interval_min_ns = UINT64_MAX;
+    m_test.interval_max_ns = 0;
+    run_for(PHASE_NS);
+
+    steady = m_test.interval_max_ns - m_test.interval_min_ns <= JITTER_NS;
+    printf("%s: %u buffers, every %.3f to %.3f ms\n", p_name,
+           m_test.buffers - buffers,
+           (double)m_test.interval_min_ns / FAKE_NS_PER_MS,
+           (double)m_test.interval_max_ns / FAKE_NS_PER_MS);
+
+    return steady;
+}
+
+int main(void)
+{
+    uint32_t in_flight;
+    bool     ok;
+
+    fake_saadc_input_fn_set(counting_input, NULL);
+
+    params_init(NULL);
+    steering_init(sample_handler);
+    if (m_test.pool_count != 2 || m_test.p_pool[0] == m_test.p_pool[1])
+    {
+        printf("steering_init() did not queue two buffers\n");
+        return EXIT_FAILURE;
+    }
+    m_test.running = true;
+
+    ok = phase_run("default rate");
+    steering_sample_rate_set(SLOW_RATE);
+    ok = phase_run("slow rate") && ok;
+
+    // Whatever the partly filled buffer holds
+    in_flight = fake_saadc_conversions() - m_test.checked;
+
+    printf("%u conversions, %u lost, %u in flight, %u buffers, %u out of "
+           "turn, %u short, %u wrong codes\n",
+           m_test.inputs, m_test.inputs - fake_saadc_conversions(), in_flight,
+           m_test.buffers, m_test.out_of_turn, m_test.short_buffers,
+           m_test.wrong_codes);
+    printf("%u samples counted, %u ring entries, %u processed\n",
+           get_sample_count(), m_test.entries, m_test.processed);
+
+    ok = ok && m_test.buffers > 0 && m_test.out_of_turn == 0 &&
+         m_test.short_buffers == 0 && m_test.wrong_codes == 0 &&
+         m_test.inputs == fake_saadc_conversions() &&
+         in_flight < m_test.buffer_size &&
+         get_sample_count() == m_test.checked &&
+         m_test.entries == m_test.buffers &&
+         m_test.processed == m_test.buffers;
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
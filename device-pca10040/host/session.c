@@ -0,0 +1,130 @@
+/**
+ * Copyright (c) 2018 Keith Wakeham
+ *
+ * All rights reserved.
+ *
+ *
+ */
+
+// A short ride on the host build: boot, connect a central, go through the
+// handshake Zwift does, turn the bars one way and back and print the angles
+// that get notified.
+
+#include <math.h>
+#include <stdio.h>
+
+#include "ble_cus.h"
+#include "fake.h"
+#include "steer-adc.h"
+
+#define SWEEP_NS (2 * FAKE_NS_PER_S)
+#define SWEEP_AMPLITUDE 3000
+#define CENTRE_CODE (MAX_ADC_RESOLUTION / 2)
+
+// Only print once the angle moved this far, in degrees
+#define PRINT_STEP 1.0f
+
+static uint64_t m_sweep_start_ns;
+
+static uint32_t m_notifications;
+static uint32_t m_indications;
+static uint64_t m_queue_ns_sum;
+static float    m_printed = NAN;
+
+static uint16_t m_steering_handle;
+
+static int16_t sweep_input(uint64_t at_ns, void *p_context)
+{
+    double phase;
+
+    UNUSED_PARAMETER(p_context);
+
+    if (at_ns < m_sweep_start_ns || at_ns > m_sweep_start_ns + SWEEP_NS)
+    {
+        return CENTRE_CODE;
+    }
+    phase = 2 * M_PI * (double)(at_ns - m_sweep_start_ns) / SWEEP_NS;
+
+    return (int16_t)(CENTRE_CODE + SWEEP_AMPLITUDE * sin(phase));
+}
+
+static void hvx_handler(fake_ble_hvx_t const *p_hvx, void *p_context)
+{
+    UNUSED_PARAMETER(p_context);
+
+    if (p_hvx->type == BLE_GATT_HVX_INDICATION)
+    {
+        m_indications++;
+        printf("%10.3f ms indication 0x%04x:",
+               (double)p_hvx->sent_ns / FAKE_NS_PER_MS, p_hvx->handle);
+        for (uint16_t i = 0; i < p_hvx->len; i++)
+        {
+            printf(" %02x", p_hvx->data[i]);
+        }
+        printf("\n");
+        return;
+    }
+    if (p_hvx->handle != m_steering_handle || p_hvx->len != sizeof(float))
+    {
+        return;
+    }
+
+    float angle;
+
+    memcpy(&angle, p_hvx->data, sizeof(angle));
+    m_notifications++;
+    m_queue_ns_sum += p_hvx->sent_ns - p_hvx->queued_ns;
+
+    if (isnan(m_printed) || fabsf(angle - m_printed) >= PRINT_STEP)
+    {
+        printf("%10.3f ms angle %6.2f, queued %.3f ms\n",
+               (double)p_hvx->sent_ns / FAKE_NS_PER_MS, angle,
+               (double)(p_hvx->sent_ns - p_hvx->queued_ns) / FAKE_NS_PER_MS);
+        m_printed = angle;
+    }
+}
+
+int main(void)
+{
+    uint16_t conn_handle;
+
+    fake_saadc_input_set(CENTRE_CODE);
+    fake_ble_hvx_handler_set(hvx_handler, NULL);
+
+    fake_firmware_boot();
+    fake_run_for(200 * FAKE_NS_PER_MS);
+
+    conn_handle = fake_central_connect(15);
+    if (conn_handle == BLE_CONN_HANDLE_INVALID)
+    {
+        fprintf(stderr, "not advertising\n");
+        return 1;
+    }
+
+    m_steering_handle = fake_ble_value_handle(STEERER_CHAR_UUID);
+
+    // Subscribe, then the challenge and the reply the app sends
+    fake_central_start(conn_handle);
+
+    // Let the stick settle so the centre is learnt, then turn
+    fake_run_for(1 * FAKE_NS_PER_S);
+    m_sweep_start_ns = fake_time_ns();
+    fake_saadc_input_fn_set(sweep_input, NULL);
+    fake_run_for(SWEEP_NS + FAKE_NS_PER_S);
+
+    printf("%u steering notifications, %.3f ms queued on average, "
+           "%u indications\n",
+           m_notifications,
+           m_notifications > 0 ? (double)m_queue_ns_sum / m_notifications /
+                                     FAKE_NS_PER_MS
+                               : 0.0,
+           m_indications);
+    printf("%u conversions, %u hvx calls, connection interval %u us\n",
+           fake_saadc_conversions(), fake_calls("sd_ble_gatts_hvx"),
+           fake_ble_conn_interval_us(conn_handle));
+
+    fake_ble_disconnect(conn_handle, BLE_HCI_REMOTE_USER_TERMINATED_CONNECTION);
+    fake_run_for(1 * FAKE_NS_PER_S);
+
+    return m_notifications > 0 ? 0 : 1;
+}
@@ -0,0 +1,693 @@
+/**
+ * Copyright (c) 2018 Keith Wakeham
+ *
+ * All rights reserved.
+ *
+ *
+ */
+
+// Long rides on the virtual clock. A central connects at a fixed interval,
+// sets the sampling and notify parameters through the config characteristic
+// and goes through the handshake, then a rider turns the bars at random for
+// as long as asked. The firmware runs unchanged, sampling from RTC2 through
+// the SAADC interrupt, keep-alive from app_timer, writes and TX complete
+// through ble_cus_on_ble_evt.
+//
+// Every steering notification is followed from the sample behind it to the
+// connection event it goes out in: ble_cus_steering_value_update() and
+// sd_ble_gatts_hvx() are wrapped at link time (-Wl,--wrap) to note which
+// sample the value in the attribute came from when the SoftDevice copied it.
+//
+//   _build/sim --rate 200 --delta 25 --keepalive 1000 --interval 7.5
+//
+// Each run is one configuration, the firmware keeps its state in statics.
+// --csv prints a single line to collect a sweep from a shell loop.
+
+#include <getopt.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "ble_cus.h"
+#include "fake.h"
+#include "params.h"
+#include "steer-adc.h"
+
+#define CENTRE_CODE (MAX_ADC_RESOLUTION / 2)
+
+// Histogram bins of 10 us up to 5 s, anything longer goes in the last one
+#define BIN_NS (10 * FAKE_NS_PER_US)
+#define BIN_COUNT 500000
+
+// Steering notifications the SoftDevice may hold, more than any link config
+#define IN_FLIGHT_MAX 32
+
+// The bars are held still for a while, then turned somewhere else
+#define HOLD_MIN_NS (500 * FAKE_NS_PER_MS)
+#define HOLD_MEAN_NS (2 * FAKE_NS_PER_S)
+#define MOVE_MIN_NS (200 * FAKE_NS_PER_MS)
+#define MOVE_MAX_NS (1000 * FAKE_NS_PER_MS)
+#define MOVE_CODES_MIN 500
+#define TURN_CODES 3000
+
+typedef struct
+{
+    uint64_t bins[BIN_COUNT];
+    uint64_t weight;
+    double   sum_ns;
+    uint64_t max_ns;
+} histogram_t;
+
+typedef enum
+{
+    HIST_SAMPLE_TO_HVX,   // sample captured to accepted by the SoftDevice
+    HIST_RESEND_TO_HVX,   // the same for keep-alives and first angles
+    HIST_HVX_TO_AIR,      // accepted to its connection event
+    HIST_SAMPLE_AGE,      // sample captured to on air
+    HIST_CENTRAL_AGE,     // age of what the central holds, over time
+    HIST_MOVE_TO_AIR,     // the bars start turning to the central seeing it
+    HIST_NOTIFY_SPACING,  // between steering notifications on air
+    HIST_COUNT
+} hist_id_t;
+
+static char const *const m_hist_names[HIST_COUNT] = {
+    [HIST_SAMPLE_TO_HVX] = "sample to hvx",
+    [HIST_RESEND_TO_HVX] = "resend to hvx",
+    [HIST_HVX_TO_AIR] = "hvx to air",
+    [HIST_SAMPLE_AGE] = "sample age on air",
+    [HIST_CENTRAL_AGE] = "age at central",
+    [HIST_MOVE_TO_AIR] = "move to air",
+    [HIST_NOTIFY_SPACING] = "notify spacing",
+};
+
+typedef struct
+{
+    uint16_t rate_hz;
+    uint16_t notify_delta;
+    uint16_t keepalive_ms;
+    double   interval_ms;
+    bool     negotiate;
+    uint8_t  queue_size;
+    uint8_t  packets_per_event;
+    uint32_t radio_cpu_us;
+    uint32_t isr_cpu_us;
+    double   noise_codes;
+    double   hours;
+    uint32_t seed;
+    bool     csv;
+} config_t;
+
+static config_t m_config = {
+    .rate_hz = 200,
+    .notify_delta = 25,
+    .keepalive_ms = 1000,
+    .interval_ms = 7.5,
+    .queue_size = 1,
+    .noise_codes = 2.0,
+    .hours = 1.0,
+    .seed = 1,
+};
+
+static histogram_t m_hists[HIST_COUNT];
+static bool        m_recording;
+
+static uint16_t m_steering_handle;
+
+// Sample behind the value ble_cus keeps in the attribute, and whether it
+// was sent because it changed
+static uint64_t m_stored_sample_ns;
+static bool     m_stored_changed;
+
+// Samples behind the notifications the SoftDevice holds, in send order
+static uint64_t m_in_flight_sample_ns[IN_FLIGHT_MAX];
+static uint8_t  m_in_flight_head;
+static uint8_t  m_in_flight_count;
+
+// What the central got last
+static bool     m_delivered;
+static uint64_t m_delivered_ns;
+static uint64_t m_delivered_sample_ns;
+static float    m_delivered_angle;
+
+static uint32_t m_updates;
+static uint32_t m_notifications;
+static uint32_t m_hvx_rejected;
+
+static uint64_t m_queue_depths[IN_FLIGHT_MAX + 1];
+static uint64_t m_conn_events;
+
+// The rider
+static uint64_t m_rng;
+static uint64_t m_move_start_ns;
+static uint64_t m_move_end_ns;
+static bool     m_move_begun;
+static double   m_move_from;
+static double   m_move_to;
+
+// The move waiting for the central to see it
+static bool     m_move_open;
+static uint64_t m_move_open_ns;
+static float    m_move_open_angle;
+static uint32_t m_moves;
+static uint32_t m_moves_unseen;
+
+static uint64_t rng_next(void)
+{
+    // xorshift64*, the same ride for the same seed
+    m_rng ^= m_rng >> 12;
+    m_rng ^= m_rng << 25;
+    m_rng ^= m_rng >> 27;
+    return m_rng * 0x2545F4914F6CDD1DULL;
+}
+
+static double rng_uniform(void)
+{
+    return (double)(rng_next() >> 11) / (double)(1ULL << 53);
+}
+
+static double rng_gauss(void)
+{
+    double u = rng_uniform();
+    double v = rng_uniform();
+
+    return sqrt(-2.0 * log(1.0 - u)) * cos(2.0 * M_PI * v);
+}
+
+// Histograms
+
+static void hist_add(hist_id_t id, uint64_t value_ns, uint64_t weight)
+{
+    histogram_t *p_hist = &m_hists[id];
+
+    if (!m_recording)
+    {
+        return;
+    }
+    p_hist->bins[MIN(value_ns / BIN_NS, BIN_COUNT - 1)] += weight;
+    p_hist->weight += weight;
+    p_hist->sum_ns += (double)value_ns * weight;
+    p_hist->max_ns = MAX(p_hist->max_ns, value_ns);
+}
+
+/**
+ * @brief Add a value that grew linearly from from_ns to to_ns, weighted by
+ * the time it spent in each bin
+ *
+ */
+static void hist_add_ramp(hist_id_t id, uint64_t from_ns, uint64_t to_ns)
+{
+    histogram_t *p_hist = &m_hists[id];
+    uint64_t     at_ns = from_ns;
+
+    if (!m_recording || to_ns <= from_ns)
+    {
+        return;
+    }
+    while (at_ns < to_ns)
+    {
+        uint64_t bin = MIN(at_ns / BIN_NS, BIN_COUNT - 1);
+        uint64_t end_ns =
+            (bin == BIN_COUNT - 1) ? to_ns : MIN((bin + 1) * BIN_NS, to_ns);
+
+        p_hist->bins[bin] += end_ns - at_ns;
+        at_ns = end_ns;
+    }
+    p_hist->weight += to_ns - from_ns;
+    p_hist->sum_ns += ((double)from_ns + to_ns) / 2 * (to_ns - from_ns);
+    p_hist->max_ns = MAX(p_hist->max_ns, to_ns);
+}
+
+/**
+ * @brief Value below which a share of the weight lies, the upper edge of its
+ * bin
+ *
+ */
+static uint64_t hist_percentile(hist_id_t id, double share)
+{
+    histogram_t const *p_hist = &m_hists[id];
+    uint64_t           target = (uint64_t)ceil(share * p_hist->weight);
+    uint64_t           sum = 0;
+
+    for (uint32_t i = 0; i < BIN_COUNT; i++)
+    {
+        sum += p_hist->bins[i];
+        if (sum >= target && sum > 0)
+        {
+            return MIN((i + 1) * BIN_NS, p_hist->max_ns);
+        }
+    }
+
+    return p_hist->max_ns;
+}
+
+// The rider, sampled by the SAADC
+
+/**
+ * @brief Hold where the last move ended, then plan the next one
+ *
+ */
+static void move_plan(uint64_t after_ns)
+{
+    double target;
+
+    m_move_start_ns =
+        after_ns + HOLD_MIN_NS +
+        (uint64_t)(-log(1.0 - rng_uniform()) * (HOLD_MEAN_NS - HOLD_MIN_NS));
+    m_move_end_ns = m_move_start_ns + MOVE_MIN_NS +
+                    (uint64_t)(rng_uniform() * (MOVE_MAX_NS - MOVE_MIN_NS));
+    do
+    {
+        target = CENTRE_CODE + (2 * rng_uniform() - 1) * TURN_CODES;
+    } while (fabs(target - m_move_to) < MOVE_CODES_MIN);
+    m_move_from = m_move_to;
+    m_move_to = target;
+    m_move_begun = false;
+}
+
+static void move_begin(void)
+{
+    m_move_begun = true;
+    if (!m_recording)
+    {
+        return;
+    }
+    if (m_move_open)
+    {
+        // Too small to get past the dead band or the notify delta in time
+        m_moves_unseen++;
+    }
+    m_moves++;
+    m_move_open = m_delivered;
+    m_move_open_ns = m_move_start_ns;
+    m_move_open_angle = m_delivered_angle;
+}
+
+static int16_t rider_input(uint64_t at_ns, void *p_context)
+{
+    double code;
+
+    UNUSED_PARAMETER(p_context);
+
+    // Moves are measured from where they start, not from the first sample
+    // that caught them
+    while (at_ns >= m_move_end_ns)
+    {
+        if (!m_move_begun)
+        {
+            move_begin();
+        }
+        move_plan(m_move_end_ns);
+    }
+    if (at_ns >= m_move_start_ns && !m_move_begun)
+    {
+        move_begin();
+    }
+
+    if (at_ns < m_move_start_ns)
+    {
+        code = m_move_from;
+    }
+    else
+    {
+        // Raised cosine from one position to the next
+        double x = (double)(at_ns - m_move_start_ns) /
+                   (double)(m_move_end_ns - m_move_start_ns);
+
+        code = m_move_from + (m_move_to - m_move_from) *
+                                 (1.0 - cos(M_PI * x)) / 2.0;
+    }
+    code += m_config.noise_codes * rng_gauss();
+
+    return (int16_t)MIN(MAX(lround(code), 0), MAX_ADC_RESOLUTION - 1);
+}
+
+// Firmware hooks
+
+uint32_t __real_ble_cus_steering_value_update(ble_cus_t *p_cus,
+                                              int16_t    angle_cdeg,
+                                              uint32_t   sample_timestamp,
+                                              bool       changed);
+
+uint32_t __wrap_ble_cus_steering_value_update(ble_cus_t *p_cus,
+                                              int16_t    angle_cdeg,
+                                              uint32_t   sample_timestamp,
+                                              bool       changed)
+{
+    uint64_t now_ticks = fake_lfclk_ticks(fake_time_ns());
+    uint32_t age_ticks = app_timer_cnt_diff_compute(
+        (uint32_t)now_ticks & RTC_COUNTER_COUNTER_Msk, sample_timestamp);
+
+    // The value in the attribute is this sample's from here on, whether it
+    // is sent now or kept pending
+    m_stored_sample_ns = fake_lfclk_ns(now_ticks - MIN(age_ticks, now_ticks));
+    m_stored_changed = changed;
+    m_updates++;
+
+    return __real_ble_cus_steering_value_update(p_cus, angle_cdeg,
+                                                sample_timestamp, changed);
+}
+
+ret_code_t __real_sd_ble_gatts_hvx(uint16_t                      conn_handle,
+                                   ble_gatts_hvx_params_t const *p_hvx_params);
+
+ret_code_t __wrap_sd_ble_gatts_hvx(uint16_t                      conn_handle,
+                                   ble_gatts_hvx_params_t const *p_hvx_params)
+{
+    ret_code_t err_code = __real_sd_ble_gatts_hvx(conn_handle, p_hvx_params);
+
+    if (p_hvx_params->handle != m_steering_handle)
+    {
+        return err_code;
+    }
+    if (err_code != NRF_SUCCESS)
+    {
+        m_hvx_rejected++;
+        return err_code;
+    }
+    if (m_in_flight_count == IN_FLIGHT_MAX)
+    {
+        fprintf(stderr, "sim: more than %d notifications in flight\n",
+                IN_FLIGHT_MAX);
+        exit(1);
+    }
+
+    m_in_flight_sample_ns[(m_in_flight_head + m_in_flight_count++) %
+                          IN_FLIGHT_MAX] = m_stored_sample_ns;
+    // Like LATENCY_SAMPLE_TO_HVX, a resend is as old as the bars are still
+    hist_add(m_stored_changed ? HIST_SAMPLE_TO_HVX : HIST_RESEND_TO_HVX,
+             fake_time_ns() - m_stored_sample_ns, 1);
+
+    return err_code;
+}
+
+static void hvx_handler(fake_ble_hvx_t const *p_hvx, void *p_context)
+{
+    uint64_t sample_ns;
+    float    angle;
+
+    UNUSED_PARAMETER(p_context);
+
+    if (p_hvx->handle != m_steering_handle ||
+        p_hvx->type != BLE_GATT_HVX_NOTIFICATION || m_in_flight_count == 0)
+    {
+        return;
+    }
+
+    sample_ns = m_in_flight_sample_ns[m_in_flight_head];
+    m_in_flight_head = (m_in_flight_head + 1) % IN_FLIGHT_MAX;
+    m_in_flight_count--;
+    memcpy(&angle, p_hvx->data, sizeof(angle));
+
+    hist_add(HIST_HVX_TO_AIR, p_hvx->sent_ns - p_hvx->queued_ns, 1);
+    hist_add(HIST_SAMPLE_AGE, p_hvx->sent_ns - sample_ns, 1);
+    if (m_delivered)
+    {
+        // Until now the central held the previous value, ageing as it went
+        hist_add_ramp(HIST_CENTRAL_AGE, m_delivered_ns - m_delivered_sample_ns,
+                      p_hvx->sent_ns - m_delivered_sample_ns);
+        hist_add(HIST_NOTIFY_SPACING, p_hvx->sent_ns - m_delivered_ns, 1);
+    }
+    if (m_move_open && p_hvx->sent_ns >= m_move_open_ns &&
+        fabsf(angle - m_move_open_angle) * STEER_ANGLE_SCALE >=
+            m_config.notify_delta)
+    {
+        hist_add(HIST_MOVE_TO_AIR, p_hvx->sent_ns - m_move_open_ns, 1);
+        m_move_open = false;
+    }
+
+    if (m_recording)
+    {
+        m_notifications++;
+    }
+    m_delivered = true;
+    m_delivered_ns = p_hvx->sent_ns;
+    m_delivered_sample_ns = sample_ns;
+    m_delivered_angle = angle;
+}
+
+static void conn_evt_handler(fake_ble_conn_evt_t const *p_evt,
+                             void *                     p_context)
+{
+    UNUSED_PARAMETER(p_context);
+
+    if (m_recording)
+    {
+        m_queue_depths[MIN(p_evt->hvn_queued, IN_FLIGHT_MAX)]++;
+        m_conn_events++;
+    }
+}
+
+// The central
+
+static bool central_start(uint16_t *p_conn_handle)
+{
+    uint16_t conn_handle;
+
+    fake_ble_conn_param_accept_set(m_config.negotiate);
+    conn_handle = fake_central_connect(m_config.interval_ms);
+    if (conn_handle == BLE_CONN_HANDLE_INVALID)
+    {
+        fprintf(stderr, "sim: not advertising\n");
+        return false;
+    }
+
+    if (!fake_central_param_set(conn_handle, PARAM_SAMPLE_RATE,
+                                m_config.rate_hz) ||
+        !fake_central_param_set(conn_handle, PARAM_NOTIFY_DELTA,
+                                m_config.notify_delta) ||
+        !fake_central_param_set(conn_handle, PARAM_KEEPALIVE_INTERVAL,
+                                m_config.keepalive_ms))
+    {
+        fprintf(stderr, "sim: the firmware refused a parameter\n");
+        return false;
+    }
+
+    m_steering_handle = fake_ble_value_handle(STEERER_CHAR_UUID);
+    fake_central_start(conn_handle);
+
+    *p_conn_handle = conn_handle;
+    return true;
+}
+
+// Report
+
+static double ms(uint64_t ns) { return (double)ns / FAKE_NS_PER_MS; }
+
+static void report(uint64_t ride_ns, double wall_s, uint16_t conn_handle)
+{
+    if (m_config.csv)
+    {
+        // rate, delta, keep-alive, interval in use, queue, radio and
+        // interrupt CPU, then p50 and p99 in ms in the order of hist_id_t
+        printf("%u,%u,%u,%.2f,%u,%u,%u", m_config.rate_hz,
+               m_config.notify_delta, m_config.keepalive_ms,
+               (double)fake_ble_conn_interval_us(conn_handle) / 1000,
+               m_config.queue_size, m_config.radio_cpu_us,
+               m_config.isr_cpu_us);
+        for (uint32_t i = 0; i < HIST_COUNT; i++)
+        {
+            printf(",%.3f,%.3f", ms(hist_percentile(i, 0.5)),
+                   ms(hist_percentile(i, 0.99)));
+        }
+        printf("\n");
+        return;
+    }
+
+    printf("rate %u Hz, notify delta %u cdeg, keep-alive %u ms, "
+           "interval %.2f ms%s\n",
+           m_config.rate_hz, m_config.notify_delta, m_config.keepalive_ms,
+           m_config.interval_ms, m_config.negotiate ? " negotiated" : "");
+    printf("queue %u, %s packets per event, radio %u us, interrupts %u us, "
+           "noise %.1f codes\n",
+           m_config.queue_size, m_config.packets_per_event ? "" : "all",
+           m_config.radio_cpu_us, m_config.isr_cpu_us, m_config.noise_codes);
+    printf("%.1f s ridden in %.1f s, interval at the end %u us\n\n",
+           (double)ride_ns / FAKE_NS_PER_S, wall_s,
+           fake_ble_conn_interval_us(conn_handle));
+
+    // The age at the central is weighted by time, it has no count
+    printf("%-18s %9s %8s %8s %8s %8s %8s %8s\n", "ms", "count", "mean",
+           "p50", "p90", "p99", "p99.9", "max");
+    for (uint32_t i = 0; i < HIST_COUNT; i++)
+    {
+        histogram_t const *p_hist = &m_hists[i];
+        char               count[16] = "-";
+
+        if (i != HIST_CENTRAL_AGE)
+        {
+            snprintf(count, sizeof(count), "%llu",
+                     (unsigned long long)p_hist->weight);
+        }
+        printf("%-18s %9s %8.3f %8.3f %8.3f %8.3f %8.3f %8.3f\n",
+               m_hist_names[i], count,
+               p_hist->weight > 0 ? ms(p_hist->sum_ns / p_hist->weight) : 0,
+               ms(hist_percentile(i, 0.5)), ms(hist_percentile(i, 0.9)),
+               ms(hist_percentile(i, 0.99)), ms(hist_percentile(i, 0.999)),
+               ms(p_hist->max_ns));
+    }
+
+    printf("\n%u value updates, %u notifications on air, %u hvx refused\n",
+           m_updates, m_notifications, m_hvx_rejected);
+    printf("%u moves, %u never seen before the next\n", m_moves,
+           m_moves_unseen);
+    printf("notifications queued at a connection event:");
+    for (uint32_t i = 0; i <= IN_FLIGHT_MAX; i++)
+    {
+        if (m_queue_depths[i] > 0)
+        {
+            printf(" %u: %.1f%%", i,
+                   100.0 * m_queue_depths[i] / MAX(m_conn_events, 1));
+        }
+    }
+    printf("\n");
+}
+
+static void usage(void)
+{
+    fprintf(stderr,
+            "usage: sim [options]\n"
+            "  --rate HZ           SAADC samples per second (200)\n"
+            "  --delta CDEG        notify delta (25)\n"
+            "  --keepalive MS      keep-alive interval (1000)\n"
+            "  --interval MS       connection interval, 1.25 ms steps (7.5)\n"
+            "  --negotiate         let the firmware change the interval\n"
+            "  --queue N           notifications the SoftDevice holds (1)\n"
+            "  --packets N         notifications per event, 0 as fit (0)\n"
+            "  --radio-cpu US      CPU a connection event takes (0)\n"
+            "  --isr-cpu US        CPU every application interrupt takes "
+            "(0)\n"
+            "  --noise CODES       ADC noise, standard deviation (2)\n"
+            "  --hours H           length of the ride (1)\n"
+            "  --seed N            rider and noise (1)\n"
+            "  --csv               one line: config, p50 and p99 of each\n");
+    exit(2);
+}
+
+static void options_parse(int argc, char **argv)
+{
+    static struct option const options[] = {
+        {"rate", required_argument, NULL, 'r'},
+        {"delta", required_argument, NULL, 'd'},
+        {"keepalive", required_argument, NULL, 'k'},
+        {"interval", required_argument, NULL, 'i'},
+        {"negotiate", no_argument, NULL, 'n'},
+        {"queue", required_argument, NULL, 'q'},
+        {"packets", required_argument, NULL, 'p'},
+        {"radio-cpu", required_argument, NULL, 'R'},
+        {"isr-cpu", required_argument, NULL, 'I'},
+        {"noise", required_argument, NULL, 'N'},
+        {"hours", required_argument, NULL, 'h'},
+        {"seed", required_argument, NULL, 's'},
+        {"csv", no_argument, NULL, 'c'},
+        {NULL, 0, NULL, 0},
+    };
+    int opt;
+
+    while ((opt = getopt_long(argc, argv, "", options, NULL)) != -1)
+    {
+        switch (opt)
+        {
+            case 'r':
+                m_config.rate_hz = (uint16_t)atoi(optarg);
+                break;
+            case 'd':
+                m_config.notify_delta = (uint16_t)atoi(optarg);
+                break;
+            case 'k':
+                m_config.keepalive_ms = (uint16_t)atoi(optarg);
+                break;
+            case 'i':
+                m_config.interval_ms = atof(optarg);
+                break;
+            case 'n':
+                m_config.negotiate = true;
+                break;
+            case 'q':
+                m_config.queue_size = (uint8_t)atoi(optarg);
+                break;
+            case 'p':
+                m_config.packets_per_event = (uint8_t)atoi(optarg);
+                break;
+            case 'R':
+                m_config.radio_cpu_us = (uint32_t)atoi(optarg);
+                break;
+            case 'I':
+                m_config.isr_cpu_us = (uint32_t)atoi(optarg);
+                break;
+            case 'N':
+                m_config.noise_codes = atof(optarg);
+                break;
+            case 'h':
+                m_config.hours = atof(optarg);
+                break;
+            case 's':
+                m_config.seed = (uint32_t)atoi(optarg);
+                break;
+            case 'c':
+                m_config.csv = true;
+                break;
+            default:
+                usage();
+        }
+    }
+    if (optind != argc || m_config.interval_ms < 7.5 ||
+        m_config.interval_ms > 4000 || m_config.hours <= 0)
+    {
+        usage();
+    }
+}
+
+int main(int argc, char **argv)
+{
+    fake_ble_link_config_t link_config;
+    struct timespec        wall_start;
+    struct timespec        wall_end;
+    uint64_t               ride_start_ns;
+    uint64_t               ride_ns;
+    uint16_t               conn_handle;
+
+    options_parse(argc, argv);
+
+    m_rng = 0x9E3779B97F4A7C15ULL * (m_config.seed + 1);
+    m_move_to = CENTRE_CODE;
+    move_plan(0);
+
+    link_config.hvn_queue_size = m_config.queue_size;
+    link_config.packets_per_event = m_config.packets_per_event;
+    fake_ble_link_config_set(&link_config);
+    fake_cpu_time_set(FAKE_PRIO_RADIO, m_config.radio_cpu_us * FAKE_NS_PER_US);
+    fake_cpu_time_set(FAKE_PRIO_SD_EVT, m_config.isr_cpu_us * FAKE_NS_PER_US);
+    fake_cpu_time_set(FAKE_PRIO_SAADC, m_config.isr_cpu_us * FAKE_NS_PER_US);
+    fake_cpu_time_set(FAKE_PRIO_RTC1, m_config.isr_cpu_us * FAKE_NS_PER_US);
+
+    fake_log_level_set(FAKE_LOG_WARNING);
+    fake_ble_hvx_handler_set(hvx_handler, NULL);
+    fake_ble_conn_evt_handler_set(conn_evt_handler, NULL);
+    fake_saadc_input_fn_set(rider_input, NULL);
+
+    clock_gettime(CLOCK_MONOTONIC, &wall_start);
+
+    fake_firmware_boot();
+    fake_run_for(200 * FAKE_NS_PER_MS);
+    if (!central_start(&conn_handle))
+    {
+        return 1;
+    }
+
+    // Long enough for the centre to be learnt and the interval to settle
+    fake_run_for(2 * FAKE_NS_PER_S);
+    m_recording = true;
+    ride_start_ns = fake_time_ns();
+    fake_run_for((uint64_t)(m_config.hours * 3600 * FAKE_NS_PER_S));
+    ride_ns = fake_time_ns() - ride_start_ns;
+
+    clock_gettime(CLOCK_MONOTONIC, &wall_end);
+
+    report(ride_ns,
+           (double)(wall_end.tv_sec - wall_start.tv_sec) +
+               (wall_end.tv_nsec - wall_start.tv_nsec) / 1e9,
+           conn_handle);
+
+    return m_notifications > 0 ? 0 : 1;
+}
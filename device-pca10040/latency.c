@@ -0,0 +1,138 @@
+/**
+ * Copyright (c) 2018 Keith Wakeham
+ *
+ * All rights reserved.
+ *
+ *
+ */
+
+#include "latency.h"
+#include <string.h>
+#include "app_timer.h"
+#include "app_util.h"
+#include "app_util_platform.h"
+
+#define TICKS_TO_US(ticks)                               \
+    ((uint32_t)(((uint64_t)(ticks)*1000000 *             \
+                 (APP_TIMER_CONFIG_RTC_FREQUENCY + 1)) / \
+                APP_TIMER_CLOCK_FREQ))
+
+typedef struct
+{
+    uint32_t buckets[LATENCY_BUCKETS];
+    uint32_t count;
+    uint32_t max;
+} histogram_t;
+
+static histogram_t m_histograms[LATENCY_COUNT];
+
+/**
+ * @brief Bucket of a duration
+ *
+ * @details Below LATENCY_SUB_BUCKETS ticks every value has its own bucket,
+ * above that each power of two is split in LATENCY_SUB_BUCKETS.
+ */
+static uint32_t bucket_get(uint32_t ticks)
+{
+    uint32_t exponent;
+    uint32_t sub;
+
+    if (ticks < LATENCY_SUB_BUCKETS)
+    {
+        return ticks;
+    }
+
+    exponent = 31 - __CLZ(ticks);
+    if (exponent >= LATENCY_MAX_EXPONENT)
+    {
+        return LATENCY_BUCKETS - 1;
+    }
+
+    sub = (ticks >> (exponent - 2)) & (LATENCY_SUB_BUCKETS - 1);
+
+    return LATENCY_SUB_BUCKETS * (exponent - 1) + sub;
+}
+
+/**
+ * @brief Smallest duration that falls in a bucket
+ *
+ */
+static uint32_t bucket_floor(uint32_t bucket)
+{
+    uint32_t exponent;
+    uint32_t sub;
+
+    if (bucket < LATENCY_SUB_BUCKETS)
+    {
+        return bucket;
+    }
+
+    exponent = bucket / LATENCY_SUB_BUCKETS + 1;
+    sub = bucket % LATENCY_SUB_BUCKETS;
+
+    return (LATENCY_SUB_BUCKETS + sub) << (exponent - 2);
+}
+
+/**
+ * @brief Upper edge of the bucket holding a percentile, in ticks
+ *
+ * @param p_histogram histogram to read, must not be empty
+ * @param per_mille percentile in 1/1000
+ */
+static uint32_t percentile_get(histogram_t const *p_histogram,
+                               uint32_t           per_mille)
+{
+    // Rank of the sample, rounded up
+    uint32_t rank =
+        (uint32_t)(((uint64_t)p_histogram->count * per_mille + 999) / 1000);
+    uint32_t seen = 0;
+
+    for (uint32_t i = 0; i < LATENCY_BUCKETS - 1; i++)
+    {
+        seen += p_histogram->buckets[i];
+        if (seen >= rank)
+        {
+            return MIN(bucket_floor(i + 1) - 1, p_histogram->max);
+        }
+    }
+
+    return p_histogram->max;
+}
+
+void latency_record(latency_id_t id, uint32_t ticks)
+{
+    histogram_t *p_histogram = &m_histograms[id];
+
+    CRITICAL_REGION_ENTER();
+    p_histogram->buckets[bucket_get(ticks)]++;
+    p_histogram->count++;
+    p_histogram->max = MAX(p_histogram->max, ticks);
+    CRITICAL_REGION_EXIT();
+}
+
+void latency_summary_get(latency_id_t id, latency_summary_t *p_summary)
+{
+    histogram_t histogram;
+
+    CRITICAL_REGION_ENTER();
+    histogram = m_histograms[id];
+    CRITICAL_REGION_EXIT();
+
+    memset(p_summary, 0, sizeof(*p_summary));
+    p_summary->count = histogram.count;
+    if (histogram.count == 0)
+    {
+        return;
+    }
+
+    p_summary->p50_us = TICKS_TO_US(percentile_get(&histogram, 500));
+    p_summary->p99_us = TICKS_TO_US(percentile_get(&histogram, 990));
+    p_summary->max_us = TICKS_TO_US(histogram.max);
+}
+
+void latency_reset(void)
+{
+    CRITICAL_REGION_ENTER();
+    memset(m_histograms, 0, sizeof(m_histograms));
+    CRITICAL_REGION_EXIT();
+}
@@ -0,0 +1,78 @@
+/**
+ * Copyright (c) 2018 Keith Wakeham
+ *
+ * All rights reserved.
+ *
+ *
+ */
+
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <stdint.h>
+
+// Buckets per power of two, the error of a percentile is below 1/4
+#define LATENCY_SUB_BUCKETS 4
+// Everything from 2^LATENCY_MAX_EXPONENT ticks (2 s) up lands in the last one
+#define LATENCY_MAX_EXPONENT 16
+#define LATENCY_BUCKETS \
+    (LATENCY_SUB_BUCKETS * (LATENCY_MAX_EXPONENT - 1) + 1)
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+    /**
+     * @brief Latencies measured along the steering path
+     *
+     */
+    typedef enum
+    {
+        LATENCY_SAMPLE_TO_HVX,   // sample captured to notification queued
+        LATENCY_HVX_TO_TX,       // notification queued to TX complete
+        LATENCY_HVX_TO_TX_FLASH, // the same, overlapping a flash operation
+        LATENCY_FLASH_OP,        // flash operation handed to FDS to done
+        LATENCY_COUNT
+    } latency_id_t;
+
+    /**
+     * @brief Percentiles of one histogram
+     *
+     * @details Percentiles are the upper edge of their bucket, never below
+     * the real value.
+     */
+    typedef struct
+    {
+        uint32_t count;
+        uint32_t p50_us;
+        uint32_t p99_us;
+        uint32_t max_us;
+    } latency_summary_t;
+
+    /**
+     * @brief Add a duration to a histogram, safe from any context
+     *
+     * @param id histogram
+     * @param ticks duration in app_timer ticks
+     */
+    void latency_record(latency_id_t id, uint32_t ticks);
+
+    /**
+     * @brief Read the percentiles of a histogram
+     *
+     * @param id histogram
+     * @param p_summary filled with the percentiles
+     */
+    void latency_summary_get(latency_id_t id, latency_summary_t *p_summary);
+
+    /**
+     * @brief Clear all histograms
+     *
+     */
+    void latency_reset(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // LATENCY_H
@@ -67,9 +67,9 @@
 #include "ble_conn_state.h"
 #include "ble_cus.h"
 #include "ble_hci.h"
+#include "ble_radio_notification.h"
 #include "ble_srv_common.h"
 #include "bsp_btn_ble.h"
-#include "fds.h"
 #include "nordic_common.h"
 #include "nrf.h"
 #include "nrf_ble_gatt.h"
@@ -84,8 +84,18 @@
 #include "peer_manager.h"
 #include "sensorsim.h"
 
+#include "bench.h"
+#include "calibration.h"
+#include "conn-params.h"
+#include "diag.h"
+#include "latency.h"
 #include "nrf_delay.h"
+#include "params.h"
+#include "power-state.h"
+#include "reconnect.h"
 #include "steer-adc.h"
+#include "storage.h"
+#include "trace.h"
 
 #define DEVICE_NAME                                                 \
     "Marl" /**< Name of device. Will be included in the advertising \
@@ -93,6 +103,14 @@
 #define MANUFACTURER_NAME                                     \
     "Chiefmarley" /**< Manufacturer. Will be passed to Device \
                              Information Service. */
+#define APP_ADV_FAST_INTERVAL                                             \
+    32 /**< The reconnect advertising interval (in units of 0.625 ms. This \
+          value corresponds to 20 ms). */
+
+#define APP_ADV_FAST_DURATION                                               \
+    500 /**< The whitelisted reconnect window (5 seconds) in units of 10 \
+           milliseconds. */
+
 #define APP_ADV_INTERVAL                                                \
     300 /**< The advertising interval (in units of 0.625 ms. This value \
            corresponds to 187.5 ms). */
@@ -130,7 +148,24 @@
     3 /**< Number of attempts before giving up the connection parameter \
          negotiation. */
 
-#define NOTIFICATION_INTERVAL APP_TIMER_TICKS(250)
+#define DIAG_INTERVAL                                                       \
+    APP_TIMER_TICKS(1000) /**< Diagnostics characteristic update interval. \
+                           */
+
+#define RADIO_NOTIFICATION_IRQ_PRIORITY                              \
+    APP_IRQ_PRIORITY_LOW /**< Priority of the radio notification SWI. \
+                          */
+#define RADIO_NOTIFICATION_DISTANCE                                        \
+    NRF_RADIO_NOTIFICATION_DISTANCE_5500US /**< Lead time before each radio \
+                                              event, long enough for one    \
+                                              oversampled conversion. */
+
+#define LATENCY_REPORT_COUNT                                          \
+    1000 /**< Number of transmitted samples between latency reports. \
+          */
+#define AIR_TIME_MAX_AGE                                               \
+    APP_TIMER_TICKS(4000) /**< Oldest connection event the next ones are \
+                             counted from. */
 
 #define SEC_PARAM_BOND 1     /**< Perform bonding. */
 #define SEC_PARAM_MITM 0     /**< Man In The Middle protection not required. */
@@ -142,21 +177,27 @@
 #define SEC_PARAM_MIN_KEY_SIZE 7  /**< Minimum encryption key size. */
 #define SEC_PARAM_MAX_KEY_SIZE 16 /**< Maximum encryption key size. */
 
+#define SCHED_MAX_EVENT_DATA_SIZE                                         \
+    APP_TIMER_SCHED_EVENT_DATA_SIZE /**< Maximum size of scheduler events. \
+                                     */
+#define SCHED_QUEUE_SIZE                                                 \
+    10 /**< Maximum number of events in the scheduler queue. */
+
 #define DEAD_BEEF                                                          \
     0xDEADBEEF /**< Value used as error code on stack dump, can be used to \
                   identify stack location on stack unwind. */
 
 NRF_BLE_GATT_DEF(m_gatt);
-NRF_BLE_QWR_DEF(m_qwr);             /**< GATT module instance. */
+NRF_BLE_QWRS_DEF(m_qwr, NRF_SDH_BLE_TOTAL_LINK_COUNT); /**< GATT module
+                                                          instances. */
 BLE_CUS_DEF(m_cus);                 /**< Context for the Queued Write module.*/
 BLE_ADVERTISING_DEF(m_advertising); /**< Advertising module instance. */
 
-APP_TIMER_DEF(m_notification_timer_id);
-
-static uint8_t m_custom_value = 0;
+APP_TIMER_DEF(m_keepalive_timer_id);
+APP_TIMER_DEF(m_diag_timer_id);
 
 static uint16_t m_conn_handle =
-    BLE_CONN_HANDLE_INVALID; /**< Handle of the current connection. */
+    BLE_CONN_HANDLE_INVALID; /**< Handle of the newest connection. */
 
 /* YOUR_JOB: Declare all services structure your application is using
  *  BLE_XYZ_DEF(m_xyz);
@@ -191,7 +232,10 @@ void assert_nrf_callback(uint16_t line_num, const uint8_t *p_file_name)
  */
 static void pm_evt_handler(pm_evt_t const *p_evt)
 {
-    ret_code_t err_code;
+    if (reconnect_on_pm_evt(p_evt))
+    {
+        ble_cus_handshake_resume(&m_cus, p_evt->conn_handle);
+    }
 
     switch (p_evt->evt_id)
     {
@@ -233,16 +277,8 @@ static void pm_evt_handler(pm_evt_t const *p_evt)
 
         case PM_EVT_STORAGE_FULL:
         {
-            // Run garbage collection on the flash.
-            err_code = fds_gc();
-            if (err_code == FDS_ERR_NO_SPACE_IN_QUEUES)
-            {
-                // Retry.
-            }
-            else
-            {
-                APP_ERROR_CHECK(err_code);
-            }
+            // Garbage collection waits until nobody is steering
+            storage_gc_request();
         }
         break;
 
@@ -294,29 +330,397 @@ static void pm_evt_handler(pm_evt_t const *p_evt)
 }
 
 static float steerer_value = 0;
-/**@brief Function for handling the Battery measurement timer timeout.
+
+static bool m_steering_active =
+    false; /**< Set while the central wants steering data. */
+
+static volatile bool m_steering_process_scheduled =
+    false; /**< Set while steering_process_evt is queued in the scheduler. */
+static bool m_sent_since_keepalive =
+    false; /**< Set when a notification went out since the last keep-alive
+              tick. */
+static int16_t m_last_sent_angle = 0; /**< Last angle handed to the SoftDevice,
+                                         in hundredths of a degree. */
+
+static uint32_t m_sent_count =
+    0; /**< Notifications since the last latency report. */
+static uint8_t m_still_intervals =
+    0; /**< Keep-alive intervals since the stick last moved by
+          PARAM_NOTIFY_DELTA. */
+static bool m_sleep_pending =
+    false; /**< Set while disconnecting to go to system off. */
+static bool m_boot_logged =
+    false; /**< Set once the boot timing went to the log. */
+
+/**@brief Function for reporting the current power state.
+ *
+ * @details Cheap when nothing changed, called wherever one of the inputs may
+ * have.
+ */
+static void power_state_update(void)
+{
+    power_state_t state;
+
+    if (m_steering_active)
+    {
+        state = steering_wake_on_motion_active() ? POWER_STATE_WAITING
+                                                 : POWER_STATE_STREAMING;
+    }
+    else if (ble_conn_state_peripheral_conn_count() > 0)
+    {
+        state = POWER_STATE_CONNECTED;
+    }
+    else
+    {
+        state = POWER_STATE_ADVERTISING;
+    }
+
+    power_state_set(state);
+    storage_hold_set(state == POWER_STATE_STREAMING);
+}
+
+/**@brief Function for logging the latency percentiles.
+ *
+ * @details Called every LATENCY_REPORT_COUNT notifications, the histograms
+ * keep accumulating until reset.
+ */
+static void latency_report(void)
+{
+    latency_summary_t to_hvx;
+    latency_summary_t to_tx;
+    latency_summary_t to_tx_flash;
+    latency_summary_t flash_op;
+    storage_stats_t   storage;
+
+    latency_summary_get(LATENCY_SAMPLE_TO_HVX, &to_hvx);
+    latency_summary_get(LATENCY_HVX_TO_TX, &to_tx);
+    latency_summary_get(LATENCY_HVX_TO_TX_FLASH, &to_tx_flash);
+    latency_summary_get(LATENCY_FLASH_OP, &flash_op);
+    storage_stats_get(&storage);
+
+    NRF_LOG_INFO("Sample to hvx p50 %d us, p99 %d us, max %d us", to_hvx.p50_us,
+                 to_hvx.p99_us, to_hvx.max_us);
+    NRF_LOG_INFO("Hvx to TX p50 %d us, p99 %d us, max %d us", to_tx.p50_us,
+                 to_tx.p99_us, to_tx.max_us);
+    if (to_tx_flash.count > 0)
+    {
+        NRF_LOG_INFO("%d during flash, p99 %d us, max %d us",
+                     to_tx_flash.count, to_tx_flash.p99_us,
+                     to_tx_flash.max_us);
+    }
+    NRF_LOG_INFO("Flash %d ops p99 %d us, max %d us, %d deferred, %d pending",
+                 flash_op.count, flash_op.p99_us, flash_op.max_us,
+                 storage.deferred, storage.pending);
+}
+
+/**@brief Function for estimating when the next connection event goes on air.
+ *
+ * @details Counts whole connection intervals on from the last one that
+ * completed a notification, on the streaming link that did so last and with
+ * that link's own interval. Skipped events and clock drift only shift the
+ * estimate, the anchor moves with every notification.
+ *
+ * @param[out] p_on_air app_timer tick count of the next connection event.
+ *
+ * @return false while there is no recent connection event to count from.
+ */
+static bool steering_air_time_get(uint32_t *p_on_air)
+{
+    uint32_t anchor;
+    uint16_t conn_interval;
+    uint32_t since;
+    uint64_t interval_us;
+    uint64_t ahead_us;
+
+    if (!ble_cus_conn_evt_get(&m_cus, &anchor, &conn_interval))
+    {
+        return false;
+    }
+    since = app_timer_cnt_diff_compute(app_timer_cnt_get(), anchor);
+    if (since > AIR_TIME_MAX_AGE)
+    {
+        return false;
+    }
+    interval_us = (uint64_t)conn_interval * 1250;
+    ahead_us = (uint64_t)since * 1000000 / APP_TIMER_CLOCK_FREQ;
+    ahead_us = (ahead_us / interval_us + 1) * interval_us;
+    *p_on_air = (anchor + (uint32_t)(ahead_us * APP_TIMER_CLOCK_FREQ /
+                                     1000000)) &
+                RTC_COUNTER_COUNTER_Msk;
+
+    return true;
+}
+
+/**@brief Function for getting the angle to send.
+ *
+ * @details Extrapolated to the next connection event when PARAM_PREDICT_LEAD
+ * is set and that event can be estimated, the latest sample otherwise.
+ */
+static int16_t steering_angle(void)
+{
+    uint32_t on_air;
+
+    if (params_get(PARAM_PREDICT_LEAD) == 0 ||
+        !steering_air_time_get(&on_air))
+    {
+        return get_angle();
+    }
+
+    return get_predicted_angle(on_air);
+}
+
+/**@brief Function for sending the current steering angle.
+ *
+ * @details The Custom Service keeps at most BLE_CUS_STEERING_MAX_IN_FLIGHT
+ * notifications queued and coalesces the rest, so at most one steering
+ * notification is sent per connection event.
+ *
+ * @note All steering state is owned by main context, this must only be called
+ * from the scheduler.
+ *
+ * @param[in] changed  false for a resend of an angle that did not move.
+ */
+static void steering_notify(bool changed)
+{
+    ret_code_t err_code;
+    int16_t    angle;
+
+    angle = steering_angle();
+    BENCH_BEGIN(BENCH_STAGE_NOTIFY);
+    err_code = ble_cus_steering_value_update(&m_cus, angle,
+                                             get_sample_timestamp(), changed);
+    BENCH_END(BENCH_STAGE_NOTIFY);
+    // Failures show up in the trace, a log here would run at the sample rate
+    TRACE(TRACE_EVT_STEER, angle, err_code);
+    if (err_code == NRF_SUCCESS)
+    {
+        m_last_sent_angle = angle;
+        m_sent_since_keepalive = true;
+        if (++m_sent_count == LATENCY_REPORT_COUNT)
+        {
+            m_sent_count = 0;
+            latency_report();
+        }
+    }
+}
+
+/**@brief Function for processing queued steering samples in main context.
+ *
+ * @details Sends the angle right away when it moved at least
+ * PARAM_NOTIFY_DELTA since the last notification.
+ */
+static void steering_process_evt(void *p_event_data, uint16_t event_size)
+{
+    int16_t delta;
+    int16_t notify_delta = (int16_t)params_get(PARAM_NOTIFY_DELTA);
+
+    UNUSED_PARAMETER(p_event_data);
+    UNUSED_PARAMETER(event_size);
+
+    // Cleared before draining so a sample queued meanwhile schedules again
+    m_steering_process_scheduled = false;
+
+    if (!steering_process())
+    {
+        return;
+    }
+    if (!m_boot_logged)
+    {
+        m_boot_logged = true;
+        diag_boot_mark(DIAG_BOOT_FIRST_ANGLE);
+        diag_boot_log();
+    }
+    if (!m_steering_active)
+    {
+        return;
+    }
+    // The first sample after waiting for motion ends the waiting state
+    power_state_update();
+
+    BENCH_BEGIN(BENCH_STAGE_GET_ANGLE);
+    delta = steering_angle() - m_last_sent_angle;
+    BENCH_END(BENCH_STAGE_GET_ANGLE);
+    if (delta >= notify_delta || delta <= -notify_delta)
+    {
+        m_still_intervals = 0;
+        power_state_activity();
+        conn_params_mgr_activity();
+        steering_notify(true);
+    }
+}
+
+/**@brief Function for handling new steering samples.
  *
- * @details This function will be called each time the battery level measurement
- * timer expires.
+ * @details Called from the SAADC interrupt, only schedules the processing.
+ */
+static void steering_sample_handler(void)
+{
+    ret_code_t err_code;
+
+    if (!m_steering_process_scheduled)
+    {
+        m_steering_process_scheduled = true;
+        err_code = app_sched_event_put(NULL, 0, steering_process_evt);
+        APP_ERROR_CHECK(err_code);
+    }
+}
+
+/**@brief Function for sending the first steering value in main context.
+ */
+static void steering_start_evt(void *p_event_data, uint16_t event_size)
+{
+    UNUSED_PARAMETER(p_event_data);
+    UNUSED_PARAMETER(event_size);
+
+    steering_notify(false);
+}
+
+/**@brief Function for handling the keep-alive timer timeout.
+ *
+ * @details Resends the current angle if nothing went out during the last
+ * PARAM_KEEPALIVE_INTERVAL. Once the stick has been still for
+ * PARAM_WAKE_ON_MOTION_DELAY intervals the sampler stops waking the CPU until
+ * it moves again. app_timer runs its handlers from the scheduler.
  *
  * @param[in] p_context  Pointer used for passing some arbitrary information
  * (context) from the app_start_timer() call to the timeout handler.
  */
-static void notification_timeout_handler(void *p_context)
+static void keepalive_timeout_handler(void *p_context)
 {
     UNUSED_PARAMETER(p_context);
+
+    if (!m_sent_since_keepalive)
+    {
+        steering_notify(false);
+    }
+    m_sent_since_keepalive = false;
+
+    if (steering_wake_on_motion_active())
+    {
+        // Counts again from the wake up
+        m_still_intervals = 0;
+    }
+    else if (++m_still_intervals >= params_get(PARAM_WAKE_ON_MOTION_DELAY))
+    {
+        // The band is re-centred on the current position every time
+        steering_wake_on_motion_enter();
+        power_state_update();
+    }
+}
+
+/**@brief Function for getting the keep-alive interval in app_timer ticks.
+ */
+static uint32_t keepalive_interval(void)
+{
+    return APP_TIMER_TICKS(params_get(PARAM_KEEPALIVE_INTERVAL));
+}
+
+/**@brief Function for applying a changed tuning parameter.
+ *
+ * @details Parameters read on every use need nothing here.
+ *
+ * @param[in] id     Parameter that changed.
+ * @param[in] value  Its new value.
+ */
+static void params_change_handler(param_id_t id, uint16_t value)
+{
     ret_code_t err_code;
-    float      angle = get_angle();
-    NRF_LOG_INFO("Float " NRF_LOG_FLOAT_MARKER "", NRF_LOG_FLOAT(angle));
-    err_code = ble_cus_steering_value_update(&m_cus, get_angle());
-    // APP_ERROR_CHECK(err_code);
 
-    // Increment the value of m_custom_value before nortifing it.
-    m_custom_value++;
+    switch (id)
+    {
+        case PARAM_SAMPLE_RATE:
+            steering_sample_rate_set(value);
+            break;
+
+        case PARAM_KEEPALIVE_INTERVAL:
+            if (m_steering_active)
+            {
+                err_code = app_timer_stop(m_keepalive_timer_id);
+                APP_ERROR_CHECK(err_code);
+                err_code = app_timer_start(m_keepalive_timer_id,
+                                           keepalive_interval(), NULL);
+                APP_ERROR_CHECK(err_code);
+            }
+            break;
+
+        default:
+            break;
+    }
+}
+
+/**@brief Function for handling the diagnostics timer timeout.
+ *
+ * @details Publishes the performance counters on the diagnostics
+ * characteristic.
+ *
+ * @param[in] p_context  Pointer used for passing some arbitrary information
+ * (context) from the app_start_timer() call to the timeout handler.
+ */
+static void diag_timeout_handler(void *p_context)
+{
+    ret_code_t          err_code;
+    ble_cus_diag_t      diag;
+    diag_cpu_t          cpu;
+    diag_boot_t         boot;
+    conn_params_stats_t conn_params;
+
+    UNUSED_PARAMETER(p_context);
+
+    diag_cpu_get(&cpu);
+    diag_boot_get(&boot);
+    conn_params_mgr_stats_get(&conn_params);
+
+    memset(&diag, 0, sizeof(diag));
+    diag.version = BLE_CUS_DIAG_VERSION;
+    diag.cpu_busy_pct = cpu.busy_pct;
+    diag.wakeups_per_s = cpu.wakeups_per_s;
+    diag.conn_interval = conn_params.conn_interval;
+    diag.stack_used = diag_stack_used();
+    diag.samples = get_sample_count();
+    diag.queued = m_cus.steering_stats.queued;
+    diag.coalesced = m_cus.steering_stats.coalesced;
+    diag.dropped = m_cus.steering_stats.dropped;
+    memcpy(diag.hvx_errors, m_cus.steering_stats.hvx_errors,
+           sizeof(diag.hvx_errors));
+    diag.boot_advertising_ms =
+        (uint16_t)MIN(boot.at_us[DIAG_BOOT_ADVERTISING] / 1000, UINT16_MAX);
+    diag.boot_first_angle_ms =
+        (uint16_t)MIN(boot.at_us[DIAG_BOOT_FIRST_ANGLE] / 1000, UINT16_MAX);
+    diag.boot_slowest = boot.slowest;
+    diag.boot_slowest_ms = (uint16_t)MIN(boot.slowest_us / 1000, UINT16_MAX);
+
+    err_code = ble_cus_diag_update(&m_cus, &diag);
+    APP_ERROR_CHECK(err_code);
+
+    BENCH_REPORT();
+}
+
+#if STEER_CONN_EVT_SYNC
+/**@brief Function for handling radio notifications.
+ *
+ * @details Starts a fresh conversion RADIO_NOTIFICATION_DISTANCE before each
+ * radio event so the sample is ready just in time for the connection event.
+ *
+ * @param[in] radio_active  True if the radio is about to become active.
+ */
+static void radio_notification_evt_handler(bool radio_active)
+{
+    if (radio_active && m_steering_active)
+    {
+        steering_convert();
+    }
+}
 
-    // err_code = ble_cus_tx_value_update(&m_cus, m_custom_value, 1);
-    // APP_ERROR_CHECK(err_code);
+/**@brief Function for initializing the radio notification.
+ */
+static void radio_notification_init(void)
+{
+    ret_code_t err_code = ble_radio_notification_init(
+        RADIO_NOTIFICATION_IRQ_PRIORITY, RADIO_NOTIFICATION_DISTANCE,
+        radio_notification_evt_handler);
+    APP_ERROR_CHECK(err_code);
 }
+#endif
 
 /**@brief Function for the Timer initialization.
  *
@@ -330,9 +734,12 @@ static void timers_init(void)
     APP_ERROR_CHECK(err_code);
 
     // Create timers.
-    err_code =
-        app_timer_create(&m_notification_timer_id, APP_TIMER_MODE_REPEATED,
-                         notification_timeout_handler);
+    err_code = app_timer_create(&m_keepalive_timer_id, APP_TIMER_MODE_REPEATED,
+                                keepalive_timeout_handler);
+    APP_ERROR_CHECK(err_code);
+
+    err_code = app_timer_create(&m_diag_timer_id, APP_TIMER_MODE_REPEATED,
+                                diag_timeout_handler);
     APP_ERROR_CHECK(err_code);
 
     /* YOUR_JOB: Create any timers to be used by the application.
@@ -424,6 +831,48 @@ p_evt->params.char_xx.value.p_str); break;
     }
 }
 */
+/**@brief Function for publishing the calibration curve in use.
+ *
+ * @param[in]   status   Result of the last curve write.
+ */
+static void curve_value_publish(ret_code_t status)
+{
+    ret_code_t err_code;
+    uint8_t    value[CALIBRATION_CURVE_ENCODED_MAX];
+    uint16_t   len;
+
+    STATIC_ASSERT(sizeof(value) <= BLE_CUS_CURVE_MAX_LEN);
+
+    len = calibration_curve_encode(status, value, sizeof(value));
+    err_code = ble_cus_curve_value_set(&m_cus, value, len);
+    APP_ERROR_CHECK(err_code);
+}
+
+/**@brief Function for answering a write to the config characteristic.
+ *
+ * @param[in]   p_data   Written batch, NULL to publish every parameter.
+ * @param[in]   len      Length of the batch.
+ */
+static void config_value_publish(uint8_t const *p_data, uint16_t len)
+{
+    ret_code_t err_code;
+    uint8_t    value[PARAMS_ENCODED_MAX];
+    uint16_t   value_len;
+
+    STATIC_ASSERT(sizeof(value) <= BLE_CUS_CONFIG_MAX_LEN);
+
+    if (p_data == NULL)
+    {
+        value_len = params_encode(value, sizeof(value));
+    }
+    else
+    {
+        value_len = params_config_write(p_data, len, value, sizeof(value));
+    }
+    err_code = ble_cus_config_value_set(&m_cus, value, value_len);
+    APP_ERROR_CHECK(err_code);
+}
+
 /**@brief Function for handling the Custom Service Service events.
  *
  * @details This function will be called for all Custom Service events which are
@@ -440,24 +889,57 @@ static void on_cus_evt(ble_cus_t *p_cus_service, ble_cus_evt_t *p_evt)
     switch (p_evt->evt_type)
     {
         case BLE_CUS_START_SENDING_STEERING_DATA:
-
-            err_code = app_timer_start(m_notification_timer_id,
-                                       NOTIFICATION_INTERVAL, NULL);
+            reconnect_handshake_done(p_evt->conn_handle);
+            conn_params_mgr_link_start(p_evt->conn_handle);
+            // A second central gets the current angle right away as well
+            err_code = app_sched_event_put(NULL, 0, steering_start_evt);
             APP_ERROR_CHECK(err_code);
+            if (!m_steering_active)
+            {
+                m_steering_active = true;
+                err_code = app_timer_start(m_keepalive_timer_id,
+                                           keepalive_interval(), NULL);
+                APP_ERROR_CHECK(err_code);
+            }
+            power_state_update();
             break;
 
-        case BLE_CUS_EVT_NOTIFICATION_DISABLED:
+        case BLE_CUS_EVT_CONNECTED:
+            // The stored curve and parameters are loaded after the service
+            // is set up
+            curve_value_publish(NRF_SUCCESS);
+            config_value_publish(NULL, 0);
+            break;
 
-            err_code = app_timer_stop(m_notification_timer_id);
-            APP_ERROR_CHECK(err_code);
+        case BLE_CUS_EVT_CURVE_WRITE:
+            err_code = calibration_curve_write(p_evt->p_data, p_evt->len);
+            if (err_code != NRF_SUCCESS)
+            {
+                NRF_LOG_WARNING("Curve write rejected, error 0x%x", err_code);
+            }
+            curve_value_publish(err_code);
             break;
 
-        case BLE_CUS_EVT_CONNECTED:
+        case BLE_CUS_EVT_CONFIG_WRITE:
+            config_value_publish(p_evt->p_data, p_evt->len);
+            break;
+
+        case BLE_CUS_EVT_STEERING_SENT:
+            reconnect_steering_sent(p_evt->conn_handle);
             break;
 
+        case BLE_CUS_EVT_NOTIFICATION_DISABLED:
         case BLE_CUS_EVT_DISCONNECTED:
-            err_code = app_timer_stop(m_notification_timer_id);
-            APP_ERROR_CHECK(err_code);
+            conn_params_mgr_link_stop(p_evt->conn_handle);
+            // Keep streaming while any other central still listens
+            if (m_steering_active &&
+                ble_cus_steering_link_count(p_cus_service) == 0)
+            {
+                m_steering_active = false;
+                err_code = app_timer_stop(m_keepalive_timer_id);
+                APP_ERROR_CHECK(err_code);
+            }
+            power_state_update();
             break;
 
         default:
@@ -478,8 +960,11 @@ static void services_init(void)
     // Initialize Queued Write Module.
     qwr_init.error_handler = nrf_qwr_error_handler;
 
-    err_code = nrf_ble_qwr_init(&m_qwr, &qwr_init);
-    APP_ERROR_CHECK(err_code);
+    for (uint32_t i = 0; i < NRF_SDH_BLE_TOTAL_LINK_COUNT; i++)
+    {
+        err_code = nrf_ble_qwr_init(&m_qwr[i], &qwr_init);
+        APP_ERROR_CHECK(err_code);
+    }
 
     // Initialize CUS Service init structure to zero.
     cus_init.evt_handler = on_cus_evt;
@@ -522,22 +1007,15 @@ static void services_init(void)
  *
  * @details This function will be called for all events in the Connection
  * Parameters Module which are passed to the application.
- *          @note All this function does is to disconnect. This could have been
- * done by simply setting the disconnect_on_fail config parameter, but instead
- * we use the event handler mechanism to demonstrate its use.
+ *          @note The connection parameter manager switches between sets
+ * depending on stick activity, a central refusing one of them is not a
+ * reason to drop the link.
  *
  * @param[in] p_evt  Event received from the Connection Parameters Module.
  */
 static void on_conn_params_evt(ble_conn_params_evt_t *p_evt)
 {
-    ret_code_t err_code;
-
-    if (p_evt->evt_type == BLE_CONN_PARAMS_EVT_FAILED)
-    {
-        err_code = sd_ble_gap_disconnect(m_conn_handle,
-                                         BLE_HCI_CONN_INTERVAL_UNACCEPTABLE);
-        APP_ERROR_CHECK(err_code);
-    }
+    conn_params_mgr_on_conn_params_evt(p_evt);
 }
 
 /**@brief Function for handling a Connection Parameters error.
@@ -570,12 +1048,19 @@ static void conn_params_init(void)
 
     err_code = ble_conn_params_init(&cp_init);
     APP_ERROR_CHECK(err_code);
+
+    conn_params_mgr_init();
 }
 
 /**@brief Function for starting timers.
  */
 static void application_timers_start(void)
 {
+    ret_code_t err_code;
+
+    err_code = app_timer_start(m_diag_timer_id, DIAG_INTERVAL, NULL);
+    APP_ERROR_CHECK(err_code);
+
     /* YOUR_JOB: Start your timers. below is an example of how to start a timer.
        ret_code_t err_code;
        err_code = app_timer_start(m_app_timer_id, TIMER_INTERVAL, NULL);
@@ -590,6 +1075,9 @@ static void sleep_mode_enter(void)
 {
     ret_code_t err_code;
 
+    NRF_LOG_INFO("System off.");
+    power_state_log();
+
     err_code = bsp_indication_set(BSP_INDICATE_IDLE);
     APP_ERROR_CHECK(err_code);
 
@@ -597,12 +1085,55 @@ static void sleep_mode_enter(void)
     err_code = bsp_btn_ble_sleep_mode_prepare();
     APP_ERROR_CHECK(err_code);
 
+    // Turning the bars wakes us up as well
+    steering_sleep_prepare();
+
+    NRF_LOG_FINAL_FLUSH();
+    TRACE_FLUSH();
+
     // Go to system-off mode (this function will not return; wakeup will cause a
     // reset).
     err_code = sd_power_system_off();
     APP_ERROR_CHECK(err_code);
 }
 
+/**@brief Function for disconnecting a link before system off.
+ */
+static void sleep_disconnect(uint16_t conn_handle, void *p_context)
+{
+    ret_code_t err_code;
+
+    UNUSED_PARAMETER(p_context);
+
+    err_code = sd_ble_gap_disconnect(conn_handle,
+                                     BLE_HCI_REMOTE_USER_TERMINATED_CONNECTION);
+    if (err_code != NRF_ERROR_INVALID_STATE)
+    {
+        APP_ERROR_CHECK(err_code);
+    }
+}
+
+/**@brief Function for handling a connection nobody subscribed to for too
+ * long.
+ *
+ * @details Drops every link, system off follows the last disconnect.
+ */
+static void power_idle_handler(void)
+{
+    ret_code_t err_code;
+
+    m_sleep_pending = true;
+
+    err_code = sd_ble_gap_adv_stop(m_advertising.adv_handle);
+    if (err_code != NRF_ERROR_INVALID_STATE)
+    {
+        APP_ERROR_CHECK(err_code);
+    }
+
+    UNUSED_RETURN_VALUE(ble_conn_state_for_each_connected(sleep_disconnect,
+                                                          NULL));
+}
+
 /**@brief Function for handling advertising events.
  *
  * @details This function will be called for advertising events which are passed
@@ -614,16 +1145,40 @@ static void on_adv_evt(ble_adv_evt_t ble_adv_evt)
 {
     ret_code_t err_code;
 
+    reconnect_on_adv_evt(ble_adv_evt);
+
     switch (ble_adv_evt)
     {
+        case BLE_ADV_EVT_DIRECTED_HIGH_DUTY:
+            NRF_LOG_INFO("Directed advertising.");
+            err_code = bsp_indication_set(BSP_INDICATE_ADVERTISING_DIRECTED);
+            APP_ERROR_CHECK(err_code);
+            break;
+
+        case BLE_ADV_EVT_FAST_WHITELIST:
+            NRF_LOG_INFO("Fast advertising with whitelist.");
+            err_code = bsp_indication_set(BSP_INDICATE_ADVERTISING_WHITELIST);
+            APP_ERROR_CHECK(err_code);
+            break;
+
         case BLE_ADV_EVT_FAST:
             NRF_LOG_INFO("Fast advertising.");
             err_code = bsp_indication_set(BSP_INDICATE_ADVERTISING);
             APP_ERROR_CHECK(err_code);
             break;
 
+        case BLE_ADV_EVT_SLOW:
+            NRF_LOG_INFO("Slow advertising.");
+            err_code = bsp_indication_set(BSP_INDICATE_ADVERTISING_SLOW);
+            APP_ERROR_CHECK(err_code);
+            break;
+
         case BLE_ADV_EVT_IDLE:
-            // sleep_mode_enter();
+            // Advertising for a second central ran out, the first one stays
+            if (ble_conn_state_peripheral_conn_count() == 0)
+            {
+                storage_flush(sleep_mode_enter);
+            }
             break;
 
         default:
@@ -631,6 +1186,29 @@ static void on_adv_evt(ble_adv_evt_t ble_adv_evt)
     }
 }
 
+/**@brief Function for advertising again while a peripheral link is free.
+ *
+ * @details Called on every connect and disconnect, so a second central can
+ * join while the first one is streaming.
+ */
+static void advertising_resume(void)
+{
+    ret_code_t err_code;
+
+    if (ble_conn_state_peripheral_conn_count() >=
+        NRF_SDH_BLE_PERIPHERAL_LINK_COUNT)
+    {
+        return;
+    }
+
+    err_code = reconnect_advertising_start();
+    // Already advertising
+    if (err_code != NRF_ERROR_INVALID_STATE)
+    {
+        APP_ERROR_CHECK(err_code);
+    }
+}
+
 /**@brief Function for handling BLE events.
  *
  * @param[in]   p_ble_evt   Bluetooth stack event.
@@ -644,6 +1222,21 @@ static void ble_evt_handler(ble_evt_t const *p_ble_evt, void *p_context)
     {
         case BLE_GAP_EVT_DISCONNECTED:
             NRF_LOG_INFO("Disconnected.");
+            if (p_ble_evt->evt.gap_evt.conn_handle == m_conn_handle)
+            {
+                m_conn_handle = BLE_CONN_HANDLE_INVALID;
+            }
+            if (m_sleep_pending)
+            {
+                if (ble_conn_state_peripheral_conn_count() == 0)
+                {
+                    storage_flush(sleep_mode_enter);
+                }
+                break;
+            }
+            power_state_update();
+            // ble_advertising only restarts for the link it saw connect last
+            advertising_resume();
             // LED indication will be changed when advertising starts.
             break;
 
@@ -652,8 +1245,12 @@ static void ble_evt_handler(ble_evt_t const *p_ble_evt, void *p_context)
             err_code = bsp_indication_set(BSP_INDICATE_CONNECTED);
             APP_ERROR_CHECK(err_code);
             m_conn_handle = p_ble_evt->evt.gap_evt.conn_handle;
-            err_code = nrf_ble_qwr_conn_handle_assign(&m_qwr, m_conn_handle);
+            err_code = nrf_ble_qwr_conn_handle_assign(&m_qwr[m_conn_handle],
+                                                      m_conn_handle);
             APP_ERROR_CHECK(err_code);
+            power_state_update();
+            // Stay connectable for another central
+            advertising_resume();
             break;
 
         case BLE_GAP_EVT_PHY_UPDATE_REQUEST:
@@ -776,15 +1373,18 @@ static void bsp_event_handler(bsp_event_t event)
     {
         case BSP_EVENT_KEY_0:
             steerer_value -= 7.5;
+            power_state_activity();
             break;
         case BSP_EVENT_KEY_1:
             steerer_value += 7.5;
+            power_state_activity();
             break;
         case BSP_EVENT_KEY_2:
             steerer_value = 0;
+            power_state_activity();
             break;
         case BSP_EVENT_SLEEP:
-            sleep_mode_enter();
+            storage_flush(sleep_mode_enter);
             break;  // BSP_EVENT_SLEEP
 
         case BSP_EVENT_DISCONNECT:
@@ -797,7 +1397,8 @@ static void bsp_event_handler(bsp_event_t event)
             break;  // BSP_EVENT_DISCONNECT
 
         case BSP_EVENT_WHITELIST_OFF:
-            if (m_conn_handle == BLE_CONN_HANDLE_INVALID)
+            if (ble_conn_state_peripheral_conn_count() <
+                NRF_SDH_BLE_PERIPHERAL_LINK_COUNT)
             {
                 err_code =
                     ble_advertising_restart_without_whitelist(&m_advertising);
@@ -829,9 +1430,16 @@ static void advertising_init(void)
         sizeof(m_adv_uuids) / sizeof(m_adv_uuids[0]);
     init.advdata.uuids_complete.p_uuids = m_adv_uuids;
 
+    // Directed to the last central, then a short whitelisted window for
+    // bonded ones, then open to everyone
+    init.config.ble_adv_whitelist_enabled = true;
+    init.config.ble_adv_directed_high_duty_enabled = true;
     init.config.ble_adv_fast_enabled = true;
-    init.config.ble_adv_fast_interval = APP_ADV_INTERVAL;
-    init.config.ble_adv_fast_timeout = APP_ADV_DURATION;
+    init.config.ble_adv_fast_interval = APP_ADV_FAST_INTERVAL;
+    init.config.ble_adv_fast_timeout = APP_ADV_FAST_DURATION;
+    init.config.ble_adv_slow_enabled = true;
+    init.config.ble_adv_slow_interval = APP_ADV_INTERVAL;
+    init.config.ble_adv_slow_timeout = APP_ADV_DURATION;
 
     init.evt_handler = on_adv_evt;
 
@@ -861,15 +1469,19 @@ static void buttons_leds_init(bool *p_erase_bonds)
 }
 
 /**@brief Function for initializing the nrf log module.
+ *
+ * @details Deferred logging buffers everything until log_backends_init().
  */
 static void log_init(void)
 {
     ret_code_t err_code = NRF_LOG_INIT(NULL);
     APP_ERROR_CHECK(err_code);
-
-    NRF_LOG_DEFAULT_BACKENDS_INIT();
 }
 
+/**@brief Function for starting the log output, once on air.
+ */
+static void log_backends_init(void) { NRF_LOG_DEFAULT_BACKENDS_INIT(); }
+
 /**@brief Function for initializing power management.
  */
 static void power_management_init(void)
@@ -886,9 +1498,11 @@ static void power_management_init(void)
  */
 static void idle_state_handle(void)
 {
+    TRACE_FLUSH();
+
     if (NRF_LOG_PROCESS() == false)
     {
-        nrf_pwr_mgmt_run();
+        diag_idle_run();
     }
 }
 
@@ -903,8 +1517,7 @@ static void advertising_start(bool erase_bonds)
     }
     else
     {
-        ret_code_t err_code =
-            ble_advertising_start(&m_advertising, BLE_ADV_MODE_FAST);
+        ret_code_t err_code = reconnect_advertising_start();
 
         APP_ERROR_CHECK(err_code);
     }
@@ -916,29 +1529,54 @@ int main(void)
 {
     bool erase_bonds;
 
-    // Initialize.
+    // Initialize. Only what advertising needs runs before it, each stage is
+    // timed for the diagnostics.
+    diag_init();
     log_init();
+    TRACE_INIT();
+    BENCH_INIT();
     timers_init();
-    APP_SCHED_INIT(8, 4);
+    APP_SCHED_INIT(SCHED_MAX_EVENT_DATA_SIZE, SCHED_QUEUE_SIZE);
     buttons_leds_init(&erase_bonds);
     power_management_init();
+    power_state_init(power_idle_handler);
+    diag_boot_mark(DIAG_BOOT_EARLY);
 
-    steering_init();
-    // steering_convert();
+    storage_init();
+    // Register with FDS before the Peer Manager starts it
+    params_init(params_change_handler);
+    // Takes the calibration over from retained RAM after a warm reset
+    calibration_init();
+    diag_boot_mark(DIAG_BOOT_STORAGE);
 
     ble_stack_init();
+#if STEER_CONN_EVT_SYNC
+    radio_notification_init();
+#endif
+    diag_boot_mark(DIAG_BOOT_SOFTDEVICE);
+
     gap_params_init();
     gatt_init();
     services_init();
     advertising_init();
     conn_params_init();
+    diag_boot_mark(DIAG_BOOT_SERVICES);
+
     peer_manager_init();
+    reconnect_init(&m_advertising);
+    diag_boot_mark(DIAG_BOOT_PEER_MANAGER);
 
-    // Start execution.
-    NRF_LOG_INFO("Starting Steerer App");
+    advertising_start(erase_bonds);
+    diag_boot_mark(DIAG_BOOT_ADVERTISING);
+
+    // Not needed to get on air. No central asks for an angle before it is
+    // connected, and until the backends are up the logger only buffers.
+    steering_init(steering_sample_handler);
+    log_backends_init();
     application_timers_start();
+    diag_boot_mark(DIAG_BOOT_DEFERRED);
 
-    advertising_start(erase_bonds);
+    NRF_LOG_INFO("Starting Steerer App");
 
     // Enter main loop.
     for (;;)
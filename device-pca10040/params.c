@@ -0,0 +1,428 @@
+/**
+ * Copyright (c) 2018 Keith Wakeham
+ *
+ * All rights reserved.
+ *
+ *
+ */
+
+#include "params.h"
+#include <stddef.h>
+#include <string.h>
+#include "app_error.h"
+#include "app_scheduler.h"
+#include "app_timer.h"
+#include "app_util.h"
+#include "fds.h"
+#include "nrf_atomic.h"
+#include "nrf_log.h"
+#include "steer-adc.h"
+#include "storage.h"
+#include "trace.h"
+
+#define PARAMS_VERSION 1
+
+// Record in STORAGE_FILE_PARAMS
+#define PARAMS_RECORD_KEY 0x0001
+
+// Changes are written once none came in for this long, so a tuning session
+// costs one flash write instead of one per value
+#define SAVE_DELAY APP_TIMER_TICKS(5000)
+
+STATIC_ASSERT(PARAM_COUNT <= PARAMS_BATCH_MAX);
+STATIC_ASSERT(PARAM_COUNT <= 32);
+
+/**
+ * @brief Default and range of a parameter
+ *
+ */
+typedef struct
+{
+    uint16_t def;
+    uint16_t min;
+    uint16_t max;
+} param_info_t;
+
+static const param_info_t m_info[PARAM_COUNT] = {
+    [PARAM_MAX_STEER_ANGLE] = {MAX_STEER_ANGLE * STEER_ANGLE_SCALE,
+                               5 * STEER_ANGLE_SCALE, 90 * STEER_ANGLE_SCALE},
+    [PARAM_DEAD_BAND] = {ZERO_FLOOR * STEER_ANGLE_SCALE, 0,
+                         10 * STEER_ANGLE_SCALE},
+    // An oversampled burst takes about 3 ms
+    [PARAM_SAMPLE_RATE] = {200, 10, 250},
+    [PARAM_NOTIFY_DELTA] = {25, 1, 1000},
+    [PARAM_KEEPALIVE_INTERVAL] = {1000, 100, 10000},
+    [PARAM_WAKE_ON_MOTION_DELAY] = {3, 1, 60},
+    [PARAM_FILTER_MIN_CUTOFF] = {1 * 256, 16, 10 * 256},
+    [PARAM_FILTER_BETA] = {96, 0, 10 * 256},
+    // Off until a rider asks for it
+    [PARAM_PREDICT_LEAD] = {0, 0, 100},
+    [PARAM_PREDICT_MAX] = {80, 0, 250},
+};
+
+// Values in the record, rounded up to whole words
+#define PARAMS_RECORD_VALUES ((PARAM_COUNT + 1) & ~1)
+
+/**
+ * @brief Parameters as stored in flash
+ *
+ * @details count says how many values follow. Firmware that knows more
+ * parameters keeps the defaults for the rest, firmware that knows fewer
+ * leaves the rest alone.
+ */
+typedef struct
+{
+    uint16_t version;
+    uint16_t count;
+    uint16_t values[PARAMS_RECORD_VALUES];
+} params_record_t;
+
+/**
+ * @brief One operation of a config write
+ *
+ */
+typedef struct
+{
+    uint8_t    op;
+    uint8_t    id;
+    uint16_t   value;
+    ret_code_t status;
+} batch_op_t;
+
+APP_TIMER_DEF(m_save_timer);
+
+// Written from the SoftDevice event context, read from anywhere
+static volatile uint16_t m_values[PARAM_COUNT];
+// What is in flash, the defaults until something was stored
+static uint16_t m_saved[PARAM_COUNT];
+// Must stay valid until the flash write is done
+static params_record_t m_record_data;
+static volatile bool   m_write_pending;
+
+static params_change_handler_t m_change_handler;
+// Bit per parameter not reported to the handler yet
+static nrf_atomic_u32_t  m_changed;
+static nrf_atomic_flag_t m_apply_scheduled;
+
+static ret_code_t value_check(uint8_t id, uint16_t value)
+{
+    if (id >= PARAM_COUNT)
+    {
+        return NRF_ERROR_NOT_FOUND;
+    }
+    if (value < m_info[id].min || value > m_info[id].max)
+    {
+        return NRF_ERROR_INVALID_PARAM;
+    }
+
+    return NRF_SUCCESS;
+}
+
+/**
+ * @brief Report the changed parameters, in main context
+ *
+ */
+static void apply_evt(void *p_event_data, uint16_t event_size)
+{
+    uint32_t changed;
+
+    UNUSED_PARAMETER(p_event_data);
+    UNUSED_PARAMETER(event_size);
+
+    // Cleared first so a change made meanwhile schedules again
+    nrf_atomic_flag_clear(&m_apply_scheduled);
+    changed = nrf_atomic_u32_fetch_store(&m_changed, 0);
+
+    for (uint8_t id = 0; id < PARAM_COUNT; id++)
+    {
+        if ((changed & (1UL << id)) != 0 && m_change_handler != NULL)
+        {
+            m_change_handler((param_id_t)id, m_values[id]);
+        }
+    }
+}
+
+static void value_store(uint8_t id, uint16_t value)
+{
+    ret_code_t err_code;
+
+    m_values[id] = value;
+    UNUSED_RETURN_VALUE(nrf_atomic_u32_or(&m_changed, 1UL << id));
+
+    if (!nrf_atomic_flag_set_fetch(&m_apply_scheduled))
+    {
+        err_code = app_sched_event_put(NULL, 0, apply_evt);
+        APP_ERROR_CHECK(err_code);
+    }
+}
+
+/**
+ * @brief Push the flash write back by SAVE_DELAY
+ *
+ */
+static void save_schedule(void)
+{
+    ret_code_t err_code;
+
+    // Operations run in order, the stop makes the start a restart
+    err_code = app_timer_stop(m_save_timer);
+    APP_ERROR_CHECK(err_code);
+    err_code = app_timer_start(m_save_timer, SAVE_DELAY, NULL);
+    APP_ERROR_CHECK(err_code);
+}
+
+static void save_timeout_handler(void *p_context)
+{
+    ret_code_t err_code;
+    bool       changed = false;
+
+    UNUSED_PARAMETER(p_context);
+
+    if (m_write_pending)
+    {
+        // The write done event schedules the next one
+        return;
+    }
+
+    for (uint8_t id = 0; id < PARAM_COUNT; id++)
+    {
+        m_record_data.values[id] = m_values[id];
+        changed |= m_record_data.values[id] != m_saved[id];
+    }
+    if (!changed)
+    {
+        return;
+    }
+    m_record_data.version = PARAMS_VERSION;
+    m_record_data.count = PARAM_COUNT;
+
+    err_code = storage_record_save(STORAGE_FILE_PARAMS, PARAMS_RECORD_KEY,
+                                   &m_record_data, sizeof(m_record_data));
+    if (err_code == FDS_ERR_NO_SPACE_IN_QUEUES)
+    {
+        save_schedule();
+        return;
+    }
+    APP_ERROR_CHECK(err_code);
+
+    m_write_pending = true;
+}
+
+/**
+ * @brief Load the stored parameters, in main context
+ *
+ */
+static void load_evt(void *p_event_data, uint16_t event_size)
+{
+    params_record_t stored;
+    uint32_t        length;
+    uint16_t        count;
+
+    UNUSED_PARAMETER(p_event_data);
+    UNUSED_PARAMETER(event_size);
+
+    length = storage_record_read(STORAGE_FILE_PARAMS, PARAMS_RECORD_KEY,
+                                 &stored, sizeof(stored));
+    if (length == 0)
+    {
+        NRF_LOG_INFO("Default parameters");
+        return;
+    }
+
+    if (length < offsetof(params_record_t, values) ||
+        stored.version != PARAMS_VERSION)
+    {
+        NRF_LOG_WARNING("Stored parameters ignored");
+        return;
+    }
+
+    // Older firmware stored fewer, newer more than there is room for here
+    count = (uint16_t)((length - offsetof(params_record_t, values)) /
+                       sizeof(stored.values[0]));
+    count = MIN(count, MIN(stored.count, PARAM_COUNT));
+    for (uint8_t id = 0; id < count; id++)
+    {
+        // One bad value does not throw away the others
+        if (value_check(id, stored.values[id]) != NRF_SUCCESS)
+        {
+            NRF_LOG_WARNING("Stored parameter %d ignored", id);
+            continue;
+        }
+        m_saved[id] = stored.values[id];
+        if (m_values[id] != stored.values[id])
+        {
+            value_store(id, stored.values[id]);
+        }
+    }
+
+    NRF_LOG_INFO("Parameters loaded");
+}
+
+static void fds_evt_handler(fds_evt_t const *p_evt)
+{
+    ret_code_t err_code;
+
+    switch (p_evt->id)
+    {
+        case FDS_EVT_INIT:
+            if (p_evt->result == NRF_SUCCESS)
+            {
+                err_code = app_sched_event_put(NULL, 0, load_evt);
+                APP_ERROR_CHECK(err_code);
+            }
+            break;
+
+        case FDS_EVT_WRITE:
+        case FDS_EVT_UPDATE:
+            if (p_evt->write.file_id != STORAGE_FILE_PARAMS)
+            {
+                break;
+            }
+            m_write_pending = false;
+            if (p_evt->result == NRF_SUCCESS)
+            {
+                memcpy(m_saved, m_record_data.values, sizeof(m_saved));
+                NRF_LOG_INFO("Parameters saved");
+            }
+            // Catches changes made during the write and failed writes
+            save_schedule();
+            break;
+
+        default:
+            break;
+    }
+}
+
+void params_init(params_change_handler_t change_handler)
+{
+    ret_code_t err_code;
+
+    for (uint8_t id = 0; id < PARAM_COUNT; id++)
+    {
+        m_values[id] = m_info[id].def;
+        m_saved[id] = m_info[id].def;
+    }
+    m_change_handler = change_handler;
+
+    err_code = fds_register(fds_evt_handler);
+    APP_ERROR_CHECK(err_code);
+
+    err_code = app_timer_create(&m_save_timer, APP_TIMER_MODE_SINGLE_SHOT,
+                                save_timeout_handler);
+    APP_ERROR_CHECK(err_code);
+}
+
+uint16_t params_get(param_id_t id) { return m_values[id]; }
+
+ret_code_t params_set(param_id_t id, uint16_t value)
+{
+    ret_code_t err_code = value_check(id, value);
+
+    if (err_code != NRF_SUCCESS || m_values[id] == value)
+    {
+        return err_code;
+    }
+
+    value_store(id, value);
+    save_schedule();
+
+    TRACE(TRACE_EVT_PARAM, id, value);
+    NRF_LOG_INFO("Parameter %d set to %d", id, value);
+
+    return NRF_SUCCESS;
+}
+
+uint16_t params_config_write(uint8_t const *p_data, uint16_t len,
+                             uint8_t *p_buffer, uint16_t size)
+{
+    ret_code_t err_code;
+    batch_op_t ops[PARAMS_BATCH_MAX];
+    uint8_t    count = 0;
+    uint16_t   offset = 0;
+    ret_code_t result = NRF_SUCCESS;
+    uint16_t   encoded = 0;
+
+    if (size < PARAMS_ENCODED_MAX)
+    {
+        return 0;
+    }
+
+    // Check the whole batch before anything is set
+    while (offset < len)
+    {
+        batch_op_t *p_op = &ops[count];
+        uint16_t    op_len = (p_data[offset] == PARAMS_OP_SET) ? 4 : 2;
+
+        if (count == PARAMS_BATCH_MAX || offset + op_len > len)
+        {
+            result = NRF_ERROR_INVALID_LENGTH;
+            break;
+        }
+
+        p_op->op = p_data[offset];
+        p_op->id = p_data[offset + 1];
+        if (p_op->op == PARAMS_OP_GET)
+        {
+            p_op->status = (p_op->id < PARAM_COUNT) ? NRF_SUCCESS
+                                                    : NRF_ERROR_NOT_FOUND;
+        }
+        else if (p_op->op == PARAMS_OP_SET)
+        {
+            p_op->value = uint16_decode(&p_data[offset + 2]);
+            p_op->status = value_check(p_op->id, p_op->value);
+        }
+        else
+        {
+            result = NRF_ERROR_INVALID_PARAM;
+            break;
+        }
+
+        if (result == NRF_SUCCESS)
+        {
+            result = p_op->status;
+        }
+        offset += op_len;
+        count++;
+    }
+
+    for (uint8_t i = 0; i < count && result == NRF_SUCCESS; i++)
+    {
+        if (ops[i].op == PARAMS_OP_SET)
+        {
+            err_code = params_set((param_id_t)ops[i].id, ops[i].value);
+            APP_ERROR_CHECK(err_code);
+        }
+    }
+
+    p_buffer[encoded++] = (uint8_t)result;
+    for (uint8_t i = 0; i < count; i++)
+    {
+        p_buffer[encoded++] = ops[i].id;
+        p_buffer[encoded++] = (uint8_t)ops[i].status;
+        encoded += uint16_encode(
+            (ops[i].id < PARAM_COUNT) ? m_values[ops[i].id] : 0,
+            &p_buffer[encoded]);
+    }
+
+    return encoded;
+}
+
+uint16_t params_encode(uint8_t *p_buffer, uint16_t size)
+{
+    uint16_t encoded = 0;
+
+    if (size < PARAMS_ENCODED_MAX)
+    {
+        return 0;
+    }
+
+    p_buffer[encoded++] = NRF_SUCCESS;
+    for (uint8_t id = 0; id < PARAM_COUNT; id++)
+    {
+        p_buffer[encoded++] = id;
+        p_buffer[encoded++] = NRF_SUCCESS;
+        encoded += uint16_encode(m_values[id], &p_buffer[encoded]);
+    }
+
+    return encoded;
+}
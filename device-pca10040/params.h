@@ -0,0 +1,134 @@
+/**
+ * Copyright (c) 2018 Keith Wakeham
+ *
+ * All rights reserved.
+ *
+ *
+ */
+
+#ifndef PARAMS_H
+#define PARAMS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "sdk_errors.h"
+
+// Operations one config write may hold, sized so the answer fits one ATT
+// payload at the default MTU of the steering service
+#define PARAMS_BATCH_MAX 11
+
+// Longest value params_config_write() and params_encode() produce
+#define PARAMS_ENCODED_MAX (1 + 4 * PARAMS_BATCH_MAX)
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+    /**
+     * @brief Tuning parameters
+     *
+     * @details The values are the ids on the config characteristic and the
+     * order in flash, only ever append.
+     */
+    typedef enum
+    {
+        PARAM_MAX_STEER_ANGLE,      // full lock, hundredths of a degree
+        PARAM_DEAD_BAND,            // reported as 0 around the centre, cdeg
+        PARAM_SAMPLE_RATE,          // SAADC bursts or blocks/8 per second
+        PARAM_NOTIFY_DELTA,         // move sent right away, cdeg
+        PARAM_KEEPALIVE_INTERVAL,   // resend of an unchanged angle, ms
+        PARAM_WAKE_ON_MOTION_DELAY, // keep-alive intervals before waiting
+        PARAM_FILTER_MIN_CUTOFF,    // One Euro cutoff at rest, 1/256 Hz
+        PARAM_FILTER_BETA,          // 1/256 Hz per 1000 codes/s
+        PARAM_PREDICT_LEAD,         // % of the way to the air time, 0 off
+        PARAM_PREDICT_MAX,          // longest extrapolation, ms
+        PARAM_COUNT
+    } param_id_t;
+
+    /**
+     * @brief Operations written to the config characteristic
+     *
+     * @details A write holds up to PARAMS_BATCH_MAX of them back to back:
+     * GET id, SET id value. Values are little endian uint16. The value read
+     * back is the status of the batch, then id, status and the value in
+     * effect for each operation. Statuses are the low byte of the
+     * ret_code_t. Either every SET of a batch takes effect or none.
+     */
+    typedef enum
+    {
+        PARAMS_OP_GET = 0x01,
+        PARAMS_OP_SET = 0x02,
+    } params_op_t;
+
+    /**
+     * @brief Called in main context after a parameter changed
+     *
+     * @details Only needed for parameters that have to be pushed into
+     * hardware or timers, params_get() returns the new value already.
+     *
+     * @param id parameter that changed
+     * @param value its new value
+     */
+    typedef void (*params_change_handler_t)(param_id_t id, uint16_t value);
+
+    /**
+     * @brief Init the parameter store with the defaults
+     *
+     * @details Registers with FDS, stored values replace the defaults once
+     * FDS is ready and are reported to the handler. Call before
+     * peer_manager_init, which starts FDS.
+     *
+     * @param change_handler called for every parameter that changed
+     */
+    void params_init(params_change_handler_t change_handler);
+
+    /**
+     * @brief Get a parameter from the RAM copy, safe from any context
+     *
+     * @param id parameter
+     * @return current value
+     */
+    uint16_t params_get(param_id_t id);
+
+    /**
+     * @brief Set a parameter
+     *
+     * @details Takes effect right away, the flash write follows once no
+     * other change came in for a while.
+     *
+     * @param id parameter
+     * @param value new value
+     * @return NRF_SUCCESS, NRF_ERROR_NOT_FOUND for an unknown id or
+     * NRF_ERROR_INVALID_PARAM if the value is out of range
+     */
+    ret_code_t params_set(param_id_t id, uint16_t value);
+
+    /**
+     * @brief Handle a write to the config characteristic
+     *
+     * @details Safe from the SoftDevice event context.
+     *
+     * @param p_data written value, a batch of operations
+     * @param len length of the value
+     * @param p_buffer where to encode the answer to
+     * @param size room in p_buffer, at least PARAMS_ENCODED_MAX
+     * @return bytes encoded
+     */
+    uint16_t params_config_write(uint8_t const *p_data, uint16_t len,
+                                 uint8_t *p_buffer, uint16_t size);
+
+    /**
+     * @brief Encode every parameter as if read by one GET batch
+     *
+     * @param p_buffer where to encode to
+     * @param size room in p_buffer, at least PARAMS_ENCODED_MAX
+     * @return bytes encoded
+     */
+    uint16_t params_encode(uint8_t *p_buffer, uint16_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // PARAMS_H
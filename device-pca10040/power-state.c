@@ -0,0 +1,179 @@
+/**
+ * Copyright (c) 2018 Keith Wakeham
+ *
+ * All rights reserved.
+ *
+ *
+ */
+
+#include "power-state.h"
+#include "app_error.h"
+#include "app_timer.h"
+#include "app_util.h"
+#include "nrf.h"
+#include "nrf_log.h"
+#include "trace.h"
+
+// Connected with nobody subscribed this long ends in system off
+#define IDLE_TIMEOUT_S 600
+
+#define TICK_INTERVAL_S 10
+#define TICK_INTERVAL APP_TIMER_TICKS(TICK_INTERVAL_S * 1000)
+
+#define TICK_FREQUENCY \
+    (APP_TIMER_CLOCK_FREQ / (APP_TIMER_CONFIG_RTC_FREQUENCY + 1))
+
+APP_TIMER_DEF(m_tick_timer);
+
+static char const *const m_state_names[POWER_STATE_COUNT] = {
+    "streaming", "waiting", "connected", "advertising"};
+
+static struct
+{
+    power_state_idle_handler_t idle_handler;
+    uint32_t                   idle_ticks;  // TICK_INTERVAL_S since activity
+    uint32_t                   accounted;   // app_timer ticks
+    uint32_t                   entered;     // time_in_state when entered
+    uint64_t                   ticks_in_state[POWER_STATE_COUNT];
+    power_state_stats_t        stats;
+} m_power = {.stats.state = POWER_STATE_ADVERTISING};
+
+/**
+ * @brief Add the time since the last call to the current state
+ *
+ * @details Called at least every TICK_INTERVAL, well within the 24 bit
+ * app_timer counter.
+ */
+static void time_update(void)
+{
+    uint32_t now = app_timer_cnt_get();
+
+    m_power.ticks_in_state[m_power.stats.state] +=
+        app_timer_cnt_diff_compute(now, m_power.accounted);
+    m_power.accounted = now;
+}
+
+/**
+ * @brief Convert accumulated ticks to milliseconds
+ *
+ */
+static uint32_t ticks_to_ms(uint64_t ticks)
+{
+    return (uint32_t)((ticks * 1000) / TICK_FREQUENCY);
+}
+
+static void tick_timeout_handler(void *p_context)
+{
+    UNUSED_PARAMETER(p_context);
+
+    time_update();
+
+    // Advertising times out on its own. While a central is subscribed the
+    // rider may hold the bars still for as long as a climb takes.
+    if (m_power.stats.state != POWER_STATE_CONNECTED)
+    {
+        m_power.idle_ticks = 0;
+        return;
+    }
+
+    m_power.idle_ticks++;
+    if (m_power.idle_ticks == IDLE_TIMEOUT_S / TICK_INTERVAL_S &&
+        m_power.idle_handler != NULL)
+    {
+        NRF_LOG_INFO("Idle for %d s", IDLE_TIMEOUT_S);
+        m_power.idle_handler();
+    }
+}
+
+/**
+ * @brief Log why the chip came out of reset
+ *
+ */
+static void reset_reason_log(uint32_t reason)
+{
+    if (reason & POWER_RESETREAS_OFF_Msk)
+    {
+        NRF_LOG_INFO("Woken from system off by a button");
+    }
+    else if (reason & POWER_RESETREAS_LPCOMP_Msk)
+    {
+        NRF_LOG_INFO("Woken from system off by the stick");
+    }
+    else if (reason == 0)
+    {
+        NRF_LOG_INFO("Power on reset");
+    }
+    else
+    {
+        NRF_LOG_INFO("Reset, reason 0x%x", reason);
+    }
+}
+
+void power_state_init(power_state_idle_handler_t idle_handler)
+{
+    ret_code_t err_code;
+
+    // Cleared by writing ones, the SoftDevice is not enabled yet
+    m_power.stats.reset_reason = NRF_POWER->RESETREAS;
+    NRF_POWER->RESETREAS = m_power.stats.reset_reason;
+    reset_reason_log(m_power.stats.reset_reason);
+
+    m_power.idle_handler = idle_handler;
+    m_power.accounted = app_timer_cnt_get();
+
+    err_code = app_timer_create(&m_tick_timer, APP_TIMER_MODE_REPEATED,
+                                tick_timeout_handler);
+    APP_ERROR_CHECK(err_code);
+
+    err_code = app_timer_start(m_tick_timer, TICK_INTERVAL, NULL);
+    APP_ERROR_CHECK(err_code);
+}
+
+void power_state_set(power_state_t state)
+{
+    uint32_t ms;
+
+    if (state == m_power.stats.state)
+    {
+        return;
+    }
+
+    time_update();
+    ms = ticks_to_ms(m_power.ticks_in_state[m_power.stats.state]) -
+         m_power.entered;
+    NRF_LOG_INFO("Power %s -> %s after %d ms",
+                 m_state_names[m_power.stats.state], m_state_names[state], ms);
+    TRACE(TRACE_EVT_POWER_STATE, state, MIN(ms / 1000, UINT16_MAX));
+
+    m_power.stats.state = state;
+    m_power.entered = ticks_to_ms(m_power.ticks_in_state[state]);
+    m_power.idle_ticks = 0;
+}
+
+void power_state_activity(void) { m_power.idle_ticks = 0; }
+
+void power_state_log(void)
+{
+    power_state_stats_t stats;
+
+    power_state_stats_get(&stats);
+
+    for (uint8_t i = 0; i < POWER_STATE_COUNT; i++)
+    {
+        NRF_LOG_INFO("Power %s total %d ms", m_state_names[i],
+                     stats.time_in_state_ms[i]);
+    }
+}
+
+void power_state_stats_get(power_state_stats_t *p_stats)
+{
+    time_update();
+
+    for (uint8_t i = 0; i < POWER_STATE_COUNT; i++)
+    {
+        m_power.stats.time_in_state_ms[i] =
+            ticks_to_ms(m_power.ticks_in_state[i]);
+    }
+
+    *p_stats = m_power.stats;
+}
@@ -0,0 +1,91 @@
+/**
+ * Copyright (c) 2018 Keith Wakeham
+ *
+ * All rights reserved.
+ *
+ *
+ */
+
+#ifndef POWER_STATE_H
+#define POWER_STATE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+    /**
+     * @brief Power states, from the most to the least expensive one
+     *
+     */
+    typedef enum
+    {
+        POWER_STATE_STREAMING,   // sampling at full rate for a central
+        POWER_STATE_WAITING,     // streaming, the sampler waits for motion
+        POWER_STATE_CONNECTED,   // connected, nobody subscribed
+        POWER_STATE_ADVERTISING, // no central connected
+        POWER_STATE_COUNT
+    } power_state_t;
+
+    /**
+     * @brief Called when nothing happened for the idle timeout while
+     * connected, the application should disconnect and go to system off
+     *
+     */
+    typedef void (*power_state_idle_handler_t)(void);
+
+    /**
+     * @brief Power state statistics since boot
+     *
+     */
+    typedef struct
+    {
+        uint32_t      time_in_state_ms[POWER_STATE_COUNT];
+        uint32_t      reset_reason; // POWER RESETREAS at boot
+        power_state_t state;
+    } power_state_stats_t;
+
+    /**
+     * @brief Init the power state tracking
+     *
+     * @details Logs what woke the chip up and clears the reset reason, call
+     * after timers_init and before the SoftDevice is enabled.
+     *
+     * @param idle_handler called once the idle timeout runs out, it only
+     * runs in POWER_STATE_CONNECTED
+     */
+    void power_state_init(power_state_idle_handler_t idle_handler);
+
+    /**
+     * @brief Switch to a state, the time spent in the previous one is logged
+     *
+     * @param state new state, setting the current one again does nothing
+     */
+    void power_state_set(power_state_t state);
+
+    /**
+     * @brief Report user activity, restarts the idle timeout
+     *
+     */
+    void power_state_activity(void);
+
+    /**
+     * @brief Log the time spent in each state since boot
+     *
+     */
+    void power_state_log(void);
+
+    /**
+     * @brief Get the power state statistics
+     *
+     * @param p_stats filled with a copy of the statistics
+     */
+    void power_state_stats_get(power_state_stats_t *p_stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // POWER_STATE_H
@@ -0,0 +1,415 @@
+/**
+ * Copyright (c) 2018 Keith Wakeham
+ *
+ * All rights reserved.
+ *
+ *
+ */
+
+#include "reconnect.h"
+#include <string.h>
+#include "app_error.h"
+#include "app_timer.h"
+#include "app_util.h"
+#include "ble.h"
+#include "nrf_log.h"
+#include "nrf_sdh_ble.h"
+
+// Stored as Peer Manager application data once a bonded central finished the
+// Zwift handshake, "ZWFT"
+#define HANDSHAKE_MARKER 0x5A574654
+
+#define RECONNECT_BLE_OBSERVER_PRIO 3
+
+#define TICK_FREQUENCY \
+    (APP_TIMER_CLOCK_FREQ / (APP_TIMER_CONFIG_RTC_FREQUENCY + 1))
+#define TICKS_TO_MS(ticks) ((uint32_t)(((uint64_t)(ticks)*1000) / TICK_FREQUENCY))
+
+static ble_advertising_t *m_p_advertising;
+
+// Last central that secured a link, directed advertising goes to it
+static pm_peer_id_t m_peer_id = PM_PEER_ID_INVALID;
+
+// Must stay valid until the flash write is done
+static const uint32_t m_handshake_marker = HANDSHAKE_MARKER;
+
+static struct
+{
+    bool     handshake_done[NRF_SDH_BLE_TOTAL_LINK_COUNT];
+    bool     drop_pending;     // a streaming central dropped
+    uint32_t drop_time;        // app_timer ticks
+    uint16_t conn_handle;      // link being measured
+    uint32_t connect_time;     // app_timer ticks
+    bool     directed;         // the measured link came from directed adv
+    reconnect_stats_t stats;
+} m_reconnect = {.conn_handle = BLE_CONN_HANDLE_INVALID};
+
+// The bonded peers changed since the lists were last loaded
+static bool m_lists_dirty = true;
+
+static bool list_in_use(ret_code_t err_code)
+{
+    return err_code == NRF_ERROR_INVALID_STATE ||
+           err_code == BLE_ERROR_GAP_WHITELIST_IN_USE ||
+           err_code == BLE_ERROR_GAP_DEVICE_IDENTITIES_IN_USE;
+}
+
+/**
+ * @brief Load the bonded peers into the whitelist and identity list
+ *
+ * @details The SoftDevice refuses both while it advertises with them, they
+ * stay dirty then and the next advertising start tries again.
+ */
+static void whitelist_apply(void)
+{
+    ret_code_t   err_code;
+    pm_peer_id_t peers[BLE_GAP_WHITELIST_ADDR_MAX_COUNT];
+    uint32_t     count = 0;
+    pm_peer_id_t peer_id;
+
+    if (!m_lists_dirty)
+    {
+        return;
+    }
+
+    peer_id = pm_next_peer_id_get(PM_PEER_ID_INVALID);
+    while (peer_id != PM_PEER_ID_INVALID && count < ARRAY_SIZE(peers))
+    {
+        peers[count++] = peer_id;
+        peer_id = pm_next_peer_id_get(peer_id);
+    }
+
+    err_code = pm_whitelist_set(count > 0 ? peers : NULL, count);
+    if (list_in_use(err_code))
+    {
+        return;
+    }
+    APP_ERROR_CHECK(err_code);
+
+    err_code = pm_device_identities_list_set(count > 0 ? peers : NULL, count);
+    if (list_in_use(err_code))
+    {
+        return;
+    }
+    if (err_code != NRF_ERROR_NOT_SUPPORTED)
+    {
+        APP_ERROR_CHECK(err_code);
+    }
+
+    m_lists_dirty = false;
+}
+
+/**
+ * @brief Note a change of the bonded peers
+ *
+ * @details Peer Manager reports them while advertising goes on, the lists
+ * are loaded when it starts over.
+ */
+static void whitelist_update(void) { m_lists_dirty = true; }
+
+/**
+ * @brief Check if the directed advertising target is bonded and not connected
+ *
+ */
+static bool directed_target_available(void)
+{
+    uint16_t conn_handle;
+
+    if (m_peer_id == PM_PEER_ID_INVALID)
+    {
+        return false;
+    }
+
+    return pm_conn_handle_get(m_peer_id, &conn_handle) == NRF_SUCCESS &&
+           conn_handle == BLE_CONN_HANDLE_INVALID;
+}
+
+/**
+ * @brief Check if a peer has finished the handshake before
+ *
+ */
+static bool handshake_cached(pm_peer_id_t peer_id)
+{
+    uint32_t marker = 0;
+    uint32_t len = sizeof(marker);
+
+    if (peer_id == PM_PEER_ID_INVALID)
+    {
+        return false;
+    }
+
+    return pm_peer_data_app_data_load(peer_id, &marker, &len) == NRF_SUCCESS &&
+           len == sizeof(marker) && marker == HANDSHAKE_MARKER;
+}
+
+/**
+ * @brief Remember the handshake of the bonded peer on a link
+ *
+ * @param conn_handle link that finished the handshake
+ */
+static void handshake_store(uint16_t conn_handle)
+{
+    ret_code_t   err_code;
+    pm_peer_id_t peer_id;
+
+    if (pm_peer_id_get(conn_handle, &peer_id) != NRF_SUCCESS ||
+        peer_id == PM_PEER_ID_INVALID || handshake_cached(peer_id))
+    {
+        return;
+    }
+
+    err_code = pm_peer_data_app_data_store(peer_id, &m_handshake_marker,
+                                           sizeof(m_handshake_marker), NULL);
+    if (err_code != NRF_SUCCESS)
+    {
+        // Only costs a full handshake on the next reconnect
+        NRF_LOG_WARNING("Handshake not cached: 0x%x", err_code);
+    }
+}
+
+/**
+ * @brief Account a reconnect that got its first steering packet out
+ *
+ */
+static void reconnect_record(void)
+{
+    uint32_t           now = app_timer_cnt_get();
+    reconnect_stats_t *p_stats = &m_reconnect.stats;
+
+    p_stats->last_ms =
+        TICKS_TO_MS(app_timer_cnt_diff_compute(now, m_reconnect.drop_time));
+    p_stats->last_conn_ms = TICKS_TO_MS(app_timer_cnt_diff_compute(
+        m_reconnect.connect_time, m_reconnect.drop_time));
+
+    if (p_stats->count == 0 || p_stats->last_ms < p_stats->min_ms)
+    {
+        p_stats->min_ms = p_stats->last_ms;
+    }
+    p_stats->max_ms = MAX(p_stats->max_ms, p_stats->last_ms);
+    p_stats->total_ms += p_stats->last_ms;
+    p_stats->count++;
+    if (m_reconnect.directed)
+    {
+        p_stats->directed++;
+    }
+
+    NRF_LOG_INFO("Reconnect: first steering packet after %d ms (connected "
+                 "after %d ms%s)",
+                 p_stats->last_ms, p_stats->last_conn_ms,
+                 m_reconnect.directed ? ", directed" : "");
+
+    m_reconnect.drop_pending = false;
+    m_reconnect.conn_handle = BLE_CONN_HANDLE_INVALID;
+}
+
+static void ble_evt_handler(ble_evt_t const *p_ble_evt, void *p_context)
+{
+    uint16_t conn_handle = p_ble_evt->evt.gap_evt.conn_handle;
+
+    UNUSED_PARAMETER(p_context);
+
+    switch (p_ble_evt->header.evt_id)
+    {
+        case BLE_GAP_EVT_CONNECTED:
+            if (m_reconnect.drop_pending &&
+                m_reconnect.conn_handle == BLE_CONN_HANDLE_INVALID)
+            {
+                m_reconnect.conn_handle = conn_handle;
+                m_reconnect.connect_time = app_timer_cnt_get();
+                m_reconnect.directed = m_p_advertising->adv_mode_current ==
+                                       BLE_ADV_MODE_DIRECTED_HIGH_DUTY;
+            }
+            break;
+
+        case BLE_GAP_EVT_DISCONNECTED:
+            if (conn_handle == m_reconnect.conn_handle)
+            {
+                // Dropped again before streaming, keep the first drop time
+                m_reconnect.conn_handle = BLE_CONN_HANDLE_INVALID;
+            }
+            if (conn_handle < NRF_SDH_BLE_TOTAL_LINK_COUNT &&
+                m_reconnect.handshake_done[conn_handle])
+            {
+                m_reconnect.handshake_done[conn_handle] = false;
+                if (!m_reconnect.drop_pending)
+                {
+                    m_reconnect.drop_pending = true;
+                    m_reconnect.drop_time = app_timer_cnt_get();
+                }
+            }
+            break;
+
+        default:
+            break;
+    }
+}
+
+NRF_SDH_BLE_OBSERVER(m_reconnect_obs, RECONNECT_BLE_OBSERVER_PRIO,
+                     ble_evt_handler, NULL);
+
+void reconnect_init(ble_advertising_t *p_advertising)
+{
+    ret_code_t   err_code;
+    pm_peer_id_t lowest_peer;
+    uint32_t     highest_rank;
+    uint32_t     lowest_rank;
+
+    m_p_advertising = p_advertising;
+
+    whitelist_apply();
+
+    err_code = pm_peer_ranks_get(&m_peer_id, &highest_rank, &lowest_peer,
+                                 &lowest_rank);
+    if (err_code != NRF_SUCCESS)
+    {
+        // No bonds yet
+        m_peer_id = PM_PEER_ID_INVALID;
+    }
+}
+
+ret_code_t reconnect_advertising_start(void)
+{
+    whitelist_apply();
+
+    return ble_advertising_start(m_p_advertising,
+                                 directed_target_available()
+                                     ? BLE_ADV_MODE_DIRECTED_HIGH_DUTY
+                                     : BLE_ADV_MODE_FAST);
+}
+
+void reconnect_on_adv_evt(ble_adv_evt_t ble_adv_evt)
+{
+    ret_code_t err_code;
+
+    switch (ble_adv_evt)
+    {
+        case BLE_ADV_EVT_PEER_ADDR_REQUEST:
+        {
+            pm_peer_data_bonding_t peer_bonding_data;
+
+            // ble_advertising asks on every restart after a disconnect, no
+            // reply moves on to the next mode
+            if (!directed_target_available() ||
+                pm_peer_data_bonding_load(m_peer_id, &peer_bonding_data) !=
+                    NRF_SUCCESS)
+            {
+                break;
+            }
+
+            err_code = ble_advertising_peer_addr_reply(
+                m_p_advertising, &peer_bonding_data.peer_ble_id.id_addr_info);
+            APP_ERROR_CHECK(err_code);
+        }
+        break;
+
+        case BLE_ADV_EVT_WHITELIST_REQUEST:
+        {
+            ble_gap_addr_t whitelist_addrs[BLE_GAP_WHITELIST_ADDR_MAX_COUNT];
+            ble_gap_irk_t  whitelist_irks[BLE_GAP_WHITELIST_ADDR_MAX_COUNT];
+            uint32_t       addr_cnt = BLE_GAP_WHITELIST_ADDR_MAX_COUNT;
+            uint32_t       irk_cnt = BLE_GAP_WHITELIST_ADDR_MAX_COUNT;
+
+            // Only the fast window is kept for bonded centrals, slow
+            // advertising stays open to new ones
+            if (m_p_advertising->adv_mode_current != BLE_ADV_MODE_FAST)
+            {
+                break;
+            }
+
+            // Between two modes, the SoftDevice is not advertising
+            whitelist_apply();
+            err_code = pm_whitelist_get(whitelist_addrs, &addr_cnt,
+                                        whitelist_irks, &irk_cnt);
+            APP_ERROR_CHECK(err_code);
+
+            err_code = ble_advertising_whitelist_reply(
+                m_p_advertising, whitelist_addrs, addr_cnt, whitelist_irks,
+                irk_cnt);
+            APP_ERROR_CHECK(err_code);
+        }
+        break;
+
+        default:
+            break;
+    }
+}
+
+bool reconnect_on_pm_evt(pm_evt_t const *p_evt)
+{
+    ret_code_t err_code;
+
+    switch (p_evt->evt_id)
+    {
+        case PM_EVT_CONN_SEC_SUCCEEDED:
+            m_peer_id = p_evt->peer_id;
+            err_code = pm_peer_rank_highest(p_evt->peer_id);
+            if (err_code != NRF_SUCCESS)
+            {
+                // Only affects which peer gets directed advertising after a
+                // reset
+                NRF_LOG_WARNING("Peer rank not stored: 0x%x", err_code);
+            }
+
+            if (p_evt->conn_handle < NRF_SDH_BLE_TOTAL_LINK_COUNT &&
+                m_reconnect.handshake_done[p_evt->conn_handle])
+            {
+                // Bonded after the handshake
+                handshake_store(p_evt->conn_handle);
+            }
+
+            return p_evt->params.conn_sec_succeeded.procedure ==
+                       PM_CONN_SEC_PROCEDURE_ENCRYPTION &&
+                   handshake_cached(p_evt->peer_id);
+
+        case PM_EVT_PEER_DATA_UPDATE_SUCCEEDED:
+            if (p_evt->params.peer_data_update_succeeded.flash_changed &&
+                p_evt->params.peer_data_update_succeeded.data_id ==
+                    PM_PEER_DATA_ID_BONDING)
+            {
+                whitelist_update();
+            }
+            break;
+
+        case PM_EVT_PEER_DELETE_SUCCEEDED:
+            if (p_evt->peer_id == m_peer_id)
+            {
+                m_peer_id = PM_PEER_ID_INVALID;
+            }
+            whitelist_update();
+            break;
+
+        case PM_EVT_PEERS_DELETE_SUCCEEDED:
+            m_peer_id = PM_PEER_ID_INVALID;
+            whitelist_update();
+            break;
+
+        default:
+            break;
+    }
+
+    return false;
+}
+
+void reconnect_handshake_done(uint16_t conn_handle)
+{
+    if (conn_handle >= NRF_SDH_BLE_TOTAL_LINK_COUNT)
+    {
+        return;
+    }
+
+    m_reconnect.handshake_done[conn_handle] = true;
+    handshake_store(conn_handle);
+}
+
+void reconnect_steering_sent(uint16_t conn_handle)
+{
+    if (conn_handle == m_reconnect.conn_handle)
+    {
+        reconnect_record();
+    }
+}
+
+void reconnect_stats_get(reconnect_stats_t *p_stats)
+{
+    *p_stats = m_reconnect.stats;
+}
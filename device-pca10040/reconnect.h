@@ -0,0 +1,106 @@
+/**
+ * Copyright (c) 2018 Keith Wakeham
+ *
+ * All rights reserved.
+ *
+ *
+ */
+
+#ifndef RECONNECT_H
+#define RECONNECT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "ble_advertising.h"
+#include "peer_manager.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+    /**
+     * @brief Reconnect statistics
+     *
+     * @details A reconnect is measured from the drop of a streaming central
+     * to the first steering notification acknowledged on the new link.
+     */
+    typedef struct
+    {
+        uint32_t count;        // reconnects measured
+        uint32_t directed;     // of those, connected by directed advertising
+        uint32_t last_ms;      // time to first steering packet
+        uint32_t min_ms;
+        uint32_t max_ms;
+        uint32_t total_ms;     // for the mean
+        uint32_t last_conn_ms; // drop to connected, last reconnect
+    } reconnect_stats_t;
+
+    /**
+     * @brief Init the reconnect path
+     *
+     * @details Loads the bonded peers into the whitelist and picks the last
+     * used one as the target of directed advertising. Call after
+     * peer_manager_init and advertising_init.
+     *
+     * @param p_advertising advertising module instance to drive
+     */
+    void reconnect_init(ble_advertising_t *p_advertising);
+
+    /**
+     * @brief Start advertising in the fastest mode that fits
+     *
+     * @details High duty directed advertising to the last central if it is
+     * bonded and not connected, then a whitelisted fast window, then slow
+     * general advertising.
+     *
+     * @return NRF_SUCCESS or the error from ble_advertising_start
+     */
+    ret_code_t reconnect_advertising_start(void);
+
+    /**
+     * @brief Forward advertising events
+     *
+     * @details Answers the peer address and whitelist requests.
+     *
+     * @param ble_adv_evt event received from ble_advertising
+     */
+    void reconnect_on_adv_evt(ble_adv_evt_t ble_adv_evt);
+
+    /**
+     * @brief Forward Peer Manager events
+     *
+     * @param p_evt event received from the Peer Manager
+     *
+     * @return true if the link is a bonded central that already did the
+     * handshake, the steering service may skip it
+     */
+    bool reconnect_on_pm_evt(pm_evt_t const *p_evt);
+
+    /**
+     * @brief Report a finished handshake, remembered for bonded centrals
+     *
+     * @param conn_handle link that started steering
+     */
+    void reconnect_handshake_done(uint16_t conn_handle);
+
+    /**
+     * @brief Report steering notifications that went out, the first one
+     * after a drop ends the reconnect
+     *
+     * @param conn_handle link they went out on
+     */
+    void reconnect_steering_sent(uint16_t conn_handle);
+
+    /**
+     * @brief Get the reconnect statistics
+     *
+     * @param p_stats filled with a copy of the statistics
+     */
+    void reconnect_stats_get(reconnect_stats_t *p_stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // RECONNECT_H
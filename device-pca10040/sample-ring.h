@@ -0,0 +1,101 @@
+/**
+ * Copyright (c) 2018 Keith Wakeham
+ *
+ * All rights reserved.
+ *
+ *
+ */
+
+#ifndef SAMPLE_RING_H
+#define SAMPLE_RING_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "nrf.h"
+
+// Must be a power of two
+#define SAMPLE_RING_SIZE 8
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+    /**
+     * @brief One averaged ADC reading and when it completed
+     *
+     */
+    typedef struct
+    {
+        int16_t  code;
+        uint32_t timestamp;
+    } sample_ring_entry_t;
+
+    /**
+     * @brief Single producer, single consumer ring of samples
+     *
+     * @details The producer (SAADC interrupt) only writes head, the consumer
+     * (main context) only writes tail, so neither side needs a lock and an
+     * entry is never read while it is being written.
+     */
+    typedef struct
+    {
+        sample_ring_entry_t entries[SAMPLE_RING_SIZE];
+        volatile uint32_t   head;
+        volatile uint32_t   tail;
+        volatile uint32_t   dropped;
+    } sample_ring_t;
+
+    /**
+     * @brief Queue a sample, called by the producer only
+     *
+     * @return false if the ring was full and the sample was dropped
+     */
+    static inline bool sample_ring_push(sample_ring_t *            p_ring,
+                                        sample_ring_entry_t const *p_entry)
+    {
+        uint32_t head = p_ring->head;
+
+        if (head - p_ring->tail == SAMPLE_RING_SIZE)
+        {
+            p_ring->dropped++;
+            return false;
+        }
+
+        p_ring->entries[head & (SAMPLE_RING_SIZE - 1)] = *p_entry;
+        // The entry must be complete before the consumer can see it
+        __DMB();
+        p_ring->head = head + 1;
+
+        return true;
+    }
+
+    /**
+     * @brief Take the oldest sample, called by the consumer only
+     *
+     * @return false if the ring was empty
+     */
+    static inline bool sample_ring_pop(sample_ring_t *      p_ring,
+                                       sample_ring_entry_t *p_entry)
+    {
+        uint32_t tail = p_ring->tail;
+
+        if (tail == p_ring->head)
+        {
+            return false;
+        }
+
+        __DMB();
+        *p_entry = p_ring->entries[tail & (SAMPLE_RING_SIZE - 1)];
+        // The entry must be copied out before the producer may reuse it
+        __DMB();
+        p_ring->tail = tail + 1;
+
+        return true;
+    }
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // SAMPLE_RING_H
@@ -8,78 +8,497 @@
 
 #include "steer-adc.h"
 #include "app_timer.h"
+#include "app_util.h"
+#include "app_util_platform.h"
+#include "bench.h"
+#include "calibration.h"
 #include "nrf_log.h"
 #include "nrf_log_ctrl.h"
 #include "nrf_log_default_backends.h"
+#include "nrf_lpcomp.h"
 #include "nrf_saadc.h"
+#include "nrfx_ppi.h"
+#include "nrfx_rtc.h"
 #include "nrfx_saadc.h"
+#include "params.h"
+#include "sample-ring.h"
+#include "steer-angle-lut.h"
+#include "steer-fir.h"
+#include "steer-predict.h"
+#include "trace.h"
 
-#define SAMPLING_INTERVAL APP_TIMER_TICKS(100)
+// Catch a lookup table that was not regenerated after a constant changed
+STATIC_ASSERT(STEER_ANGLE_LUT_MAX_STEER_ANGLE == MAX_STEER_ANGLE);
+STATIC_ASSERT(STEER_ANGLE_LUT_MAX_ADC_RESOLUTION == MAX_ADC_RESOLUTION);
+STATIC_ASSERT(STEER_ANGLE_LUT_SCALE == STEER_ANGLE_SCALE);
 
-APP_TIMER_DEF(m_sampling_timer);
+// Number of samples EasyDMA collects before the CPU is woken up
+#if STEER_CONN_EVT_SYNC
+#define SAMPLES_PER_BUFFER 1
+#else
+#define SAMPLES_PER_BUFFER 8
+#endif
+
+#define STEER_FIR (STEER_FIR_ENABLED && !STEER_CONN_EVT_SYNC)
+
+#if STEER_FIR
+// Every PARAM_SAMPLE_RATE period takes this many single conversions, spread
+// out evenly instead of in one burst. A buffer is one block of the decimator
+// and the steering sample rate stays the same.
+#define SAMPLE_CONVERSIONS (STEER_FIR_DECIMATION / SAMPLES_PER_BUFFER)
+#define SAMPLE_OVERSAMPLE NRF_SAADC_OVERSAMPLE_DISABLED
+// Conversions a steering sample is made from
+#define SAMPLE_WINDOW STEER_FIR_TAPS
+STATIC_ASSERT(SAMPLE_CONVERSIONS * SAMPLES_PER_BUFFER == STEER_FIR_DECIMATION);
+#else
+#define SAMPLE_CONVERSIONS 1
+#define SAMPLE_OVERSAMPLE NRFX_SAADC_CONFIG_OVERSAMPLE
+#define SAMPLE_WINDOW SAMPLES_PER_BUFFER
+#endif
+
+#define BUFFER_CONVERSIONS (SAMPLES_PER_BUFFER * SAMPLE_CONVERSIONS)
+
+#define SAMPLE_RTC_FREQUENCY 32768
+
+// Period at which RTC2 triggers the SAADC SAMPLE task through PPI, set from
+// PARAM_SAMPLE_RATE and SAMPLE_CONVERSIONS in main context and read by the
+// SAADC interrupt
+static volatile uint32_t m_sample_rtc_ticks;
+
+#if !STEER_CONN_EVT_SYNC
+static const nrfx_rtc_t m_sample_rtc = NRFX_RTC_INSTANCE(2);
+static nrf_ppi_channel_t m_sample_ppi_channel;
+// SAADC END restarts the DMA while waiting for motion
+static nrf_ppi_channel_t m_restart_ppi_channel;
+// Each conversion lands here while waiting for motion, nobody reads it
+// unless it crossed a limit
+static nrf_saadc_value_t m_wake_result;
+#endif
+// Set while the SAADC runs on its own and only the limit events interrupt
+static volatile bool m_wake_on_motion;
+
+// While waiting for motion one averaged burst per steering sample is checked
+// against STEER_WAKE_BAND, single conversions would cross it on noise alone
+#define WAKE_OVERSAMPLE NRFX_SAADC_CONFIG_OVERSAMPLE
+
+// The driver hands one buffer to EasyDMA while the other one is queued, we
+// re-queue each buffer as soon as it has been averaged or filtered.
+static nrf_saadc_value_t m_buffer_pool[2][BUFFER_CONVERSIONS];
+#if STEER_FIR
+// Only touched from the SAADC interrupt
+static steer_fir_t m_fir;
+#endif
+// Filled by the SAADC interrupt, drained by steering_process()
+static sample_ring_t m_sample_ring;
+// Conversions since boot, written by the SAADC interrupt only
+static volatile uint32_t m_sample_count;
+
+// Only touched from main context
+int16_t                sample = 0;
+static uint32_t        m_sample_timestamp = 0;
+static steer_predict_t m_predict;
 
-static nrf_saadc_value_t m_buffer_pool[2];
-int16_t                  sample = 0;
+static steering_sample_handler_t m_sample_handler = NULL;
 
 bool converting = false;
-bool flag_float_angle = false;
 
-// Set to true to zero out the steerer with the next adc reading
-bool    zero_out = true;
-int32_t zero_offset = 0;
+// Speed adaptive (One Euro) smoothing of the ADC codes. Cutoffs are in 1/256 Hz
+// and the speed is in ADC codes per second. The cutoff while the stick is
+// still and its increase per 1000 codes/s are PARAM_FILTER_MIN_CUTOFF and
+// PARAM_FILTER_BETA.
+#define FILTER_ENABLED 1
+#define FILTER_D_CUTOFF_Q8 (1 * 256)  // cutoff of the speed estimate
+#define FILTER_MAX_CUTOFF_Q8 (100 * 256)
+#define FILTER_MAX_SPEED 1000000
+#define FILTER_MAX_DT APP_TIMER_TICKS(1000)
+
+#define TWO_PI_Q16 411775
+#define TICK_FREQUENCY \
+    (APP_TIMER_CLOCK_FREQ / (APP_TIMER_CONFIG_RTC_FREQUENCY + 1))
+// One burst runs 2^oversample conversions of 10 us acquisition and up to 2 us
+// conversion time. It ends this many app_timer ticks after its middle.
+#define BURST_OFFSET(oversample) \
+    ((((1UL << (oversample)) * 12) * TICK_FREQUENCY) / (2 * 1000000UL))
+#define SAMPLE_BURST_OFFSET BURST_OFFSET(SAMPLE_OVERSAMPLE)
+// DONE fires this many app_timer ticks after the middle of the samples that
+// were averaged or filtered, the filter is symmetric
+#define SAMPLE_CAPTURE_OFFSET                             \
+    (((SAMPLE_WINDOW - 1) * m_sample_rtc_ticks) / 2 + \
+     SAMPLE_BURST_OFFSET)
+
+// 2 * pi / TICK_FREQUENCY in Q31, so w needs no run time division
+#define W_FACTOR_Q31 (((uint64_t)TWO_PI_Q16 << 15) / TICK_FREQUENCY)
+
+#if FILTER_ENABLED
+static struct
+{
+    bool     initialised;
+    int32_t  x_q4;  // filtered ADC code
+    int32_t  dx;    // filtered speed
+    uint32_t timestamp;
+} m_filter;
+
+/**
+ * @brief Smoothing factor of a first order low pass, alpha = w / (1 + w) with
+ * w = 2 * pi * cutoff * dt
+ *
+ * @param cutoff_q8 cutoff frequency in 1/256 Hz
+ * @param dt time since the previous sample in app_timer ticks
+ * @return alpha in Q15
+ */
+static uint32_t filter_alpha_q15(uint32_t cutoff_q8, uint32_t dt)
+{
+    uint32_t w_q16 =
+        (uint32_t)(((uint64_t)cutoff_q8 * dt * W_FACTOR_Q31) >> (8 + 15));
+
+    // 1 - 1 / (1 + w), keeps the division within 32 bits
+    return 32768 - (0x80000000u / (65536 + w_q16));
+}
+
+/**
+ * @brief Run one ADC code through the One Euro filter
+ *
+ * @details The cutoff follows the filtered speed of the stick, so it smooths
+ * hard while the stick is still and barely lags during fast moves.
+ *
+ * @param x ADC code
+ * @param timestamp app_timer tick count of the sample
+ * @return filtered ADC code
+ */
+static int16_t filter_update(int16_t x, uint32_t timestamp)
+{
+    int32_t  x_q4 = (int32_t)x << 4;
+    int32_t  dx;
+    uint32_t dt;
+    uint32_t speed;
+    uint32_t cutoff;
 
-// Max amount of turn allowed
-#define MAX_STEER_ANGLE (35)
+    if (!m_filter.initialised)
+    {
+        m_filter.initialised = true;
+        m_filter.x_q4 = x_q4;
+        m_filter.dx = 0;
+        m_filter.timestamp = timestamp;
+        return x;
+    }
 
-// used to make sure we don't move around when we're close to center of joystick
-#define ZERO_FLOOR 1
+    dt = app_timer_cnt_diff_compute(timestamp, m_filter.timestamp);
+    dt = MAX(dt, 1);
+    dt = MIN(dt, FILTER_MAX_DT);
+    m_filter.timestamp = timestamp;
 
-// 14 bits
-#define MAX_ADC_RESOLUTION 16384
+    dx = ((x_q4 - m_filter.x_q4) * (TICK_FREQUENCY >> 4)) / (int32_t)dt;
+    m_filter.dx += (int32_t)(((int64_t)(dx - m_filter.dx) *
+                              filter_alpha_q15(FILTER_D_CUTOFF_Q8, dt)) >>
+                             15);
+
+    speed = (m_filter.dx < 0) ? -m_filter.dx : m_filter.dx;
+    speed = MIN(speed, FILTER_MAX_SPEED);
+    cutoff = params_get(PARAM_FILTER_MIN_CUTOFF) +
+             (speed * params_get(PARAM_FILTER_BETA)) / 1000;
+    cutoff = MIN(cutoff, FILTER_MAX_CUTOFF_Q8);
+
+    m_filter.x_q4 += (int32_t)(((int64_t)(x_q4 - m_filter.x_q4) *
+                                filter_alpha_q15(cutoff, dt)) >>
+                               15);
+
+    return (m_filter.x_q4 + 8) >> 4;
+}
+#endif
 
 #ifdef BOARD_PCA10040
 #define STEERER_PIN NRF_SAADC_INPUT_AIN0
+#define STEERER_LPCOMP_INPUT NRF_LPCOMP_INPUT_0
 #elif BOARD_PCA10059
 #define STEERER_PIN NRF_SAADC_INPUT_AIN7
+#define STEERER_LPCOMP_INPUT NRF_LPCOMP_INPUT_7
+#endif
+
+// LPCOMP compares against VDD in sixteenths. The SAADC full scale, 0.6 V
+// with gain 1/5, is taken to be VDD.
+#define LPCOMP_STEP (MAX_ADC_RESOLUTION / 16)
+// Keep the reference at least this far from where the stick rests
+#define LPCOMP_MIN_DISTANCE (LPCOMP_STEP / 4)
+
+#if !STEER_CONN_EVT_SYNC
+/**
+ * @brief Trigger SAADC SAMPLE every ticks RTC2 ticks from now on
+ *
+ */
+static void sample_trigger_period_set(uint32_t ticks)
+{
+    ret_code_t err_code;
+
+    err_code = nrfx_rtc_cc_set(&m_sample_rtc, 0, ticks, false);
+    APP_ERROR_CHECK(err_code);
+    // A counter already past a lower compare value would run until it wraps
+    nrfx_rtc_counter_clear(&m_sample_rtc);
+}
+
+/**
+ * @brief Go back to streaming after the stick left the band
+ *
+ * @details Runs in the SAADC interrupt. The conversion that crossed the limit
+ * is queued as a regular sample so the move is not delayed by a full buffer.
+ *
+ * @param limit_type which limit was crossed
+ */
+static void wake_on_motion_exit(nrf_saadc_limit_t limit_type)
+{
+    ret_code_t          err_code;
+    sample_ring_entry_t entry;
+    bool                queued;
+
+    nrfx_saadc_limits_set(0, NRFX_SAADC_LIMITL_DISABLED,
+                          NRFX_SAADC_LIMITH_DISABLED);
+    err_code = nrfx_ppi_channel_disable(m_restart_ppi_channel);
+    APP_ERROR_CHECK(err_code);
+
+    entry.code = m_wake_result;
+    entry.timestamp = (app_timer_cnt_get() - BURST_OFFSET(WAKE_OVERSAMPLE)) &
+                      RTC_COUNTER_COUNTER_Msk;
+    m_sample_count++;
+
+    // The driver went idle on the first END it saw, restart it from scratch
+    m_wake_on_motion = false;
+    nrf_saadc_event_clear(NRF_SAADC_EVENT_END);
+    nrf_saadc_int_enable(NRF_SAADC_INT_END);
+
+#if STEER_FIR
+    // The input before the wait is too old to filter with the new one
+    steer_fir_init(&m_fir);
+    nrf_saadc_oversample_set((nrf_saadc_oversample_t)SAMPLE_OVERSAMPLE);
+    sample_trigger_period_set(m_sample_rtc_ticks);
+#endif
+
+    err_code = nrfx_saadc_buffer_convert(m_buffer_pool[0], BUFFER_CONVERSIONS);
+    APP_ERROR_CHECK(err_code);
+
+    err_code = nrfx_saadc_buffer_convert(m_buffer_pool[1], BUFFER_CONVERSIONS);
+    APP_ERROR_CHECK(err_code);
+
+    queued = sample_ring_push(&m_sample_ring, &entry);
+    TRACE(TRACE_EVT_MOTION_WAKE, entry.code, limit_type);
+    if (queued && m_sample_handler != NULL)
+    {
+        m_sample_handler();
+    }
+}
 #endif
 
 void saadc_callback(nrfx_saadc_evt_t const *p_event)
 {
-    if (p_event->type ==
-        NRFX_SAADC_EVT_DONE)  // Capture offset calibration complete event
+    if (m_wake_on_motion && p_event->type == NRFX_SAADC_EVT_DONE)
     {
+        // END is left pending while waiting for motion, the driver reports it
+        // with whatever buffer it had. Nothing to hand back.
+    }
+    else if (p_event->type ==
+             NRFX_SAADC_EVT_DONE)  // A whole buffer has been filled by EasyDMA
+    {
+        ret_code_t               err_code;
+        nrf_saadc_value_t const *p_buffer = p_event->data.done.p_buffer;
+        sample_ring_entry_t      entry;
+        bool                     queued;
+
+        BENCH_BEGIN(BENCH_STAGE_SAADC);
+
         converting = false;
-        if (zero_out)
+        m_sample_count += p_event->data.done.size;
+
+#if STEER_FIR
+        // Always a whole block, buffers are only handed over full
+        entry.code = steer_fir_decimate(&m_fir, p_buffer);
+#else
+        {
+            int32_t sum = 0;
+
+            for (uint16_t i = 0; i < p_event->data.done.size; i++)
+            {
+                sum += p_buffer[i];
+            }
+            entry.code = sum / p_event->data.done.size;
+        }
+#endif
+        // Tag the sample with when the averaged signal was on the pin
+        entry.timestamp = (app_timer_cnt_get() - SAMPLE_CAPTURE_OFFSET) &
+                          RTC_COUNTER_COUNTER_Msk;
+
+        // Hand the buffer back so it becomes the next one in line
+        err_code = nrfx_saadc_buffer_convert(p_event->data.done.p_buffer,
+                                             BUFFER_CONVERSIONS);
+        APP_ERROR_CHECK(err_code);
+
+        // Everything else happens in steering_process()
+        queued = sample_ring_push(&m_sample_ring, &entry);
+        TRACE(TRACE_EVT_SAMPLE, entry.code, queued);
+        if (queued && m_sample_handler != NULL)
         {
-            zero_out = false;
+            m_sample_handler();
+        }
 
-            zero_offset = (MAX_ADC_RESOLUTION / 2) - m_buffer_pool[0];
-            NRF_LOG_INFO("Zero %d %d", m_buffer_pool[0], zero_offset);
+        BENCH_END(BENCH_STAGE_SAADC);
+    }
+#if !STEER_CONN_EVT_SYNC
+    else if (p_event->type == NRFX_SAADC_EVT_LIMIT)
+    {
+        if (m_wake_on_motion)
+        {
+            wake_on_motion_exit(p_event->data.limit.limit_type);
         }
     }
+#endif
     else if (p_event->type == NRFX_SAADC_EVT_CALIBRATEDONE)
     {
         // Nothing, not calibrating
     }
 }
 
-void sampling_timer_callback(void *p_context)
+bool steering_process(void)
 {
-    flag_float_angle = true;
-    ret_code_t err_code;
-    err_code = nrfx_saadc_buffer_convert(&m_buffer_pool[0], 1);
+    sample_ring_entry_t entry;
+    bool                updated = false;
+
+    BENCH_BEGIN(BENCH_STAGE_PROCESS);
+
+    while (sample_ring_pop(&m_sample_ring, &entry))
+    {
+        m_sample_timestamp = entry.timestamp;
+#if FILTER_ENABLED
+        BENCH_BEGIN(BENCH_STAGE_FILTER);
+        sample = filter_update(entry.code, entry.timestamp);
+        BENCH_END(BENCH_STAGE_FILTER);
+#else
+        sample = entry.code;
+#endif
+        steer_predict_update(&m_predict, sample, entry.timestamp);
+        updated = true;
+
+        calibration_update(sample);
+    }
+
+    // An empty ring is not a call worth timing
+    if (updated)
+    {
+        BENCH_END(BENCH_STAGE_PROCESS);
+    }
+
+    return updated;
+}
+
+#if !STEER_CONN_EVT_SYNC
+static void sample_rtc_handler(nrfx_rtc_int_type_t int_type)
+{
+    // RTC2 only drives PPI, no interrupts are enabled
+    UNUSED_PARAMETER(int_type);
+}
+
+/**
+ * @brief Let RTC2 COMPARE0 trigger SAADC SAMPLE and restart itself via PPI
+ *
+ */
+static void sample_trigger_init(void)
+{
+    ret_code_t        err_code;
+    nrfx_rtc_config_t rtc_config = NRFX_RTC_DEFAULT_CONFIG;
+
+    rtc_config.prescaler = RTC_FREQ_TO_PRESCALER(SAMPLE_RTC_FREQUENCY);
+
+    err_code = nrfx_rtc_init(&m_sample_rtc, &rtc_config, sample_rtc_handler);
     APP_ERROR_CHECK(err_code);
-    err_code = nrfx_saadc_sample();
+
+    err_code = nrfx_rtc_cc_set(&m_sample_rtc, 0, m_sample_rtc_ticks, false);
+    APP_ERROR_CHECK(err_code);
+
+    err_code = nrfx_ppi_channel_alloc(&m_sample_ppi_channel);
+    APP_ERROR_CHECK(err_code);
+
+    err_code = nrfx_ppi_channel_assign(
+        m_sample_ppi_channel,
+        nrfx_rtc_event_address_get(&m_sample_rtc, NRF_RTC_EVENT_COMPARE_0),
+        nrfx_saadc_sample_task_get());
     APP_ERROR_CHECK(err_code);
+
+    err_code = nrfx_ppi_channel_fork_assign(
+        m_sample_ppi_channel,
+        nrfx_rtc_task_address_get(&m_sample_rtc, NRF_RTC_TASK_CLEAR));
+    APP_ERROR_CHECK(err_code);
+
+    err_code = nrfx_ppi_channel_enable(m_sample_ppi_channel);
+    APP_ERROR_CHECK(err_code);
+
+    // Enabled only while waiting for motion
+    err_code = nrfx_ppi_channel_alloc(&m_restart_ppi_channel);
+    APP_ERROR_CHECK(err_code);
+
+    err_code = nrfx_ppi_channel_assign(
+        m_restart_ppi_channel,
+        nrf_saadc_event_address_get(NRF_SAADC_EVENT_END),
+        nrf_saadc_task_address_get(NRF_SAADC_TASK_START));
+    APP_ERROR_CHECK(err_code);
+
+    nrfx_rtc_enable(&m_sample_rtc);
+}
+#endif
+
+/**
+ * @brief Arm LPCOMP on the steering input to wake from system off
+ *
+ * @details The reference is the sixteenth of VDD closest to where the stick
+ * rests, but not within LPCOMP_MIN_DISTANCE of it. Turning the bars across
+ * it either way wakes the chip.
+ */
+static void lpcomp_wake_arm(void)
+{
+    nrf_lpcomp_config_t config;
+    int32_t             step;
+    int32_t             distance;
+
+    step = (sample + LPCOMP_STEP / 2) / LPCOMP_STEP;
+    step = MAX(step, 1);
+    step = MIN(step, 15);
+    distance = sample - step * LPCOMP_STEP;
+    if (distance > -LPCOMP_MIN_DISTANCE && distance < LPCOMP_MIN_DISTANCE)
+    {
+        step += ((distance > 0 && step > 1) || step == 15) ? -1 : 1;
+    }
+
+    // REFSEL lists the eighths first, then the odd sixteenths
+    if (step & 1)
+    {
+        config.reference =
+            (nrf_lpcomp_ref_t)(LPCOMP_REFSEL_REFSEL_Ref1_16 + step / 2);
+    }
+    else
+    {
+        config.reference =
+            (nrf_lpcomp_ref_t)(LPCOMP_REFSEL_REFSEL_Ref1_8 + step / 2 - 1);
+    }
+    config.detection = NRF_LPCOMP_DETECT_CROSS;
+#ifdef LPCOMP_FEATURE_HYST_PRESENT
+    config.hyst = NRF_LPCOMP_HYST_50mV;
+#endif
+
+    nrf_lpcomp_configure(&config);
+    nrf_lpcomp_input_select(STEERER_LPCOMP_INPUT);
+    nrf_lpcomp_enable();
+    nrf_lpcomp_task_trigger(NRF_LPCOMP_TASK_START);
+    while (!nrf_lpcomp_event_check(NRF_LPCOMP_EVENT_READY))
+    {
+        // Takes a few microseconds
+    }
+    nrf_lpcomp_event_clear(NRF_LPCOMP_EVENT_CROSS);
+
+    NRF_LOG_INFO("Wake on stick at %d/16 VDD", step);
 }
 
-void steering_init(void)
+void steering_init(steering_sample_handler_t sample_handler)
 {
     NRF_LOG_INFO("steer init");
     ret_code_t          err_code;
     nrfx_saadc_config_t saadc_config = {
         .resolution = (nrf_saadc_resolution_t)NRF_SAADC_RESOLUTION_14BIT,
-        .oversample = (nrf_saadc_oversample_t)NRFX_SAADC_CONFIG_OVERSAMPLE,
+        .oversample = (nrf_saadc_oversample_t)SAMPLE_OVERSAMPLE,
         .interrupt_priority = NRFX_SAADC_CONFIG_IRQ_PRIORITY,
         .low_power_mode = NRFX_SAADC_CONFIG_LP_MODE};
 
@@ -91,19 +510,31 @@ void steering_init(void)
     channel_config_steer.gain =
         NRF_SAADC_GAIN1_5;  // this is measured against either vdd/4 or vcore =
                             // 0.6v.
+    // One SAMPLE task runs the whole oversampling sequence
+    channel_config_steer.burst = NRF_SAADC_BURST_ENABLED;
 
-    nrfx_saadc_channel_init(0, &channel_config_steer);
+    err_code = nrfx_saadc_channel_init(0, &channel_config_steer);
     APP_ERROR_CHECK(err_code);
 
-    err_code = nrfx_saadc_buffer_convert(&m_buffer_pool[0], 1);
-    APP_ERROR_CHECK(err_code);
+#if STEER_FIR
+    steer_fir_init(&m_fir);
+#endif
 
-    err_code = app_timer_create(&m_sampling_timer, APP_TIMER_MODE_REPEATED,
-                                sampling_timer_callback);
+    err_code = nrfx_saadc_buffer_convert(m_buffer_pool[0], BUFFER_CONVERSIONS);
     APP_ERROR_CHECK(err_code);
 
-    err_code = app_timer_start(m_sampling_timer, SAMPLING_INTERVAL, NULL);
+    err_code = nrfx_saadc_buffer_convert(m_buffer_pool[1], BUFFER_CONVERSIONS);
     APP_ERROR_CHECK(err_code);
+
+    m_sample_handler = sample_handler;
+    m_sample_rtc_ticks = SAMPLE_RTC_FREQUENCY /
+                         (params_get(PARAM_SAMPLE_RATE) * SAMPLE_CONVERSIONS);
+
+#if STEER_CONN_EVT_SYNC
+    // The application triggers every conversion through steering_convert()
+#else
+    sample_trigger_init();
+#endif
 }
 
 void steering_convert(void)
@@ -114,22 +545,150 @@ void steering_convert(void)
     APP_ERROR_CHECK(err_code);
 }
 
+void steering_wake_on_motion_enter(void)
+{
+#if STEER_CONN_EVT_SYNC
+    // Conversions already follow the connection events, nothing to save
+#else
+    ret_code_t err_code;
+    int16_t    low;
+    int16_t    high;
+
+    if (m_wake_on_motion)
+    {
+        return;
+    }
+
+    // Centre the band on where the stick settled
+    low = (int16_t)MAX(sample - STEER_WAKE_BAND, 0);
+    high = (int16_t)MIN(sample + STEER_WAKE_BAND, MAX_ADC_RESOLUTION - 1);
+
+    // Set first, the driver may report a DONE while it is being stopped
+    m_wake_on_motion = true;
+    nrfx_saadc_abort();
+
+#if STEER_FIR
+    // Back to one averaged burst per steering sample until the stick moves
+    nrf_saadc_oversample_set((nrf_saadc_oversample_t)WAKE_OVERSAMPLE);
+    sample_trigger_period_set(SAMPLE_RTC_FREQUENCY /
+                              params_get(PARAM_SAMPLE_RATE));
+#endif
+
+    // RTC2 keeps triggering SAMPLE, every END re-arms the same one word
+    // buffer through PPI and only a crossed limit interrupts
+    nrf_saadc_int_disable(NRF_SAADC_INT_END);
+    nrf_saadc_event_clear(NRF_SAADC_EVENT_END);
+    nrf_saadc_buffer_init(&m_wake_result, 1);
+    nrfx_saadc_limits_set(0, low, high);
+
+    err_code = nrfx_ppi_channel_enable(m_restart_ppi_channel);
+    APP_ERROR_CHECK(err_code);
+
+    nrf_saadc_task_trigger(NRF_SAADC_TASK_START);
+
+    TRACE(TRACE_EVT_MOTION_WAIT, low, high);
+#endif
+}
+
+bool steering_wake_on_motion_active(void) { return m_wake_on_motion; }
+
+void steering_sleep_prepare(void)
+{
+#if !STEER_CONN_EVT_SYNC
+    ret_code_t err_code;
+
+    nrfx_rtc_disable(&m_sample_rtc);
+    err_code = nrfx_ppi_channel_disable(m_sample_ppi_channel);
+    APP_ERROR_CHECK(err_code);
+    err_code = nrfx_ppi_channel_disable(m_restart_ppi_channel);
+    APP_ERROR_CHECK(err_code);
+#endif
+    // Anything the driver still reports is dropped
+    m_wake_on_motion = true;
+    nrfx_saadc_uninit();
+
+    calibration_retain();
+    lpcomp_wake_arm();
+}
+
+void steering_sample_rate_set(uint16_t rate_hz)
+{
+#if STEER_CONN_EVT_SYNC
+    UNUSED_PARAMETER(rate_hz);
+#else
+    m_sample_rtc_ticks = SAMPLE_RTC_FREQUENCY / (rate_hz * SAMPLE_CONVERSIONS);
+
+    // Waiting for motion runs bursts at the steering rate, exiting picks the
+    // new period up. Not while the SAADC interrupt exits the wait.
+    CRITICAL_REGION_ENTER();
+    sample_trigger_period_set(m_wake_on_motion
+                                  ? SAMPLE_RTC_FREQUENCY / rate_hz
+                                  : m_sample_rtc_ticks);
+    CRITICAL_REGION_EXIT();
+#endif
+}
+
+uint32_t get_sample_timestamp(void) { return m_sample_timestamp; }
+
+uint32_t get_sample_count(void) { return m_sample_count; }
+
 void steering_display_value(void) { NRF_LOG_INFO("read: %d, ", sample); }
 
-//
-float get_angle(void)
+int16_t get_code_angle(int16_t raw_code)
+{
+    int32_t code = calibration_map(raw_code);
+    int32_t max_angle = params_get(PARAM_MAX_STEER_ANGLE);
+    int32_t dead_band = params_get(PARAM_DEAD_BAND);
+    int32_t angle;
+
+    if (code < 0)
+    {
+        code = 0;
+    }
+    else if (code > MAX_ADC_RESOLUTION - 1)
+    {
+        code = MAX_ADC_RESOLUTION - 1;
+    }
+
+    angle = steer_angle_lut[code];
+    if (max_angle != MAX_STEER_ANGLE * STEER_ANGLE_SCALE)
+    {
+        // The table is built for MAX_STEER_ANGLE
+        angle = (angle * max_angle) / (MAX_STEER_ANGLE * STEER_ANGLE_SCALE);
+    }
+    if (angle < dead_band && angle > -dead_band)
+    {
+        return 0;
+    }
+
+    return (int16_t)angle;
+}
+
+int16_t get_angle(void) { return get_code_angle(sample); }
+
+int16_t get_predicted_angle(uint32_t on_air)
 {
-    float steering_angle = 0;
+    uint32_t horizon;
+    int32_t  code;
 
-    steering_angle =
-        (((m_buffer_pool[0] + zero_offset) / (float)MAX_ADC_RESOLUTION) *
-         (MAX_STEER_ANGLE * 2)) -
-        MAX_STEER_ANGLE;
+    if (!m_predict.initialised)
+    {
+        return get_angle();
+    }
 
-    if (fabsf(steering_angle) < ZERO_FLOOR)
+    horizon = app_timer_cnt_diff_compute(on_air, m_predict.timestamp);
+    if (horizon > (RTC_COUNTER_COUNTER_Msk >> 1))
     {
-        steering_angle = 0;
+        // Before the sample, the counter only looks like it wrapped
+        horizon = 0;
     }
+    horizon = (horizon * params_get(PARAM_PREDICT_LEAD)) / 100;
+    horizon = MIN(horizon, APP_TIMER_TICKS(params_get(PARAM_PREDICT_MAX)));
+
+    // Past an end stop the calibration maps it to full lock, no further
+    code = steer_predict_extrapolate(&m_predict, horizon);
+    code = MAX(code, INT16_MIN);
+    code = MIN(code, INT16_MAX);
 
-    return steering_angle;
+    return get_code_angle((int16_t)code);
 }
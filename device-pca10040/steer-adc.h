@@ -10,28 +10,167 @@
 #define STEERING_H
 
 #include <inttypes.h>
-#include <math.h>
+#include <stdbool.h>
 #include <stdint.h>
 
 #include "app_error.h"
 #include "nrfx_saadc.h"
 
+// Max amount of turn allowed, steer-angle-lut.h is built for it and
+// PARAM_MAX_STEER_ANGLE scales from there
+#define MAX_STEER_ANGLE (35)
+
+// used to make sure we don't move around when we're close to center of
+// joystick, default of PARAM_DEAD_BAND
+#define ZERO_FLOOR 1
+
+// 14 bits
+#define MAX_ADC_RESOLUTION 16384
+
+// Angles are passed around in hundredths of a degree
+#define STEER_ANGLE_SCALE 100
+
+// Set to 1 to take one conversion right before each connection event instead
+// of sampling continuously
+#ifndef STEER_CONN_EVT_SYNC
+#define STEER_CONN_EVT_SYNC 0
+#endif
+
+// Set to 0 to have the SAADC average bursts of 2^NRFX_SAADC_CONFIG_OVERSAMPLE
+// conversions instead of filtering single ones with steer-fir.c. Not used
+// with STEER_CONN_EVT_SYNC.
+#ifndef STEER_FIR_ENABLED
+#define STEER_FIR_ENABLED 1
+#endif
+
+// Half width of the band around the resting position, in ADC codes, while
+// waiting for motion. About 0.2 degrees, below the smallest change that is
+// notified right away. Sized for bursts averaged by the SAADC, a single
+// conversion is too noisy for it.
+#define STEER_WAKE_BAND 48
+
 #ifdef __cplusplus
 extern "C"
 {
 #endif
+    /**
+     * @brief Called from the SAADC interrupt whenever a new sample has been
+     * queued, the application should call steering_process() from main
+     * context in response
+     *
+     */
+    typedef void (*steering_sample_handler_t)(void);
+
     /**
      * @brief Init the steer module
      *
+     * @param sample_handler optional handler for new samples, may be NULL
+     */
+    void steering_init(steering_sample_handler_t sample_handler);
+
+    /**
+     * @brief Filter the samples queued by the SAADC interrupt, must be called
+     * from main context
+     *
+     * @return true if the angle was updated
+     */
+    bool steering_process(void);
+
+    /**
+     * @brief Start a single conversion outside of the sampling schedule
+     *
+     */
+    void steering_convert(void);
+
+    /**
+     * @brief Stop waking up for every buffer until the stick moves
+     *
+     * @details The SAADC keeps sampling through PPI with limits set
+     * STEER_WAKE_BAND around the current position, one oversampled burst
+     * per PARAM_SAMPLE_RATE period also with STEER_FIR_ENABLED. The first
+     * conversion outside the band is queued as a sample and full rate
+     * streaming resumes, call again once the stick is still to re-centre the
+     * band. Main context only, does nothing with STEER_CONN_EVT_SYNC.
+     *
+     */
+    void steering_wake_on_motion_enter(void);
+
+    /**
+     * @brief Check if the sampler is waiting for motion
+     *
+     * @return true between steering_wake_on_motion_enter() and the next limit
+     * event
+     */
+    bool steering_wake_on_motion_active(void);
+
+    /**
+     * @brief Stop sampling and arm the wake up from system off
+     *
+     * @details Keeps the calibration in RAM for the next boot and arms LPCOMP
+     * on the steering input, so turning the bars wakes the chip. Call right
+     * before sd_power_system_off().
+     *
+     */
+    void steering_sleep_prepare(void);
+
+    /**
+     * @brief Change the sampling rate without stopping the sampler
+     *
+     * @details Main context only, does nothing with STEER_CONN_EVT_SYNC.
+     *
+     * @param rate_hz oversampled bursts per second, or eighths of a
+     * decimator block with STEER_FIR_ENABLED, within the PARAM_SAMPLE_RATE
+     * range
+     */
+    void steering_sample_rate_set(uint16_t rate_hz);
+
+    /**
+     * @brief Get the time of the latest sample
+     *
+     * @return app_timer tick count when the latest sample was captured, the
+     * middle of the averaged buffer or of the decimator's taps
      */
-    void steering_init(void);
+    uint32_t get_sample_timestamp(void);
+
+    /**
+     * @brief Get the number of ADC samples taken since boot
+     *
+     * @return conversions, each one a full oversampled burst or a single
+     * one with STEER_FIR_ENABLED
+     */
+    uint32_t get_sample_count(void);
 
     /**
      * @brief Get the angle of the joystick
      *
-     * @return float angle of joystick
+     * @details Scaled to PARAM_MAX_STEER_ANGLE at full lock, 0 within
+     * PARAM_DEAD_BAND of the centre.
+     *
+     * @return angle of joystick in hundredths of a degree
+     */
+    int16_t get_angle(void);
+
+    /**
+     * @brief Get the angle the joystick will be at when a notification goes
+     * on air
+     *
+     * @details Extrapolated from the speed of the recent samples by
+     * PARAM_PREDICT_LEAD percent of the time from the latest sample to
+     * on_air, at most PARAM_PREDICT_MAX. Stops at full lock like
+     * get_angle(). Main context only.
+     *
+     * @param on_air app_timer tick count of the connection event
+     * @return angle of joystick in hundredths of a degree
+     */
+    int16_t get_predicted_angle(uint32_t on_air);
+
+    /**
+     * @brief Get the angle an ADC code maps to with the current calibration
+     *
+     * @param raw_code ADC code as sampled
+     * @return angle in hundredths of a degree, as get_angle() would give it
      */
-    float get_angle(void);
+    int16_t get_code_angle(int16_t raw_code);
 
 #ifdef __cplusplus
 }
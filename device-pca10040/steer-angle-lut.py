@@ -0,0 +1,72 @@
+#!/usr/bin/env python3
+"""Generate steer-angle-lut.h from the steering constants in steer-adc.h.
+
+Usage: steer-angle-lut.py <steer-adc.h> <steer-angle-lut.h>
+
+Every ADC code on the calibrated scale maps to an angle in hundredths of a
+degree. The dead band and the configured full lock are applied at run time.
+"""
+import re
+import sys
+
+ENTRIES_PER_LINE = 10
+
+
+def read_define(header, name):
+    match = re.search(r"#define\s+%s\s+\(?(\d+)\)?" % name, header)
+    if match is None:
+        raise SystemExit("%s not found" % name)
+    return int(match.group(1))
+
+
+def angle_cdeg(code, max_angle, resolution, scale):
+    # Same line as the float formula, scaled up so it stays exact:
+    # ((code / resolution) * (max_angle * 2)) - max_angle
+    num = code * max_angle * 2 * scale - max_angle * scale * resolution
+    # Round half away from zero
+    if num >= 0:
+        return (2 * num + resolution) // (2 * resolution)
+    return -((-2 * num + resolution) // (2 * resolution))
+
+
+def main():
+    with open(sys.argv[1], 'r') as f:
+        header = f.read()
+
+    max_angle = read_define(header, 'MAX_STEER_ANGLE')
+    resolution = read_define(header, 'MAX_ADC_RESOLUTION')
+    scale = read_define(header, 'STEER_ANGLE_SCALE')
+
+    values = [angle_cdeg(code, max_angle, resolution, scale)
+              for code in range(resolution)]
+
+    lines = [
+        '/* Generated by steer-angle-lut.py from steer-adc.h, do not edit. */',
+        '',
+        '#ifndef STEER_ANGLE_LUT_H',
+        '#define STEER_ANGLE_LUT_H',
+        '',
+        '#include <stdint.h>',
+        '',
+        '#define STEER_ANGLE_LUT_MAX_STEER_ANGLE %d' % max_angle,
+        '#define STEER_ANGLE_LUT_MAX_ADC_RESOLUTION %d' % resolution,
+        '#define STEER_ANGLE_LUT_SCALE %d' % scale,
+        '',
+        'static const int16_t steer_angle_lut[%d] = {' % resolution,
+    ]
+    for i in range(0, resolution, ENTRIES_PER_LINE):
+        chunk = values[i:i + ENTRIES_PER_LINE]
+        lines.append('    ' + ', '.join('%d' % v for v in chunk) + ',')
+    lines += [
+        '};',
+        '',
+        '#endif  // STEER_ANGLE_LUT_H',
+        '',
+    ]
+
+    with open(sys.argv[2], 'w') as f:
+        f.write('\n'.join(lines))
+
+
+if __name__ == "__main__":
+    main()
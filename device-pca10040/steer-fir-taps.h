@@ -0,0 +1,42 @@
+/* Generated by steer-fir-taps.py from steer-fir.h, do not edit. */
+
+#ifndef STEER_FIR_TAPS_H
+#define STEER_FIR_TAPS_H
+
+#include <stdint.h>
+
+#define STEER_FIR_TAPS_DECIMATION 64
+#define STEER_FIR_TAPS_BLOCKS_MAX 2
+#define STEER_FIR_TAPS_CUTOFF 32
+
+#if STEER_FIR_BLOCKS == 1
+static const int16_t steer_fir_taps[64] = {
+    2, 8, 19, 33, 52, 75, 102, 133, 167, 205,
+    245, 289, 334, 382, 431, 481, 531, 582, 632, 681,
+    728, 774, 816, 857, 893, 926, 955, 980, 1000, 1015,
+    1025, 1031, 1031, 1025, 1015, 1000, 980, 955, 926, 893,
+    857, 816, 774, 728, 681, 632, 582, 531, 481, 431,
+    382, 334, 289, 245, 205, 167, 133, 102, 75, 52,
+    33, 19, 8, 2,
+};
+#elif STEER_FIR_BLOCKS == 2
+static const int16_t steer_fir_taps[128] = {
+    0, 1, 1, 3, 4, 6, 9, 11, 15, 19,
+    23, 28, 33, 39, 45, 52, 60, 68, 77, 86,
+    95, 105, 116, 127, 138, 150, 162, 175, 188, 201,
+    215, 229, 243, 257, 271, 286, 300, 314, 329, 343,
+    357, 371, 385, 398, 412, 425, 437, 449, 461, 472,
+    482, 492, 501, 510, 518, 525, 531, 537, 542, 546,
+    549, 552, 554, 554, 554, 554, 552, 549, 546, 542,
+    537, 531, 525, 518, 510, 501, 492, 482, 472, 461,
+    449, 437, 425, 412, 398, 385, 371, 357, 343, 329,
+    314, 300, 286, 271, 257, 243, 229, 215, 201, 188,
+    175, 162, 150, 138, 127, 116, 105, 95, 86, 77,
+    68, 60, 52, 45, 39, 33, 28, 23, 19, 15,
+    11, 9, 6, 4, 3, 1, 1, 0,
+};
+#else
+#error "No taps for STEER_FIR_BLOCKS, see STEER_FIR_BLOCKS_MAX"
+#endif
+
+#endif  // STEER_FIR_TAPS_H
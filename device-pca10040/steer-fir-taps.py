@@ -0,0 +1,114 @@
+#!/usr/bin/env python3
+"""Generate steer-fir-taps.h from the decimator constants in steer-fir.h.
+
+Usage: steer-fir-taps.py <steer-fir.h> <steer-fir-taps.h>
+
+A Hann windowed sinc low pass, the cutoff relative to the output rate so the
+response follows PARAM_SAMPLE_RATE. The taps are Q15, oldest sample first,
+and add up to exactly 1.0 so a still stick reads the same code. There is a
+table for every length up to STEER_FIR_BLOCKS_MAX blocks, STEER_FIR_BLOCKS
+picks one at compile time.
+"""
+import math
+import re
+import sys
+
+ENTRIES_PER_LINE = 10
+Q15 = 1 << 15
+# Largest SAADC code magnitude, 14 bit
+MAX_CODE = 1 << 14
+
+
+def read_define(header, name):
+    match = re.search(r"#define\s+%s\s+\(?(\d+)\)?" % name, header)
+    if match is None:
+        raise SystemExit("%s not found" % name)
+    return int(match.group(1))
+
+
+def design(taps, decimation, cutoff):
+    # Cycles per input sample
+    fc = cutoff / 100.0 / decimation
+    values = []
+    for n in range(taps):
+        m = n - (taps - 1) / 2.0
+        if m == 0:
+            ideal = 2 * fc
+        else:
+            ideal = math.sin(2 * math.pi * fc * m) / (math.pi * m)
+        window = 0.5 - 0.5 * math.cos(2 * math.pi * (n + 1) / (taps + 1))
+        values.append(ideal * window)
+    total = sum(values)
+    exact = [v * Q15 / total for v in values]
+    q15 = [int(math.floor(v)) for v in exact]
+
+    # Hand out what flooring lost to the largest remainders, a symmetric pair
+    # at a time so the delay stays exactly half the length
+    order = sorted(range((taps + 1) // 2),
+                   key=lambda n: exact[n] - q15[n], reverse=True)
+    error = Q15 - sum(q15)
+    for n in order:
+        pair = n != taps - 1 - n
+        if error < (2 if pair else 1):
+            continue
+        q15[n] += 1
+        if pair:
+            q15[taps - 1 - n] += 1
+        error -= 2 if pair else 1
+    if error != 0:
+        raise SystemExit('taps do not add up to 1.0, %d left' % error)
+    return q15
+
+
+def main():
+    with open(sys.argv[1], 'r') as f:
+        header = f.read()
+
+    decimation = read_define(header, 'STEER_FIR_DECIMATION')
+    blocks_max = read_define(header, 'STEER_FIR_BLOCKS_MAX')
+    cutoff = read_define(header, 'STEER_FIR_CUTOFF')
+
+    lines = [
+        '/* Generated by steer-fir-taps.py from steer-fir.h, do not edit. */',
+        '',
+        '#ifndef STEER_FIR_TAPS_H',
+        '#define STEER_FIR_TAPS_H',
+        '',
+        '#include <stdint.h>',
+        '',
+        '#define STEER_FIR_TAPS_DECIMATION %d' % decimation,
+        '#define STEER_FIR_TAPS_BLOCKS_MAX %d' % blocks_max,
+        '#define STEER_FIR_TAPS_CUTOFF %d' % cutoff,
+        '',
+    ]
+    for blocks in range(1, blocks_max + 1):
+        taps = decimation * blocks
+        values = design(taps, decimation, cutoff)
+        # The decimator sums in 32 bits
+        if sum(abs(v) for v in values) * MAX_CODE >= 1 << 31:
+            raise SystemExit('taps too large for a 32 bit sum')
+
+        lines += [
+            '#%s STEER_FIR_BLOCKS == %d' % ('if' if blocks == 1 else 'elif',
+                                            blocks),
+            'static const int16_t steer_fir_taps[%d] = {' % taps,
+        ]
+        for i in range(0, taps, ENTRIES_PER_LINE):
+            chunk = values[i:i + ENTRIES_PER_LINE]
+            lines.append('    ' + ', '.join('%d' % v for v in chunk) + ',')
+        lines.append('};')
+    lines += [
+        '#else',
+        '#error "No taps for STEER_FIR_BLOCKS, see STEER_FIR_BLOCKS_MAX"',
+        '#endif',
+        '',
+        '#endif  // STEER_FIR_TAPS_H',
+        '',
+    ]
+
+    with open(sys.argv[2], 'w') as f:
+        f.write('\n'.join(lines))
+
+
+if __name__ == "__main__":
+    main()
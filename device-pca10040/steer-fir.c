@@ -0,0 +1,141 @@
+/**
+ * Copyright (c) 2018 Keith Wakeham
+ *
+ * All rights reserved.
+ *
+ *
+ */
+
+#include "steer-fir.h"
+
+#include <string.h>
+
+#include "app_util.h"
+#include "nrf.h"
+#include "steer-fir-taps.h"
+
+// Catch taps that were not regenerated after a constant changed
+STATIC_ASSERT(STEER_FIR_TAPS_DECIMATION == STEER_FIR_DECIMATION);
+STATIC_ASSERT(STEER_FIR_TAPS_BLOCKS_MAX == STEER_FIR_BLOCKS_MAX);
+STATIC_ASSERT(ARRAY_SIZE(steer_fir_taps) == STEER_FIR_TAPS);
+STATIC_ASSERT(STEER_FIR_TAPS_CUTOFF == STEER_FIR_CUTOFF);
+STATIC_ASSERT((STEER_FIR_DECIMATION % 2) == 0);
+
+// Output = sum of taps * input in Q15, rounded
+#define STEER_FIR_SHIFT 15
+#define STEER_FIR_ROUND (1L << (STEER_FIR_SHIFT - 1))
+
+/**
+ * @brief Two neighbouring int16 as one word for SMLAD, the first one in the
+ * low half
+ *
+ * @details Neither the DMA buffers nor the taps are word aligned for sure,
+ * memcpy becomes a single LDR, which takes unaligned addresses.
+ */
+static inline uint32_t read_q15x2(int16_t const *p_value)
+{
+    uint32_t value;
+
+    memcpy(&value, p_value, sizeof(value));
+    return value;
+}
+
+void steer_fir_init(steer_fir_t *p_fir)
+{
+    memset(p_fir, 0, sizeof(*p_fir));
+}
+
+/**
+ * @brief Add one block to every output it is part of
+ *
+ * @details The block is the newest one of the output due now and one block
+ * older for each of the following ones, each uses a different segment of the
+ * taps. Every input pair is loaded once for all of them.
+ *
+ * @return the output due now
+ */
+static int32_t fir_block(steer_fir_t *p_fir, int16_t const *p_block)
+{
+    int32_t acc[STEER_FIR_BLOCKS];
+    int32_t out;
+
+    memcpy(acc, p_fir->acc, sizeof(acc));
+
+    for (uint32_t i = 0; i < STEER_FIR_DECIMATION; i += 2)
+    {
+        uint32_t x = read_q15x2(&p_block[i]);
+
+        for (uint32_t due = 0; due < STEER_FIR_BLOCKS; due++)
+        {
+            int16_t const *p_taps =
+                &steer_fir_taps[(STEER_FIR_BLOCKS - 1 - due) *
+                                STEER_FIR_DECIMATION];
+
+            acc[due] = (int32_t)__SMLAD(x, read_q15x2(&p_taps[i]),
+                                        (uint32_t)acc[due]);
+        }
+    }
+
+    out = acc[0];
+    for (uint32_t due = 1; due < STEER_FIR_BLOCKS; due++)
+    {
+        p_fir->acc[due - 1] = acc[due];
+    }
+    p_fir->acc[STEER_FIR_BLOCKS - 1] = 0;
+
+    return out;
+}
+
+int16_t steer_fir_decimate(steer_fir_t *p_fir, int16_t const *p_block)
+{
+    int32_t out;
+
+    if (!p_fir->primed)
+    {
+        // Stand in for the blocks before the first one
+        for (uint32_t i = 1; i < STEER_FIR_BLOCKS; i++)
+        {
+            UNUSED_RETURN_VALUE(fir_block(p_fir, p_block));
+        }
+        p_fir->primed = true;
+    }
+    out = fir_block(p_fir, p_block);
+
+    return (int16_t)((out + STEER_FIR_ROUND) >> STEER_FIR_SHIFT);
+}
+
+void steer_fir_reference_init(steer_fir_reference_t *p_fir)
+{
+    memset(p_fir, 0, sizeof(*p_fir));
+}
+
+int16_t steer_fir_reference_decimate(steer_fir_reference_t *p_fir,
+                                     int16_t const *        p_block)
+{
+    int32_t acc = 0;
+
+    if (!p_fir->primed)
+    {
+        for (uint32_t i = 0; i < STEER_FIR_TAPS; i += STEER_FIR_DECIMATION)
+        {
+            memcpy(&p_fir->history[i], p_block,
+                   STEER_FIR_DECIMATION * sizeof(p_block[0]));
+        }
+        p_fir->primed = true;
+    }
+    else
+    {
+        memmove(&p_fir->history[0], &p_fir->history[STEER_FIR_DECIMATION],
+                (STEER_FIR_TAPS - STEER_FIR_DECIMATION) *
+                    sizeof(p_fir->history[0]));
+        memcpy(&p_fir->history[STEER_FIR_TAPS - STEER_FIR_DECIMATION], p_block,
+               STEER_FIR_DECIMATION * sizeof(p_block[0]));
+    }
+
+    for (uint32_t i = 0; i < STEER_FIR_TAPS; i++)
+    {
+        acc += (int32_t)steer_fir_taps[i] * p_fir->history[i];
+    }
+
+    return (int16_t)((acc + STEER_FIR_ROUND) >> STEER_FIR_SHIFT);
+}
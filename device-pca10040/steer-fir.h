@@ -0,0 +1,100 @@
+/**
+ * Copyright (c) 2018 Keith Wakeham
+ *
+ * All rights reserved.
+ *
+ *
+ */
+
+#ifndef STEER_FIR_H
+#define STEER_FIR_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Conversions filtered into one steering sample, one DMA block. Even, they
+// are read in pairs.
+#define STEER_FIR_DECIMATION 64
+
+// Length of the filter in blocks. Its delay is half of it, the stopband gets
+// better with every block. One block delays by half a block, 20 ms at the
+// default PARAM_SAMPLE_RATE, two by a whole one. Set to 2 for the steeper
+// filter.
+#ifndef STEER_FIR_BLOCKS
+#define STEER_FIR_BLOCKS 1
+#endif
+
+// Longest filter steer-fir-taps.py designs taps for
+#define STEER_FIR_BLOCKS_MAX 2
+
+#define STEER_FIR_TAPS (STEER_FIR_DECIMATION * STEER_FIR_BLOCKS)
+
+// Passband edge in percent of the output rate, steer-fir-taps.py designs the
+// taps from it
+#define STEER_FIR_CUTOFF 32
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+    /**
+     * @brief Decimator state, the sums of the outputs still waiting for
+     * blocks
+     *
+     */
+    typedef struct
+    {
+        int32_t acc[STEER_FIR_BLOCKS];
+        bool    primed;
+    } steer_fir_t;
+
+    /**
+     * @brief State of the scalar reference, the input it still needs
+     *
+     */
+    typedef struct
+    {
+        int16_t history[STEER_FIR_TAPS];
+        bool    primed;
+    } steer_fir_reference_t;
+
+    /**
+     * @brief Forget the input so far
+     *
+     * @details The next block is taken to have been there for the whole
+     * length of the filter, so the first output is not pulled towards 0.
+     */
+    void steer_fir_init(steer_fir_t *p_fir);
+
+    /**
+     * @brief Filter a block and decimate it to one output
+     *
+     * @details Two taps per SMLAD. Taps and input are 14 bit codes at most,
+     * the 32 bit sums cannot overflow.
+     *
+     * @param p_block STEER_FIR_DECIMATION conversions, oldest first
+     * @return the filtered code at the end of the block, delayed by half the
+     * length of the filter
+     */
+    int16_t steer_fir_decimate(steer_fir_t *p_fir, int16_t const *p_block);
+
+    /**
+     * @brief Same as steer_fir_init() for the reference
+     *
+     */
+    void steer_fir_reference_init(steer_fir_reference_t *p_fir);
+
+    /**
+     * @brief Plain convolution over the history, one tap at a time
+     *
+     * @details Gives the same output as steer_fir_decimate() for the same
+     * input, the host checks the two against each other.
+     */
+    int16_t steer_fir_reference_decimate(steer_fir_reference_t *p_fir,
+                                         int16_t const *        p_block);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // STEER_FIR_H
@@ -0,0 +1,57 @@
+/**
+ * Copyright (c) 2018 Keith Wakeham
+ *
+ * All rights reserved.
+ *
+ *
+ */
+
+#include "steer-predict.h"
+
+#include <string.h>
+
+#include "app_timer.h"
+#include "app_util.h"
+
+void steer_predict_init(steer_predict_t *p_predict)
+{
+    memset(p_predict, 0, sizeof(*p_predict));
+}
+
+void steer_predict_update(steer_predict_t *p_predict, int16_t code,
+                          uint32_t timestamp)
+{
+    int32_t  z_q8 = (int32_t)code << 8;
+    int32_t  r_q8;
+    uint32_t dt;
+
+    dt = app_timer_cnt_diff_compute(timestamp, p_predict->timestamp);
+    if (!p_predict->initialised || dt > STEER_PREDICT_MAX_GAP)
+    {
+        p_predict->initialised = true;
+        p_predict->x_q8 = z_q8;
+        p_predict->v_q16 = 0;
+        p_predict->timestamp = timestamp;
+        return;
+    }
+    dt = MAX(dt, 1);
+    p_predict->timestamp = timestamp;
+
+    // Predict to this sample, then pull position and speed towards it
+    p_predict->x_q8 += (int32_t)(((int64_t)p_predict->v_q16 * dt) >> 8);
+    r_q8 = z_q8 - p_predict->x_q8;
+    p_predict->x_q8 +=
+        (int32_t)(((int64_t)r_q8 * STEER_PREDICT_ALPHA_Q15) >> 15);
+    p_predict->v_q16 += (int32_t)((((int64_t)r_q8 * STEER_PREDICT_BETA_Q15) >>
+                                   7) /
+                                  (int32_t)dt);
+}
+
+int32_t steer_predict_extrapolate(steer_predict_t const *p_predict,
+                                  uint32_t               horizon)
+{
+    int64_t x_q8 = p_predict->x_q8 +
+                   (((int64_t)p_predict->v_q16 * horizon) >> 8);
+
+    return (int32_t)((x_q8 + 128) >> 8);
+}
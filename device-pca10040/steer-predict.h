@@ -0,0 +1,71 @@
+/**
+ * Copyright (c) 2018 Keith Wakeham
+ *
+ * All rights reserved.
+ *
+ *
+ */
+
+#ifndef STEER_PREDICT_H
+#define STEER_PREDICT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Alpha-beta tracker gains in Q15. The decimator already took the noise out,
+// the position follows the samples closely and the speed settles within two
+// or three. host/replay.c scores other gains against recorded turns.
+#define STEER_PREDICT_ALPHA_Q15 29491 // 0.9
+#define STEER_PREDICT_BETA_Q15 24129  // alpha^2 / (2 - alpha)
+
+// A gap between samples longer than this, in app_timer ticks, starts over
+// from standstill. Longer than the slowest sample rate gives, waiting for
+// motion stops the samples for seconds.
+#define STEER_PREDICT_MAX_GAP 32768 // 1 s
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+    /**
+     * @brief Position and speed of the stick as of the latest sample
+     *
+     */
+    typedef struct
+    {
+        bool     initialised;
+        int32_t  x_q8;      // ADC code
+        int32_t  v_q16;     // ADC codes per app_timer tick
+        uint32_t timestamp; // app_timer ticks of the latest sample
+    } steer_predict_t;
+
+    /**
+     * @brief Forget the stick, the next sample is taken as standing still
+     *
+     */
+    void steer_predict_init(steer_predict_t *p_predict);
+
+    /**
+     * @brief Track one sample
+     *
+     * @param code filtered ADC code
+     * @param timestamp app_timer ticks when it was captured, not before the
+     * previous one
+     */
+    void steer_predict_update(steer_predict_t *p_predict, int16_t code,
+                              uint32_t timestamp);
+
+    /**
+     * @brief Where the stick will be if it keeps its speed
+     *
+     * @param horizon app_timer ticks after the latest sample
+     * @return ADC code, not clamped to the ADC range
+     */
+    int32_t steer_predict_extrapolate(steer_predict_t const *p_predict,
+                                      uint32_t               horizon);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // STEER_PREDICT_H
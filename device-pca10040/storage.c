@@ -0,0 +1,429 @@
+/**
+ * Copyright (c) 2018 Keith Wakeham
+ *
+ * All rights reserved.
+ *
+ *
+ */
+
+#include "storage.h"
+#include <string.h>
+#include "app_error.h"
+#include "app_scheduler.h"
+#include "app_timer.h"
+#include "app_util.h"
+#include "app_util_platform.h"
+#include "fds.h"
+#include "latency.h"
+#include "nrf_atomic.h"
+#include "nrf_log.h"
+#include "trace.h"
+
+// Writes up to this many words take well below a millisecond and go out even
+// while held back, the SoftDevice fits each flash operation between radio
+// events. Page erases do not fit at short connection intervals.
+#define SMALL_WRITE_WORDS 4
+
+// Records waiting for the flash, one per file and key
+#define QUEUE_SIZE 4
+
+// Operation in TRACE_EVT_FLASH
+#define TRACE_OP_WRITE 1
+#define TRACE_OP_GC 2
+
+/**
+ * @brief A record waiting to be written
+ *
+ */
+typedef struct
+{
+    uint16_t    file_id;
+    uint16_t    key;
+    void const *p_data;
+    uint32_t    size;
+    bool        deferred; // counted as held back already
+} job_t;
+
+static struct
+{
+    job_t         queue[QUEUE_SIZE];
+    uint8_t       queued;
+    volatile bool gc_pending;
+    volatile bool hold;
+
+    // One operation is handed to FDS at a time, so it is easy to time
+    volatile bool     in_flight;
+    bool              in_flight_gc;
+    uint32_t          op_start;
+    volatile uint32_t op_end;   // ticks when the last one finished
+    bool              op_ended; // op_end is valid
+
+    storage_idle_handler_t idle_handler;
+    storage_stats_t        stats;
+} m_storage;
+
+static nrf_atomic_flag_t m_drain_scheduled;
+
+static void drain_schedule(void);
+
+static bool file_owned(uint16_t file_id)
+{
+    return file_id == STORAGE_FILE_CALIBRATION ||
+           file_id == STORAGE_FILE_PARAMS;
+}
+
+/**
+ * @brief Hand a record to FDS
+ *
+ */
+static ret_code_t job_issue(job_t const *p_job)
+{
+    fds_record_t      record;
+    fds_record_desc_t desc;
+    fds_find_token_t  token;
+
+    record.file_id = p_job->file_id;
+    record.key = p_job->key;
+    record.data.p_data = p_job->p_data;
+    record.data.length_words = BYTES_TO_WORDS(p_job->size);
+
+    memset(&token, 0, sizeof(token));
+    if (fds_record_find(p_job->file_id, p_job->key, &desc, &token) ==
+        NRF_SUCCESS)
+    {
+        return fds_record_update(&desc, &record);
+    }
+
+    return fds_record_write(NULL, &record);
+}
+
+/**
+ * @brief Start the next operation that may run
+ *
+ * @details Called with interrupts masked, the FDS event of the operation
+ * cannot come in before in_flight is set.
+ *
+ * @return true if the drain has to be scheduled again
+ */
+static bool next_start(void)
+{
+    ret_code_t err_code;
+
+    if (m_storage.gc_pending && !m_storage.hold)
+    {
+        m_storage.in_flight = true;
+        m_storage.in_flight_gc = true;
+        m_storage.op_start = app_timer_cnt_get();
+
+        err_code = fds_gc();
+        if (err_code == NRF_SUCCESS)
+        {
+            m_storage.gc_pending = false;
+            return false;
+        }
+        m_storage.in_flight = false;
+        if (err_code == FDS_ERR_NO_SPACE_IN_QUEUES || err_code == FDS_ERR_BUSY ||
+            err_code == FDS_ERR_NOT_INITIALIZED)
+        {
+            // The next FDS event schedules the drain again
+            return false;
+        }
+        APP_ERROR_CHECK(err_code);
+    }
+
+    for (uint8_t i = 0; i < m_storage.queued; i++)
+    {
+        job_t *p_job = &m_storage.queue[i];
+
+        if (m_storage.hold && BYTES_TO_WORDS(p_job->size) > SMALL_WRITE_WORDS)
+        {
+            if (!p_job->deferred)
+            {
+                p_job->deferred = true;
+                m_storage.stats.deferred++;
+            }
+            continue;
+        }
+
+        m_storage.in_flight = true;
+        m_storage.in_flight_gc = false;
+        m_storage.op_start = app_timer_cnt_get();
+
+        err_code = job_issue(p_job);
+        if (err_code == NRF_SUCCESS)
+        {
+            m_storage.queue[i] = m_storage.queue[--m_storage.queued];
+            return false;
+        }
+        m_storage.in_flight = false;
+        if (err_code == FDS_ERR_NO_SPACE_IN_FLASH)
+        {
+            // Try again after the garbage collection
+            if (!m_storage.gc_pending && m_storage.hold)
+            {
+                m_storage.stats.deferred++;
+            }
+            m_storage.gc_pending = true;
+            return !m_storage.hold;
+        }
+        if (err_code == FDS_ERR_NO_SPACE_IN_QUEUES ||
+            err_code == FDS_ERR_BUSY || err_code == FDS_ERR_NOT_INITIALIZED)
+        {
+            return false;
+        }
+        APP_ERROR_CHECK(err_code);
+    }
+
+    return false;
+}
+
+/**
+ * @brief Start waiting flash work, in main context
+ *
+ */
+static void drain_evt(void *p_event_data, uint16_t event_size)
+{
+    storage_idle_handler_t idle_handler = NULL;
+    bool                   again = false;
+
+    UNUSED_PARAMETER(p_event_data);
+    UNUSED_PARAMETER(event_size);
+
+    // Cleared first so work queued meanwhile schedules again
+    nrf_atomic_flag_clear(&m_drain_scheduled);
+
+    CRITICAL_REGION_ENTER();
+    if (!m_storage.in_flight)
+    {
+        again = next_start();
+    }
+    if (!m_storage.in_flight && !m_storage.gc_pending &&
+        m_storage.queued == 0)
+    {
+        idle_handler = m_storage.idle_handler;
+        m_storage.idle_handler = NULL;
+    }
+    CRITICAL_REGION_EXIT();
+
+    if (again)
+    {
+        drain_schedule();
+    }
+    if (idle_handler != NULL)
+    {
+        idle_handler();
+    }
+}
+
+static void drain_schedule(void)
+{
+    ret_code_t err_code;
+
+    if (!nrf_atomic_flag_set_fetch(&m_drain_scheduled))
+    {
+        err_code = app_sched_event_put(NULL, 0, drain_evt);
+        APP_ERROR_CHECK(err_code);
+    }
+}
+
+/**
+ * @brief Account for the operation that finished
+ *
+ */
+static void op_done(ret_code_t result)
+{
+    uint32_t now = app_timer_cnt_get();
+    uint32_t ticks = app_timer_cnt_diff_compute(now, m_storage.op_start);
+
+    latency_record(LATENCY_FLASH_OP, ticks);
+    TRACE(TRACE_EVT_FLASH, m_storage.in_flight_gc ? TRACE_OP_GC : TRACE_OP_WRITE,
+          MIN(ticks, UINT16_MAX));
+
+    if (result != NRF_SUCCESS)
+    {
+        m_storage.stats.failed++;
+        NRF_LOG_WARNING("Flash operation failed, result %d", result);
+    }
+    else if (m_storage.in_flight_gc)
+    {
+        m_storage.stats.gc_runs++;
+    }
+    else
+    {
+        m_storage.stats.writes++;
+    }
+
+    m_storage.op_end = now;
+    m_storage.op_ended = true;
+    m_storage.in_flight = false;
+}
+
+static void fds_evt_handler(fds_evt_t const *p_evt)
+{
+    switch (p_evt->id)
+    {
+        case FDS_EVT_WRITE:
+        case FDS_EVT_UPDATE:
+            if (m_storage.in_flight && !m_storage.in_flight_gc &&
+                file_owned(p_evt->write.file_id))
+            {
+                op_done(p_evt->result);
+            }
+            break;
+
+        case FDS_EVT_GC:
+            // Only started from here
+            if (m_storage.in_flight && m_storage.in_flight_gc)
+            {
+                op_done(p_evt->result);
+            }
+            break;
+
+        default:
+            break;
+    }
+
+    // Whatever finished, FDS has room again
+    drain_schedule();
+}
+
+void storage_init(void)
+{
+    ret_code_t err_code;
+
+    err_code = fds_register(fds_evt_handler);
+    APP_ERROR_CHECK(err_code);
+}
+
+ret_code_t storage_record_save(uint16_t file_id, uint16_t key,
+                               void const *p_data, uint32_t size)
+{
+    ret_code_t err_code = NRF_SUCCESS;
+    uint8_t    i;
+
+    CRITICAL_REGION_ENTER();
+    for (i = 0; i < m_storage.queued; i++)
+    {
+        if (m_storage.queue[i].file_id == file_id &&
+            m_storage.queue[i].key == key)
+        {
+            break;
+        }
+    }
+    if (i == QUEUE_SIZE)
+    {
+        err_code = FDS_ERR_NO_SPACE_IN_QUEUES;
+    }
+    else
+    {
+        if (i == m_storage.queued)
+        {
+            m_storage.queued++;
+            m_storage.queue[i].deferred = false;
+        }
+        m_storage.queue[i].file_id = file_id;
+        m_storage.queue[i].key = key;
+        m_storage.queue[i].p_data = p_data;
+        m_storage.queue[i].size = size;
+    }
+    CRITICAL_REGION_EXIT();
+
+    if (err_code == NRF_SUCCESS)
+    {
+        drain_schedule();
+    }
+
+    return err_code;
+}
+
+uint32_t storage_record_read(uint16_t file_id, uint16_t key, void *p_data,
+                             uint32_t size)
+{
+    ret_code_t         err_code;
+    fds_record_desc_t  desc;
+    fds_find_token_t   token;
+    fds_flash_record_t flash_record;
+    uint32_t           length;
+
+    memset(&token, 0, sizeof(token));
+    if (fds_record_find(file_id, key, &desc, &token) != NRF_SUCCESS)
+    {
+        return 0;
+    }
+
+    err_code = fds_record_open(&desc, &flash_record);
+    APP_ERROR_CHECK(err_code);
+    length = flash_record.p_header->length_words * sizeof(uint32_t);
+    memcpy(p_data, flash_record.p_data, MIN(length, size));
+    err_code = fds_record_close(&desc);
+    APP_ERROR_CHECK(err_code);
+
+    return length;
+}
+
+bool storage_record_load(uint16_t file_id, uint16_t key, void *p_data,
+                         uint32_t size)
+{
+    return storage_record_read(file_id, key, p_data, size) ==
+           BYTES_TO_WORDS(size) * sizeof(uint32_t);
+}
+
+void storage_gc_request(void)
+{
+    CRITICAL_REGION_ENTER();
+    if (!m_storage.gc_pending && m_storage.hold)
+    {
+        m_storage.stats.deferred++;
+    }
+    m_storage.gc_pending = true;
+    CRITICAL_REGION_EXIT();
+
+    drain_schedule();
+}
+
+void storage_hold_set(bool hold)
+{
+    if (m_storage.hold == hold)
+    {
+        return;
+    }
+
+    m_storage.hold = hold;
+    if (!hold)
+    {
+        drain_schedule();
+    }
+}
+
+void storage_flush(storage_idle_handler_t idle_handler)
+{
+    m_storage.idle_handler = idle_handler;
+    m_storage.hold = false;
+    drain_schedule();
+}
+
+bool storage_busy_since(uint32_t since)
+{
+    uint32_t now;
+
+    if (m_storage.in_flight)
+    {
+        return true;
+    }
+    if (!m_storage.op_ended)
+    {
+        return false;
+    }
+
+    now = app_timer_cnt_get();
+    return app_timer_cnt_diff_compute(now, m_storage.op_end) <
+           app_timer_cnt_diff_compute(now, since);
+}
+
+void storage_stats_get(storage_stats_t *p_stats)
+{
+    CRITICAL_REGION_ENTER();
+    *p_stats = m_storage.stats;
+    p_stats->pending = m_storage.queued + (m_storage.gc_pending ? 1 : 0);
+    CRITICAL_REGION_EXIT();
+}
@@ -0,0 +1,146 @@
+/**
+ * Copyright (c) 2018 Keith Wakeham
+ *
+ * All rights reserved.
+ *
+ *
+ */
+
+#ifndef STORAGE_H
+#define STORAGE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "sdk_errors.h"
+
+// FDS files of the application, the Peer Manager uses 0xC000 and up
+#define STORAGE_FILE_CALIBRATION 0x5354 // "ST"
+#define STORAGE_FILE_PARAMS 0x5041      // "PA"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+    /**
+     * @brief Flash maintenance statistics
+     *
+     * @details Durations of the flash operations are in the LATENCY_FLASH_OP
+     * histogram, notifications that overlapped one in LATENCY_HVX_TO_TX_FLASH.
+     */
+    typedef struct
+    {
+        uint32_t writes;   // record writes and updates done
+        uint32_t gc_runs;  // garbage collections done
+        uint32_t deferred; // operations held back while streaming
+        uint32_t failed;   // operations FDS reported an error for
+        uint8_t  pending;  // waiting right now, garbage collection included
+    } storage_stats_t;
+
+    /**
+     * @brief Called once nothing is waiting or in flight any more
+     *
+     */
+    typedef void (*storage_idle_handler_t)(void);
+
+    /**
+     * @brief Init the flash maintenance
+     *
+     * @details Registers with FDS. Call before peer_manager_init, which
+     * starts FDS.
+     */
+    void storage_init(void);
+
+    /**
+     * @brief Write a record, or replace the one with the same file and key
+     *
+     * @details Queued, then handed to FDS from main context one operation at
+     * a time. Large writes wait while flash work is held back. The data must
+     * stay valid until FDS reports the write done, a second save of the same
+     * record before that replaces the queued one.
+     *
+     * @param file_id FDS file
+     * @param key record key within the file
+     * @param p_data what to store, word aligned
+     * @param size bytes to store, rounded up to words
+     * @return NRF_SUCCESS if the write was queued or
+     * FDS_ERR_NO_SPACE_IN_QUEUES
+     */
+    ret_code_t storage_record_save(uint16_t file_id, uint16_t key,
+                                   void const *p_data, uint32_t size);
+
+    /**
+     * @brief Read a record
+     *
+     * @param file_id FDS file
+     * @param key record key within the file
+     * @param p_data where to copy the record to
+     * @param size expected size in bytes
+     * @return true if it was found and had the expected size, p_data may
+     * hold part of a record of another size otherwise
+     */
+    bool storage_record_load(uint16_t file_id, uint16_t key, void *p_data,
+                             uint32_t size);
+
+    /**
+     * @brief Read a record of any length
+     *
+     * @details For records that grow over firmware versions, copies what
+     * fits and leaves the rest of p_data alone.
+     *
+     * @param file_id FDS file
+     * @param key record key within the file
+     * @param p_data where to copy the record to
+     * @param size room in p_data in bytes
+     * @return length of the stored record in bytes, 0 if there is none
+     */
+    uint32_t storage_record_read(uint16_t file_id, uint16_t key, void *p_data,
+                                 uint32_t size);
+
+    /**
+     * @brief Ask for a garbage collection, safe from any context
+     *
+     * @details Runs once flash work is no longer held back.
+     */
+    void storage_gc_request(void);
+
+    /**
+     * @brief Hold back garbage collection and large writes
+     *
+     * @details Set while a central is streaming, the page erases of a
+     * garbage collection would compete with the radio.
+     *
+     * @param hold true to hold back, false to run what is waiting
+     */
+    void storage_hold_set(bool hold);
+
+    /**
+     * @brief Run everything that is waiting, then call the handler
+     *
+     * @details Ends any hold. The handler runs in main context, right away if
+     * nothing is waiting.
+     *
+     * @param idle_handler called once all flash work is done
+     */
+    void storage_flush(storage_idle_handler_t idle_handler);
+
+    /**
+     * @brief Check if a flash operation overlapped a period
+     *
+     * @param since app_timer ticks when the period started, it ends now
+     * @return true if one is in flight or finished after since
+     */
+    bool storage_busy_since(uint32_t since);
+
+    /**
+     * @brief Get the flash maintenance statistics
+     *
+     * @param p_stats filled with a copy of the statistics
+     */
+    void storage_stats_get(storage_stats_t *p_stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // STORAGE_H
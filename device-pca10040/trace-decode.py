@@ -0,0 +1,77 @@
+#!/usr/bin/env python3
+"""Decode binary trace records streamed on RTT channel 1.
+
+Usage: trace-decode.py <trace.h> <trace.bin>
+
+Capture with e.g. JLinkRTTLogger -Device NRF52832_XXAA -RTTChannel 1 trace.bin
+Event names and argument names are read from the trace_evt_t enum in trace.h.
+"""
+import re
+import struct
+import sys
+
+RECORD = struct.Struct('<IHH')
+TICK_FREQUENCY = 32768
+TIMESTAMP_BITS = 24
+
+
+def read_events(header):
+    events = {}
+    for match in re.finditer(
+            r'TRACE_EVT_(\w+)\s*=\s*(0x[0-9a-fA-F]+|\d+),\s*//\s*a:\s*(\w+),'
+            r'\s*b:\s*(\w+)', header):
+        name, value, arg_a, arg_b = match.groups()
+        events[int(value, 0)] = (name, arg_a, arg_b)
+    if not events:
+        raise SystemExit('no TRACE_EVT_ values found')
+    return events
+
+
+def format_arg(name, value):
+    if name.endswith('cdeg'):
+        # Signed, hundredths of a degree
+        value = struct.unpack('<h', struct.pack('<H', value))[0]
+        return '%s=%.2f' % (name, value / 100.0)
+    if name == 'evt_id' or name.startswith('err'):
+        return '%s=0x%x' % (name, value)
+    return '%s=%d' % (name, value)
+
+
+def decode(data, events):
+    wrap = 1 << TIMESTAMP_BITS
+    last = None
+    ticks = 0
+    for offset in range(0, len(data) - RECORD.size + 1, RECORD.size):
+        header, a, b = RECORD.unpack_from(data, offset)
+        evt_id = header >> TIMESTAMP_BITS
+        timestamp = header & (wrap - 1)
+        # Records are written in order, assume less than one wrap (512 s)
+        # between two of them
+        if last is not None:
+            ticks += (timestamp - last) % wrap
+        last = timestamp
+
+        name, arg_a, arg_b = events.get(evt_id, ('UNKNOWN_%02x' % evt_id,
+                                                 'a', 'b'))
+        if name == 'OVERRUN':
+            yield ticks, name, 'lost=%d' % (a | (b << 16))
+            continue
+        yield ticks, name, format_arg(arg_a, a) + ' ' + format_arg(arg_b, b)
+
+
+def main():
+    with open(sys.argv[1], 'r') as f:
+        events = read_events(f.read())
+    with open(sys.argv[2], 'rb') as f:
+        data = f.read()
+
+    previous = 0
+    for ticks, name, args in decode(data, events):
+        print('%12.6f %+10.6f %-12s %s' % (ticks / TICK_FREQUENCY,
+                                           (ticks - previous) / TICK_FREQUENCY,
+                                           name, args))
+        previous = ticks
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,101 @@
+/**
+ * Copyright (c) 2018 Keith Wakeham
+ *
+ * All rights reserved.
+ *
+ *
+ */
+
+#include "trace.h"
+
+#if TRACE_ENABLED
+
+#include "SEGGER_RTT.h"
+#include "app_util.h"
+
+#define TRACE_RTT_BUFFER_SIZE 512
+
+// Records per RTT write, a write larger than the free space is skipped whole
+#define TRACE_RTT_BATCH (TRACE_RTT_BUFFER_SIZE / sizeof(trace_record_t) / 4)
+
+trace_ring_t trace_ring;
+
+static uint8_t  m_rtt_buffer[TRACE_RTT_BUFFER_SIZE];
+static uint32_t m_tail; // next record to stream
+static uint32_t m_lost; // overwritten before they went out, not reported yet
+
+/**
+ * @brief Skip records the writers already overwrote
+ *
+ * @param head head of the ring when the read started
+ */
+static void overrun_skip(uint32_t head)
+{
+    if (head - m_tail > TRACE_RING_SIZE)
+    {
+        m_lost += head - m_tail - TRACE_RING_SIZE;
+        m_tail = head - TRACE_RING_SIZE;
+    }
+}
+
+/**
+ * @brief Build the record reporting m_lost
+ *
+ */
+static trace_record_t overrun_record(void)
+{
+    trace_record_t record;
+
+    record.header = ((uint32_t)TRACE_EVT_OVERRUN << 24) |
+                    (NRF_RTC1->COUNTER & 0x00FFFFFF);
+    record.a = (uint16_t)m_lost;
+    record.b = (uint16_t)(m_lost >> 16);
+
+    return record;
+}
+
+void trace_init_rtt(void)
+{
+    // Skip whole writes while the host is not reading, never block
+    UNUSED_RETURN_VALUE(SEGGER_RTT_ConfigUpBuffer(
+        TRACE_RTT_CHANNEL, "Trace", m_rtt_buffer, sizeof(m_rtt_buffer),
+        SEGGER_RTT_MODE_NO_BLOCK_SKIP));
+}
+
+void trace_flush_rtt(void)
+{
+    uint32_t head = trace_ring.head;
+
+    overrun_skip(head);
+
+    if (m_lost != 0)
+    {
+        trace_record_t record = overrun_record();
+
+        if (SEGGER_RTT_WriteNoLock(TRACE_RTT_CHANNEL, &record,
+                                   sizeof(record)) == 0)
+        {
+            return;
+        }
+        m_lost = 0;
+    }
+
+    while (m_tail != head)
+    {
+        uint32_t index = m_tail & (TRACE_RING_SIZE - 1);
+        uint32_t count = MIN(head - m_tail, TRACE_RING_SIZE - index);
+
+        count = MIN(count, TRACE_RTT_BATCH);
+
+        // Contiguous records go out in one write, or stay queued
+        if (SEGGER_RTT_WriteNoLock(TRACE_RTT_CHANNEL,
+                                   &trace_ring.records[index],
+                                   count * sizeof(trace_record_t)) == 0)
+        {
+            return;
+        }
+        m_tail += count;
+    }
+}
+
+#endif  // TRACE_ENABLED
@@ -0,0 +1,137 @@
+/**
+ * Copyright (c) 2018 Keith Wakeham
+ *
+ * All rights reserved.
+ *
+ *
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "nrf.h"
+
+// Set to 0 to compile every TRACE() out
+#ifndef TRACE_ENABLED
+#define TRACE_ENABLED 1
+#endif
+
+// Records kept in RAM, must be a power of two
+#define TRACE_RING_SIZE 128
+
+// RTT up channel the records are streamed on, 0 belongs to NRF_LOG
+#define TRACE_RTT_CHANNEL 1
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+    /**
+     * @brief Trace event ids
+     *
+     * @details trace-decode.py reads the values and the argument names from
+     * the comments, keep one event per line.
+     */
+    typedef enum
+    {
+        TRACE_EVT_OVERRUN = 0x01,     // a: lost_lo, b: lost_hi
+        TRACE_EVT_BLE = 0x02,         // a: evt_id, b: conn_handle
+        TRACE_EVT_SAMPLE = 0x03,      // a: code, b: queued
+        TRACE_EVT_STEER = 0x04,       // a: angle_cdeg, b: err_code
+        TRACE_EVT_HVX_QUEUED = 0x05,  // a: conn_handle, b: in_flight
+        TRACE_EVT_HVX_PENDING = 0x06, // a: conn_handle, b: coalesced
+        TRACE_EVT_HVX_ERROR = 0x07,   // a: conn_handle, b: err_code
+        TRACE_EVT_TX_COMPLETE = 0x08, // a: conn_handle, b: count
+        TRACE_EVT_CONN_PARAMS = 0x09, // a: interval, b: latency
+        TRACE_EVT_MOTION_WAIT = 0x0A, // a: limit_low, b: limit_high
+        TRACE_EVT_MOTION_WAKE = 0x0B, // a: code, b: limit_type
+        TRACE_EVT_POWER_STATE = 0x0C, // a: state, b: prev_s
+        TRACE_EVT_PARAM = 0x0D,       // a: id, b: value
+        TRACE_EVT_FLASH = 0x0E,       // a: op, b: ticks
+        TRACE_EVT_BOOT = 0x0F,        // a: stage, b: ms
+    } trace_evt_t;
+
+    /**
+     * @brief One trace record
+     *
+     * @details header holds the event id in the top byte and the low 24 bits
+     * of the app_timer RTC (RTC1, 32768 Hz) below it.
+     */
+    typedef struct
+    {
+        uint32_t header;
+        uint16_t a;
+        uint16_t b;
+    } trace_record_t;
+
+    /**
+     * @brief Ring of the newest records, oldest ones are overwritten
+     *
+     */
+    typedef struct
+    {
+        trace_record_t    records[TRACE_RING_SIZE];
+        volatile uint32_t head;
+    } trace_ring_t;
+
+    extern trace_ring_t trace_ring;
+
+    /**
+     * @brief Write a record, safe from any interrupt priority
+     *
+     * @details Only reserves a slot and stores three words, no formatting.
+     */
+    static inline void trace_record(trace_evt_t id, uint16_t a, uint16_t b)
+    {
+        uint32_t        head;
+        trace_record_t *p_record;
+
+        do
+        {
+            head = __LDREXW(&trace_ring.head);
+        } while (__STREXW(head + 1, &trace_ring.head) != 0);
+
+        p_record = &trace_ring.records[head & (TRACE_RING_SIZE - 1)];
+        p_record->a = a;
+        p_record->b = b;
+        p_record->header =
+            ((uint32_t)id << 24) | (NRF_RTC1->COUNTER & 0x00FFFFFF);
+    }
+
+    /**
+     * @brief Set up the RTT channel
+     *
+     */
+    void trace_init_rtt(void);
+
+    /**
+     * @brief Stream unread records to RTT, records stay queued while the
+     * host is not reading
+     *
+     */
+    void trace_flush_rtt(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#if TRACE_ENABLED
+#define TRACE(id, a, b) trace_record((id), (uint16_t)(a), (uint16_t)(b))
+#define TRACE_INIT() trace_init_rtt()
+#define TRACE_FLUSH() trace_flush_rtt()
+#else
+// Arguments are not evaluated, but still count as used
+#define TRACE(id, a, b)      \
+    do                       \
+    {                        \
+        (void)sizeof(a);     \
+        (void)sizeof(b);     \
+    } while (0)
+#define TRACE_INIT()
+#define TRACE_FLUSH()
+#endif
+
+#endif  // TRACE_H